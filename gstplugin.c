@@ -15,6 +15,12 @@ static gboolean plugin_init (GstPlugin * plugin)
 {
     gboolean ret = FALSE;
 
+    // pick the analysis kernels once for every element of the plugin
+    InitAnalysisKernels();
+
+    GST_INFO("printanalysis kernels: %s (cpu supports %s)",
+        CpuLevelName(GetDefaultCpuLevel()), CpuLevelName(GetSupportedCpuLevel()));
+
     ret |= GST_ELEMENT_REGISTER (printanalysis, plugin);
     return ret;
 }
@@ -0,0 +1,309 @@
+#include "imageanalysis.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+
+// partitions narrower than this have no spectrum
+#define BANDING_MIN_COLUMNS 8
+
+// in place radix-2 transform of n complex values, pfTwiddles holds the roots of unity of 2 * n points
+static void ComplexFFT(float* pfData, int n, const float* pfTwiddles)
+{
+    for (int i = 1, j = 0; i < n; i++)
+    {
+        int iBit = n >> 1;
+
+        for (; j & iBit; iBit >>= 1)
+            j ^= iBit;
+
+        j ^= iBit;
+
+        if (i < j)
+        {
+            float re = pfData[2 * i], im = pfData[2 * i + 1];
+
+            pfData[2 * i] = pfData[2 * j];
+            pfData[2 * i + 1] = pfData[2 * j + 1];
+            pfData[2 * j] = re;
+            pfData[2 * j + 1] = im;
+        }
+    }
+
+    for (int nLength = 2; nLength <= n; nLength <<= 1)
+    {
+        int nHalf = nLength / 2;
+        int iStride = 2 * n / nLength;
+
+        for (int i = 0; i < n; i += nLength)
+        {
+            for (int k = 0; k < nHalf; k++)
+            {
+                const float* pfW = &pfTwiddles[2 * k * iStride];
+                float* pfA = &pfData[2 * (i + k)];
+                float* pfB = &pfData[2 * (i + k + nHalf)];
+                float re = pfB[0] * pfW[0] - pfB[1] * pfW[1];
+                float im = pfB[0] * pfW[1] + pfB[1] * pfW[0];
+
+                pfB[0] = pfA[0] - re;
+                pfB[1] = pfA[1] - im;
+                pfA[0] += re;
+                pfA[1] += im;
+            }
+        }
+    }
+}
+
+// transform of n real values, n a power of two of at least 4, into the n / 2 + 1 complex bins up to
+// Nyquist. the even and odd samples are packed into n / 2 complex values so the transform runs at half
+// the length, the two interleaved spectra are separated again afterwards
+void RealFFT(const float* pfSignal, float* pfSpectrum, int n, const float* pfTwiddles)
+{
+    int m = n / 2;
+
+    memcpy(pfSpectrum, pfSignal, n * sizeof(float));
+    ComplexFFT(pfSpectrum, m, pfTwiddles);
+
+    float re0 = pfSpectrum[0], im0 = pfSpectrum[1];
+
+    pfSpectrum[0] = re0 + im0;
+    pfSpectrum[1] = 0;
+    pfSpectrum[2 * m] = re0 - im0;
+    pfSpectrum[2 * m + 1] = 0;
+
+    for (int k = 1; k <= m / 2; k++)
+    {
+        float* pfK = &pfSpectrum[2 * k];
+        float* pfM = &pfSpectrum[2 * (m - k)];
+        const float* pfW = &pfTwiddles[2 * k];
+
+        // even part E = (Z[k] + conj(Z[m - k])) / 2, odd part O = (Z[k] - conj(Z[m - k])) / 2i
+        float eRe = (pfK[0] + pfM[0]) / 2, eIm = (pfK[1] - pfM[1]) / 2;
+        float oRe = (pfK[1] + pfM[1]) / 2, oIm = (pfM[0] - pfK[0]) / 2;
+        float wRe = oRe * pfW[0] - oIm * pfW[1];
+        float wIm = oRe * pfW[1] + oIm * pfW[0];
+
+        // X[k] = E + W O, X[m - k] = conj(E - W O)
+        pfK[0] = eRe + wRe;
+        pfK[1] = eIm + wIm;
+        pfM[0] = eRe - wRe;
+        pfM[1] = wIm - eIm;
+    }
+}
+
+static void FreeSpectrum(BandingSpectrum* pSpectrum)
+{
+    free(pSpectrum->pfPower);
+    free(pSpectrum->pfWindow);
+    free(pSpectrum->pfTwiddles);
+    memset(pSpectrum, 0, sizeof(BandingSpectrum));
+}
+
+static gboolean InitSpectrum(BandingSpectrum* pSpectrum, int nColumns)
+{
+    int nSize = 4;
+
+    pSpectrum->nColumns = nColumns;
+
+    if (nColumns < BANDING_MIN_COLUMNS)
+        return TRUE;
+
+    while (nSize < nColumns)
+        nSize <<= 1;
+
+    pSpectrum->pfPower = calloc(nSize / 2 + 1, sizeof(float));
+    pSpectrum->pfWindow = malloc(nColumns * sizeof(float));
+    pSpectrum->pfTwiddles = malloc(nSize * sizeof(float));
+
+    if (!pSpectrum->pfPower || !pSpectrum->pfWindow || !pSpectrum->pfTwiddles)
+        return FALSE;
+
+    pSpectrum->nSize = nSize;
+    pSpectrum->fWindowSum = 0;
+
+    for (int x = 0; x < nColumns; x++)
+    {
+        pSpectrum->pfWindow[x] = (float)(0.5 - 0.5 * cos(2 * M_PI * (x + 0.5) / nColumns));
+        pSpectrum->fWindowSum += pSpectrum->pfWindow[x];
+    }
+
+    for (int k = 0; k < nSize / 2; k++)
+    {
+        pSpectrum->pfTwiddles[2 * k] = (float)cos(2 * M_PI * k / nSize);
+        pSpectrum->pfTwiddles[2 * k + 1] = (float)-sin(2 * M_PI * k / nSize);
+    }
+
+    return TRUE;
+}
+
+// spectra follow the partitions of the AOI layout, a change of the layout starts a new average
+static gboolean CheckSpectra(BandingAnalysis* pBanding, const AoiLayout* pLayout)
+{
+    gboolean bChanged = pBanding->nSpectra != pLayout->nPartitions;
+
+    for (int i = 0; i < pBanding->nSpectra && !bChanged; i++)
+        bChanged = pBanding->pSpectra[i].nColumns != pLayout->piXStart[i + 1] - pLayout->piXStart[i];
+
+    if (!bChanged)
+        return pBanding->pSpectra != NULL;
+
+    FreeBanding(pBanding);
+
+    pBanding->pSpectra = calloc(MAX(pLayout->nPartitions, 1), sizeof(BandingSpectrum));
+
+    if (!pBanding->pSpectra)
+        return FALSE;
+
+    pBanding->nSpectra = pLayout->nPartitions;
+
+    for (int i = 0; i < pBanding->nSpectra; i++)
+    {
+        BandingSpectrum* pSpectrum = &pBanding->pSpectra[i];
+
+        if (!InitSpectrum(pSpectrum, pLayout->piXStart[i + 1] - pLayout->piXStart[i]))
+            goto failed;
+
+        pBanding->nSignal = MAX(pBanding->nSignal, pSpectrum->nSize);
+    }
+
+    // the windowed profile followed by its nSignal / 2 + 1 complex bins
+    pBanding->pfSignal = malloc((2 * pBanding->nSignal + 2) * sizeof(float));
+
+    if (pBanding->pfSignal)
+        return TRUE;
+
+failed:
+    FreeBanding(pBanding);
+    return FALSE;
+}
+
+// the local maxima of the averaged power, refined between bins by a parabola through the magnitudes.
+// banding repeats at least twice across the partition, anything slower is shading and the leakage
+// of the window around DC
+static void FindPeaks(BandingSpectrum* pSpectrum, guint nFrames)
+{
+    const float* pfPower = pSpectrum->pfPower;
+    int nBins = pSpectrum->nSize / 2;
+    int iFirst = MAX((2 * pSpectrum->nSize + pSpectrum->nColumns - 1) / pSpectrum->nColumns, 1);
+
+    pSpectrum->nPeaks = 0;
+
+    for (int k = iFirst; k < nBins; k++)
+    {
+        if (pfPower[k] <= pfPower[k - 1] || pfPower[k] < pfPower[k + 1])
+            continue;
+
+        float a = sqrtf(pfPower[k - 1]), b = sqrtf(pfPower[k]), c = sqrtf(pfPower[k + 1]);
+        float fDenominator = a - 2 * b + c;
+        float fOffset = fDenominator < 0 ? 0.5f * (a - c) / fDenominator : 0;
+        float fMagnitude = sqrtf(pfPower[k] / nFrames);
+        BandingPeak peak;
+        int j;
+
+        peak.fFrequency = (k + fOffset) / pSpectrum->nSize;
+        peak.fPeriod = 1 / peak.fFrequency;
+        peak.fAmplitude = 2 * fMagnitude / pSpectrum->fWindowSum;
+
+        // keep the strongest, in descending order
+        for (j = pSpectrum->nPeaks; j > 0 && pSpectrum->peaks[j - 1].fAmplitude < peak.fAmplitude; j--)
+        {
+            if (j < BANDING_PEAKS)
+                pSpectrum->peaks[j] = pSpectrum->peaks[j - 1];
+        }
+
+        if (j < BANDING_PEAKS)
+        {
+            pSpectrum->peaks[j] = peak;
+            pSpectrum->nPeaks = MIN(pSpectrum->nPeaks + 1, BANDING_PEAKS);
+        }
+    }
+}
+
+// adds the spectra of the last frame's column profiles, the mean of nSignalChannels channels of every
+// column, to the running average and reports the peaks once opts.bandingFrames frames are in
+void UpdateBanding(ImageAnalysis* pImageAnalysis, int nSignalChannels)
+{
+    BandingAnalysis* pBanding = &pImageAnalysis->banding;
+    guint nAverageFrames = MAX(pImageAnalysis->opts.bandingFrames, 1);
+
+    if (!CheckSpectra(pBanding, &pImageAnalysis->aoi))
+        return;
+
+    for (int i = 0; i < pBanding->nSpectra; i++)
+    {
+        BandingSpectrum* pSpectrum = &pBanding->pSpectra[i];
+        float* pfSignal = pBanding->pfSignal;
+        float* pfBins = &pBanding->pfSignal[pBanding->nSignal];
+        float fMean = 0;
+
+        if (!pSpectrum->nSize)
+            continue;
+
+        GetAoiColumnMeans(pImageAnalysis, i, nSignalChannels, pfSignal);
+
+        // without the mean the window does not smear the DC level over the low bins
+        for (int x = 0; x < pSpectrum->nColumns; x++)
+            fMean += pfSignal[x];
+
+        fMean /= pSpectrum->nColumns;
+
+        for (int x = 0; x < pSpectrum->nColumns; x++)
+            pfSignal[x] = (pfSignal[x] - fMean) * pSpectrum->pfWindow[x];
+
+        memset(&pfSignal[pSpectrum->nColumns], 0, (pSpectrum->nSize - pSpectrum->nColumns) * sizeof(float));
+
+        RealFFT(pfSignal, pfBins, pSpectrum->nSize, pSpectrum->pfTwiddles);
+
+        for (int k = 0; k <= pSpectrum->nSize / 2; k++)
+            pSpectrum->pfPower[k] += pfBins[2 * k] * pfBins[2 * k] + pfBins[2 * k + 1] * pfBins[2 * k + 1];
+    }
+
+    if (++pBanding->nFrames < nAverageFrames)
+        return;
+
+    for (int i = 0; i < pBanding->nSpectra; i++)
+    {
+        BandingSpectrum* pSpectrum = &pBanding->pSpectra[i];
+
+        if (!pSpectrum->nSize)
+            continue;
+
+        FindPeaks(pSpectrum, pBanding->nFrames);
+        memset(pSpectrum->pfPower, 0, (pSpectrum->nSize / 2 + 1) * sizeof(float));
+    }
+
+    pBanding->nAveraged = pBanding->nFrames;
+    pBanding->nFrames = 0;
+}
+
+// starts a new average, the peaks of the last one are dropped
+void ResetBanding(BandingAnalysis* pBanding)
+{
+    for (int i = 0; i < pBanding->nSpectra; i++)
+    {
+        BandingSpectrum* pSpectrum = &pBanding->pSpectra[i];
+
+        if (pSpectrum->nSize)
+            memset(pSpectrum->pfPower, 0, (pSpectrum->nSize / 2 + 1) * sizeof(float));
+
+        pSpectrum->nPeaks = 0;
+    }
+
+    pBanding->nFrames = 0;
+    pBanding->nAveraged = 0;
+}
+
+void FreeBanding(BandingAnalysis* pBanding)
+{
+    for (int i = 0; i < pBanding->nSpectra; i++)
+        FreeSpectrum(&pBanding->pSpectra[i]);
+
+    free(pBanding->pSpectra);
+    free(pBanding->pfSignal);
+    memset(pBanding, 0, sizeof(BandingAnalysis));
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <glib.h>
+
+// strongest periodic components reported per AOI partition
+#define BANDING_PEAKS 4
+
+// a sinusoid across the columns of a partition
+typedef struct BandingPeak
+{
+	float	fFrequency;		// cycles per column
+	float	fPeriod;		// columns per cycle
+	float	fAmplitude;		// of the sinusoid, in the units of the column means
+} BandingPeak;
+
+// power spectrum of the column profile of one AOI partition, summed over the frames of an average
+typedef struct BandingSpectrum
+{
+	int			nColumns;		// columns of the partition the spectrum is sized for
+	int			nSize;			// transform length, the power of two at or above nColumns, 0 for partitions too narrow
+	float*		pfPower;		// nSize / 2 + 1 bins
+	float*		pfWindow;		// Hann window over nColumns
+	float*		pfTwiddles;		// cos and -sin of 2 pi k / nSize for k < nSize / 2
+	float		fWindowSum;
+	BandingPeak	peaks[BANDING_PEAKS];	// from the last complete average, strongest first
+	int			nPeaks;
+} BandingSpectrum;
+
+typedef struct BandingAnalysis
+{
+	BandingSpectrum*	pSpectra;		// one per AOI partition
+	int					nSpectra;
+	float*				pfSignal;		// scratch, the windowed profile and its transform
+	int					nSignal;
+	guint				nFrames;		// frames summed since the last average completed
+	guint				nAveraged;		// frames behind the reported peaks, 0 before the first average
+} BandingAnalysis;
+
+void RealFFT(const float* pfSignal, float* pfSpectrum, int n, const float* pfTwiddles);
+void ResetBanding(BandingAnalysis* pBanding);
+void FreeBanding(BandingAnalysis* pBanding);
@@ -0,0 +1,365 @@
+#include "libimageanalysis.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+// feeds synthetic frames through the analysis engine and prints one JSON object per configuration,
+// so the numbers can be collected and compared across releases
+//
+//   imageanalysis-bench [--iterations N] [--format bgrx|yuy2] [--cpu-level LEVEL] [--max-width W] [--quick]
+
+typedef struct BenchResolution
+{
+    int iWidth;
+    int iHeight;
+} BenchResolution;
+
+typedef struct BenchMode
+{
+    const char*     pName;
+    AnalysisType    analysisType;
+    guint           analyses;
+    PaperWhiteMode  paperWhite;
+} BenchMode;
+
+typedef struct BenchOverlay
+{
+    const char*     pName;
+    BlackoutType    blackoutType;
+    GrayscaleType   grayscaleType;
+} BenchOverlay;
+
+typedef struct BenchConfig
+{
+    ImageFormat             format;
+    BenchResolution         resolution;
+    CpuLevel                cpuLevel;
+    const BenchMode*        pMode;
+    const BenchOverlay*     pOverlay;
+    int                     iAoiHeight;
+    int                     iAoiPartitions;
+    int                     nPartitions;
+} BenchConfig;
+
+static const BenchResolution resolutions[] = { { 640, 480 }, { 1280, 720 }, { 1920, 1080 }, { 3840, 2160 }, { 7680, 4320 } };
+
+static const BenchMode modes[] =
+{
+    { "intensity", INTENSITY, 0 },
+    { "mean", MEAN, 0 },
+    { "histogram", HISTOGRAM, 0 },
+    { "total", TOTAL, 0 },
+    { "all", NONE, ANALYSIS_ALL },
+    { "row-profile", ROW_PROFILE, 0 },
+    { "profiles", NONE, ANALYSIS_PROFILES },
+    { "banding", BANDING, 0 },
+    { "nozzle-check", NOZZLE_CHECK, 0 },
+    { "defects", DEFECTS, 0 },
+    { "paper-white", TOTAL, 0, PAPER_WHITE_BRIGHTEST },
+};
+
+static const BenchOverlay overlays[] =
+{
+    { "none", BLACK_NONE, GRAY_NONE },
+    { "blackout-aoi", BLACK_AOI, GRAY_AOI },
+    { "blackout-all", BLACK_ALL, GRAY_ALL },
+};
+
+static const int aoiHeights[] = { 64, 256 };
+static const int aoiPartitionCounts[] = { 1, 8, 32 };
+static const int partitionCounts[] = { 16, 128 };
+
+static gint iIterations = 20;
+static gchar* pFormatName = NULL;
+static gchar* pCpuLevelName = NULL;
+static gint iMaxWidth = 7680;
+static gboolean bQuick = FALSE;
+
+static GOptionEntry entries[] =
+{
+    { "iterations", 'n', 0, G_OPTION_ARG_INT, &iIterations, "Timed frames per configuration", "N" },
+    { "format", 'f', 0, G_OPTION_ARG_STRING, &pFormatName, "Only run bgrx or yuy2 frames", "FORMAT" },
+    { "cpu-level", 'c', 0, G_OPTION_ARG_STRING, &pCpuLevelName, "Only run scalar, sse4.1, avx2 or avx512 kernels", "LEVEL" },
+    { "max-width", 'w', 0, G_OPTION_ARG_INT, &iMaxWidth, "Skip resolutions wider than W", "W" },
+    { "quick", 'q', 0, G_OPTION_ARG_NONE, &bQuick, "One configuration per mode and overlay, for smoke runs", NULL },
+    { NULL }
+};
+
+static gint64 BenchNowNs(void)
+{
+#ifdef _WIN32
+    LARGE_INTEGER frequency, counter;
+
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (gint64)((double)counter.QuadPart * 1e9 / frequency.QuadPart);
+#else
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (gint64)now.tv_sec * 1000000000 + now.tv_nsec;
+#endif
+}
+
+static int CompareTimes(const void* a, const void* b)
+{
+    gint64 x = *(const gint64*)a;
+    gint64 y = *(const gint64*)b;
+
+    return (x > y) - (x < y);
+}
+
+static double Percentile(const gint64* piSorted, int n, int iPercent)
+{
+    return (double)piSorted[((n - 1) * iPercent + 50) / 100];
+}
+
+// a gradient with some noise so the histograms and the partitions see varied values
+static void FillSyntheticFrame(guint8* pImage, int iStride, int iHeight)
+{
+    guint32 uSeed = 0x12345678;
+
+    for (int y = 0; y < iHeight; y++)
+    {
+        guint8* pRow = &pImage[(gsize)iStride * y];
+
+        for (int x = 0; x < iStride; x++)
+        {
+            uSeed = uSeed * 1664525 + 1013904223;
+            pRow[x] = (guint8)((x / 4 + y) + (uSeed >> 28));
+        }
+    }
+}
+
+// partitions laid out as a grid of cells covering the frame
+static gchar* BuildPartitionsJson(int iWidth, int iHeight, int nPartitions)
+{
+    GString* pJson = g_string_new("{\"partitions\":[");
+    int nColumns = 1;
+
+    while (nColumns * nColumns < nPartitions)
+        nColumns++;
+
+    int nRows = (nPartitions + nColumns - 1) / nColumns;
+    int iCellWidth = iWidth / nColumns;
+    int iCellHeight = iHeight / nRows;
+
+    for (int i = 0; i < nPartitions; i++)
+    {
+        int x = i % nColumns;
+        int y = i / nColumns;
+
+        g_string_append_printf(pJson, "%s{\"id\":%d,\"center_x\":%d,\"center_y\":%d,\"width\":%d,\"height\":%d,\"bg_r\":255,\"bg_g\":255,\"bg_b\":255}",
+            i ? "," : "", i, x * iCellWidth + iCellWidth / 2, y * iCellHeight + iCellHeight / 2, iCellWidth * 3 / 4, iCellHeight * 3 / 4);
+    }
+
+    g_string_append(pJson, "]}");
+    return g_string_free(pJson, FALSE);
+}
+
+static void RunConfig(const BenchConfig* pConfig, const guint8* pPristine, guint8* pWork, gint64* piTimes)
+{
+    int iWidth = pConfig->resolution.iWidth;
+    int iHeight = pConfig->resolution.iHeight;
+    int iStride = iWidth * ImageFormatPixelBytes(pConfig->format);
+    gsize nBytes = (gsize)iStride * iHeight;
+    AnalysisOpts opts = { 0 };
+    ImageAnalysis* pImageAnalysis;
+
+    opts.analysisType = pConfig->pMode->analysisType;
+    opts.analyses = pConfig->pMode->analyses;
+    opts.aoiHeight = pConfig->iAoiHeight;
+    opts.aoiPartitions = pConfig->iAoiPartitions;
+    opts.connectValues = TRUE;
+    opts.blackoutType = pConfig->pOverlay->blackoutType;
+    opts.grayscaleType = pConfig->pOverlay->grayscaleType;
+    opts.cpuLevel = pConfig->cpuLevel;
+    opts.paperWhite = pConfig->pMode->paperWhite;
+
+    pImageAnalysis = CreateImageAnalysis(pConfig->format, iWidth, iHeight, &opts);
+
+    if (!pImageAnalysis)
+        return;
+
+    if (pConfig->nPartitions)
+    {
+        gchar* pJson = BuildPartitionsJson(iWidth, iHeight, pConfig->nPartitions);
+
+        ParsePartitionsFromString(pImageAnalysis, pJson);
+        g_free(pJson);
+    }
+
+    // a ladder of 8 pixel pitch across the first AOI partition, for the nozzle check to look for
+    if (GetRequestedAnalyses(&opts) & ANALYSIS_NOZZLE_CHECK)
+    {
+        NozzleCheck check = { 0, 4, 8, MAX(iWidth / pConfig->iAoiPartitions / 8, 1), 2, 0.5f };
+
+        SetNozzleChecks(pImageAnalysis, &check, 1);
+    }
+
+    // the element clears this after reporting, here every frame measures the partitions
+    pImageAnalysis->bPartitionsReady = pConfig->nPartitions > 0;
+
+    // one untimed frame builds the overlay and faults in the buffers
+    memcpy(pWork, pPristine, nBytes);
+    AnalyzeImage(pImageAnalysis, pWork, iStride);
+
+    for (int i = 0; i < iIterations; i++)
+    {
+        // the overlay is drawn into the frame, every run starts from the same content
+        memcpy(pWork, pPristine, nBytes);
+
+        gint64 iStart = BenchNowNs();
+        AnalyzeImage(pImageAnalysis, pWork, iStride);
+        piTimes[i] = BenchNowNs() - iStart;
+    }
+
+    qsort(piTimes, iIterations, sizeof(gint64), CompareTimes);
+
+    double fMedian = Percentile(piTimes, iIterations, 50);
+
+    printf("{\"format\":\"%s\",\"width\":%d,\"height\":%d,\"cpu_level\":\"%s\",\"mode\":\"%s\",\"overlay\":\"%s\","
+        "\"aoi_height\":%d,\"aoi_partitions\":%d,\"partitions\":%d,\"iterations\":%d,"
+        "\"ns_per_pixel\":%.4f,\"gb_per_s\":%.3f,\"min_us\":%.1f,\"p50_us\":%.1f,\"p90_us\":%.1f,\"p99_us\":%.1f}\n",
+        pConfig->format == IMAGE_FORMAT_BGRX ? "BGRx" : "YUY2", iWidth, iHeight, pImageAnalysis->pKernels->pName,
+        pConfig->pMode->pName, pConfig->pOverlay->pName, pConfig->iAoiHeight, pConfig->iAoiPartitions, pConfig->nPartitions, iIterations,
+        fMedian / ((double)iWidth * iHeight), nBytes / fMedian, piTimes[0] / 1000.0, fMedian / 1000.0,
+        Percentile(piTimes, iIterations, 90) / 1000.0, Percentile(piTimes, iIterations, 99) / 1000.0);
+    fflush(stdout);
+
+    DestroyImageAnalysis(pImageAnalysis);
+}
+
+// sweeps the AOI and partition layouts that matter for the mode
+static void RunMode(BenchConfig* pConfig, const guint8* pPristine, guint8* pWork, gint64* piTimes)
+{
+    static const int quickAoiHeights[] = { 256 };
+    static const int quickAoiPartitionCounts[] = { 8 };
+    static const int quickPartitionCounts[] = { 16 };
+    guint analyses = pConfig->pMode->analyses ? pConfig->pMode->analyses : 1u << pConfig->pMode->analysisType;
+    gboolean bAoi = (analyses & ANALYSIS_AOI) != 0;
+    gboolean bTotal = (analyses & ANALYSIS_TOTAL) != 0;
+    const int* piAoiHeights = bQuick ? quickAoiHeights : aoiHeights;
+    const int* piAoiPartitions = bQuick ? quickAoiPartitionCounts : aoiPartitionCounts;
+    const int* piPartitions = bQuick ? quickPartitionCounts : partitionCounts;
+    int nAoiHeights = bAoi ? (bQuick ? 1 : G_N_ELEMENTS(aoiHeights)) : 1;
+    int nAoiPartitions = bAoi ? (bQuick ? 1 : G_N_ELEMENTS(aoiPartitionCounts)) : 1;
+    int nPartitions = bTotal ? (bQuick ? 1 : G_N_ELEMENTS(partitionCounts)) : 1;
+
+    for (int h = 0; h < nAoiHeights; h++)
+    {
+        for (int a = 0; a < nAoiPartitions; a++)
+        {
+            for (int p = 0; p < nPartitions; p++)
+            {
+                pConfig->iAoiHeight = bAoi ? MIN(piAoiHeights[h], pConfig->resolution.iHeight - 2) : 0;
+                pConfig->iAoiPartitions = bAoi ? piAoiPartitions[a] : 1;
+                pConfig->nPartitions = bTotal ? piPartitions[p] : 0;
+
+                RunConfig(pConfig, pPristine, pWork, piTimes);
+            }
+        }
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    GOptionContext* pContext = g_option_context_new("- benchmark the print analysis kernels");
+    GError* pError = NULL;
+    CpuLevel firstLevel = CPU_LEVEL_SCALAR;
+    CpuLevel lastLevel;
+
+    g_option_context_add_main_entries(pContext, entries, NULL);
+
+    if (!g_option_context_parse(pContext, &argc, &argv, &pError))
+    {
+        fprintf(stderr, "%s\n", pError->message);
+        g_error_free(pError);
+        g_option_context_free(pContext);
+        return 1;
+    }
+
+    g_option_context_free(pContext);
+
+    if (iIterations < 1)
+        iIterations = 1;
+
+    InitAnalysisKernels();
+    lastLevel = GetSupportedCpuLevel();
+
+    if (pCpuLevelName)
+    {
+        CpuLevel level = ParseCpuLevel(pCpuLevelName);
+
+        if (level == CPU_LEVEL_AUTO || level > lastLevel)
+        {
+            fprintf(stderr, "cpu level %s is not supported here, the highest is %s\n", pCpuLevelName, CpuLevelName(lastLevel));
+            return 1;
+        }
+
+        firstLevel = lastLevel = level;
+    }
+
+    gint64* piTimes = calloc(iIterations, sizeof(gint64));
+
+    for (int f = IMAGE_FORMAT_BGRX; f <= IMAGE_FORMAT_YUY2; f++)
+    {
+        if (pFormatName && g_ascii_strcasecmp(pFormatName, f == IMAGE_FORMAT_BGRX ? "bgrx" : "yuy2") != 0)
+            continue;
+
+        for (guint r = 0; r < G_N_ELEMENTS(resolutions); r++)
+        {
+            BenchConfig config = { 0 };
+            int iStride = resolutions[r].iWidth * ImageFormatPixelBytes((ImageFormat)f);
+            gsize nBytes = (gsize)iStride * resolutions[r].iHeight;
+
+            if (resolutions[r].iWidth > iMaxWidth || (bQuick && resolutions[r].iWidth > 1920))
+                continue;
+
+            guint8* pPristine = malloc(nBytes);
+            guint8* pWork = malloc(nBytes);
+
+            if (!pPristine || !pWork)
+            {
+                fprintf(stderr, "out of memory for %dx%d frames\n", resolutions[r].iWidth, resolutions[r].iHeight);
+                free(pPristine);
+                free(pWork);
+                continue;
+            }
+
+            FillSyntheticFrame(pPristine, iStride, resolutions[r].iHeight);
+
+            config.format = (ImageFormat)f;
+            config.resolution = resolutions[r];
+
+            for (int level = firstLevel; level <= lastLevel; level++)
+            {
+                config.cpuLevel = (CpuLevel)level;
+
+                for (guint m = 0; m < G_N_ELEMENTS(modes); m++)
+                {
+                    config.pMode = &modes[m];
+
+                    for (guint o = 0; o < G_N_ELEMENTS(overlays); o++)
+                    {
+                        config.pOverlay = &overlays[o];
+                        RunMode(&config, pPristine, pWork, piTimes);
+                    }
+                }
+            }
+
+            free(pPristine);
+            free(pWork);
+        }
+    }
+
+    free(piTimes);
+    return 0;
+}
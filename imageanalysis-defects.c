@@ -0,0 +1,188 @@
+#include "imageanalysis.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+// column means are averages of 8 bit values, a baseline quieter than this is quantization
+#define DEFECT_MIN_SIGMA 0.5f
+
+// the baseline follows the AOI layout, a change of the layout starts learning from scratch
+static gboolean CheckBaseline(DefectAnalysis* pDefects, int nColumns)
+{
+    if (pDefects->nColumns == nColumns && pDefects->pfMean)
+        return TRUE;
+
+    guint64 iFrame = pDefects->iFrame;
+
+    FreeDefects(pDefects);
+    pDefects->iFrame = iFrame;
+
+    int n = MAX(nColumns, 1);
+
+    pDefects->pfMean = calloc(n, sizeof(float));
+    pDefects->pfVariance = calloc(n, sizeof(float));
+    pDefects->piRun = calloc(n, sizeof(guint));
+    pDefects->piRunStartFrame = calloc(n, sizeof(guint64));
+    pDefects->piRunStartTimestamp = calloc(n, sizeof(gint64));
+    pDefects->pfProfile = calloc(n, sizeof(float));
+
+    if (!pDefects->pfMean || !pDefects->pfVariance || !pDefects->piRun ||
+        !pDefects->piRunStartFrame || !pDefects->piRunStartTimestamp || !pDefects->pfProfile)
+    {
+        FreeDefects(pDefects);
+        return FALSE;
+    }
+
+    pDefects->nColumns = nColumns;
+    return TRUE;
+}
+
+static DefectEvent* AddEvent(DefectAnalysis* pDefects)
+{
+    if (pDefects->nEvents == pDefects->nAllocatedEvents)
+    {
+        int nAllocated = MAX(pDefects->nAllocatedEvents * 2, 16);
+        DefectEvent* pEvents = realloc(pDefects->pEvents, nAllocated * sizeof(DefectEvent));
+
+        if (!pEvents)
+            return NULL;
+
+        pDefects->pEvents = pEvents;
+        pDefects->nAllocatedEvents = nAllocated;
+    }
+
+    return &pDefects->pEvents[pDefects->nEvents++];
+}
+
+// the flagged columns of every band joined into events, a run ends at a column that is not flagged
+// or at the end of its band
+static void CollectEvents(DefectAnalysis* pDefects, const AoiLayout* pLayout, guint nFrames)
+{
+    pDefects->nEvents = 0;
+
+    for (int b = 0; b < pLayout->nBands; b++)
+    {
+        const AoiBand* pBand = &pLayout->pBands[b];
+        DefectEvent* pEvent = NULL;
+
+        for (int c = pBand->iFirstColumn; c < pBand->iFirstColumn + pBand->width; c++)
+        {
+            if (pDefects->piRun[c] < nFrames)
+            {
+                pEvent = NULL;
+                continue;
+            }
+
+            float fSigma = MAX(sqrtf(pDefects->pfVariance[c]), DEFECT_MIN_SIGMA);
+            float fDeviation = pDefects->pfProfile[c] - pDefects->pfMean[c];
+            float fSeverity = fabsf(fDeviation) / fSigma;
+            int x = pBand->x + c - pBand->iFirstColumn;
+
+            if (!pEvent)
+            {
+                pEvent = AddEvent(pDefects);
+
+                if (!pEvent)
+                    return;
+
+                pEvent->x0 = x;
+                pEvent->fSeverity = 0;
+                pEvent->iStartFrame = pDefects->piRunStartFrame[c];
+                pEvent->iStartTimestamp = pDefects->piRunStartTimestamp[c];
+            }
+
+            pEvent->x1 = x;
+
+            if (fSeverity > pEvent->fSeverity)
+            {
+                pEvent->fSeverity = fSeverity;
+                pEvent->fDeviation = fDeviation;
+            }
+
+            // the event started with its earliest column
+            if (pDefects->piRunStartFrame[c] < pEvent->iStartFrame)
+            {
+                pEvent->iStartFrame = pDefects->piRunStartFrame[c];
+                pEvent->iStartTimestamp = pDefects->piRunStartTimestamp[c];
+            }
+        }
+    }
+}
+
+// compares the last frame's column means, nSignalChannels as for UpdateBanding, against the baseline,
+// then learns the columns that stayed within opts.defectSigma standard deviations. columns are only
+// judged once the baseline holds 1 / opts.defectAlpha frames
+void UpdateDefects(ImageAnalysis* pImageAnalysis, int nSignalChannels)
+{
+    DefectAnalysis* pDefects = &pImageAnalysis->defects;
+    const AoiLayout* pLayout = &pImageAnalysis->aoi;
+    const AnalysisOpts* pOpts = &pImageAnalysis->opts;
+    float fAlpha = (float)(pOpts->defectAlpha > 0 ? MIN(pOpts->defectAlpha, 1.0) : DEFECT_DEFAULT_ALPHA);
+    float fSigmas = (float)(pOpts->defectSigma > 0 ? pOpts->defectSigma : DEFECT_DEFAULT_SIGMA);
+    guint nFrames = pOpts->defectFrames ? pOpts->defectFrames : DEFECT_DEFAULT_FRAMES;
+
+    if (!CheckBaseline(pDefects, pLayout->nColumns))
+        return;
+
+    // after CheckBaseline, a new baseline has learned nothing yet
+    gboolean bJudged = pDefects->nLearned >= (guint64)ceilf(1 / fAlpha);
+
+    for (int i = 0; i < pLayout->nPartitions; i++)
+        GetAoiColumnMeans(pImageAnalysis, i, nSignalChannels, &pDefects->pfProfile[pLayout->piXStart[i]]);
+
+    // until the baseline is long enough it is the plain average of the frames so far
+    float fRate = MAX(fAlpha, 1.0f / (float)(pDefects->nLearned + 1));
+
+    for (int c = 0; c < pLayout->nColumns; c++)
+    {
+        float fDeviation = pDefects->pfProfile[c] - pDefects->pfMean[c];
+        float fSigma = MAX(sqrtf(pDefects->pfVariance[c]), DEFECT_MIN_SIGMA);
+
+        if (bJudged && fabsf(fDeviation) > fSigmas * fSigma)
+        {
+            if (!pDefects->piRun[c])
+            {
+                pDefects->piRunStartFrame[c] = pDefects->iFrame;
+                pDefects->piRunStartTimestamp[c] = pImageAnalysis->iTimestamp;
+            }
+
+            if (pDefects->piRun[c] < G_MAXUINT)
+                pDefects->piRun[c]++;
+
+            continue;
+        }
+
+        pDefects->piRun[c] = 0;
+        pDefects->pfMean[c] += fRate * fDeviation;
+        pDefects->pfVariance[c] = (1 - fRate) * (pDefects->pfVariance[c] + fRate * fDeviation * fDeviation);
+    }
+
+    pDefects->nLearned++;
+    pDefects->iFrame++;
+
+    CollectEvents(pDefects, pLayout, nFrames);
+}
+
+// learns the baseline again from the next frame on
+void ResetDefects(DefectAnalysis* pDefects)
+{
+    pDefects->nLearned = 0;
+    pDefects->nEvents = 0;
+
+    if (pDefects->piRun)
+        memset(pDefects->piRun, 0, pDefects->nColumns * sizeof(guint));
+}
+
+void FreeDefects(DefectAnalysis* pDefects)
+{
+    free(pDefects->pfMean);
+    free(pDefects->pfVariance);
+    free(pDefects->piRun);
+    free(pDefects->piRunStartFrame);
+    free(pDefects->piRunStartTimestamp);
+    free(pDefects->pfProfile);
+    free(pDefects->pEvents);
+    memset(pDefects, 0, sizeof(DefectAnalysis));
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <glib.h>
+
+// used for the options left at 0
+#define DEFECT_DEFAULT_ALPHA	0.02
+#define DEFECT_DEFAULT_SIGMA	4.0
+#define DEFECT_DEFAULT_FRAMES	3
+
+// neighbouring columns that deviated from their baseline in enough consecutive frames
+typedef struct DefectEvent
+{
+	int		x0;					// first and last column, in frame coordinates
+	int		x1;
+	float	fSeverity;			// largest deviation of its columns in the last frame, in standard deviations
+	float	fDeviation;			// the same deviation in the units of the column means, negative when darker
+	gint64	iStartTimestamp;	// PTS of the first deviating frame, in ns, -1 when the frames carry none
+	guint64	iStartFrame;		// counted from the first analyzed frame
+} DefectEvent;
+
+// exponentially weighted mean and variance of every AOI column, updated in place from every frame in
+// which the column did not deviate, so a streak stays flagged instead of becoming the baseline
+typedef struct DefectAnalysis
+{
+	int				nColumns;			// AOI columns the baseline is sized for
+	float*			pfMean;
+	float*			pfVariance;
+	guint*			piRun;				// consecutive frames the column deviated
+	guint64*		piRunStartFrame;
+	gint64*			piRunStartTimestamp;
+	float*			pfProfile;			// scratch, column means of the last frame
+	guint64			nLearned;			// frames in the baseline
+	guint64			iFrame;
+	DefectEvent*	pEvents;			// defects in the last frame
+	int				nEvents;
+	int				nAllocatedEvents;
+} DefectAnalysis;
+
+void ResetDefects(DefectAnalysis* pDefects);
+void FreeDefects(DefectAnalysis* pDefects);
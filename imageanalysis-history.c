@@ -0,0 +1,336 @@
+#include "imageanalysis-history.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+static const char* valueNames[HISTORY_VALUES] = {
+    "total-0", "total-1", "total-2",
+    "average-0", "average-1", "average-2",
+    "non-uniformity-0", "non-uniformity-1", "non-uniformity-2"
+};
+
+// running sums of one partition, the trend is fitted against seconds since the start of the window
+typedef struct HistorySums
+{
+    double fT;
+    double fTT;
+    double fV[HISTORY_VALUES];
+    double fTV[HISTORY_VALUES];
+} HistorySums;
+
+gboolean InitPartitionHistory(PartitionHistory* pHistory, int nCapacity)
+{
+    FreePartitionHistory(pHistory);
+
+    if (nCapacity <= 0)
+        return TRUE;
+
+    pHistory->pSamples = malloc(nCapacity * sizeof(PartitionSample));
+
+    if (!pHistory->pSamples)
+        return FALSE;
+
+    pHistory->nCapacity = nCapacity;
+    return TRUE;
+}
+
+void FreePartitionHistory(PartitionHistory* pHistory)
+{
+    free(pHistory->pSamples);
+    memset(pHistory, 0, sizeof(PartitionHistory));
+}
+
+const char* HistoryValueName(int iValue)
+{
+    return iValue >= 0 && iValue < HISTORY_VALUES ? valueNames[iValue] : "unknown";
+}
+
+static void GetPartitionValues(const PrintPartition* pPartition, gint32* piValues)
+{
+    piValues[0] = pPartition->total.rgb.r;
+    piValues[1] = pPartition->total.rgb.g;
+    piValues[2] = pPartition->total.rgb.b;
+    piValues[3] = pPartition->avg.rgb.r;
+    piValues[4] = pPartition->avg.rgb.g;
+    piValues[5] = pPartition->avg.rgb.b;
+    piValues[6] = pPartition->nonUniformity.rgb.r;
+    piValues[7] = pPartition->nonUniformity.rgb.g;
+    piValues[8] = pPartition->nonUniformity.rgb.b;
+}
+
+void RecordPartitions(PartitionHistory* pHistory, gint64 iTimestamp, const PrintPartition* pPartitions, int nPartitions)
+{
+    if (!pHistory->nCapacity)
+        return;
+
+    for (int i = 0; i < nPartitions; i++)
+    {
+        PartitionSample* pSample = &pHistory->pSamples[pHistory->nWritten % pHistory->nCapacity];
+
+        pSample->iTimestamp = iTimestamp;
+        pSample->iId = pPartitions[i].id;
+        GetPartitionValues(&pPartitions[i], pSample->values);
+
+        pHistory->nWritten++;
+    }
+}
+
+gint64 LatestHistoryTimestamp(const PartitionHistory* pHistory)
+{
+    if (!pHistory->nWritten)
+        return -1;
+
+    return pHistory->pSamples[(pHistory->nWritten - 1) % pHistory->nCapacity].iTimestamp;
+}
+
+static int CompareAggregateIds(const void* a, const void* b)
+{
+    gint32 x = ((const HistoryAggregate*)a)->iId;
+    gint32 y = ((const HistoryAggregate*)b)->iId;
+
+    return (x > y) - (x < y);
+}
+
+void QueryPartitionHistory(const PartitionHistory* pHistory, gint64 iFrom, gint64 iTo, HistoryAggregate* pAggregates, int nAggregates)
+{
+    int nStored = (int)MIN(pHistory->nWritten, (guint64)pHistory->nCapacity);
+    HistorySums* pSums = calloc(MAX(nAggregates, 1), sizeof(HistorySums));
+
+    // sorted by id, so every sample finds its partition with a binary search
+    qsort(pAggregates, nAggregates, sizeof(HistoryAggregate), CompareAggregateIds);
+
+    for (int i = 0; i < nAggregates; i++)
+    {
+        gint32 iId = pAggregates[i].iId;
+
+        memset(&pAggregates[i], 0, sizeof(HistoryAggregate));
+        pAggregates[i].iId = iId;
+    }
+
+    if (!pSums)
+        return;
+
+    // newest to oldest, stopping at the first sample before the window
+    for (int k = 1; k <= nStored; k++)
+    {
+        const PartitionSample* pSample = &pHistory->pSamples[(pHistory->nWritten - k) % pHistory->nCapacity];
+        HistoryAggregate key = { pSample->iId };
+        HistoryAggregate* pAggregate;
+        HistorySums* pSum;
+        double t;
+
+        if (pSample->iTimestamp < iFrom)
+            break;
+
+        if (pSample->iTimestamp > iTo)
+            continue;
+
+        pAggregate = bsearch(&key, pAggregates, nAggregates, sizeof(HistoryAggregate), CompareAggregateIds);
+
+        if (!pAggregate)
+            continue;
+
+        pSum = &pSums[pAggregate - pAggregates];
+        t = (pSample->iTimestamp - iFrom) / 1e9;
+
+        for (int v = 0; v < HISTORY_VALUES; v++)
+        {
+            double fValue = pSample->values[v];
+
+            if (!pAggregate->nSamples || fValue < pAggregate->fMin[v])
+                pAggregate->fMin[v] = fValue;
+
+            if (!pAggregate->nSamples || fValue > pAggregate->fMax[v])
+                pAggregate->fMax[v] = fValue;
+
+            pSum->fV[v] += fValue;
+            pSum->fTV[v] += t * fValue;
+        }
+
+        pSum->fT += t;
+        pSum->fTT += t * t;
+        pAggregate->nSamples++;
+    }
+
+    for (int i = 0; i < nAggregates; i++)
+    {
+        HistoryAggregate* pAggregate = &pAggregates[i];
+        HistorySums* pSum = &pSums[i];
+        int n = pAggregate->nSamples;
+        double fDenominator = n * pSum->fTT - pSum->fT * pSum->fT;
+
+        if (!n)
+            continue;
+
+        for (int v = 0; v < HISTORY_VALUES; v++)
+        {
+            pAggregate->fMean[v] = pSum->fV[v] / n;
+
+            // samples all taken at the same time have no trend
+            if (fDenominator > 1e-12)
+                pAggregate->fTrend[v] = (n * pSum->fTV[v] - pSum->fT * pSum->fV[v]) / fDenominator;
+        }
+    }
+
+    free(pSums);
+}
+
+static gboolean StartPartitionWindow(PartitionWindow* pWindow, const PrintPartition* pPartitions, int nPartitions)
+{
+    if (nPartitions > pWindow->nAllocated)
+    {
+        HistoryAggregate* pAggregates = realloc(pWindow->pAggregates, nPartitions * sizeof(HistoryAggregate));
+
+        if (!pAggregates)
+            return FALSE;
+
+        pWindow->pAggregates = pAggregates;
+        pWindow->nAllocated = nPartitions;
+    }
+
+    memset(pWindow->pAggregates, 0, nPartitions * sizeof(HistoryAggregate));
+
+    for (int i = 0; i < nPartitions; i++)
+        pWindow->pAggregates[i].iId = pPartitions[i].id;
+
+    pWindow->nAggregates = nPartitions;
+    pWindow->nFrames = 0;
+    return TRUE;
+}
+
+gboolean AddToPartitionWindow(PartitionWindow* pWindow, gint64 iTimestamp, const PrintPartition* pPartitions, int nPartitions)
+{
+    gboolean bSamePartitions = pWindow->nFrames && nPartitions == pWindow->nAggregates;
+
+    for (int i = 0; bSamePartitions && i < nPartitions; i++)
+        bSamePartitions = pWindow->pAggregates[i].iId == pPartitions[i].id;
+
+    if (!bSamePartitions && !StartPartitionWindow(pWindow, pPartitions, nPartitions))
+        return FALSE;
+
+    if (!pWindow->nFrames)
+        pWindow->iStart = iTimestamp;
+
+    pWindow->iEnd = iTimestamp;
+    pWindow->nFrames++;
+
+    for (int i = 0; i < nPartitions; i++)
+    {
+        HistoryAggregate* pAggregate = &pWindow->pAggregates[i];
+        gint32 values[HISTORY_VALUES];
+
+        GetPartitionValues(&pPartitions[i], values);
+        pAggregate->nSamples++;
+
+        for (int v = 0; v < HISTORY_VALUES; v++)
+        {
+            if (pAggregate->nSamples == 1 || values[v] < pAggregate->fMin[v])
+                pAggregate->fMin[v] = values[v];
+
+            if (pAggregate->nSamples == 1 || values[v] > pAggregate->fMax[v])
+                pAggregate->fMax[v] = values[v];
+
+            // running mean, so nothing overflows however long the window is
+            pAggregate->fMean[v] += (values[v] - pAggregate->fMean[v]) / pAggregate->nSamples;
+        }
+    }
+
+    return TRUE;
+}
+
+void ResetPartitionWindow(PartitionWindow* pWindow)
+{
+    pWindow->nAggregates = 0;
+    pWindow->nFrames = 0;
+}
+
+void FreePartitionWindow(PartitionWindow* pWindow)
+{
+    free(pWindow->pAggregates);
+    memset(pWindow, 0, sizeof(PartitionWindow));
+}
+
+static gboolean StartPartitionDelta(PartitionDelta* pDelta, const PrintPartition* pPartitions, int nPartitions)
+{
+    if (nPartitions > pDelta->nAllocated)
+    {
+        gint32* piIds = realloc(pDelta->piIds, nPartitions * sizeof(gint32));
+        gint32* piValues = piIds ? realloc(pDelta->piValues, nPartitions * HISTORY_VALUES * sizeof(gint32)) : NULL;
+        gboolean* pbChanged = piValues ? realloc(pDelta->pbChanged, nPartitions * sizeof(gboolean)) : NULL;
+
+        // whatever was reallocated is kept, the old sizes still fit
+        if (piIds)
+            pDelta->piIds = piIds;
+
+        if (piValues)
+            pDelta->piValues = piValues;
+
+        if (!pbChanged)
+            return FALSE;
+
+        pDelta->pbChanged = pbChanged;
+        pDelta->nAllocated = nPartitions;
+    }
+
+    for (int i = 0; i < nPartitions; i++)
+        pDelta->piIds[i] = pPartitions[i].id;
+
+    pDelta->nPartitions = nPartitions;
+    return TRUE;
+}
+
+int UpdatePartitionDelta(PartitionDelta* pDelta, const PrintPartition* pPartitions, int nPartitions, double fThreshold, guint nKeyframeInterval)
+{
+    gboolean bKeyframe = !pDelta->nSequence || nPartitions != pDelta->nPartitions || (nKeyframeInterval && pDelta->nSinceKeyframe + 1 >= nKeyframeInterval);
+    int nChanged = 0;
+
+    for (int i = 0; !bKeyframe && i < nPartitions; i++)
+        bKeyframe = pDelta->piIds[i] != pPartitions[i].id;
+
+    if (bKeyframe && !StartPartitionDelta(pDelta, pPartitions, nPartitions))
+        return 0;
+
+    for (int i = 0; i < nPartitions; i++)
+    {
+        gint32* piEmitted = &pDelta->piValues[i * HISTORY_VALUES];
+        gint32 values[HISTORY_VALUES];
+
+        GetPartitionValues(&pPartitions[i], values);
+        pDelta->pbChanged[i] = bKeyframe;
+
+        for (int v = 0; v < HISTORY_VALUES && !pDelta->pbChanged[i]; v++)
+            pDelta->pbChanged[i] = fabs((double)values[v] - piEmitted[v]) > fThreshold;
+
+        if (pDelta->pbChanged[i])
+        {
+            memcpy(piEmitted, values, sizeof(values));
+            nChanged++;
+        }
+    }
+
+    pDelta->bKeyframe = bKeyframe;
+    pDelta->nSinceKeyframe = bKeyframe ? 0 : pDelta->nSinceKeyframe + 1;
+
+    if (nChanged || bKeyframe)
+        pDelta->nSequence++;
+
+    return nChanged;
+}
+
+void ResetPartitionDelta(PartitionDelta* pDelta)
+{
+    pDelta->nPartitions = 0;
+    pDelta->nSequence = 0;
+    pDelta->nSinceKeyframe = 0;
+}
+
+void FreePartitionDelta(PartitionDelta* pDelta)
+{
+    free(pDelta->piIds);
+    free(pDelta->piValues);
+    free(pDelta->pbChanged);
+    memset(pDelta, 0, sizeof(PartitionDelta));
+}
+
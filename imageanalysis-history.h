@@ -0,0 +1,89 @@
+#pragma once
+
+#include "imageanalysis.h"
+
+// partition values kept for every frame, r,g,b for RGB and y,u,v for YUY2
+#define HISTORY_VALUES 9
+
+typedef struct PartitionSample
+{
+	gint64	iTimestamp;		// PTS of the frame, in ns
+	gint32	iId;
+	gint32	values[HISTORY_VALUES];	// total, average and non-uniformity
+} PartitionSample;
+
+// fixed capacity ring of samples, the oldest are overwritten once it is full
+typedef struct PartitionHistory
+{
+	PartitionSample*	pSamples;
+	int					nCapacity;
+	guint64				nWritten;
+} PartitionHistory;
+
+typedef struct HistoryAggregate
+{
+	gint32	iId;
+	int		nSamples;
+	double	fMin[HISTORY_VALUES];
+	double	fMax[HISTORY_VALUES];
+	double	fMean[HISTORY_VALUES];
+	double	fTrend[HISTORY_VALUES];	// least squares slope, per second
+} HistoryAggregate;
+
+// per partition min, max and mean of every frame since the window was reset, updated in place
+typedef struct PartitionWindow
+{
+	HistoryAggregate*	pAggregates;	// in the order of the partitions, fTrend is unused
+	int					nAggregates;
+	int					nAllocated;
+	int					nFrames;
+	gint64				iStart;			// PTS of the first and last frame, in ns
+	gint64				iEnd;
+} PartitionWindow;
+
+// partition values as they were last emitted, so only the partitions that moved are sent again
+//
+// delta documents look like {"sequence": n, "keyframe": bool, "partitions": [...]}, the partitions
+// are the objects of the full partitions document. a keyframe carries every partition and replaces
+// the consumer's state, other documents only carry the partitions that moved and are merged into it
+// by id. sequences are consecutive, a consumer that misses one waits for the next keyframe, see
+// MergePartitionsJsonStr for the reference merge
+typedef struct PartitionDelta
+{
+	gint32*		piIds;
+	gint32*		piValues;			// HISTORY_VALUES per partition
+	gboolean*	pbChanged;			// partitions of the pending document
+	int			nPartitions;
+	int			nAllocated;
+	guint64		nSequence;			// sequence of the pending document
+	guint		nSinceKeyframe;		// frames since the last keyframe
+	gboolean	bKeyframe;
+} PartitionDelta;
+
+gboolean InitPartitionHistory(PartitionHistory* pHistory, int nCapacity);
+void FreePartitionHistory(PartitionHistory* pHistory);
+const char* HistoryValueName(int iValue);
+
+void RecordPartitions(PartitionHistory* pHistory, gint64 iTimestamp, const PrintPartition* pPartitions, int nPartitions);
+gint64 LatestHistoryTimestamp(const PartitionHistory* pHistory);
+
+// aggregates the samples in [iFrom, iTo] of the partitions with the ids of pAggregates[i].iId
+void QueryPartitionHistory(const PartitionHistory* pHistory, gint64 iFrom, gint64 iTo, HistoryAggregate* pAggregates, int nAggregates);
+
+// a window restarts when the partitions change while it is open
+gboolean AddToPartitionWindow(PartitionWindow* pWindow, gint64 iTimestamp, const PrintPartition* pPartitions, int nPartitions);
+void ResetPartitionWindow(PartitionWindow* pWindow);
+void FreePartitionWindow(PartitionWindow* pWindow);
+char* PartitionWindowToJsonStr(const PartitionWindow* pWindow);
+
+// compares the partitions with the values last emitted, returns how many moved by more than fThreshold
+// in any value, every partition on keyframes, which come every nKeyframeInterval frames (0 for none) and
+// whenever the partitions change
+int UpdatePartitionDelta(PartitionDelta* pDelta, const PrintPartition* pPartitions, int nPartitions, double fThreshold, guint nKeyframeInterval);
+void ResetPartitionDelta(PartitionDelta* pDelta);
+void FreePartitionDelta(PartitionDelta* pDelta);
+char* PartitionDeltaToJsonStr(ImageAnalysis* pImageAnalysis, const PartitionDelta* pDelta);
+
+// applies a delta document to the state built from the previous ones, returns the new state or
+// NULL when the delta can't be applied and the consumer has to wait for a keyframe
+char* MergePartitionsJsonStr(const char* pStateJsonStr, const char* pDeltaJsonStr);
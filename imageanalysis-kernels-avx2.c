@@ -0,0 +1,165 @@
+#include "imageanalysis-kernels.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+
+#include <immintrin.h>
+
+
+KERNEL_TARGET("avx2") static void AccumulateBGRxAvx2(int* piSums, const guint8* pSrc, int n)
+{
+    // red, green, blue of 4 pixels packed into the low 12 bytes of each lane
+    const __m256i shuffle = _mm256_broadcastsi128_si256(_mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+    // then the 24 bytes of both lanes made contiguous
+    const __m256i pack = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+    int x = 0;
+
+    for (; x + 8 <= n; x += 8, pSrc += 32, piSums += 24)
+    {
+        __m256i rgb = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)pSrc), shuffle), pack);
+        __m128i lo = _mm256_castsi256_si128(rgb);
+        __m256i* pSums = (__m256i*)piSums;
+
+        _mm256_storeu_si256(pSums, _mm256_add_epi32(_mm256_loadu_si256(pSums), _mm256_cvtepu8_epi32(lo)));
+        _mm256_storeu_si256(pSums + 1, _mm256_add_epi32(_mm256_loadu_si256(pSums + 1), _mm256_cvtepu8_epi32(_mm_srli_si128(lo, 8))));
+        _mm256_storeu_si256(pSums + 2, _mm256_add_epi32(_mm256_loadu_si256(pSums + 2), _mm256_cvtepu8_epi32(_mm256_extracti128_si256(rgb, 1))));
+    }
+
+    AccumulateBGRxScalar(piSums, pSrc, n - x);
+}
+
+KERNEL_TARGET("avx2") static void AccumulateBGRxQuadAvx2(int* piSums, const guint8* pSrc, int n)
+{
+    // red, green, blue, 0 of every pixel
+    const __m256i shuffle = _mm256_broadcastsi128_si256(_mm_setr_epi8(2, 1, 0, -1, 6, 5, 4, -1, 10, 9, 8, -1, 14, 13, 12, -1));
+    int x = 0;
+
+    for (; x + 8 <= n; x += 8, pSrc += 32, piSums += 32)
+    {
+        __m256i rgb = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)pSrc), shuffle);
+        __m128i lo = _mm256_castsi256_si128(rgb);
+        __m128i hi = _mm256_extracti128_si256(rgb, 1);
+        __m256i* pSums = (__m256i*)piSums;
+
+        _mm256_storeu_si256(pSums, _mm256_add_epi32(_mm256_loadu_si256(pSums), _mm256_cvtepu8_epi32(lo)));
+        _mm256_storeu_si256(pSums + 1, _mm256_add_epi32(_mm256_loadu_si256(pSums + 1), _mm256_cvtepu8_epi32(_mm_srli_si128(lo, 8))));
+        _mm256_storeu_si256(pSums + 2, _mm256_add_epi32(_mm256_loadu_si256(pSums + 2), _mm256_cvtepu8_epi32(hi)));
+        _mm256_storeu_si256(pSums + 3, _mm256_add_epi32(_mm256_loadu_si256(pSums + 3), _mm256_cvtepu8_epi32(_mm_srli_si128(hi, 8))));
+    }
+
+    AccumulateBGRxQuadScalar(piSums, pSrc, n - x);
+}
+
+KERNEL_TARGET("avx2") static void AccumulateBytesAvx2(int* piSums, const guint8* pSrc, int n)
+{
+    int x = 0;
+
+    for (; x + 32 <= n; x += 32, pSrc += 32, piSums += 32)
+    {
+        __m128i lo = _mm_loadu_si128((const __m128i*)pSrc);
+        __m128i hi = _mm_loadu_si128((const __m128i*)(pSrc + 16));
+        __m256i* pSums = (__m256i*)piSums;
+
+        _mm256_storeu_si256(pSums, _mm256_add_epi32(_mm256_loadu_si256(pSums), _mm256_cvtepu8_epi32(lo)));
+        _mm256_storeu_si256(pSums + 1, _mm256_add_epi32(_mm256_loadu_si256(pSums + 1), _mm256_cvtepu8_epi32(_mm_srli_si128(lo, 8))));
+        _mm256_storeu_si256(pSums + 2, _mm256_add_epi32(_mm256_loadu_si256(pSums + 2), _mm256_cvtepu8_epi32(hi)));
+        _mm256_storeu_si256(pSums + 3, _mm256_add_epi32(_mm256_loadu_si256(pSums + 3), _mm256_cvtepu8_epi32(_mm_srli_si128(hi, 8))));
+    }
+
+    AccumulateBytesScalar(piSums, pSrc, n - x);
+}
+
+KERNEL_TARGET("avx2") static void SumBytes4Avx2(int* piSums, const guint8* pSrc, int n)
+{
+    const __m256i mask = _mm256_set1_epi32(0xff);
+    __m256i s0 = _mm256_setzero_si256(), s1 = _mm256_setzero_si256(), s2 = _mm256_setzero_si256(), s3 = _mm256_setzero_si256();
+    int x = 0;
+
+    // every lane sums one word of 8, the byte positions are split off by shifting
+    for (; x + 8 <= n; x += 8, pSrc += 32)
+    {
+        __m256i words = _mm256_loadu_si256((const __m256i*)pSrc);
+
+        s0 = _mm256_add_epi32(s0, _mm256_and_si256(words, mask));
+        s1 = _mm256_add_epi32(s1, _mm256_and_si256(_mm256_srli_epi32(words, 8), mask));
+        s2 = _mm256_add_epi32(s2, _mm256_and_si256(_mm256_srli_epi32(words, 16), mask));
+        s3 = _mm256_add_epi32(s3, _mm256_srli_epi32(words, 24));
+    }
+
+    // fold the lanes, then transpose so every sum lands in the lane of its byte position
+    __m256i s01 = _mm256_add_epi32(_mm256_unpacklo_epi32(s0, s1), _mm256_unpackhi_epi32(s0, s1));
+    __m256i s23 = _mm256_add_epi32(_mm256_unpacklo_epi32(s2, s3), _mm256_unpackhi_epi32(s2, s3));
+    __m256i sums = _mm256_add_epi32(_mm256_unpacklo_epi64(s01, s23), _mm256_unpackhi_epi64(s01, s23));
+    __m128i total = _mm_add_epi32(_mm256_castsi256_si128(sums), _mm256_extracti128_si256(sums, 1));
+
+    _mm_storeu_si128((__m128i*)piSums, _mm_add_epi32(_mm_loadu_si128((const __m128i*)piSums), total));
+
+    SumBytes4Scalar(piSums, pSrc, n - x);
+}
+
+KERNEL_TARGET("avx2") static void Fill32Avx2(guint8* pDst, guint32 uValue, int n)
+{
+    __m256i value = _mm256_set1_epi32((int)uValue);
+    int x = 0;
+
+    if (n * 4 >= FILL_STREAM_BYTES)
+    {
+        for (; x < n && ((guintptr)pDst & 31); x++, pDst += 4)
+            *(guint32*)pDst = uValue;
+
+        for (; x + 8 <= n; x += 8, pDst += 32)
+            _mm256_stream_si256((__m256i*)pDst, value);
+
+        _mm_sfence();
+    }
+
+    for (; x + 8 <= n; x += 8, pDst += 32)
+        _mm256_storeu_si256((__m256i*)pDst, value);
+
+    Fill32Scalar(pDst, uValue, n - x);
+}
+
+KERNEL_TARGET("avx2") static void PlotRowsAvx2(int* piDst, const int* piSrc, int n, int iDivisor, int iOrigRange, int iMinOrig, int iNewRange, int iMinNew)
+{
+    __m256d divisor = _mm256_set1_pd(iDivisor);
+    __m256d minOrig = _mm256_set1_pd(iMinOrig);
+    __m256d origRange = _mm256_set1_pd(iOrigRange);
+    __m256d newRange = _mm256_set1_pd(iNewRange);
+    __m256d minNew = _mm256_set1_pd(iMinNew);
+    int x = 0;
+
+    if (!iOrigRange)
+    {
+        Fill32Avx2((guint8*)piDst, (guint32)iMinNew, n);
+        return;
+    }
+
+    for (; x + 4 <= n; x += 4, piSrc += 4, piDst += 4)
+    {
+        // the quotient of two ints below 2^31 truncates exactly in double precision
+        __m256d fValue = _mm256_round_pd(_mm256_div_pd(_mm256_cvtepi32_pd(_mm_loadu_si128((const __m128i*)piSrc)), divisor), _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+
+        fValue = _mm256_add_pd(_mm256_mul_pd(_mm256_div_pd(_mm256_sub_pd(fValue, minOrig), origRange), newRange), minNew);
+
+        _mm_storeu_si128((__m128i*)piDst, _mm256_cvttpd_epi32(fValue));
+    }
+
+    PlotRowsScalar(piDst, piSrc, n - x, iDivisor, iOrigRange, iMinOrig, iNewRange, iMinNew);
+}
+
+// histograms scatter into the bins and stay scalar
+const AnalysisKernels analysisKernelsAvx2 =
+{
+    CPU_LEVEL_AVX2,
+    "avx2",
+    AccumulateBGRxAvx2,
+    AccumulateBGRxQuadAvx2,
+    AccumulateBytesAvx2,
+    SumBytes4Avx2,
+    HistogramBGRxScalar,
+    HistogramYUY2Scalar,
+    Fill32Avx2,
+    SetChromaOrc,
+    PlotRowsAvx2,
+};
+
+#endif
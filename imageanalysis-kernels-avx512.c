@@ -0,0 +1,166 @@
+#include "imageanalysis-kernels.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+
+#include <immintrin.h>
+
+
+KERNEL_TARGET("avx512f,avx512bw") static void AccumulateBGRxAvx512(int* piSums, const guint8* pSrc, int n)
+{
+    // red, green, blue of 4 pixels packed into the low 12 bytes of each lane
+    const __m512i shuffle = _mm512_broadcast_i32x4(_mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+    // then the 48 bytes of all lanes made contiguous
+    const __m512i pack = _mm512_setr_epi32(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, 3, 7, 11, 15);
+    int x = 0;
+
+    for (; x + 16 <= n; x += 16, pSrc += 64, piSums += 48)
+    {
+        __m512i rgb = _mm512_permutexvar_epi32(pack, _mm512_shuffle_epi8(_mm512_loadu_si512(pSrc), shuffle));
+        __m512i* pSums = (__m512i*)piSums;
+
+        _mm512_storeu_si512(pSums, _mm512_add_epi32(_mm512_loadu_si512(pSums), _mm512_cvtepu8_epi32(_mm512_castsi512_si128(rgb))));
+        _mm512_storeu_si512(pSums + 1, _mm512_add_epi32(_mm512_loadu_si512(pSums + 1), _mm512_cvtepu8_epi32(_mm512_extracti32x4_epi32(rgb, 1))));
+        _mm512_storeu_si512(pSums + 2, _mm512_add_epi32(_mm512_loadu_si512(pSums + 2), _mm512_cvtepu8_epi32(_mm512_extracti32x4_epi32(rgb, 2))));
+    }
+
+    AccumulateBGRxScalar(piSums, pSrc, n - x);
+}
+
+KERNEL_TARGET("avx512f,avx512bw") static void AccumulateBGRxQuadAvx512(int* piSums, const guint8* pSrc, int n)
+{
+    // red, green, blue, 0 of every pixel
+    const __m512i shuffle = _mm512_broadcast_i32x4(_mm_setr_epi8(2, 1, 0, -1, 6, 5, 4, -1, 10, 9, 8, -1, 14, 13, 12, -1));
+    int x = 0;
+
+    for (; x + 16 <= n; x += 16, pSrc += 64, piSums += 64)
+    {
+        __m512i rgb = _mm512_shuffle_epi8(_mm512_loadu_si512(pSrc), shuffle);
+        __m512i* pSums = (__m512i*)piSums;
+
+        _mm512_storeu_si512(pSums, _mm512_add_epi32(_mm512_loadu_si512(pSums), _mm512_cvtepu8_epi32(_mm512_castsi512_si128(rgb))));
+        _mm512_storeu_si512(pSums + 1, _mm512_add_epi32(_mm512_loadu_si512(pSums + 1), _mm512_cvtepu8_epi32(_mm512_extracti32x4_epi32(rgb, 1))));
+        _mm512_storeu_si512(pSums + 2, _mm512_add_epi32(_mm512_loadu_si512(pSums + 2), _mm512_cvtepu8_epi32(_mm512_extracti32x4_epi32(rgb, 2))));
+        _mm512_storeu_si512(pSums + 3, _mm512_add_epi32(_mm512_loadu_si512(pSums + 3), _mm512_cvtepu8_epi32(_mm512_extracti32x4_epi32(rgb, 3))));
+    }
+
+    AccumulateBGRxQuadScalar(piSums, pSrc, n - x);
+}
+
+KERNEL_TARGET("avx512f,avx512bw") static void AccumulateBytesAvx512(int* piSums, const guint8* pSrc, int n)
+{
+    int x = 0;
+
+    for (; x + 64 <= n; x += 64, pSrc += 64, piSums += 64)
+    {
+        __m512i* pSums = (__m512i*)piSums;
+
+        for (int k = 0; k < 4; k++)
+        {
+            __m128i bytes = _mm_loadu_si128((const __m128i*)(pSrc + 16 * k));
+
+            _mm512_storeu_si512(pSums + k, _mm512_add_epi32(_mm512_loadu_si512(pSums + k), _mm512_cvtepu8_epi32(bytes)));
+        }
+    }
+
+    AccumulateBytesScalar(piSums, pSrc, n - x);
+}
+
+KERNEL_TARGET("avx512f,avx512bw") static void SumBytes4Avx512(int* piSums, const guint8* pSrc, int n)
+{
+    const __m512i mask = _mm512_set1_epi32(0xff);
+    __m512i s0 = _mm512_setzero_si512(), s1 = _mm512_setzero_si512(), s2 = _mm512_setzero_si512(), s3 = _mm512_setzero_si512();
+    int x = 0;
+
+    // every lane sums one word of 16, the byte positions are split off by shifting
+    for (; x + 16 <= n; x += 16, pSrc += 64)
+    {
+        __m512i words = _mm512_loadu_si512(pSrc);
+
+        s0 = _mm512_add_epi32(s0, _mm512_and_si512(words, mask));
+        s1 = _mm512_add_epi32(s1, _mm512_and_si512(_mm512_srli_epi32(words, 8), mask));
+        s2 = _mm512_add_epi32(s2, _mm512_and_si512(_mm512_srli_epi32(words, 16), mask));
+        s3 = _mm512_add_epi32(s3, _mm512_srli_epi32(words, 24));
+    }
+
+    // fold the lanes, then transpose so every sum lands in the lane of its byte position
+    __m256i f0 = _mm256_add_epi32(_mm512_castsi512_si256(s0), _mm512_extracti64x4_epi64(s0, 1));
+    __m256i f1 = _mm256_add_epi32(_mm512_castsi512_si256(s1), _mm512_extracti64x4_epi64(s1, 1));
+    __m256i f2 = _mm256_add_epi32(_mm512_castsi512_si256(s2), _mm512_extracti64x4_epi64(s2, 1));
+    __m256i f3 = _mm256_add_epi32(_mm512_castsi512_si256(s3), _mm512_extracti64x4_epi64(s3, 1));
+    __m256i f01 = _mm256_add_epi32(_mm256_unpacklo_epi32(f0, f1), _mm256_unpackhi_epi32(f0, f1));
+    __m256i f23 = _mm256_add_epi32(_mm256_unpacklo_epi32(f2, f3), _mm256_unpackhi_epi32(f2, f3));
+    __m256i sums = _mm256_add_epi32(_mm256_unpacklo_epi64(f01, f23), _mm256_unpackhi_epi64(f01, f23));
+    __m128i total = _mm_add_epi32(_mm256_castsi256_si128(sums), _mm256_extracti128_si256(sums, 1));
+
+    _mm_storeu_si128((__m128i*)piSums, _mm_add_epi32(_mm_loadu_si128((const __m128i*)piSums), total));
+
+    SumBytes4Scalar(piSums, pSrc, n - x);
+}
+
+KERNEL_TARGET("avx512f,avx512bw") static void Fill32Avx512(guint8* pDst, guint32 uValue, int n)
+{
+    __m512i value = _mm512_set1_epi32((int)uValue);
+    int x = 0;
+
+    if (n * 4 >= FILL_STREAM_BYTES)
+    {
+        for (; x < n && ((guintptr)pDst & 63); x++, pDst += 4)
+            *(guint32*)pDst = uValue;
+
+        for (; x + 16 <= n; x += 16, pDst += 64)
+            _mm512_stream_si512((__m512i*)pDst, value);
+
+        _mm_sfence();
+    }
+
+    for (; x + 16 <= n; x += 16, pDst += 64)
+        _mm512_storeu_si512(pDst, value);
+
+    Fill32Scalar(pDst, uValue, n - x);
+}
+
+KERNEL_TARGET("avx512f,avx512bw") static void PlotRowsAvx512(int* piDst, const int* piSrc, int n, int iDivisor, int iOrigRange, int iMinOrig, int iNewRange, int iMinNew)
+{
+    __m512d divisor = _mm512_set1_pd(iDivisor);
+    __m512d minOrig = _mm512_set1_pd(iMinOrig);
+    __m512d origRange = _mm512_set1_pd(iOrigRange);
+    __m512d newRange = _mm512_set1_pd(iNewRange);
+    __m512d minNew = _mm512_set1_pd(iMinNew);
+    int x = 0;
+
+    if (!iOrigRange)
+    {
+        Fill32Avx512((guint8*)piDst, (guint32)iMinNew, n);
+        return;
+    }
+
+    for (; x + 8 <= n; x += 8, piSrc += 8, piDst += 8)
+    {
+        // the quotient of two ints below 2^31 truncates exactly in double precision
+        __m512d fValue = _mm512_roundscale_pd(_mm512_div_pd(_mm512_cvtepi32_pd(_mm256_loadu_si256((const __m256i*)piSrc)), divisor), _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+
+        fValue = _mm512_add_pd(_mm512_mul_pd(_mm512_div_pd(_mm512_sub_pd(fValue, minOrig), origRange), newRange), minNew);
+
+        _mm256_storeu_si256((__m256i*)piDst, _mm512_cvttpd_epi32(fValue));
+    }
+
+    PlotRowsScalar(piDst, piSrc, n - x, iDivisor, iOrigRange, iMinOrig, iNewRange, iMinNew);
+}
+
+// histograms scatter into the bins and stay scalar
+const AnalysisKernels analysisKernelsAvx512 =
+{
+    CPU_LEVEL_AVX512,
+    "avx512",
+    AccumulateBGRxAvx512,
+    AccumulateBGRxQuadAvx512,
+    AccumulateBytesAvx512,
+    SumBytes4Avx512,
+    HistogramBGRxScalar,
+    HistogramYUY2Scalar,
+    Fill32Avx512,
+    SetChromaOrc,
+    PlotRowsAvx512,
+};
+
+#endif
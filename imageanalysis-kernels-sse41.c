@@ -0,0 +1,171 @@
+#include "imageanalysis-kernels.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+
+#include <smmintrin.h>
+
+
+KERNEL_TARGET("sse4.1") static void AccumulateBGRxSse41(int* piSums, const guint8* pSrc, int n)
+{
+    // red, green, blue of 4 pixels packed into the low 12 bytes
+    const __m128i shuffle = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    int x = 0;
+
+    for (; x + 4 <= n; x += 4, pSrc += 16, piSums += 12)
+    {
+        __m128i rgb = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)pSrc), shuffle);
+        __m128i* pSums = (__m128i*)piSums;
+
+        _mm_storeu_si128(pSums, _mm_add_epi32(_mm_loadu_si128(pSums), _mm_cvtepu8_epi32(rgb)));
+        _mm_storeu_si128(pSums + 1, _mm_add_epi32(_mm_loadu_si128(pSums + 1), _mm_cvtepu8_epi32(_mm_srli_si128(rgb, 4))));
+        _mm_storeu_si128(pSums + 2, _mm_add_epi32(_mm_loadu_si128(pSums + 2), _mm_cvtepu8_epi32(_mm_srli_si128(rgb, 8))));
+    }
+
+    AccumulateBGRxScalar(piSums, pSrc, n - x);
+}
+
+KERNEL_TARGET("sse4.1") static void AccumulateBGRxQuadSse41(int* piSums, const guint8* pSrc, int n)
+{
+    // red, green, blue, 0 of every pixel
+    const __m128i shuffle = _mm_setr_epi8(2, 1, 0, -1, 6, 5, 4, -1, 10, 9, 8, -1, 14, 13, 12, -1);
+    int x = 0;
+
+    for (; x + 4 <= n; x += 4, pSrc += 16, piSums += 16)
+    {
+        __m128i rgb = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)pSrc), shuffle);
+        __m128i* pSums = (__m128i*)piSums;
+
+        _mm_storeu_si128(pSums, _mm_add_epi32(_mm_loadu_si128(pSums), _mm_cvtepu8_epi32(rgb)));
+        _mm_storeu_si128(pSums + 1, _mm_add_epi32(_mm_loadu_si128(pSums + 1), _mm_cvtepu8_epi32(_mm_srli_si128(rgb, 4))));
+        _mm_storeu_si128(pSums + 2, _mm_add_epi32(_mm_loadu_si128(pSums + 2), _mm_cvtepu8_epi32(_mm_srli_si128(rgb, 8))));
+        _mm_storeu_si128(pSums + 3, _mm_add_epi32(_mm_loadu_si128(pSums + 3), _mm_cvtepu8_epi32(_mm_srli_si128(rgb, 12))));
+    }
+
+    AccumulateBGRxQuadScalar(piSums, pSrc, n - x);
+}
+
+KERNEL_TARGET("sse4.1") static void AccumulateBytesSse41(int* piSums, const guint8* pSrc, int n)
+{
+    int x = 0;
+
+    for (; x + 16 <= n; x += 16, pSrc += 16, piSums += 16)
+    {
+        __m128i bytes = _mm_loadu_si128((const __m128i*)pSrc);
+        __m128i* pSums = (__m128i*)piSums;
+
+        _mm_storeu_si128(pSums, _mm_add_epi32(_mm_loadu_si128(pSums), _mm_cvtepu8_epi32(bytes)));
+        _mm_storeu_si128(pSums + 1, _mm_add_epi32(_mm_loadu_si128(pSums + 1), _mm_cvtepu8_epi32(_mm_srli_si128(bytes, 4))));
+        _mm_storeu_si128(pSums + 2, _mm_add_epi32(_mm_loadu_si128(pSums + 2), _mm_cvtepu8_epi32(_mm_srli_si128(bytes, 8))));
+        _mm_storeu_si128(pSums + 3, _mm_add_epi32(_mm_loadu_si128(pSums + 3), _mm_cvtepu8_epi32(_mm_srli_si128(bytes, 12))));
+    }
+
+    AccumulateBytesScalar(piSums, pSrc, n - x);
+}
+
+// the horizontal sums of 4 vectors, in the lanes of their vector
+KERNEL_TARGET("sse4.1") static inline __m128i HorizontalSums4Sse41(__m128i s0, __m128i s1, __m128i s2, __m128i s3)
+{
+    __m128i s01 = _mm_add_epi32(_mm_unpacklo_epi32(s0, s1), _mm_unpackhi_epi32(s0, s1));
+    __m128i s23 = _mm_add_epi32(_mm_unpacklo_epi32(s2, s3), _mm_unpackhi_epi32(s2, s3));
+
+    return _mm_add_epi32(_mm_unpacklo_epi64(s01, s23), _mm_unpackhi_epi64(s01, s23));
+}
+
+KERNEL_TARGET("sse4.1") static void SumBytes4Sse41(int* piSums, const guint8* pSrc, int n)
+{
+    const __m128i mask = _mm_set1_epi32(0xff);
+    __m128i s0 = _mm_setzero_si128(), s1 = _mm_setzero_si128(), s2 = _mm_setzero_si128(), s3 = _mm_setzero_si128();
+    int x = 0;
+
+    // every lane sums one word of 4, the byte positions are split off by shifting
+    for (; x + 4 <= n; x += 4, pSrc += 16)
+    {
+        __m128i words = _mm_loadu_si128((const __m128i*)pSrc);
+
+        s0 = _mm_add_epi32(s0, _mm_and_si128(words, mask));
+        s1 = _mm_add_epi32(s1, _mm_and_si128(_mm_srli_epi32(words, 8), mask));
+        s2 = _mm_add_epi32(s2, _mm_and_si128(_mm_srli_epi32(words, 16), mask));
+        s3 = _mm_add_epi32(s3, _mm_srli_epi32(words, 24));
+    }
+
+    _mm_storeu_si128((__m128i*)piSums, _mm_add_epi32(_mm_loadu_si128((const __m128i*)piSums), HorizontalSums4Sse41(s0, s1, s2, s3)));
+
+    SumBytes4Scalar(piSums, pSrc, n - x);
+}
+
+KERNEL_TARGET("sse4.1") static void Fill32Sse41(guint8* pDst, guint32 uValue, int n)
+{
+    __m128i value = _mm_set1_epi32((int)uValue);
+    int x = 0;
+
+    if (n * 4 >= FILL_STREAM_BYTES)
+    {
+        for (; x < n && ((guintptr)pDst & 15); x++, pDst += 4)
+            *(guint32*)pDst = uValue;
+
+        for (; x + 4 <= n; x += 4, pDst += 16)
+            _mm_stream_si128((__m128i*)pDst, value);
+
+        _mm_sfence();
+    }
+
+    for (; x + 4 <= n; x += 4, pDst += 16)
+        _mm_storeu_si128((__m128i*)pDst, value);
+
+    Fill32Scalar(pDst, uValue, n - x);
+}
+
+KERNEL_TARGET("sse4.1") static inline __m128i PlotPairSse41(__m128i values, __m128d divisor, __m128d minOrig, __m128d origRange, __m128d newRange, __m128d minNew)
+{
+    // the quotient of two ints below 2^31 truncates exactly in double precision
+    __m128d fValue = _mm_round_pd(_mm_div_pd(_mm_cvtepi32_pd(values), divisor), _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+
+    fValue = _mm_add_pd(_mm_mul_pd(_mm_div_pd(_mm_sub_pd(fValue, minOrig), origRange), newRange), minNew);
+
+    return _mm_cvttpd_epi32(fValue);
+}
+
+KERNEL_TARGET("sse4.1") static void PlotRowsSse41(int* piDst, const int* piSrc, int n, int iDivisor, int iOrigRange, int iMinOrig, int iNewRange, int iMinNew)
+{
+    __m128d divisor = _mm_set1_pd(iDivisor);
+    __m128d minOrig = _mm_set1_pd(iMinOrig);
+    __m128d origRange = _mm_set1_pd(iOrigRange);
+    __m128d newRange = _mm_set1_pd(iNewRange);
+    __m128d minNew = _mm_set1_pd(iMinNew);
+    int x = 0;
+
+    if (!iOrigRange)
+    {
+        Fill32Sse41((guint8*)piDst, (guint32)iMinNew, n);
+        return;
+    }
+
+    for (; x + 4 <= n; x += 4, piSrc += 4, piDst += 4)
+    {
+        __m128i values = _mm_loadu_si128((const __m128i*)piSrc);
+        __m128i lo = PlotPairSse41(values, divisor, minOrig, origRange, newRange, minNew);
+        __m128i hi = PlotPairSse41(_mm_srli_si128(values, 8), divisor, minOrig, origRange, newRange, minNew);
+
+        _mm_storeu_si128((__m128i*)piDst, _mm_unpacklo_epi64(lo, hi));
+    }
+
+    PlotRowsScalar(piDst, piSrc, n - x, iDivisor, iOrigRange, iMinOrig, iNewRange, iMinNew);
+}
+
+// histograms scatter into the bins and stay scalar
+const AnalysisKernels analysisKernelsSse41 =
+{
+    CPU_LEVEL_SSE41,
+    "sse4.1",
+    AccumulateBGRxSse41,
+    AccumulateBGRxQuadSse41,
+    AccumulateBytesSse41,
+    SumBytes4Sse41,
+    HistogramBGRxScalar,
+    HistogramYUY2Scalar,
+    Fill32Sse41,
+    SetChromaOrc,
+    PlotRowsSse41,
+};
+
+#endif
@@ -0,0 +1,290 @@
+#include "imageanalysis-kernels.h"
+#include "imageanalysis-orc-dist.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+#ifndef DISABLE_ORC
+#include <orc/orc.h>
+#endif
+
+
+static CpuLevel supportedLevel = CPU_LEVEL_SCALAR;
+static CpuLevel defaultLevel = CPU_LEVEL_SCALAR;
+
+static const char* levelNames[CPU_LEVEL_LAST] = { "auto", "scalar", "sse4.1", "avx2", "avx512" };
+
+void AccumulateBGRxScalar(int* piSums, const guint8* pSrc, int n)
+{
+    for (int x = 0; x < n; x++, pSrc += 4, piSums += 3)
+    {
+        piSums[0] += pSrc[2];
+        piSums[1] += pSrc[1];
+        piSums[2] += pSrc[0];
+    }
+}
+
+void AccumulateBGRxQuadScalar(int* piSums, const guint8* pSrc, int n)
+{
+    for (int x = 0; x < n; x++, pSrc += 4, piSums += 4)
+    {
+        piSums[0] += pSrc[2];
+        piSums[1] += pSrc[1];
+        piSums[2] += pSrc[0];
+    }
+}
+
+void AccumulateBytesScalar(int* piSums, const guint8* pSrc, int n)
+{
+    for (int x = 0; x < n; x++)
+        piSums[x] += pSrc[x];
+}
+
+void SumBytes4Scalar(int* piSums, const guint8* pSrc, int n)
+{
+    int s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+
+    for (int x = 0; x < n; x++, pSrc += 4)
+    {
+        s0 += pSrc[0];
+        s1 += pSrc[1];
+        s2 += pSrc[2];
+        s3 += pSrc[3];
+    }
+
+    piSums[0] += s0;
+    piSums[1] += s1;
+    piSums[2] += s2;
+    piSums[3] += s3;
+}
+
+void HistogramBGRxScalar(int* piHistogram, const guint8* pSrc, int n)
+{
+    for (int x = 0; x < n; x++, pSrc += 4)
+    {
+        piHistogram[pSrc[2] * 3] += 1;
+        piHistogram[pSrc[1] * 3 + 1] += 1;
+        piHistogram[pSrc[0] * 3 + 2] += 1;
+    }
+}
+
+void HistogramYUY2Scalar(int* piHistogram, const guint8* pSrc, int n)
+{
+    // Y0 U Y1 V, the chroma of even pixels is counted as Cr and of odd pixels as Cb
+    for (int x = 0; x + 1 < n; x += 2, pSrc += 4)
+    {
+        piHistogram[pSrc[0] * 3] += 1;
+        piHistogram[pSrc[1] * 3 + 1] += 1;
+        piHistogram[pSrc[2] * 3] += 1;
+        piHistogram[pSrc[3] * 3 + 2] += 1;
+    }
+}
+
+void Fill32Scalar(guint8* pDst, guint32 uValue, int n)
+{
+    guint32* puDst = (guint32*)pDst;
+
+    for (int x = 0; x < n; x++)
+        puDst[x] = uValue;
+}
+
+void PlotRowsScalar(int* piDst, const int* piSrc, int n, int iDivisor, int iOrigRange, int iMinOrig, int iNewRange, int iMinNew)
+{
+    for (int x = 0; x < n; x++)
+    {
+        double fValue = piSrc[x] / iDivisor;
+
+        piDst[x] = iOrigRange ? (int)(((fValue - iMinOrig) / iOrigRange) * iNewRange + iMinNew) : iMinNew;
+    }
+}
+
+void AccumulateBytesOrc(int* piSums, const guint8* pSrc, int n)
+{
+    image_analysis_orc_accumulate_u8((gint32*)piSums, pSrc, n);
+}
+
+void Fill32Orc(guint8* pDst, guint32 uValue, int n)
+{
+    image_analysis_orc_fill_u32((guint32*)pDst, (int)uValue, n);
+}
+
+void SetChromaOrc(guint8* pDst, guint8 uChroma, int n)
+{
+    image_analysis_orc_set_chroma(pDst, uChroma, n);
+}
+
+// the portable level, the loops orc can express run as orc programs
+// (their C backup with DISABLE_ORC)
+const AnalysisKernels analysisKernelsScalar =
+{
+    CPU_LEVEL_SCALAR,
+#ifdef DISABLE_ORC
+    "scalar",
+#else
+    "orc",
+#endif
+    AccumulateBGRxScalar,
+    AccumulateBGRxQuadScalar,
+    AccumulateBytesOrc,
+    SumBytes4Scalar,
+    HistogramBGRxScalar,
+    HistogramYUY2Scalar,
+    Fill32Orc,
+    SetChromaOrc,
+    PlotRowsScalar,
+};
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+static void CpuId(int iLeaf, int iSubLeaf, unsigned int regs[4])
+{
+#if defined(_MSC_VER)
+    __cpuidex((int*)regs, iLeaf, iSubLeaf);
+#else
+    __cpuid_count(iLeaf, iSubLeaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+static unsigned long long ReadXcr0(void)
+{
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    unsigned int eax, edx;
+    __asm__ volatile ("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return ((unsigned long long)edx << 32) | eax;
+#endif
+}
+
+static CpuLevel DetectCpuLevel(void)
+{
+    unsigned int regs[4];
+    unsigned int uMaxLeaf;
+    unsigned long long uXcr0 = 0;
+    CpuLevel level = CPU_LEVEL_SCALAR;
+
+    CpuId(0, 0, regs);
+    uMaxLeaf = regs[0];
+
+    if (uMaxLeaf < 1)
+        return level;
+
+    CpuId(1, 0, regs);
+
+    // ecx bit 19 sse4.1, bit 9 ssse3
+    if (!(regs[2] & (1u << 19)) || !(regs[2] & (1u << 9)))
+        return level;
+
+    level = CPU_LEVEL_SSE41;
+
+    // the os has to save the ymm (and zmm) state, ecx bit 27 osxsave, bit 28 avx
+    if (!(regs[2] & (1u << 27)) || !(regs[2] & (1u << 28)) || uMaxLeaf < 7)
+        return level;
+
+    uXcr0 = ReadXcr0();
+
+    if ((uXcr0 & 0x6) != 0x6)
+        return level;
+
+    CpuId(7, 0, regs);
+
+    // ebx bit 5 avx2
+    if (!(regs[1] & (1u << 5)))
+        return level;
+
+    level = CPU_LEVEL_AVX2;
+
+    // ebx bit 16 avx512f, bit 30 avx512bw, xcr0 opmask, zmm hi256 and hi16 zmm state
+    if ((regs[1] & (1u << 16)) && (regs[1] & (1u << 30)) && (uXcr0 & 0xe6) == 0xe6)
+        level = CPU_LEVEL_AVX512;
+
+    return level;
+}
+#else
+static CpuLevel DetectCpuLevel(void)
+{
+    return CPU_LEVEL_SCALAR;
+}
+#endif
+
+CpuLevel ParseCpuLevel(const char* pName)
+{
+    for (int i = CPU_LEVEL_AUTO; i < CPU_LEVEL_LAST; i++)
+    {
+        if (g_ascii_strcasecmp(pName, levelNames[i]) == 0)
+            return (CpuLevel)i;
+    }
+
+    // accept the names without the dot too, sse41
+    if (g_ascii_strcasecmp(pName, "sse41") == 0)
+        return CPU_LEVEL_SSE41;
+
+    return CPU_LEVEL_AUTO;
+}
+
+void InitAnalysisKernels(void)
+{
+    const char* pForced = g_getenv("PRINTANALYSIS_CPU_LEVEL");
+
+#ifndef DISABLE_ORC
+    orc_init();
+#endif
+
+    supportedLevel = DetectCpuLevel();
+    defaultLevel = supportedLevel;
+
+    // PRINTANALYSIS_CPU_LEVEL=scalar|sse4.1|avx2|avx512 caps the level for benchmarking
+    if (pForced)
+    {
+        CpuLevel forced = ParseCpuLevel(pForced);
+
+        if (forced != CPU_LEVEL_AUTO)
+            defaultLevel = MIN(forced, supportedLevel);
+    }
+}
+
+CpuLevel GetSupportedCpuLevel(void)
+{
+    return supportedLevel;
+}
+
+CpuLevel GetDefaultCpuLevel(void)
+{
+    return defaultLevel;
+}
+
+const AnalysisKernels* GetAnalysisKernels(CpuLevel level)
+{
+    if (level == CPU_LEVEL_AUTO || level >= CPU_LEVEL_LAST)
+        level = defaultLevel;
+
+    // never hand out kernels the cpu can't run
+    level = MIN(level, supportedLevel);
+
+    switch (level)
+    {
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+    case CPU_LEVEL_AVX512:
+        return &analysisKernelsAvx512;
+
+    case CPU_LEVEL_AVX2:
+        return &analysisKernelsAvx2;
+
+    case CPU_LEVEL_SSE41:
+        return &analysisKernelsSse41;
+#endif
+
+    default:
+        return &analysisKernelsScalar;
+    }
+}
+
+const char* CpuLevelName(CpuLevel level)
+{
+    return level < CPU_LEVEL_LAST ? levelNames[level] : "unknown";
+}
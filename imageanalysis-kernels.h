@@ -0,0 +1,85 @@
+#pragma once
+
+#include <glib.h>
+
+
+// instruction set levels the analysis kernels are built for, in ascending order
+typedef enum
+{
+	CPU_LEVEL_AUTO = 0,		// best level supported by the cpu, or PRINTANALYSIS_CPU_LEVEL
+	CPU_LEVEL_SCALAR,
+	CPU_LEVEL_SSE41,
+	CPU_LEVEL_AVX2,
+	CPU_LEVEL_AVX512,
+	CPU_LEVEL_LAST
+} CpuLevel;
+
+// msvc takes the instruction set of a vector kernel file from its project settings, gcc and
+// clang build the kernels with the target given to each function, gcc would contract the
+// mul and add of plotRows to fma under avx512f, which implies it
+#if defined(_MSC_VER)
+#define KERNEL_TARGET(isa)
+#elif defined(__clang__)
+#define KERNEL_TARGET(isa) __attribute__((target(isa)))
+#else
+#define KERNEL_TARGET(isa) __attribute__((target(isa), optimize("fp-contract=off")))
+#endif
+
+// fills of at least this size use non-temporal stores, the frame goes downstream and
+// isn't read back, so there is no point in pulling it through the cache
+#define FILL_STREAM_BYTES (256 * 1024)
+
+// the hot loops of the analyses, one table per instruction set level
+typedef struct AnalysisKernels
+{
+	CpuLevel	level;
+	const char*	pName;
+
+	// add n BGRx pixels to n red, green, blue int triples
+	void (*accumulateBGRx) (int* piSums, const guint8* pSrc, int n);
+	// add n BGRx pixels to n red, green, blue, k int quads, k is left untouched
+	void (*accumulateBGRxQuad) (int* piSums, const guint8* pSrc, int n);
+	// add n bytes to n ints
+	void (*accumulateBytes) (int* piSums, const guint8* pSrc, int n);
+	// add the bytes of n 32 bit words to 4 ints, one per byte position, B G R x for BGRx
+	// pixels and Y0 U Y1 V for YUY2 macropixels
+	void (*sumBytes4) (int* piSums, const guint8* pSrc, int n);
+	// count n BGRx pixels into red, green, blue bins
+	void (*histogramBGRx) (int* piHistogram, const guint8* pSrc, int n);
+	// count n YUY2 pixels into luma, Cr, Cb bins
+	void (*histogramYUY2) (int* piHistogram, const guint8* pSrc, int n);
+	// store n copies of a 32 bit value
+	void (*fill32) (guint8* pDst, guint32 uValue, int n);
+	// set the chroma of n YUY2 pixels, luma is kept
+	void (*setChroma) (guint8* pDst, guint8 uChroma, int n);
+	// scale n sums divided by iDivisor to graph rows, as NormalizeValue does, the vector
+	// versions match it exactly as long as the compiler doesn't contract mul and add to fma
+	void (*plotRows) (int* piDst, const int* piSrc, int n, int iDivisor, int iOrigRange, int iMinOrig, int iNewRange, int iMinNew);
+} AnalysisKernels;
+
+void InitAnalysisKernels(void);
+CpuLevel GetSupportedCpuLevel(void);
+CpuLevel GetDefaultCpuLevel(void);
+const AnalysisKernels* GetAnalysisKernels(CpuLevel level);
+const char* CpuLevelName(CpuLevel level);
+CpuLevel ParseCpuLevel(const char* pName);
+
+// scalar kernels, shared by the levels that have nothing faster
+void AccumulateBGRxScalar(int* piSums, const guint8* pSrc, int n);
+void AccumulateBGRxQuadScalar(int* piSums, const guint8* pSrc, int n);
+void AccumulateBytesScalar(int* piSums, const guint8* pSrc, int n);
+void SumBytes4Scalar(int* piSums, const guint8* pSrc, int n);
+void HistogramBGRxScalar(int* piHistogram, const guint8* pSrc, int n);
+void HistogramYUY2Scalar(int* piHistogram, const guint8* pSrc, int n);
+void Fill32Scalar(guint8* pDst, guint32 uValue, int n);
+void PlotRowsScalar(int* piDst, const int* piSrc, int n, int iDivisor, int iOrigRange, int iMinOrig, int iNewRange, int iMinNew);
+
+// orc programs of imageanalysis-orc.orc, compiled for the cpu the plugin loads on
+void AccumulateBytesOrc(int* piSums, const guint8* pSrc, int n);
+void Fill32Orc(guint8* pDst, guint32 uValue, int n);
+void SetChromaOrc(guint8* pDst, guint8 uChroma, int n);
+
+extern const AnalysisKernels analysisKernelsScalar;
+extern const AnalysisKernels analysisKernelsSse41;
+extern const AnalysisKernels analysisKernelsAvx2;
+extern const AnalysisKernels analysisKernelsAvx512;
@@ -0,0 +1,220 @@
+#include "imageanalysis.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+static void FreeCheckResults(NozzleCheckResult* pResults, int nResults)
+{
+    for (int i = 0; pResults && i < nResults; i++)
+        free(pResults[i].pLines);
+
+    free(pResults);
+}
+
+// the checks are copied, the lines of every check are allocated once here and reused by every frame
+gboolean SetNozzleChecks(ImageAnalysis* pImageAnalysis, const NozzleCheck* pChecks, int nChecks)
+{
+    NozzleAnalysis* pNozzle = &pImageAnalysis->nozzle;
+    NozzleCheck* pCopy = NULL;
+    NozzleCheckResult* pResults = NULL;
+    float* pfDepths = NULL;
+    int nDepths = 1;
+
+    if (nChecks)
+    {
+        pCopy = malloc(nChecks * sizeof(NozzleCheck));
+        pResults = calloc(nChecks, sizeof(NozzleCheckResult));
+
+        if (!pCopy || !pResults)
+            goto failed;
+
+        memcpy(pCopy, pChecks, nChecks * sizeof(NozzleCheck));
+
+        for (int i = 0; i < nChecks; i++)
+        {
+            pResults[i].pLines = calloc(MAX(pChecks[i].nLines, 1), sizeof(NozzleLine));
+
+            if (!pResults[i].pLines)
+                goto failed;
+
+            nDepths = MAX(nDepths, pChecks[i].nLines);
+        }
+
+        pfDepths = malloc(nDepths * sizeof(float));
+
+        if (!pfDepths)
+            goto failed;
+    }
+
+    FreeNozzleAnalysis(pNozzle);
+
+    pNozzle->pChecks = pCopy;
+    pNozzle->pResults = pResults;
+    pNozzle->nChecks = nChecks;
+    pNozzle->pfDepths = pfDepths;
+    pNozzle->nDepths = nChecks ? nDepths : 0;
+    return TRUE;
+
+failed:
+    free(pCopy);
+    FreeCheckResults(pResults, nChecks);
+    return FALSE;
+}
+
+// k-th smallest of n values, the values are reordered, linear on average
+static float SelectValue(float* pfValues, int n, int k)
+{
+    int iLeft = 0, iRight = n - 1;
+
+    while (iLeft < iRight)
+    {
+        float fPivot = pfValues[(iLeft + iRight) / 2];
+        int i = iLeft, j = iRight;
+
+        while (i <= j)
+        {
+            while (pfValues[i] < fPivot)
+                i++;
+
+            while (pfValues[j] > fPivot)
+                j--;
+
+            if (i <= j)
+            {
+                float f = pfValues[i];
+
+                pfValues[i++] = pfValues[j];
+                pfValues[j--] = f;
+            }
+        }
+
+        if (k <= j)
+            iRight = j;
+        else if (k >= i)
+            iLeft = i;
+        else
+            break;
+    }
+
+    return pfValues[k];
+}
+
+// every line is looked for within half a pitch of where it is expected, so each column of the profile
+// is visited about once however many lines the ladder has. the line is the darkest column of its window,
+// its depth is measured against the brightest paper on the lower of its two sides
+static void CheckLadder(const NozzleCheck* pCheck, NozzleCheckResult* pResult, const float* pfProfile, int nColumns, float* pfDepths)
+{
+    float fHalfPitch = pCheck->fPitch / 2;
+
+    for (int i = 0; i < pCheck->nLines; i++)
+    {
+        NozzleLine* pLine = &pResult->pLines[i];
+        float fExpected = pCheck->fFirst + i * pCheck->fPitch;
+        int x0 = MAX((int)ceilf(fExpected - fHalfPitch), 0);
+        int x1 = MIN((int)floorf(fExpected + fHalfPitch), nColumns - 1);
+        int xMin = x0;
+
+        pLine->fPosition = fExpected;
+        pLine->fDepth = 0;
+
+        // lines outside the partition are missing
+        if (x1 - x0 < 2)
+        {
+            pfDepths[i] = 0;
+            continue;
+        }
+
+        for (int x = x0 + 1; x <= x1; x++)
+        {
+            if (pfProfile[x] < pfProfile[xMin])
+                xMin = x;
+        }
+
+        float fLeft = pfProfile[xMin], fRight = pfProfile[xMin];
+
+        for (int x = x0; x < xMin; x++)
+            fLeft = MAX(fLeft, pfProfile[x]);
+
+        for (int x = xMin + 1; x <= x1; x++)
+            fRight = MAX(fRight, pfProfile[x]);
+
+        pLine->fDepth = MIN(fLeft, fRight) - pfProfile[xMin];
+        pfDepths[i] = pLine->fDepth;
+
+        // vertex of the parabola through the darkest column and its neighbours
+        if (xMin > 0 && xMin < nColumns - 1)
+        {
+            float a = pfProfile[xMin - 1], b = pfProfile[xMin], c = pfProfile[xMin + 1];
+            float fDenominator = a - 2 * b + c;
+
+            pLine->fPosition = xMin + (fDenominator > 0 ? 0.5f * (a - c) / fDenominator : 0);
+        }
+        else
+        {
+            pLine->fPosition = (float)xMin;
+        }
+    }
+
+    // lines are judged against the ladder itself, so the check follows the exposure and the ink
+    pResult->fMedianDepth = SelectValue(pfDepths, pCheck->nLines, pCheck->nLines / 2);
+    pResult->nMissing = 0;
+    pResult->nDeviated = 0;
+
+    float fMinDepth = pCheck->fMinContrast * pResult->fMedianDepth;
+
+    for (int i = 0; i < pCheck->nLines; i++)
+    {
+        NozzleLine* pLine = &pResult->pLines[i];
+        float fExpected = pCheck->fFirst + i * pCheck->fPitch;
+
+        pLine->bMissing = pLine->fDepth <= fMinDepth;
+        pLine->bDeviated = !pLine->bMissing && fabsf(pLine->fPosition - fExpected) > pCheck->fTolerance;
+
+        pResult->nMissing += pLine->bMissing;
+        pResult->nDeviated += pLine->bDeviated;
+    }
+}
+
+// checks the ladders in the last frame's column profiles, nSignalChannels as for UpdateBanding
+void UpdateNozzleChecks(ImageAnalysis* pImageAnalysis, int nSignalChannels)
+{
+    NozzleAnalysis* pNozzle = &pImageAnalysis->nozzle;
+    const AoiLayout* pLayout = &pImageAnalysis->aoi;
+
+    if (pNozzle->nProfile < pLayout->nColumns)
+    {
+        float* pfProfile = realloc(pNozzle->pfProfile, pLayout->nColumns * sizeof(float));
+
+        if (!pfProfile)
+            return;
+
+        pNozzle->pfProfile = pfProfile;
+        pNozzle->nProfile = pLayout->nColumns;
+    }
+
+    for (int i = 0; i < pNozzle->nChecks; i++)
+    {
+        const NozzleCheck* pCheck = &pNozzle->pChecks[i];
+        NozzleCheckResult* pResult = &pNozzle->pResults[i];
+
+        pResult->bValid = pCheck->iPartition < pLayout->nPartitions;
+
+        if (pResult->bValid)
+        {
+            int nColumns = GetAoiColumnMeans(pImageAnalysis, pCheck->iPartition, nSignalChannels, pNozzle->pfProfile);
+
+            CheckLadder(pCheck, pResult, pNozzle->pfProfile, nColumns, pNozzle->pfDepths);
+        }
+    }
+}
+
+void FreeNozzleAnalysis(NozzleAnalysis* pNozzle)
+{
+    free(pNozzle->pChecks);
+    FreeCheckResults(pNozzle->pResults, pNozzle->nChecks);
+    free(pNozzle->pfProfile);
+    free(pNozzle->pfDepths);
+    memset(pNozzle, 0, sizeof(NozzleAnalysis));
+}
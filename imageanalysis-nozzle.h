@@ -0,0 +1,45 @@
+#pragma once
+
+#include <glib.h>
+
+// a nozzle check ladder, nLines dark lines at a fixed pitch across the columns of one AOI partition
+typedef struct NozzleCheck
+{
+	int		iPartition;		// AOI partition whose column profile holds the ladder, counted across all bands
+	float	fFirst;			// expected column of the first line, from the start of the partition
+	float	fPitch;			// columns between neighbouring lines
+	int		nLines;
+	float	fTolerance;		// columns a line may sit off its expected position before it is deviated
+	float	fMinContrast;	// depth a line needs to be present, as a fraction of the median depth of the ladder
+} NozzleCheck;
+
+// a line of the ladder as found in the last frame
+typedef struct NozzleLine
+{
+	float		fPosition;		// sub-pixel column of the line center, from the start of the partition
+	float		fDepth;			// below the paper on both sides, in the units of the column means
+	gboolean	bMissing;
+	gboolean	bDeviated;
+} NozzleLine;
+
+typedef struct NozzleCheckResult
+{
+	NozzleLine*	pLines;			// nLines of the check
+	int			nMissing;
+	int			nDeviated;
+	float		fMedianDepth;
+	gboolean	bValid;			// FALSE when the partition does not exist in the layout
+} NozzleCheckResult;
+
+typedef struct NozzleAnalysis
+{
+	NozzleCheck*		pChecks;
+	int					nChecks;
+	NozzleCheckResult*	pResults;		// one per check, allocated with the checks
+	float*				pfProfile;		// scratch, column means of the partition being checked
+	int					nProfile;
+	float*				pfDepths;		// scratch for the median, as many as the longest ladder
+	int					nDepths;
+} NozzleAnalysis;
+
+void FreeNozzleAnalysis(NozzleAnalysis* pNozzle);
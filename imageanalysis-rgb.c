@@ -1,12 +1,12 @@
 #include <limits.h>
-#include <gst/gst.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "imageanalysis-rgb.h"
 
 
-#define ROW(pImage, width, y) &pImage[width * sizeof(RGBQUAD) * y]
-#define ROWCOL(pImage, width, x, y) &pImage[(width * sizeof(RGBQUAD) * y) + (x*sizeof(RGBQUAD))]
+#define ROW(pImage, stride, y) &pImage[(stride) * (y)]
+#define ROWCOL(pImage, stride, x, y) &pImage[((stride) * (y)) + (x*sizeof(RGBQUAD))]
 
 #define RGB_BLACK ((RGBQUAD){0, 0, 0, 0})
 #define RGB_WHITE ((RGBQUAD){255, 255, 255, 0})
@@ -14,6 +14,8 @@
 #define RGB_GREEN ((RGBQUAD){0, 255, 0, 0})
 #define RGB_BLUE ((RGBQUAD){255, 0, 0, 0})
 
+#define KERNELS(pImageAnalysisRgb) (GST_IMAGE_ANALYSIS(pImageAnalysisRgb)->pKernels)
+
     
 static inline void AdjustMinMax(INTRGBTRIPLE newMin, INTRGBTRIPLE newMax, INTRGBTRIPLE* min, INTRGBTRIPLE* max)
 {
@@ -36,24 +38,25 @@ static void ComputeMinMax(INTRGBTRIPLE* pValues, int iNumValues, INTRGBTRIPLE* m
         AdjustMinMax(pValues[i], pValues[i], min, max);
 }
 
-static void NormalizeRGB(INTRGBTRIPLE* iValue, int iOrigRange, int iMinOrig, int iNewRange, int iMinNew)
+static inline guint32 RgbQuadValue(RGBQUAD color)
 {
-    iValue->red = (int) NormalizeValue(iValue->red, iOrigRange, iMinOrig, iNewRange, iMinNew);
-    iValue->green = (int)NormalizeValue(iValue->green, iOrigRange, iMinOrig, iNewRange, iMinNew);
-    iValue->blue = (int)NormalizeValue(iValue->blue, iOrigRange, iMinOrig, iNewRange, iMinNew);
+    guint32 uValue;
+
+    memcpy(&uValue, &color, sizeof(uValue));
+    return uValue;
 }
 
-static void Normalize(ImageAnalysisRGB* pImageAnalysisRgb, int iOrigMin, int iOrigMax, int iRangeMin, int iRangeMax)
+// scales the columns of one AOI band to graph rows inside the band
+static void Normalize(ImageAnalysisRGB* pImageAnalysisRgb, const AoiBand* pBand, int iDivisor, int iOrigMin, int iOrigMax)
 {
-    ImageAnalysis* pImageAnalysis = GST_IMAGE_ANALYSIS(pImageAnalysisRgb);
+    int iRangeMin = pBand->y;
+    int iRangeMax = pBand->y + pBand->height;
     //int iNewRange = iRangeMax - iRangeMin;
     int iNewRange = iRangeMin - iRangeMax;
 
-    for (guint i = 0; i < pImageAnalysis->opts.aoiPartitions; i++)
-    {
-        for (int j = 0; j < pImageAnalysisRgb->piNumResults[i]; j++)
-            NormalizeRGB(&pImageAnalysisRgb->ppResults[i][j], iOrigMax - iOrigMin, iOrigMin, iNewRange, iRangeMax);
-    }
+    // the accumulated values are kept for the results, the graph goes to pPlot
+    KERNELS(pImageAnalysisRgb)->plotRows((int*)&pImageAnalysisRgb->pPlot[pBand->iFirstColumn], (const int*)&pImageAnalysisRgb->pResults[pBand->iFirstColumn],
+        pBand->width * 3, iDivisor, iOrigMax - iOrigMin, iOrigMin, iNewRange, iRangeMax);
 }
 
 static void ScaleGraph(const INTRGBTRIPLE* input, int inSize, INTRGBTRIPLE* output, int outSize)
@@ -76,255 +79,313 @@ static void ScaleGraph(const INTRGBTRIPLE* input, int inSize, INTRGBTRIPLE* outp
     }
 }
 
-static void Blackout(ImageAnalysisRGB* pImageAnalysisRgb, guint8* pImage)
+static void BuildAOIOverlay(ImageAnalysisRGB* pImageAnalysisRgb)
 {
     ImageAnalysis* pImageAnalysis = GST_IMAGE_ANALYSIS(pImageAnalysisRgb);
+    const AoiLayout* pLayout = &pImageAnalysis->aoi;
+    guint32 uAoiColor;
 
-    if (pImageAnalysis->opts.blackoutType == BLACK_ALL)
+    if (pImageAnalysis->opts.blackoutType == BLACK_NONE)
     {
-        int iNumPixels = pImageAnalysis->iImageWidth * pImageAnalysis->iImageHeight;
-
-        for (int i = 0; i < iNumPixels; i++)
-            ((RGBQUAD*)pImage)[i] = RGB_BLACK;
+        uAoiColor = RgbQuadValue(RGB_BLACK);
     }
-    else if (pImageAnalysis->opts.blackoutType == BLACK_AOI)
+    else
     {
-        int iAoiMinY = (pImageAnalysis->iImageHeight - pImageAnalysis->opts.aoiHeight) / 2;
-        int iAoiMaxY = iAoiMinY + pImageAnalysis->opts.aoiHeight;
-
-        for (int y = iAoiMinY; y < iAoiMaxY; y++)
+        // rows follow each other, so the blackout is a single run
+        if (pImageAnalysis->opts.blackoutType == BLACK_ALL)
+            AddOverlayRun(pImageAnalysis, OVERLAY_FILL, 0, pImageAnalysis->iRowPixels * pImageAnalysis->iImageHeight, RgbQuadValue(RGB_BLACK));
+        else if (pImageAnalysis->opts.blackoutType == BLACK_AOI)
         {
-            RGBQUAD* pRGB = (RGBQUAD*)ROW(pImage, pImageAnalysis->iImageWidth, y);
-
-            for (int x = 0; x < pImageAnalysis->iImageWidth; x++)
-                pRGB[x] = RGB_BLACK;
+            for (int b = 0; b < pLayout->nBands; b++)
+                AddOverlayRect(pImageAnalysis, OVERLAY_FILL, pLayout->pBands[b].x, pLayout->pBands[b].y, pLayout->pBands[b].width, pLayout->pBands[b].height, RgbQuadValue(RGB_BLACK));
         }
+
+        uAoiColor = RgbQuadValue(RGB_WHITE);
     }
+
+    // the bottom and top line of our areas of interest and the partition lines
+    for (int b = 0; b < pLayout->nBands; b++)
+        AddAoiBandOutline(pImageAnalysis, &pLayout->pBands[b], uAoiColor);
 }
 
-static void DrawAOI(ImageAnalysisRGB* pImageAnalysisRgb, guint8* pImage)
+static void BuildPartitionsOverlay(ImageAnalysis* pImageAnalysis)
 {
-    ImageAnalysis* pImageAnalysis = GST_IMAGE_ANALYSIS(pImageAnalysisRgb);
-    int iAoiMinY = (pImageAnalysis->iImageHeight - pImageAnalysis->opts.aoiHeight) / 2;
-    int iAoiMaxY = iAoiMinY + pImageAnalysis->opts.aoiHeight;
-    RGBQUAD* pRgb;
-    RGBQUAD aoiColor;
+    guint32 uColor = RgbQuadValue(RGB_BLACK);
 
-    if (pImageAnalysis->opts.blackoutType == BLACK_NONE)
-    {
-        aoiColor = RGB_BLACK;
-    }
-    else
+    for (int i = 0; i < pImageAnalysis->nPartitions; i++)
     {
-        Blackout(pImageAnalysisRgb, pImage);
-        aoiColor = RGB_WHITE;
+        PrintPartition* pPartition = &pImageAnalysis->pPartitions[i];
+        int x0 = pPartition->centerX - pPartition->width / 2;
+        int y0 = pPartition->centerY - pPartition->height / 2;
+
+        AddOverlayRow(pImageAnalysis, OVERLAY_FILL, x0, y0, pPartition->width, uColor);
+        AddOverlayRow(pImageAnalysis, OVERLAY_FILL, x0, y0 + pPartition->height, pPartition->width, uColor);
+        AddOverlayColumn(pImageAnalysis, OVERLAY_FILL, x0, y0, pPartition->height, uColor);
+        AddOverlayColumn(pImageAnalysis, OVERLAY_FILL, x0 + pPartition->width, y0, pPartition->height, uColor);
     }
+}
 
-    // Draw the bottom line of our area of interest
-    pRgb = (RGBQUAD*)ROW(pImage, pImageAnalysis->iImageWidth, iAoiMinY);
+static void BuildOverlay(ImageAnalysisRGB* pImageAnalysisRgb, guint analyses)
+{
+    ImageAnalysis* pImageAnalysis = GST_IMAGE_ANALYSIS(pImageAnalysisRgb);
 
-    for (int x = 0; x < pImageAnalysis->iImageWidth; x++)
-        pRgb[x] = aoiColor;
+    ResetOverlay(pImageAnalysis);
 
-    // Draw the top line of our area of interest
-    pRgb = (RGBQUAD*)ROW(pImage, pImageAnalysis->iImageWidth, iAoiMaxY);
+    if (analyses & ANALYSIS_AOI)
+        BuildAOIOverlay(pImageAnalysisRgb);
 
-    for (int x = 0; x < pImageAnalysis->iImageWidth; x++)
-        pRgb[x] = aoiColor;
+    pImageAnalysis->overlay.nBaseSpans = pImageAnalysis->overlay.nSpans;
 
-    // draw the partition lines
-    for (guint i = 1; i < pImageAnalysis->opts.aoiPartitions; i++)
-    {
-        int x = (int)((float)pImageAnalysis->iImageWidth / pImageAnalysis->opts.aoiPartitions * i);
+    if (analyses & ANALYSIS_TOTAL)
+        BuildPartitionsOverlay(pImageAnalysis);
+}
 
-        for (int y = iAoiMinY; y < iAoiMaxY; y++)
-            ((RGBQUAD*)ROW(pImage, pImageAnalysis->iImageWidth, y))[x] = aoiColor;
-    }
+static void DrawOverlay(ImageAnalysisRGB* pImageAnalysisRgb, guint8* pImage, int iFirst, int iLast)
+{
+    OverlaySpan* pSpans = GST_IMAGE_ANALYSIS(pImageAnalysisRgb)->overlay.pSpans;
+
+    for (int i = iFirst; i < iLast; i++)
+        KERNELS(pImageAnalysisRgb)->fill32(pImage + pSpans[i].iOffset * sizeof(RGBQUAD), pSpans[i].uValue, pSpans[i].nPixels);
 }
 
-static void DrawLine(ImageAnalysisRGB* pImageAnalysisRgb, guint8* pImage, int x0, int y0, int x1, int y1, RGBQUAD color)
+// writes the spans of every column in a single left to right pass, later channels are drawn over earlier ones
+static void FillPlotSpans(ImageAnalysisRGB* pImageAnalysisRgb, guint8* pImage, const RGBQUAD* pColors, int nChannels)
 {
     ImageAnalysis* pImageAnalysis = GST_IMAGE_ANALYSIS(pImageAnalysisRgb);
-    int dx = abs(x1 - x0);
-    int dy = abs(y1 - y0);
-    int sx = (x0 < x1) ? 1 : -1;
-    int sy = (y0 < y1) ? 1 : -1;
-    int err = dx - dy;
+    const int* piRowOffset = pImageAnalysis->graph.piRowOffset;
+    const AoiLayout* pLayout = &pImageAnalysis->aoi;
 
-    while (1)
+    for (int b = 0; b < pLayout->nBands; b++)
     {
-        // Set the current pixel to red
-        RGBQUAD* pixel = (RGBQUAD*)(ROWCOL(pImage, pImageAnalysis->iImageWidth, x0, y0));
-        *pixel = color;
+        const AoiBand* pBand = &pLayout->pBands[b];
 
-        // Check if we've reached the end point
-        if (x0 == x1 && y0 == y1) break;
-
-        int e2 = 2 * err;
-
-        if (e2 > -dy)
+        for (int x = 0; x < pBand->width; x++)
         {
-            err -= dy;
-            x0 += sx;
-        }
+            guint8* pColumn = pImage + (pBand->x + x) * sizeof(RGBQUAD);
+            const PlotSpan* pSpans = &pImageAnalysis->graph.pSpans[(pBand->iFirstColumn + x) * PLOT_MAX_CHANNELS];
 
-        if (e2 < dx)
-        {
-            err += dx;
-            y0 += sy;
+            for (int c = 0; c < nChannels; c++)
+            {
+                for (int y = pSpans[c].y0; y <= pSpans[c].y1; y++)
+                    *(RGBQUAD*)(pColumn + piRowOffset[y]) = pColors[c];
+            }
         }
     }
 }
 
-static void PlotValues(ImageAnalysisRGB* pImageAnalysisRgb, guint8* pImage)
+// writes the runs of every sampled AOI row, later channels are drawn over earlier ones
+static void FillRowSpans(ImageAnalysisRGB* pImageAnalysisRgb, guint8* pImage, const RGBQUAD* pColors, int nChannels)
 {
     ImageAnalysis* pImageAnalysis = GST_IMAGE_ANALYSIS(pImageAnalysisRgb);
+    const AoiLayout* pLayout = &pImageAnalysis->aoi;
+    int iRowStep = pImageAnalysis->results.iRowStep;
 
-    for (guint i = 0; i < pImageAnalysis->opts.aoiPartitions; i++)
+    for (int b = 0; b < pLayout->nBands; b++)
     {
-        int xStart = (int)((float)pImageAnalysis->iImageWidth / pImageAnalysis->opts.aoiPartitions * i);
+        const AoiBand* pBand = &pLayout->pBands[b];
 
-        for (int j = 0; j < pImageAnalysisRgb->piNumResults[i]; j++)
+        if (!pBand->width)
+            continue;
+
+        for (int j = 0; j < pBand->iRows; j++)
         {
-            ((RGBQUAD*)ROW((pImage), pImageAnalysis->iImageWidth, pImageAnalysisRgb->ppResults[i][j].red))[j + xStart] = RGB_RED;
-            ((RGBQUAD*)ROW((pImage), pImageAnalysis->iImageWidth, pImageAnalysisRgb->ppResults[i][j].green))[j + xStart] = RGB_GREEN;
-            ((RGBQUAD*)ROW((pImage), pImageAnalysis->iImageWidth, pImageAnalysisRgb->ppResults[i][j].blue))[j + xStart] = RGB_BLUE;
+            RGBQUAD* pRow = (RGBQUAD*)ROW(pImage, pImageAnalysis->iStride, (pBand->y + j * iRowStep));
+            const RowSpan* pSpans = &pImageAnalysis->graph.pRowSpans[(pBand->iFirstRow + j) * PLOT_MAX_CHANNELS];
 
-            if (pImageAnalysis->opts.connectValues && j > 0)
+            for (int c = 0; c < nChannels; c++)
             {
-                DrawLine(pImageAnalysisRgb, pImage + xStart * sizeof(RGBQUAD), j - 1, pImageAnalysisRgb->ppResults[i][j - 1].red, j, pImageAnalysisRgb->ppResults[i][j].red, RGB_RED);
-                DrawLine(pImageAnalysisRgb, pImage + xStart * sizeof(RGBQUAD), j - 1, pImageAnalysisRgb->ppResults[i][j - 1].green, j, pImageAnalysisRgb->ppResults[i][j].green, RGB_GREEN);
-                DrawLine(pImageAnalysisRgb, pImage + xStart * sizeof(RGBQUAD), j - 1, pImageAnalysisRgb->ppResults[i][j - 1].blue, j, pImageAnalysisRgb->ppResults[i][j].blue, RGB_BLUE);
+                for (int x = pSpans[c].x0; x <= pSpans[c].x1; x++)
+                    pRow[x] = pColors[c];
             }
         }
     }
 }
 
-static void CheckAllocatedMemory(ImageAnalysisRGB* pImageAnalysisRgb)
+// the mean of every row across the band, as a column inside the band
+static void PlotRowProfiles(ImageAnalysisRGB* pImageAnalysisRgb, guint8* pImage)
 {
+    const RGBQUAD colors[] = { RGB_RED, RGB_GREEN, RGB_BLUE };
     ImageAnalysis* pImageAnalysis = GST_IMAGE_ANALYSIS(pImageAnalysisRgb);
+    const AoiLayout* pLayout = &pImageAnalysis->aoi;
 
-    if (pImageAnalysis->iPrevPartitions != pImageAnalysis->opts.aoiPartitions)
+    for (int b = 0; b < pLayout->nBands; b++)
     {
-        if (pImageAnalysisRgb->ppResults)
-        {
-            for (int i = 0; i < pImageAnalysis->iPrevPartitions; i++)
-                free(pImageAnalysisRgb->ppResults[i]);
-
-            free(pImageAnalysisRgb->ppResults);
-            free(pImageAnalysisRgb->piNumResults);
-        }
+        const AoiBand* pBand = &pLayout->pBands[b];
 
-        pImageAnalysisRgb->ppResults = calloc(pImageAnalysis->opts.aoiPartitions, sizeof(INTRGBTRIPLE));
-        pImageAnalysisRgb->piNumResults = calloc(pImageAnalysis->opts.aoiPartitions, sizeof(int));
+        if (!pBand->width)
+            continue;
 
-        for (guint i = 0; i < pImageAnalysis->opts.aoiPartitions; i++)
-        {
-            int xStart = (int)((float)pImageAnalysis->iImageWidth / pImageAnalysis->opts.aoiPartitions * i);
-            int xEnd = (int)((float)pImageAnalysis->iImageWidth / pImageAnalysis->opts.aoiPartitions * (i + 1));
+        KERNELS(pImageAnalysisRgb)->plotRows((int*)&pImageAnalysisRgb->pRowPlot[pBand->iFirstRow], (const int*)&pImageAnalysisRgb->pRowResults[pBand->iFirstRow],
+            pBand->iRows * 3, pBand->width, UCHAR_MAX, 0, pBand->width - 1, pBand->x);
 
-            pImageAnalysisRgb->piNumResults[i] = xEnd - xStart;
-            pImageAnalysisRgb->ppResults[i] = calloc(pImageAnalysisRgb->piNumResults[i], sizeof(INTRGBTRIPLE));
-        }
+        for (int c = 0; c < 3; c++)
+            BuildRowSpans(pImageAnalysis, (const int*)pImageAnalysisRgb->pRowPlot, 3, c, pBand->iFirstRow, pBand->iRows);
     }
 
-    pImageAnalysis->iPrevPartitions = pImageAnalysis->opts.aoiPartitions;
+    FillRowSpans(pImageAnalysisRgb, pImage, colors, 3);
 }
 
-static void ComputeIntensityActual(ImageAnalysisRGB* pImageAnalysisRgb, guint8* pImage, int iAoiMinY, int iAoiMaxY)
+static void PlotValues(ImageAnalysisRGB* pImageAnalysisRgb, guint8* pImage)
 {
+    const RGBQUAD colors[] = { RGB_RED, RGB_GREEN, RGB_BLUE };
     ImageAnalysis* pImageAnalysis = GST_IMAGE_ANALYSIS(pImageAnalysisRgb);
-    RGBQUAD* pRGB = NULL;
+    const int* piXStart = pImageAnalysis->aoi.piXStart;
 
-    for (int y = iAoiMinY; y < iAoiMaxY; y++)
+    for (int i = 0; i < pImageAnalysis->aoi.nPartitions; i++)
     {
-        pRGB = (RGBQUAD*)ROW(pImage, pImageAnalysis->iImageWidth, y);
-
-        for (guint i = 0; i < pImageAnalysis->opts.aoiPartitions; i++)
-        {
-            int xStart = (int) ((float)pImageAnalysis->iImageWidth / pImageAnalysis->opts.aoiPartitions * i);
-
-            for (int j = 0; j < pImageAnalysisRgb->piNumResults[i]; j++)
-            {
-                pImageAnalysisRgb->ppResults[i][j].red += pRGB[j + xStart].rgbRed;
-                pImageAnalysisRgb->ppResults[i][j].green += pRGB[j + xStart].rgbGreen;
-                pImageAnalysisRgb->ppResults[i][j].blue += pRGB[j + xStart].rgbBlue;
-            }
-        }
+        for (int c = 0; c < 3; c++)
+            BuildPlotSpans(pImageAnalysis, (const int*)pImageAnalysisRgb->pPlot, 3, c, 1, piXStart[i], piXStart[i + 1] - piXStart[i]);
     }
+
+    FillPlotSpans(pImageAnalysisRgb, pImage, colors, 3);
 }
 
-static void ComputeIntensity(ImageAnalysisRGB* pImageAnalysisRgb, guint8* pImage)
+static void CheckAllocatedMemory(ImageAnalysisRGB* pImageAnalysisRgb, guint analyses)
 {
     ImageAnalysis* pImageAnalysis = GST_IMAGE_ANALYSIS(pImageAnalysisRgb);
-    int iAoiMinY = (pImageAnalysis->iImageHeight - pImageAnalysis->opts.aoiHeight) / 2;
-    int iAoiMaxY = iAoiMinY + pImageAnalysis->opts.aoiHeight;
+    const AoiLayout* pLayout = &pImageAnalysis->aoi;
+
+    if (BuildAoiLayout(pImageAnalysis, 1))
+    {
+        free(pImageAnalysisRgb->pHistograms);
+        free(pImageAnalysisRgb->pResults);
+        free(pImageAnalysisRgb->pPlot);
+        free(pImageAnalysisRgb->pRowResults);
+        free(pImageAnalysisRgb->pRowPlot);
+
+        pImageAnalysisRgb->pHistograms = calloc(MAX(pLayout->nPartitions, 1) * (UCHAR_MAX + 1), sizeof(INTRGBTRIPLE));
+        pImageAnalysisRgb->pResults = calloc(MAX(pLayout->nColumns, 1), sizeof(INTRGBTRIPLE));
+        pImageAnalysisRgb->pPlot = calloc(MAX(pLayout->nColumns, 1), sizeof(INTRGBTRIPLE));
+        pImageAnalysisRgb->pRowResults = calloc(MAX(pLayout->nRows, 1), sizeof(INTRGBTRIPLE));
+        pImageAnalysisRgb->pRowPlot = calloc(MAX(pLayout->nRows, 1), sizeof(INTRGBTRIPLE));
+    }
 
-    CheckAllocatedMemory(pImageAnalysisRgb);
-    ComputeIntensityActual(pImageAnalysisRgb, pImage, iAoiMinY, iAoiMaxY);
-    DrawAOI(pImageAnalysisRgb, pImage);
-    Normalize(pImageAnalysisRgb, 0, UCHAR_MAX * pImageAnalysis->opts.aoiHeight, iAoiMinY, iAoiMaxY);
-    PlotValues(pImageAnalysisRgb, pImage);
+    if (analyses & ANALYSIS_COLUMNS)
+        memset(pImageAnalysisRgb->pResults, 0, pLayout->nColumns * sizeof(INTRGBTRIPLE));
+
+    if (analyses & ANALYSIS_HISTOGRAM)
+        memset(pImageAnalysisRgb->pHistograms, 0, pLayout->nPartitions * (UCHAR_MAX + 1) * sizeof(INTRGBTRIPLE));
+
+    if (analyses & ANALYSIS_ROW_PROFILE)
+        memset(pImageAnalysisRgb->pRowResults, 0, pLayout->nRows * sizeof(INTRGBTRIPLE));
 }
 
-void ComputeAverageActual(ImageAnalysisRGB* pImageAnalysisRgb, guint8* pImage, int iAoiMinY, int iAoiMaxY)
+// accumulators consume nColumns columns of the AOI row iRow from iColumn on, all in partition iPartition,
+// pRGB points to the pixel of iColumn
+typedef void (*AccumulateFunc) (ImageAnalysisRGB* pImageAnalysisRgb, const RGBQUAD* pRGB, int iPartition, int iColumn, int nColumns, int iRow);
+
+static void AccumulateColumns(ImageAnalysisRGB* pImageAnalysisRgb, const RGBQUAD* pRGB, int iPartition, int iColumn, int nColumns, int iRow)
 {
-    ImageAnalysis* pImageAnalysis = GST_IMAGE_ANALYSIS(pImageAnalysisRgb);
-    int iNumValues = iAoiMaxY - iAoiMinY;
+    KERNELS(pImageAnalysisRgb)->accumulateBGRx((int*)&pImageAnalysisRgb->pResults[iColumn], (const guint8*)pRGB, nColumns);
+}
 
-    ComputeIntensityActual(pImageAnalysisRgb, pImage, iAoiMinY, iAoiMaxY);
+static void AccumulateHistogram(ImageAnalysisRGB* pImageAnalysisRgb, const RGBQUAD* pRGB, int iPartition, int iColumn, int nColumns, int iRow)
+{
+    INTRGBTRIPLE* pHistogram = &pImageAnalysisRgb->pHistograms[iPartition * (UCHAR_MAX + 1)];
 
-    for (guint i = 0; i < pImageAnalysis->opts.aoiPartitions; i++)
-    {
-        for (int j = 0; j < pImageAnalysisRgb->piNumResults[i]; j++)
-        {
-            pImageAnalysisRgb->ppResults[i][j].red /= iNumValues;
-            pImageAnalysisRgb->ppResults[i][j].green /= iNumValues;
-            pImageAnalysisRgb->ppResults[i][j].blue /= iNumValues;
-        }
-    }
+    KERNELS(pImageAnalysisRgb)->histogramBGRx((int*)pHistogram, (const guint8*)pRGB, nColumns);
 }
 
-void ComputeAverage(ImageAnalysisRGB* pImageAnalysisRgb, guint8* pImage)
+static void AccumulateRow(ImageAnalysisRGB* pImageAnalysisRgb, const RGBQUAD* pRGB, int iPartition, int iColumn, int nColumns, int iRow)
 {
-    ImageAnalysis* pImageAnalysis = GST_IMAGE_ANALYSIS(pImageAnalysisRgb);
-    int iAoiMinY = (pImageAnalysis->iImageHeight - pImageAnalysis->opts.aoiHeight) / 2;
-    int iAoiMaxY = iAoiMinY + pImageAnalysis->opts.aoiHeight;
+    INTRGBTRIPLE* pRow = &pImageAnalysisRgb->pRowResults[iRow];
+    int sums[4] = { 0 };
 
-    CheckAllocatedMemory(pImageAnalysisRgb);
-    ComputeAverageActual(pImageAnalysisRgb, pImage, iAoiMinY, iAoiMaxY);
-    DrawAOI(pImageAnalysisRgb, pImage);
-    Normalize(pImageAnalysisRgb, 0, UCHAR_MAX, iAoiMinY, iAoiMaxY);
-    PlotValues(pImageAnalysisRgb, pImage);
+    // b g r x
+    KERNELS(pImageAnalysisRgb)->sumBytes4(sums, (const guint8*)pRGB, nColumns);
+
+    pRow->red += sums[2];
+    pRow->green += sums[1];
+    pRow->blue += sums[0];
 }
 
-void ComputeHistogram(ImageAnalysisRGB* pImageAnalysisRgb, guint8* pImage)
+typedef struct AccumulatorRGB
 {
-    ImageAnalysis* pImageAnalysis = GST_IMAGE_ANALYSIS(pImageAnalysisRgb);
-    RGBQUAD* pRGB = NULL;
-    int iAoiMinY = (pImageAnalysis->iImageHeight - pImageAnalysis->opts.aoiHeight) / 2;
-    int iAoiMaxY = iAoiMinY + pImageAnalysis->opts.aoiHeight;
+    guint           analyses;   // analyses fed by this accumulator
+    AccumulateFunc  accumulate;
+} AccumulatorRGB;
 
-    CheckAllocatedMemory(pImageAnalysisRgb);
+static const AccumulatorRGB accumulators[] =
+{
+    { ANALYSIS_COLUMNS,                     AccumulateColumns },
+    { ANALYSIS_HISTOGRAM,                   AccumulateHistogram },
+    { ANALYSIS_ROW_PROFILE,                 AccumulateRow },
+};
 
-    for (guint i = 0; i < pImageAnalysis->opts.aoiPartitions; i++)
+static void AccumulateBandRows(ImageAnalysisRGB* pImageAnalysisRgb, guint8* pImage, const AoiBand* pBand, int yStart, int yEnd,
+    const AccumulateFunc* pfnActive, int nActive)
+{
+    ImageAnalysis* pImageAnalysis = GST_IMAGE_ANALYSIS(pImageAnalysisRgb);
+    const int* piXStart = pImageAnalysis->aoi.piXStart;
+    int iLast = pBand->iFirstPartition + pBand->nPartitions;
+    int iEndColumn = pBand->iFirstColumn + pBand->width;
+    int iBlockColumns = ACCUMULATOR_BLOCK_BYTES / sizeof(INTRGBTRIPLE);
+    int iFirst = pBand->iFirstPartition;
+    int iRowStep = QualityRowStep(pImageAnalysis->quality);
+    int yFirst = FirstSampledRow(yStart, pBand->y, iRowStep);
+
+    // the partitions are contiguous, so accumulate the rows one cache sized block
+    // of columns at a time before moving to the next block, handing every row
+    // segment to all the requested accumulators while it is in cache
+    for (int x0 = pBand->iFirstColumn; x0 < iEndColumn; x0 += iBlockColumns)
     {
-        int xStart = (int) ((float)pImageAnalysis->iImageWidth / pImageAnalysis->opts.aoiPartitions * i);
-        int xEnd = (int) ((float)pImageAnalysis->iImageWidth / pImageAnalysis->opts.aoiPartitions * (i + 1));
+        int x1 = MIN(x0 + iBlockColumns, iEndColumn);
 
-        memset(pImageAnalysisRgb->piHistogram, 0, (UCHAR_MAX+1) * sizeof(INTRGBTRIPLE));
+        while (piXStart[iFirst + 1] <= x0)
+            iFirst++;
 
-        for (int y = iAoiMinY; y < iAoiMaxY; y++)
+        for (int y = yFirst; y < yEnd; y += iRowStep)
         {
-            pRGB = (RGBQUAD*)ROW(pImage, pImageAnalysis->iImageWidth, y);
+            RGBQUAD* pRGB = (RGBQUAD*)ROW(pImage, pImageAnalysis->iStride, y) + pBand->x - pBand->iFirstColumn;
+            int iRow = pBand->iFirstRow + (y - pBand->y) / iRowStep;
 
-            for (int x = xStart; x < xEnd; x++)
+            for (int i = iFirst; i < iLast && piXStart[i] < x1; i++)
             {
-                pImageAnalysisRgb->piHistogram[pRGB[x].rgbRed].red += 1;
-                pImageAnalysisRgb->piHistogram[pRGB[x].rgbGreen].green += 1;
-                pImageAnalysisRgb->piHistogram[pRGB[x].rgbBlue].blue += 1;
+                int xa = MAX(x0, piXStart[i]);
+                int xb = MIN(x1, piXStart[i + 1]);
+
+                for (int a = 0; a < nActive; a++)
+                    pfnActive[a](pImageAnalysisRgb, &pRGB[xa], i, xa, xb - xa, iRow);
             }
         }
+    }
+}
+
+// feeds the rows [yStart, yEnd) of every AOI band covering them to the accumulators
+static void AccumulateAOIRows(ImageAnalysisRGB* pImageAnalysisRgb, guint8* pImage, int yStart, int yEnd, guint analyses)
+{
+    const AoiLayout* pLayout = &GST_IMAGE_ANALYSIS(pImageAnalysisRgb)->aoi;
+    AccumulateFunc pfnActive[G_N_ELEMENTS(accumulators)];
+    int nActive = 0;
+
+    for (int a = 0; a < G_N_ELEMENTS(accumulators); a++)
+    {
+        if (accumulators[a].analyses & analyses)
+            pfnActive[nActive++] = accumulators[a].accumulate;
+    }
+
+    for (int b = 0; b < pLayout->nBands; b++)
+    {
+        const AoiBand* pBand = &pLayout->pBands[b];
+        int y0 = MAX(yStart, pBand->y);
+        int y1 = MIN(yEnd, pBand->y + pBand->height);
+
+        if (y0 < y1)
+            AccumulateBandRows(pImageAnalysisRgb, pImage, pBand, y0, y1, pfnActive, nActive);
+    }
+}
+
+static void NormalizeHistograms(ImageAnalysisRGB* pImageAnalysisRgb, const AoiBand* pBand)
+{
+    ImageAnalysis* pImageAnalysis = GST_IMAGE_ANALYSIS(pImageAnalysisRgb);
+    const int* piXStart = pImageAnalysis->aoi.piXStart;
+    int iAoiMinY = pBand->y;
+    int iAoiMaxY = pBand->y + pBand->height;
+
+    for (int i = pBand->iFirstPartition; i < pBand->iFirstPartition + pBand->nPartitions; i++)
+    {
+        // normalize a copy, the counts are kept for the results
+        memcpy(pImageAnalysisRgb->piHistogram, &pImageAnalysisRgb->pHistograms[i * (UCHAR_MAX + 1)], (UCHAR_MAX + 1) * sizeof(INTRGBTRIPLE));
 
         INTRGBTRIPLE min, max;
         ComputeMinMax(pImageAnalysisRgb->piHistogram, UCHAR_MAX + 1, &min, &max);
@@ -337,155 +398,391 @@ void ComputeHistogram(ImageAnalysisRGB* pImageAnalysisRgb, guint8* pImage)
             pImageAnalysisRgb->piHistogram[j].blue   = (int)NormalizeValue(pImageAnalysisRgb->piHistogram[j].blue, max.blue - min.blue, min.blue, iAoiMinY - iAoiMaxY, iAoiMaxY);
         }
 
-        ScaleGraph(pImageAnalysisRgb->piHistogram, UCHAR_MAX + 1, pImageAnalysisRgb->ppResults[i], pImageAnalysisRgb->piNumResults[i]);
+        StageBegin(pImageAnalysis, STAGE_SCALE_GRAPH);
+        ScaleGraph(pImageAnalysisRgb->piHistogram, UCHAR_MAX + 1, &pImageAnalysisRgb->pPlot[piXStart[i]], piXStart[i + 1] - piXStart[i]);
+        StageEnd(pImageAnalysis, STAGE_SCALE_GRAPH);
     }
+}
 
-    DrawAOI(pImageAnalysisRgb, pImage);
-    PlotValues(pImageAnalysisRgb, pImage);
+static void DrawProfiles(ImageAnalysisRGB* pImageAnalysisRgb, guint8* pImage, guint analyses)
+{
+    ImageAnalysis* pImageAnalysis = GST_IMAGE_ANALYSIS(pImageAnalysisRgb);
+    const AoiLayout* pLayout = &pImageAnalysis->aoi;
+
+    if (analyses & ANALYSIS_INTENSITY)
+    {
+        StageBegin(pImageAnalysis, STAGE_NORMALIZE);
+
+        for (int b = 0; b < pLayout->nBands; b++)
+            Normalize(pImageAnalysisRgb, &pLayout->pBands[b], 1, 0, UCHAR_MAX * pLayout->pBands[b].iRows);
+
+        StageEnd(pImageAnalysis, STAGE_NORMALIZE);
+
+        StageBegin(pImageAnalysis, STAGE_PLOT);
+        PlotValues(pImageAnalysisRgb, pImage);
+        StageEnd(pImageAnalysis, STAGE_PLOT);
+    }
+
+    if (analyses & ANALYSIS_MEAN)
+    {
+        StageBegin(pImageAnalysis, STAGE_NORMALIZE);
+
+        for (int b = 0; b < pLayout->nBands; b++)
+            Normalize(pImageAnalysisRgb, &pLayout->pBands[b], MAX(pLayout->pBands[b].iRows, 1), 0, UCHAR_MAX);
+
+        StageEnd(pImageAnalysis, STAGE_NORMALIZE);
+
+        StageBegin(pImageAnalysis, STAGE_PLOT);
+        PlotValues(pImageAnalysisRgb, pImage);
+        StageEnd(pImageAnalysis, STAGE_PLOT);
+    }
+
+    if (analyses & ANALYSIS_HISTOGRAM)
+    {
+        StageBegin(pImageAnalysis, STAGE_NORMALIZE);
+
+        for (int b = 0; b < pLayout->nBands; b++)
+            NormalizeHistograms(pImageAnalysisRgb, &pLayout->pBands[b]);
+
+        StageEnd(pImageAnalysis, STAGE_NORMALIZE);
+
+        StageBegin(pImageAnalysis, STAGE_PLOT);
+        PlotValues(pImageAnalysisRgb, pImage);
+        StageEnd(pImageAnalysis, STAGE_PLOT);
+    }
+
+    if (analyses & ANALYSIS_ROW_PROFILE)
+    {
+        StageBegin(pImageAnalysis, STAGE_PLOT);
+        PlotRowProfiles(pImageAnalysisRgb, pImage);
+        StageEnd(pImageAnalysis, STAGE_PLOT);
+    }
 }
 
-static void ComputePartitionTotal(ImageAnalysis* pImageAnalysis, guint8* pImage, PrintPartition* pPartition)
+static inline void AccumulatePartitionRow(ImageAnalysis* pImageAnalysis, PartitionStore* pStore, int i, const RGBQUAD* pRGB)
 {
-    int nStartX = pPartition->centerX - pPartition->width / 2;
-    int nEndX = nStartX + pPartition->width;
-    int nStartY = pPartition->centerY - pPartition->height / 2;
-    int nEndY = nStartY + pPartition->height;
-	gint pW = pPartition->width, pH = pPartition->height;
-	double bg_r = pPartition->bg.rgb.r*pH, bg_g = pPartition->bg.rgb.g*pH, bg_b = pPartition->bg.rgb.b*pH;
-	double bg_k = min(bg_r, min(bg_g, bg_b));
-    double satR, satG, satB, satK;
-    double satRmin, satGmin, satBmin, satKmin;
-    double satRmax, satGmax, satBmax, satKmax;
-    double satRavg, satGavg, satBavg, satKavg;
-    double satRtot, satGtot, satBtot, satKtot;
-    pPartition->total = (Pixel) { 0, 0, 0 };
-    pPartition->nonUniformity = (Pixel){ 0, 0, 0 };
+    // the arena holds r, g, b, k ints per column, k is only filled in when finalizing
+    pImageAnalysis->pKernels->accumulateBGRxQuad(&pStore->piColumns[pStore->piColumnStart[i] * PARTITION_CHANNELS],
+        (const guint8*)&pRGB[pStore->piX0[i]], pStore->piX1[i] - pStore->piX0[i]);
+}
 
-    if (pPartition->colTotal)
-        free(pPartition->colTotal);
+static void SweepPartitionBand(ImageAnalysis* pImageAnalysis, guint8* pImage, int iBand)
+{
+    PartitionIndex* pIndex = &pImageAnalysis->partitionIndex;
+    PartitionStore* pStore = &pImageAnalysis->store;
+    int iFirst = pIndex->piBandStart[iBand];
+    int iLast = pIndex->piBandStart[iBand + 1];
+    int yStart = iBand * PARTITION_BAND_HEIGHT;
+    int yEnd = MIN(yStart + PARTITION_BAND_HEIGHT, pImageAnalysis->iImageHeight);
+
+    if (iFirst == iLast)
+        return;
+
+    // hand every row of the band to the partitions covering it
+    for (int y = yStart; y < yEnd; y++)
+    {
+        RGBQUAD* pRGB = (RGBQUAD*)ROW(pImage, pImageAnalysis->iStride, y);
 
-    pPartition->colTotal = calloc(pPartition->width, sizeof(Pixel));
+        for (int k = iFirst; k < iLast; k++)
+        {
+            int i = pIndex->piItems[k];
 
-    for (int y = nStartY; y < nEndY; y++)
+            if (y >= pStore->piY0[i] && y < pStore->piY1[i])
+                AccumulatePartitionRow(pImageAnalysis, pStore, i, pRGB);
+        }
+    }
+}
+
+// the k-th smallest of the values, reorders them
+static gint SelectColumnValue(gint* piValues, int n, int k)
+{
+    int iLeft = 0, iRight = n - 1;
+
+    while (iLeft < iRight)
     {
-        RGBQUAD* pRGB = (RGBQUAD*)ROW(pImage, pImageAnalysis->iImageWidth, y);
+        gint iPivot = piValues[(iLeft + iRight) / 2];
+        int i = iLeft, j = iRight;
 
-        for (int x = nStartX; x < nEndX; x++)
+        while (i <= j)
         {
-            pPartition->colTotal[x - nStartX].rgb.r += pRGB[x].rgbRed;
-            pPartition->colTotal[x - nStartX].rgb.g += pRGB[x].rgbGreen;
-            pPartition->colTotal[x - nStartX].rgb.b += pRGB[x].rgbBlue;
-            
-            pPartition->total.rgb.r += pRGB[x].rgbRed;
-            pPartition->total.rgb.g += pRGB[x].rgbGreen;
-            pPartition->total.rgb.b += pRGB[x].rgbBlue;
+            while (piValues[i] < iPivot)
+                i++;
+
+            while (piValues[j] > iPivot)
+                j--;
+
+            if (i <= j)
+            {
+                gint v = piValues[i];
+
+                piValues[i++] = piValues[j];
+                piValues[j--] = v;
+            }
         }
+
+        if (k <= j)
+            iRight = j;
+        else if (k >= i)
+            iLeft = i;
+        else
+            break;
     }
 
-    pPartition->avg.rgb.r = pPartition->total.rgb.r / pPartition->width;
-    pPartition->avg.rgb.g = pPartition->total.rgb.g / pPartition->width;
-    pPartition->avg.rgb.b = pPartition->total.rgb.b / pPartition->width;
+    return piValues[k];
+}
 
-    pPartition->min.rgb.r = pPartition->min.rgb.g = pPartition->min.rgb.b = INT_MAX;
-    pPartition->max.rgb.r = pPartition->max.rgb.g = pPartition->max.rgb.b = 0;
+// paper white of this frame from the brightest columns of a partition, per pixel
+static void MeasureBrightestColumns(PartitionStore* pStore, int i, guint percentile, float* pfWhite)
+{
+    gint pW = pStore->piColumnStart[i + 1] - pStore->piColumnStart[i], pH = pStore->piY1[i] - pStore->piY0[i];
+    const gint* piCol = &pStore->piColumns[pStore->piColumnStart[i] * PARTITION_CHANNELS];
+    int k = (int)((gint64)(pW - 1) * percentile / 100);
 
-	satRmin = satGmin = satBmin = satKmin = DBL_MAX;
-	satRmax = satGmax = satBmax = satKmax = 0.0;
-	satRtot = satGtot = satBtot = satKtot = 0.0;
+    for (int c = 0; c < 3; c++)
+    {
+        for (int x = 0; x < pW; x++)
+            pStore->piSelect[x] = piCol[x * PARTITION_CHANNELS + c];
 
-    for (int i = 0; i < pPartition->width; i++)
+        pfWhite[c] = (float)SelectColumnValue(pStore->piSelect, pW, k) / pH;
+    }
+}
+
+// paper white of this frame from all the columns of a blank partition, per pixel
+static void MeasureBlankColumns(PartitionStore* pStore, int i, float* pfWhite)
+{
+    gint pW = pStore->piColumnStart[i + 1] - pStore->piColumnStart[i], pH = pStore->piY1[i] - pStore->piY0[i];
+    const gint* piCol = &pStore->piColumns[pStore->piColumnStart[i] * PARTITION_CHANNELS];
+
+    for (int c = 0; c < 3; c++)
     {
-		Pixel* pCol = &pPartition->colTotal[i];
-		gint R = pCol->rgb.r / pH, G = pCol->rgb.g / pH, B = pCol->rgb.b / pH;
-		gint Rbg = bg_r / pH, Gbg = bg_g / pH, Bbg = bg_b / pH;
-		satR = 1.0 - ((double)pCol->rgb.r / bg_r); 
-		satG = 1.0 - ((double)pCol->rgb.g / bg_g);
-		satB = 1.0 - ((double)pCol->rgb.b / bg_b);
-		pCol->rgb.k = min(pCol->rgb.r, min(pCol->rgb.g, pCol->rgb.b));
-        satK = 1.0 - ((double)pCol->rgb.k / bg_k);
+        gint64 iSum = 0;
 
-        satR = max(satR, 0.0); satG = max(satG, 0.0);
-        satB = max(satB, 0.0); satK = max(satK, 0.0);
-		satRmin = min(satR, satRmin); satGmin = min(satG, satGmin); 
-        satBmin = min(satB, satBmin); satKmin = min(satK, satKmin);
-		satRmax = max(satR, satRmax); satGmax = max(satG, satGmax);
-		satBmax = max(satB, satBmax); satKmax = max(satK, satKmax);
-        satRtot += satR; satGtot += satG; satBtot += satB; satKtot += satK;
+        for (int x = 0; x < pW; x++)
+            iSum += piCol[x * PARTITION_CHANNELS + c];
 
-        pPartition->min.rgb.r = pPartition->colTotal[i].rgb.r < pPartition->min.rgb.r ? pPartition->colTotal[i].rgb.r : pPartition->min.rgb.r;
-        pPartition->min.rgb.g = pPartition->colTotal[i].rgb.g < pPartition->min.rgb.g ? pPartition->colTotal[i].rgb.g : pPartition->min.rgb.g;
-        pPartition->min.rgb.b = pPartition->colTotal[i].rgb.b < pPartition->min.rgb.b ? pPartition->colTotal[i].rgb.b : pPartition->min.rgb.b;
+        pfWhite[c] = (float)((double)iSum / ((double)pW * pH));
+    }
+}
 
-        pPartition->max.rgb.r = pPartition->colTotal[i].rgb.r > pPartition->max.rgb.r ? pPartition->colTotal[i].rgb.r : pPartition->max.rgb.r;
-        pPartition->max.rgb.g = pPartition->colTotal[i].rgb.g > pPartition->max.rgb.g ? pPartition->colTotal[i].rgb.g : pPartition->max.rgb.g;
-        pPartition->max.rgb.b = pPartition->colTotal[i].rgb.b > pPartition->max.rgb.b ? pPartition->colTotal[i].rgb.b : pPartition->max.rgb.b;
+// moves the paper white of every partition toward the one measured in this frame, partitions with a
+// configured background keep it unless the paper white comes from somewhere else
+static void UpdatePaperWhite(ImageAnalysis* pImageAnalysis)
+{
+    PartitionStore* pStore = &pImageAnalysis->store;
+    const AnalysisOpts* pOpts = &pImageAnalysis->opts;
+    double alpha = pOpts->paperWhiteAlpha > 0.0 ? pOpts->paperWhiteAlpha : PAPER_WHITE_DEFAULT_ALPHA;
+    guint percentile = pOpts->paperWhitePercentile ? MIN(pOpts->paperWhitePercentile, 100) : PAPER_WHITE_DEFAULT_PERCENTILE;
+    float fBlank[3];
+    int iBlank = -1;
+
+    if (pOpts->paperWhite == PAPER_WHITE_PARTITION)
+    {
+        iBlank = FindPartition(pImageAnalysis->pPartitions, pStore->nPartitions, pOpts->paperWhitePartition);
 
-        pPartition->nonUniformity.rgb.r += abs(pPartition->colTotal[i].rgb.r - pPartition->avg.rgb.r);
-        pPartition->nonUniformity.rgb.g += abs(pPartition->colTotal[i].rgb.g - pPartition->avg.rgb.g);
-        pPartition->nonUniformity.rgb.b += abs(pPartition->colTotal[i].rgb.b - pPartition->avg.rgb.b);
+        // without the blank partition every partition is calibrated on its own
+        if (iBlank >= 0 && pStore->piColumnStart[iBlank + 1] > pStore->piColumnStart[iBlank] && pStore->piY1[iBlank] > pStore->piY0[iBlank])
+            MeasureBlankColumns(pStore, iBlank, fBlank);
+        else
+            iBlank = -1;
+    }
+
+    for (int i = 0; i < pStore->nPartitions; i++)
+    {
+        float* pfEstimate = &pStore->pfPaperWhite[i * 3];
+        float fWhite[3];
+
+        // the first frames weigh more, so the estimate settles before alpha takes over
+        float fRate = (float)MAX(alpha, 1.0 / (pStore->piPaperWhiteFrames[i] + 1));
+
+        if (pStore->piColumnStart[i + 1] == pStore->piColumnStart[i] || pStore->piY1[i] == pStore->piY0[i])
+            continue;
+
+        if (pOpts->paperWhite == PAPER_WHITE_CONFIGURED && (pStore->piBg[0][i] || pStore->piBg[1][i] || pStore->piBg[2][i]))
+        {
+            for (int c = 0; c < 3; c++)
+                pfEstimate[c] = (float)pStore->piBg[c][i];
+        }
+        else
+        {
+            if (iBlank >= 0)
+                memcpy(fWhite, fBlank, sizeof(fWhite));
+            else
+                MeasureBrightestColumns(pStore, i, percentile, fWhite);
+
+            for (int c = 0; c < 3; c++)
+                pfEstimate[c] += fRate * (fWhite[c] - pfEstimate[c]);
+        }
+
+        for (int c = 0; c < 3; c++)
+            pStore->piPaperWhite[c][i] = (gint)(pfEstimate[c] + 0.5f);
+
+        pStore->piPaperWhite[3][i] = MIN(pStore->piPaperWhite[0][i], MIN(pStore->piPaperWhite[1][i], pStore->piPaperWhite[2][i]));
+
+        if (pStore->piPaperWhiteFrames[i] < G_MAXINT)
+            pStore->piPaperWhiteFrames[i]++;
     }
-    satRavg = satRtot / pW;
-	satGavg = satGtot / pW;
-	satBavg = satBtot / pW;
-	satKavg = satKtot / pW;
-	pPartition->minSat.rgb.r = (gint)(satRmin*1000.0);
-	pPartition->minSat.rgb.g = (gint)(satGmin*1000.0);
-	pPartition->minSat.rgb.b = (gint)(satBmin*1000.0);
-    pPartition->minSat.rgb.k = (gint)(satKmin*1000.0);
-    pPartition->maxSat.rgb.r = (gint)(satRmax*1000.0);
-    pPartition->maxSat.rgb.g = (gint)(satGmax*1000.0);
-    pPartition->maxSat.rgb.b = (gint)(satBmax*1000.0);
-    pPartition->maxSat.rgb.k = (gint)(satKmax*1000.0);
-    pPartition->avgSat.rgb.r = (gint)(satRavg*1000.0);
-    pPartition->avgSat.rgb.g = (gint)(satGavg*1000.0);
-    pPartition->avgSat.rgb.b = (gint)(satBavg*1000.0);
-    pPartition->avgSat.rgb.k = (gint)(satKavg*1000.0);
-	pPartition->total.rgb.r /= (pPartition->width * pPartition->height);
-	pPartition->total.rgb.g /= (pPartition->width * pPartition->height);
-	pPartition->total.rgb.b /= (pPartition->width * pPartition->height);
-	pPartition->nonUniformity.rgb.r /= pPartition->width;
-	pPartition->nonUniformity.rgb.g /= pPartition->width;
-	pPartition->nonUniformity.rgb.b /= pPartition->width;
 }
 
-static void DrawPartition(ImageAnalysis* pImageAnalysis, guint8* pImage, PrintPartition* pPartition)
+// column sums, min, max and saturation of one partition, its columns are contiguous in the arena
+static void ScanPartitionColumns(PartitionStore* pStore, int i)
 {
-    int x0 = pPartition->centerX - pPartition->width / 2;
-    int x1 = x0 + pPartition->width;
-    int y0 = pPartition->centerY - pPartition->height / 2;
-    int y1 = y0 + pPartition->height;
+    gint pW = pStore->piColumnStart[i + 1] - pStore->piColumnStart[i], pH = pStore->piY1[i] - pStore->piY0[i];
+    gint* piCol = &pStore->piColumns[pStore->piColumnStart[i] * PARTITION_CHANNELS];
+    gint total[3] = { 0, 0, 0 }, minCol[3] = { INT_MAX, INT_MAX, INT_MAX }, maxCol[3] = { 0, 0, 0 };
+    double bg[PARTITION_CHANNELS], satMin[PARTITION_CHANNELS], satMax[PARTITION_CHANNELS], satTot[PARTITION_CHANNELS];
+
+    if (pW <= 0 || pH <= 0)
+    {
+        for (int c = 0; c < PARTITION_CHANNELS; c++)
+        {
+            pStore->piTotal[c][i] = pStore->piMin[c][i] = pStore->piMax[c][i] = 0;
+            pStore->piMinSat[c][i] = pStore->piMaxSat[c][i] = pStore->piAvgSat[c][i] = 0;
+        }
+
+        return;
+    }
+
+    for (int c = 0; c < 3; c++)
+        bg[c] = (double)pStore->pfPaperWhite[i * 3 + c] * pH;
 
-    RGBQUAD* pRgb0 = (RGBQUAD*)ROW(pImage, pImageAnalysis->iImageWidth, y0);
-    RGBQUAD* pRgb1 = (RGBQUAD*)ROW(pImage, pImageAnalysis->iImageWidth, y1);
+    bg[3] = MIN(bg[0], MIN(bg[1], bg[2]));
 
-    // draw the horizontal lines
-    for (int x = x0; x < x1; x++)
-        pRgb0[x] = pRgb1[x] = RGB_BLACK;
+    for (int c = 0; c < PARTITION_CHANNELS; c++)
+    {
+        satMin[c] = DBL_MAX;
+        satMax[c] = satTot[c] = 0.0;
+    }
+
+    for (int x = 0; x < pW; x++, piCol += PARTITION_CHANNELS)
+    {
+        // k is the darkest of r, g and b, the accumulation kernel leaves it empty
+        piCol[3] = MIN(piCol[0], MIN(piCol[1], piCol[2]));
+
+        for (int c = 0; c < PARTITION_CHANNELS; c++)
+        {
+            double sat = MAX(1.0 - ((double)piCol[c] / bg[c]), 0.0);
+
+            satMin[c] = MIN(sat, satMin[c]);
+            satMax[c] = MAX(sat, satMax[c]);
+            satTot[c] += sat;
+        }
 
-    // draw the vertical lines
-    for (int y = y0; y < y1; y++)
+        for (int c = 0; c < 3; c++)
+        {
+            total[c] += piCol[c];
+            minCol[c] = MIN(piCol[c], minCol[c]);
+            maxCol[c] = MAX(piCol[c], maxCol[c]);
+        }
+    }
+
+    for (int c = 0; c < 3; c++)
     {
-        RGBQUAD* pRGB = (RGBQUAD*)ROW(pImage, pImageAnalysis->iImageWidth, y);
-        pRGB[x0] = pRGB[x1] = RGB_BLACK;
+        pStore->piTotal[c][i] = total[c];
+        pStore->piMin[c][i] = minCol[c];
+        pStore->piMax[c][i] = maxCol[c];
     }
 
-    gdiplus_draw_rgb(pImageAnalysis->pGdiObj, pPartition->total.rgb.r, pPartition->total.rgb.g, pPartition->total.rgb.b, x0, y0);
+    for (int c = 0; c < PARTITION_CHANNELS; c++)
+    {
+        pStore->piMinSat[c][i] = (gint)(satMin[c] * 1000.0);
+        pStore->piMaxSat[c][i] = (gint)(satMax[c] * 1000.0);
+        pStore->piAvgSat[c][i] = (gint)(satTot[c] / pW * 1000.0);
+    }
 }
 
-static void ComputeTotal(ImageAnalysisRGB* pImageAnalysisRgb, guint8* pImage)
+static void SumPartitionDeviation(PartitionStore* pStore, int i)
+{
+    gint pW = pStore->piColumnStart[i + 1] - pStore->piColumnStart[i];
+    const gint* piCol = &pStore->piColumns[pStore->piColumnStart[i] * PARTITION_CHANNELS];
+
+    for (int c = 0; c < 3; c++)
+    {
+        gint avg = pStore->piAvg[c][i], sum = 0;
+
+        for (int x = 0; x < pW; x++)
+            sum += abs(piCol[x * PARTITION_CHANNELS + c] - avg);
+
+        pStore->piNonUniformity[c][i] = sum;
+    }
+}
+
+static void FinalizePartitionTotals(ImageAnalysis* pImageAnalysis)
+{
+    PartitionStore* pStore = &pImageAnalysis->store;
+    int n = pStore->nPartitions;
+    const gint* piStart = pStore->piColumnStart;
+
+    UpdatePaperWhite(pImageAnalysis);
+
+    for (int i = 0; i < n; i++)
+        ScanPartitionColumns(pStore, i);
+
+    // the per partition steps run across partitions, a channel at a time, k only has saturation
+    for (int c = 0; c < 3; c++)
+    {
+        const gint* piTotal = pStore->piTotal[c];
+        gint* piAvg = pStore->piAvg[c];
+
+        for (int i = 0; i < n; i++)
+        {
+            gint pW = piStart[i + 1] - piStart[i];
+
+            piAvg[i] = pW > 0 ? piTotal[i] / pW : 0;
+        }
+    }
+
+    for (int i = 0; i < n; i++)
+        SumPartitionDeviation(pStore, i);
+
+    for (int c = 0; c < 3; c++)
+    {
+        gint* piTotal = pStore->piTotal[c];
+        gint* piNonUniformity = pStore->piNonUniformity[c];
+
+        for (int i = 0; i < n; i++)
+        {
+            gint pW = piStart[i + 1] - piStart[i], nPixels = pW * (pStore->piY1[i] - pStore->piY0[i]);
+
+            piTotal[i] = nPixels > 0 ? piTotal[i] / nPixels : 0;
+            piNonUniformity[i] = nPixels > 0 ? piNonUniformity[i] / pW : 0;
+        }
+    }
+}
+
+static void DrawPartitionLabels(ImageAnalysis* pImageAnalysis, guint8* pImage)
+{
+    // the outlines are in the overlay, only the values change from frame to frame
+    if (pImageAnalysis->drawLabels)
+        pImageAnalysis->drawLabels(pImageAnalysis->pLabelData, pImage, pImageAnalysis->iImageWidth, pImageAnalysis->iImageHeight,
+            pImageAnalysis->iStride, pImageAnalysis->pPartitions, pImageAnalysis->nPartitions);
+}
+
+static void AnalysisPass(ImageAnalysisRGB* pImageAnalysisRgb, guint8* pImage, guint analyses)
 {
     ImageAnalysis* pImageAnalysis = GST_IMAGE_ANALYSIS(pImageAnalysisRgb);
 
-    if (pImageAnalysis->bPartitionsReady)
+    if (analyses & ANALYSIS_TOTAL)
+        memset(pImageAnalysis->store.piColumns, 0, pImageAnalysis->store.nColumns * PARTITION_CHANNELS * sizeof(gint));
+
+    // walk the image once from top to bottom, band by band, so the AOI bands and the
+    // partitions consume every row while it is still in cache
+    for (int yStart = 0; yStart < pImageAnalysis->iImageHeight; yStart += PARTITION_BAND_HEIGHT)
     {
-        for (int i = 0; i < pImageAnalysis->nPartitions; i++)
-            ComputePartitionTotal(pImageAnalysis, pImage, &pImageAnalysis->pPartitions[i]);
+        int yEnd = MIN(yStart + PARTITION_BAND_HEIGHT, pImageAnalysis->iImageHeight);
+        int b = yStart / PARTITION_BAND_HEIGHT;
+
+        if (analyses & ANALYSIS_AOI)
+            AccumulateAOIRows(pImageAnalysisRgb, pImage, yStart, yEnd, analyses);
+
+        if ((analyses & ANALYSIS_TOTAL) && b < pImageAnalysis->partitionIndex.nBands)
+            SweepPartitionBand(pImageAnalysis, pImage, b);
     }
 
-    gdiplus_init_context(pImageAnalysis->pGdiObj, pImage, pImageAnalysis->iImageWidth, pImageAnalysis->iImageHeight, pImageAnalysis->iStride);
-    
-    for (int i = 0; i < pImageAnalysis->nPartitions; i++)
-        DrawPartition(pImageAnalysis, pImage, &pImageAnalysis->pPartitions[i]);
+    if (analyses & ANALYSIS_TOTAL)
+    {
+        FinalizePartitionTotals(pImageAnalysis);
+        PublishPartitions(pImageAnalysis);
+    }
 }
 
 void init_rgb(ImageAnalysis* pImageAnalysis, AnalysisOpts* opts, int iImageWidth, int iImageHeight)
@@ -493,11 +790,13 @@ void init_rgb(ImageAnalysis* pImageAnalysis, AnalysisOpts* opts, int iImageWidth
     ImageAnalysisRGB* pImageAnalysisRgb = GST_IMAGE_ANALYSIS_RGB(pImageAnalysis);
 
     pImageAnalysis->opts = *opts;
+    pImageAnalysis->pKernels = GetAnalysisKernels(opts->cpuLevel);
     pImageAnalysis->iImageWidth = iImageWidth;
     pImageAnalysis->iImageHeight = iImageHeight;
-    pImageAnalysis->iPrevPartitions = 0;
 
-    CheckAllocatedMemory(pImageAnalysisRgb);
+    // the layout sizes the span buffer of the graph renderer, so it has to exist first
+    InitGraphRenderer(pImageAnalysis);
+    CheckAllocatedMemory(pImageAnalysisRgb, 0);
 
     pImageAnalysisRgb->piHistogram = calloc(UCHAR_MAX + 1, sizeof(INTRGBTRIPLE));
 }
@@ -509,40 +808,119 @@ void deinit_rgb(ImageAnalysis* pImageAnalysis)
     if (pImageAnalysisRgb->piHistogram)
         free(pImageAnalysisRgb->piHistogram);
 
-    if (pImageAnalysisRgb->ppResults)
-    {
-        for (int i = 0; i < pImageAnalysis->iPrevPartitions; i++)
-            free(pImageAnalysisRgb->ppResults[i]);
-
-        free(pImageAnalysisRgb->ppResults);
-        free(pImageAnalysisRgb->piNumResults);
-    }
+    free(pImageAnalysisRgb->pHistograms);
+    free(pImageAnalysisRgb->pResults);
+    free(pImageAnalysisRgb->pPlot);
+    free(pImageAnalysisRgb->pRowResults);
+    free(pImageAnalysisRgb->pRowPlot);
+
+    FreeAoiLayout(pImageAnalysis);
+    FreeBanding(&pImageAnalysis->banding);
+    FreeNozzleAnalysis(&pImageAnalysis->nozzle);
+    FreeDefects(&pImageAnalysis->defects);
+    FreePartitions(pImageAnalysis);
+    FreeOverlay(pImageAnalysis);
+    FreeGraphRenderer(pImageAnalysis);
 }
 
-void analyize_rgb(ImageAnalysis* pImageAnalysis, GstVideoFrame* frame)
+void analyize_rgb(ImageAnalysis* pImageAnalysis, guint8* pImage)
 {
     ImageAnalysisRGB* pImageAnalysisRgb = GST_IMAGE_ANALYSIS_RGB(pImageAnalysis);
-    guint8* pImage = GST_VIDEO_FRAME_PLANE_DATA(frame, 0);
+    AnalysisResults* pResults = &pImageAnalysis->results;
+    guint requested = GetRequestedAnalyses(&pImageAnalysis->opts);
+    guint analyses = requested;
+
+    // partitions are only measured after they have been (re)configured
+    if (!pImageAnalysis->bPartitionsReady)
+        analyses &= ~ANALYSIS_TOTAL;
+
+    CheckAllocatedMemory(pImageAnalysisRgb, analyses);
+
+    StageBegin(pImageAnalysis, STAGE_OVERLAY);
+
+    if (!pImageAnalysis->overlay.bValid)
+        BuildOverlay(pImageAnalysisRgb, requested);
+
+    StageEnd(pImageAnalysis, STAGE_OVERLAY);
+
+    StageBegin(pImageAnalysis, STAGE_ACCUMULATE);
+    AnalysisPass(pImageAnalysisRgb, pImage, analyses);
+    StageEnd(pImageAnalysis, STAGE_ACCUMULATE);
+
+    pResults->analyses = analyses;
+    pResults->nColumns = pImageAnalysis->aoi.nColumns;
+    pResults->iRowStep = QualityRowStep(pImageAnalysis->quality);
+    SetAoiBandRows(pImageAnalysis, pResults->iRowStep);
+    pResults->iRows = pImageAnalysis->aoi.nBands ? pImageAnalysis->aoi.pBands[0].iRows : 0;
+    pResults->nBands = pImageAnalysis->aoi.nBands;
+    pResults->pBands = pImageAnalysis->aoi.pBands;
+    pResults->quality = pImageAnalysis->quality;
+    pResults->nColumnChannels = sizeof(INTRGBTRIPLE) / sizeof(int);
+    pResults->piColumns = (const int*)pImageAnalysisRgb->pResults;
+    pResults->nHistograms = pImageAnalysis->aoi.nPartitions;
+    pResults->nHistogramChannels = sizeof(INTRGBTRIPLE) / sizeof(int);
+    pResults->piHistograms = (const int*)pImageAnalysisRgb->pHistograms;
+    pResults->nRowChannels = sizeof(INTRGBTRIPLE) / sizeof(int);
+    pResults->piRows = (const int*)pImageAnalysisRgb->pRowResults;
+    pResults->nPartitions = (analyses & ANALYSIS_TOTAL) ? pImageAnalysis->nPartitions : 0;
+    pResults->pPartitions = pImageAnalysis->pPartitions;
+    pResults->pBanding = &pImageAnalysis->banding;
+    pResults->pNozzle = &pImageAnalysis->nozzle;
+    pResults->pDefects = &pImageAnalysis->defects;
+
+    if (analyses & ANALYSIS_BANDING)
+    {
+        // r, g and b of every column together
+        StageBegin(pImageAnalysis, STAGE_BANDING);
+        UpdateBanding(pImageAnalysis, 3);
+        StageEnd(pImageAnalysis, STAGE_BANDING);
+    }
 
-    switch (pImageAnalysis->opts.analysisType)
+    if (analyses & ANALYSIS_NOZZLE_CHECK)
     {
-    case INTENSITY:
-        ComputeIntensity(pImageAnalysisRgb, pImage);
-        break;
+        StageBegin(pImageAnalysis, STAGE_NOZZLE_CHECK);
+        UpdateNozzleChecks(pImageAnalysis, 3);
+        StageEnd(pImageAnalysis, STAGE_NOZZLE_CHECK);
+    }
 
-    case MEAN:
-        ComputeAverage(pImageAnalysisRgb, pImage);
-        break;
+    if (analyses & ANALYSIS_DEFECTS)
+    {
+        StageBegin(pImageAnalysis, STAGE_DEFECTS);
+        UpdateDefects(pImageAnalysis, 3);
+        StageEnd(pImageAnalysis, STAGE_DEFECTS);
+    }
 
-    case HISTOGRAM:
-        ComputeHistogram(pImageAnalysisRgb, pImage);
-        break;
+    StageBegin(pImageAnalysis, STAGE_OVERLAY);
+    DrawOverlay(pImageAnalysisRgb, pImage, 0, pImageAnalysis->overlay.nBaseSpans);
+    StageEnd(pImageAnalysis, STAGE_OVERLAY);
 
-    case TOTAL:
-        ComputeTotal(pImageAnalysisRgb, pImage);
-        break;
+    if ((analyses & ANALYSIS_AOI) && pImageAnalysis->quality < QUALITY_EIGHTH)
+        DrawProfiles(pImageAnalysisRgb, pImage, analyses);
 
-    default:
-        break;
+    StageBegin(pImageAnalysis, STAGE_OVERLAY);
+    DrawOverlay(pImageAnalysisRgb, pImage, pImageAnalysis->overlay.nBaseSpans, pImageAnalysis->overlay.nSpans);
+    StageEnd(pImageAnalysis, STAGE_OVERLAY);
+
+    if ((requested & ANALYSIS_TOTAL) && pImageAnalysis->quality < QUALITY_QUARTER)
+    {
+        StageBegin(pImageAnalysis, STAGE_LABELS);
+        DrawPartitionLabels(pImageAnalysis, pImage);
+        StageEnd(pImageAnalysis, STAGE_LABELS);
     }
 }
+
+// draws the static overlay without analyzing the frame, for frames that are too late to be measured
+void overlay_rgb(ImageAnalysis* pImageAnalysis, guint8* pImage)
+{
+    ImageAnalysisRGB* pImageAnalysisRgb = GST_IMAGE_ANALYSIS_RGB(pImageAnalysis);
+
+    CheckAllocatedMemory(pImageAnalysisRgb, 0);
+
+    if (!pImageAnalysis->overlay.bValid)
+        BuildOverlay(pImageAnalysisRgb, GetRequestedAnalyses(&pImageAnalysis->opts));
+
+    pImageAnalysis->results.analyses = 0;
+    pImageAnalysis->results.nPartitions = 0;
+
+    DrawOverlay(pImageAnalysisRgb, pImage, 0, pImageAnalysis->overlay.nSpans);
+}
@@ -20,9 +20,12 @@ typedef struct ImageAnalysisRGB
 {
 	ImageAnalysis	imageAnalysis;
 
-	INTRGBTRIPLE*	piHistogram;
-	INTRGBTRIPLE**	ppResults;
-	int*			piNumResults;
+	INTRGBTRIPLE*	piHistogram;	// scratch for normalizing one partition's histogram
+	INTRGBTRIPLE*	pHistograms;	// (UCHAR_MAX + 1) bins per AOI partition
+	INTRGBTRIPLE*	pResults;		// one accumulator per column
+	INTRGBTRIPLE*	pPlot;			// graph rows of the values being plotted, one per column
+	INTRGBTRIPLE*	pRowResults;	// one accumulator per AOI row
+	INTRGBTRIPLE*	pRowPlot;		// graph columns of the row profiles, one per AOI row
 } ImageAnalysisRGB;
 
 #define GST_IMAGE_ANALYSIS_RGB(obj) ((ImageAnalysisRGB*) obj) 
@@ -30,4 +33,5 @@ typedef struct ImageAnalysisRGB
 
 void init_rgb(ImageAnalysis* pImageAnalysis, AnalysisOpts* opts, int iImageWidth, int iImageHeight);
 void deinit_rgb(ImageAnalysis* pImageAnalysis);
-void analyize_rgb(ImageAnalysis* pImageAnalysis, GstVideoFrame* frame);
+void analyize_rgb(ImageAnalysis* pImageAnalysis, guint8* pImage);
+void overlay_rgb(ImageAnalysis* pImageAnalysis, guint8* pImage);
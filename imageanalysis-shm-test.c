@@ -0,0 +1,400 @@
+#include "libimageanalysis.h"
+#include "imageanalysis-shm.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// writes the results ring in this process and reads it in a second one, started from the same
+// executable, exits 0 when the reader saw every record it could read intact and in order
+//
+//   imageanalysis-shm-test [--records N] [--slots N]
+//
+// the reader runs as imageanalysis-shm-test --reader NAME, it gives up after SHM_TEST_TIMEOUT_S
+
+#define SHM_TEST_COLUMNS        64
+#define SHM_TEST_CHANNELS       3
+#define SHM_TEST_PARTITIONS     4
+#define SHM_TEST_BANDS          2
+#define SHM_TEST_TIMEOUT_S      30
+#define SHM_TEST_PAUSE_US       100
+
+static gint iRecords = 5000;
+static gint iSlots = 8;
+static gchar* pReaderName = NULL;
+
+static GOptionEntry entries[] =
+{
+    { "records", 'n', 0, G_OPTION_ARG_INT, &iRecords, "Records the reader has to check", "N" },
+    { "slots", 's', 0, G_OPTION_ARG_INT, &iSlots, "Slots of the ring", "N" },
+    { "reader", 0, G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_STRING, &pReaderName, "Read the ring NAME, started by the writer", "NAME" },
+    { NULL }
+};
+
+typedef struct ShmTestWriter
+{
+    ResultsShmWriter*   pWriter;
+    AnalysisResults     results;
+    int                 piColumns[SHM_TEST_COLUMNS * SHM_TEST_CHANNELS];
+    PrintPartition      partitions[SHM_TEST_PARTITIONS];
+    AoiBand             bands[SHM_TEST_BANDS];
+    guint64             nWritten;
+    gboolean            bReaderDone;
+    gint                iReaderStatus;
+    GMainLoop*          pLoop;
+} ShmTestWriter;
+
+// every value of record iRecord follows from iRecord, so a torn or misplaced copy shows
+static int ShmTestValue(guint64 iRecord, int i)
+{
+    return (int)(iRecord * 7 + i);
+}
+
+static void InitTestResults(ShmTestWriter* pTest)
+{
+    memset(&pTest->results, 0, sizeof(AnalysisResults));
+
+    pTest->results.analyses = ANALYSIS_INTENSITY | ANALYSIS_TOTAL;
+    pTest->results.nColumns = SHM_TEST_COLUMNS;
+    pTest->results.nColumnChannels = SHM_TEST_CHANNELS;
+    pTest->results.iRows = 16;
+    pTest->results.piColumns = pTest->piColumns;
+    pTest->results.nPartitions = SHM_TEST_PARTITIONS;
+    pTest->results.pPartitions = pTest->partitions;
+    pTest->results.nBands = SHM_TEST_BANDS;
+    pTest->results.pBands = pTest->bands;
+
+    // the columns split evenly between the bands
+    for (int b = 0; b < SHM_TEST_BANDS; b++)
+    {
+        pTest->bands[b].x = 0;
+        pTest->bands[b].y = b * 40;
+        pTest->bands[b].width = SHM_TEST_COLUMNS / SHM_TEST_BANDS;
+        pTest->bands[b].height = 16;
+        pTest->bands[b].nPartitions = 2;
+        pTest->bands[b].iFirstColumn = b * SHM_TEST_COLUMNS / SHM_TEST_BANDS;
+    }
+}
+
+static void WriteTestRecord(ShmTestWriter* pTest)
+{
+    guint64 iRecord = pTest->nWritten++;
+
+    for (int i = 0; i < SHM_TEST_COLUMNS * SHM_TEST_CHANNELS; i++)
+        pTest->piColumns[i] = ShmTestValue(iRecord, i);
+
+    for (int p = 0; p < SHM_TEST_PARTITIONS; p++)
+    {
+        pTest->partitions[p].id = p + 1;
+        pTest->partitions[p].total.rgb.r = ShmTestValue(iRecord, p);
+        pTest->partitions[p].total.rgb.g = ShmTestValue(iRecord, p + 1);
+        pTest->partitions[p].total.rgb.b = ShmTestValue(iRecord, p + 2);
+    }
+
+    for (int b = 0; b < SHM_TEST_BANDS; b++)
+        pTest->bands[b].iRows = ShmTestValue(iRecord, b);
+
+    WriteResultsShm(pTest->pWriter, (gint64)iRecord * 40000000, &pTest->results);
+}
+
+// the columns, the partitions, the bands and the timestamp all have to belong to the record
+static gboolean CheckTestRecord(const ResultsShmRecord* pRecord, guint64 iRecord)
+{
+    const int32_t* piColumns = ResultsShmColumns(pRecord);
+    const ResultsShmPartition* pPartitions = ResultsShmPartitions(pRecord);
+    const ResultsShmBand* pBands = ResultsShmBands(pRecord);
+
+    if (pRecord->iRecord != iRecord || pRecord->iTimestamp != (int64_t)iRecord * 40000000 ||
+        pRecord->nColumns != SHM_TEST_COLUMNS || pRecord->nColumnChannels != SHM_TEST_CHANNELS ||
+        pRecord->nPartitions != SHM_TEST_PARTITIONS || pRecord->nBands != SHM_TEST_BANDS)
+        return FALSE;
+
+    for (int i = 0; i < SHM_TEST_COLUMNS * SHM_TEST_CHANNELS; i++)
+    {
+        if (piColumns[i] != ShmTestValue(iRecord, i))
+            return FALSE;
+    }
+
+    for (int p = 0; p < SHM_TEST_PARTITIONS; p++)
+    {
+        if (pPartitions[p].iId != p + 1 || pPartitions[p].total[0] != ShmTestValue(iRecord, p) ||
+            pPartitions[p].total[1] != ShmTestValue(iRecord, p + 1) || pPartitions[p].total[2] != ShmTestValue(iRecord, p + 2))
+            return FALSE;
+    }
+
+    for (int b = 0; b < SHM_TEST_BANDS; b++)
+    {
+        if (pBands[b].y != b * 40 || pBands[b].width != SHM_TEST_COLUMNS / SHM_TEST_BANDS ||
+            pBands[b].iFirstColumn != b * SHM_TEST_COLUMNS / SHM_TEST_BANDS || pBands[b].iRows != ShmTestValue(iRecord, b))
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+// follows the newest record until it checked iRecords of them, records older than the ring holds
+// must be refused
+static int RunReader(const char* pName)
+{
+    gint64 iDeadline = g_get_monotonic_time() + SHM_TEST_TIMEOUT_S * G_USEC_PER_SEC;
+    ResultsShmReader* pReader = NULL;
+    ResultsShmRecord* pRecord;
+    guint64 iLast = 0, nSlots;
+    gint nChecked = 0, nSkipped = 0;
+
+    while (!(pReader = OpenResultsShm(pName)))
+    {
+        if (g_get_monotonic_time() > iDeadline)
+        {
+            fprintf(stderr, "reader: %s could not be opened\n", pName);
+            return 1;
+        }
+
+        g_usleep(1000);
+    }
+
+    pRecord = malloc(ResultsShmRecordBytes(pReader));
+    nSlots = (guint64)iSlots;
+
+    while (nChecked < iRecords)
+    {
+        guint64 nWritten = ResultsShmWritten(pReader);
+
+        if (g_get_monotonic_time() > iDeadline)
+        {
+            fprintf(stderr, "reader: timed out after %d records\n", nChecked);
+            break;
+        }
+
+        // nothing new, leave the processor to the writer
+        if (!nWritten || nWritten - 1 <= iLast)
+        {
+            g_usleep(SHM_TEST_PAUSE_US);
+            continue;
+        }
+
+        // a slot reused by a completed newer record never passes for the old one
+        if (nWritten > nSlots + 1 && ReadResultsShm(pReader, nWritten - nSlots - 1, pRecord, ResultsShmRecordBytes(pReader)))
+        {
+            fprintf(stderr, "reader: overwritten record %" G_GUINT64_FORMAT " was returned\n", nWritten - nSlots - 1);
+            break;
+        }
+
+        if (!ReadResultsShm(pReader, nWritten - 1, pRecord, ResultsShmRecordBytes(pReader)))
+        {
+            // overwritten while it was copied
+            nSkipped++;
+            continue;
+        }
+
+        if (!CheckTestRecord(pRecord, nWritten - 1))
+        {
+            fprintf(stderr, "reader: record %" G_GUINT64_FORMAT " is torn\n", nWritten - 1);
+            break;
+        }
+
+        iLast = nWritten - 1;
+        nChecked++;
+    }
+
+    printf("reader: %d records checked, %d overwritten while copied\n", nChecked, nSkipped);
+
+    free(pRecord);
+    CloseResultsShm(pReader);
+    return nChecked == iRecords ? 0 : 1;
+}
+
+// in one process: records not written yet and records whose slot was reused are refused, the ones
+// still in the ring come back intact, and a reader sees when the ring is replaced
+static gboolean CheckOverwrittenSlots(const char* pName)
+{
+    ShmTestWriter test = { 0 };
+    ResultsShmReader* pReader;
+    ResultsShmRecord* pRecord;
+    gboolean bPassed = TRUE;
+    guint64 nRecords = 2 * 4 + 2;
+
+    InitTestResults(&test);
+    test.pWriter = CreateResultsShm(pName, 4, SHM_TEST_COLUMNS * SHM_TEST_CHANNELS, SHM_TEST_BANDS);
+    pReader = test.pWriter ? OpenResultsShm(pName) : NULL;
+
+    if (!pReader)
+    {
+        fprintf(stderr, "%s could not be created\n", pName);
+        DestroyResultsShm(test.pWriter);
+        return FALSE;
+    }
+
+    pRecord = malloc(ResultsShmRecordBytes(pReader));
+
+    for (guint64 i = 0; i < nRecords; i++)
+        WriteTestRecord(&test);
+
+    for (guint64 i = 0; i <= nRecords; i++)
+    {
+        gboolean bHeld = i >= nRecords - 4 && i < nRecords;
+        int iRead = ReadResultsShm(pReader, i, pRecord, ResultsShmRecordBytes(pReader));
+
+        if (iRead != bHeld || (iRead && !CheckTestRecord(pRecord, i)))
+        {
+            fprintf(stderr, "record %" G_GUINT64_FORMAT " of %" G_GUINT64_FORMAT " in 4 slots: read %d, expected %d\n", i, nRecords, iRead, bHeld);
+            bPassed = FALSE;
+        }
+    }
+
+    free(pRecord);
+
+    if (ResultsShmReplaced(pReader))
+    {
+        fprintf(stderr, "the ring was replaced while its writer was still there\n");
+        bPassed = FALSE;
+    }
+
+    // as for a new AOI layout, the old ring goes first and its readers reopen the name
+    DestroyResultsShm(test.pWriter);
+
+    if (!ResultsShmReplaced(pReader))
+    {
+        fprintf(stderr, "the ring was not marked replaced\n");
+        bPassed = FALSE;
+    }
+
+    CloseResultsShm(pReader);
+
+    test.pWriter = CreateResultsShm(pName, 4, 2 * SHM_TEST_COLUMNS * SHM_TEST_CHANNELS, SHM_TEST_BANDS);
+    pReader = test.pWriter ? OpenResultsShm(pName) : NULL;
+
+    if (!pReader || ResultsShmReplaced(pReader) || ResultsShmRecordBytes(pReader) < sizeof(ResultsShmRecord) + 2 * SHM_TEST_COLUMNS * SHM_TEST_CHANNELS * sizeof(int32_t))
+    {
+        fprintf(stderr, "%s was not reopened with the new layout\n", pName);
+        bPassed = FALSE;
+    }
+
+    CloseResultsShm(pReader);
+    DestroyResultsShm(test.pWriter);
+    return bPassed;
+}
+
+static void OnReaderExit(GPid pid, gint iStatus, gpointer pUserData)
+{
+    ShmTestWriter* pTest = pUserData;
+
+    pTest->bReaderDone = TRUE;
+    pTest->iReaderStatus = iStatus;
+    g_spawn_close_pid(pid);
+    g_main_loop_quit(pTest->pLoop);
+}
+
+static gboolean OnWrite(gpointer pUserData)
+{
+    ShmTestWriter* pTest = pUserData;
+
+    // a burst at a time, so the reader sees both quiet slots and slots the writer is filling, the
+    // pause keeps the reader running on a single processor
+    for (int i = 0; i < 16; i++)
+        WriteTestRecord(pTest);
+
+    g_usleep(SHM_TEST_PAUSE_US);
+
+    return G_SOURCE_CONTINUE;
+}
+
+static gboolean OnTimeout(gpointer pUserData)
+{
+    ShmTestWriter* pTest = pUserData;
+
+    fprintf(stderr, "writer: the reader did not finish within %d s\n", SHM_TEST_TIMEOUT_S);
+    g_main_loop_quit(pTest->pLoop);
+    return G_SOURCE_REMOVE;
+}
+
+// fills the ring until the reader process exits
+static gboolean CheckTwoProcesses(const char* pProgram, const char* pName)
+{
+    ShmTestWriter test = { 0 };
+    gchar* pRecordsArg = g_strdup_printf("--records=%d", iRecords);
+    gchar* pSlotsArg = g_strdup_printf("--slots=%d", iSlots);
+    gchar* argv[] = { (gchar*)pProgram, "--reader", (gchar*)pName, pRecordsArg, pSlotsArg, NULL };
+    GError* pError = NULL;
+    GPid pid;
+    gboolean bPassed = FALSE;
+
+    InitTestResults(&test);
+    test.pWriter = CreateResultsShm(pName, iSlots, SHM_TEST_COLUMNS * SHM_TEST_CHANNELS, SHM_TEST_BANDS);
+
+    if (!test.pWriter)
+        fprintf(stderr, "%s could not be created\n", pName);
+    else if (!g_spawn_async(NULL, argv, NULL, G_SPAWN_DO_NOT_REAP_CHILD, NULL, NULL, &pid, &pError))
+        fprintf(stderr, "the reader could not be started: %s\n", pError->message);
+    else
+    {
+        test.pLoop = g_main_loop_new(NULL, FALSE);
+
+        g_child_watch_add(pid, OnReaderExit, &test);
+        g_idle_add(OnWrite, &test);
+        g_timeout_add_seconds(SHM_TEST_TIMEOUT_S + 5, OnTimeout, &test);
+        g_main_loop_run(test.pLoop);
+        g_main_loop_unref(test.pLoop);
+
+#if GLIB_CHECK_VERSION(2, 70, 0)
+        bPassed = test.bReaderDone && g_spawn_check_wait_status(test.iReaderStatus, NULL);
+#else
+        bPassed = test.bReaderDone && g_spawn_check_exit_status(test.iReaderStatus, NULL);
+#endif
+        printf("writer: %" G_GUINT64_FORMAT " records written\n", test.nWritten);
+    }
+
+    g_clear_error(&pError);
+    DestroyResultsShm(test.pWriter);
+    g_free(pRecordsArg);
+    g_free(pSlotsArg);
+    return bPassed;
+}
+
+int main(int argc, char* argv[])
+{
+    GOptionContext* pContext = g_option_context_new("- checks the results ring between two processes");
+    GError* pError = NULL;
+    gboolean bPassed = TRUE;
+
+    g_option_context_add_main_entries(pContext, entries, NULL);
+
+    if (!g_option_context_parse(pContext, &argc, &argv, &pError))
+    {
+        fprintf(stderr, "%s\n", pError->message);
+        g_error_free(pError);
+        g_option_context_free(pContext);
+        return 2;
+    }
+
+    g_option_context_free(pContext);
+
+    if (iRecords < 1 || iSlots < 1)
+    {
+        fprintf(stderr, "records and slots have to be positive\n");
+        return 2;
+    }
+
+    if (pReaderName)
+        return RunReader(pReaderName);
+
+    // a name of its own, so runs next to each other or next to a pipeline don't meet
+    gchar* pName = g_strdup_printf("imageanalysis-shm-test-%08x", g_random_int());
+    gchar* pProgram = g_find_program_in_path(argv[0]);
+
+    if (!CheckOverwrittenSlots(pName))
+        bPassed = FALSE;
+    else if (!pProgram)
+    {
+        fprintf(stderr, "%s not found to start the reader\n", argv[0]);
+        bPassed = FALSE;
+    }
+    else
+        bPassed = CheckTwoProcesses(pProgram, pName);
+
+    printf("%s\n", bPassed ? "passed" : "FAILED");
+
+    g_free(pProgram);
+    g_free(pName);
+    return bPassed ? 0 : 1;
+}
@@ -0,0 +1,365 @@
+#include "imageanalysis-shm.h"
+#include "libimageanalysis.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#define SHM_FENCE() MemoryBarrier()
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define SHM_FENCE() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#endif
+
+// attempts to copy a slot the writer keeps changing, a writer that died while filling one never releases it
+#define SHM_READ_RETRIES 1000
+
+
+typedef struct ShmMapping
+{
+#ifdef _WIN32
+    HANDLE  hMapping;
+#else
+    char*   pName;
+    int     bOwner;
+#endif
+    void*   pBase;
+    size_t  nBytes;
+} ShmMapping;
+
+struct ResultsShmWriter
+{
+    ShmMapping          mapping;
+    ResultsShmHeader*   pHeader;
+};
+
+struct ResultsShmReader
+{
+    ShmMapping          mapping;
+    ResultsShmHeader*   pHeader;
+};
+
+static gboolean MapShm(ShmMapping* pMapping, const char* pName, size_t nBytes, gboolean bCreate)
+{
+#ifdef _WIN32
+    if (bCreate)
+        pMapping->hMapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, (DWORD)((guint64)nBytes >> 32), (DWORD)nBytes, pName);
+    else
+        pMapping->hMapping = OpenFileMappingA(FILE_MAP_READ, FALSE, pName);
+
+    if (!pMapping->hMapping)
+        return FALSE;
+
+    // readers still hold a previous ring of this name, it must not be reused for the new one
+    if (bCreate && GetLastError() == ERROR_ALREADY_EXISTS)
+    {
+        CloseHandle(pMapping->hMapping);
+        return FALSE;
+    }
+
+    pMapping->pBase = MapViewOfFile(pMapping->hMapping, bCreate ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, nBytes);
+
+    if (!pMapping->pBase)
+    {
+        CloseHandle(pMapping->hMapping);
+        return FALSE;
+    }
+#else
+    struct stat st;
+    int fd;
+
+    // POSIX shared memory names start with a single slash
+    pMapping->pName = g_strdup_printf("/%s", pName[0] == '/' ? pName + 1 : pName);
+    pMapping->bOwner = bCreate;
+
+    // readers still mapping a previous ring keep it, new readers get the new one
+    if (bCreate)
+        shm_unlink(pMapping->pName);
+
+    fd = shm_open(pMapping->pName, bCreate ? O_CREAT | O_EXCL | O_RDWR : O_RDONLY, 0644);
+
+    if (fd < 0)
+        goto failed;
+
+    if (bCreate && ftruncate(fd, nBytes) != 0)
+    {
+        close(fd);
+        shm_unlink(pMapping->pName);
+        goto failed;
+    }
+
+    if (!bCreate)
+        nBytes = fstat(fd, &st) == 0 ? (size_t)st.st_size : 0;
+
+    pMapping->pBase = nBytes ? mmap(NULL, nBytes, bCreate ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+
+    if (pMapping->pBase == MAP_FAILED)
+    {
+        if (bCreate)
+            shm_unlink(pMapping->pName);
+
+        goto failed;
+    }
+#endif
+
+    pMapping->nBytes = nBytes;
+    return TRUE;
+
+#ifndef _WIN32
+failed:
+    g_free(pMapping->pName);
+    memset(pMapping, 0, sizeof(ShmMapping));
+    return FALSE;
+#endif
+}
+
+static void UnmapShm(ShmMapping* pMapping)
+{
+#ifdef _WIN32
+    UnmapViewOfFile(pMapping->pBase);
+    CloseHandle(pMapping->hMapping);
+#else
+    munmap(pMapping->pBase, pMapping->nBytes);
+
+    if (pMapping->bOwner)
+        shm_unlink(pMapping->pName);
+
+    g_free(pMapping->pName);
+#endif
+    memset(pMapping, 0, sizeof(ShmMapping));
+}
+
+static ResultsShmRecord* ShmSlot(ResultsShmHeader* pHeader, guint64 iRecord)
+{
+    return (ResultsShmRecord*)((guint8*)pHeader + sizeof(ResultsShmHeader) + (iRecord % pHeader->nSlots) * pHeader->slotBytes);
+}
+
+ResultsShmWriter* CreateResultsShm(const char* pName, int nSlots, int maxColumnValues, int maxBands)
+{
+    ResultsShmWriter* pWriter = calloc(1, sizeof(ResultsShmWriter));
+    size_t slotBytes = sizeof(ResultsShmRecord) + maxColumnValues * sizeof(int32_t) + RESULTS_SHM_MAX_PARTITIONS * sizeof(ResultsShmPartition) +
+        maxBands * sizeof(ResultsShmBand);
+
+    if (!pWriter || nSlots <= 0 || maxColumnValues < 0 || maxBands < 0)
+        goto failed;
+
+    // slots on their own cache lines, so a reader copying one never shares a line with the writer
+    slotBytes = (slotBytes + 63) & ~(size_t)63;
+
+    if (!MapShm(&pWriter->mapping, pName, sizeof(ResultsShmHeader) + nSlots * slotBytes, TRUE))
+        goto failed;
+
+    pWriter->pHeader = pWriter->mapping.pBase;
+    memset(pWriter->pHeader, 0, pWriter->mapping.nBytes);
+
+    pWriter->pHeader->version = RESULTS_SHM_VERSION;
+    pWriter->pHeader->nSlots = nSlots;
+    pWriter->pHeader->slotBytes = (uint32_t)slotBytes;
+    pWriter->pHeader->maxColumnValues = maxColumnValues;
+    pWriter->pHeader->maxPartitions = RESULTS_SHM_MAX_PARTITIONS;
+    pWriter->pHeader->maxBands = maxBands;
+
+    // readers check the magic last, once the rest of the header is in place
+    SHM_FENCE();
+    pWriter->pHeader->magic = RESULTS_SHM_MAGIC;
+
+    return pWriter;
+
+failed:
+    free(pWriter);
+    return NULL;
+}
+
+void DestroyResultsShm(ResultsShmWriter* pWriter)
+{
+    if (!pWriter)
+        return;
+
+    // after the last record, readers open the name again once they see it
+    SHM_FENCE();
+    pWriter->pHeader->replaced = 1;
+
+    UnmapShm(&pWriter->mapping);
+    free(pWriter);
+}
+
+void WriteResultsShm(ResultsShmWriter* pWriter, gint64 iTimestamp, const AnalysisResults* pResults)
+{
+    ResultsShmHeader* pHeader = pWriter->pHeader;
+    guint64 iRecord = pHeader->nWritten;
+    ResultsShmRecord* pRecord = ShmSlot(pHeader, iRecord);
+    int nColumnValues = 0;
+    int nPartitions = MIN(pResults->nPartitions, RESULTS_SHM_MAX_PARTITIONS);
+    int nBands = MIN(pResults->nBands, (int)pHeader->maxBands);
+
+    if (pResults->analyses & (ANALYSIS_INTENSITY | ANALYSIS_MEAN))
+        nColumnValues = MIN(pResults->nColumns * pResults->nColumnChannels, (int)pHeader->maxColumnValues);
+
+    pRecord->sequence++;
+    SHM_FENCE();
+
+    pRecord->analyses = pResults->analyses;
+    pRecord->iRecord = iRecord;
+    pRecord->iTimestamp = iTimestamp;
+    pRecord->nColumnChannels = pResults->nColumnChannels;
+    pRecord->nColumns = pResults->nColumnChannels ? nColumnValues / pResults->nColumnChannels : 0;
+    pRecord->iRows = pResults->iRows;
+    pRecord->quality = pResults->quality;
+    pRecord->nPartitions = nPartitions;
+    pRecord->nBands = nBands;
+
+    memcpy((int32_t*)ResultsShmColumns(pRecord), pResults->piColumns, pRecord->nColumns * pRecord->nColumnChannels * sizeof(int32_t));
+
+    for (int i = 0; i < nPartitions; i++)
+    {
+        ResultsShmPartition* pDst = (ResultsShmPartition*)&ResultsShmPartitions(pRecord)[i];
+        const PrintPartition* pSrc = &pResults->pPartitions[i];
+
+        pDst->iId = pSrc->id;
+        pDst->total[0] = pSrc->total.rgb.r;
+        pDst->total[1] = pSrc->total.rgb.g;
+        pDst->total[2] = pSrc->total.rgb.b;
+        pDst->avg[0] = pSrc->avg.rgb.r;
+        pDst->avg[1] = pSrc->avg.rgb.g;
+        pDst->avg[2] = pSrc->avg.rgb.b;
+        pDst->nonUniformity[0] = pSrc->nonUniformity.rgb.r;
+        pDst->nonUniformity[1] = pSrc->nonUniformity.rgb.g;
+        pDst->nonUniformity[2] = pSrc->nonUniformity.rgb.b;
+    }
+
+    for (int i = 0; i < nBands; i++)
+    {
+        ResultsShmBand* pDst = (ResultsShmBand*)&ResultsShmBands(pRecord)[i];
+        const AoiBand* pSrc = &pResults->pBands[i];
+
+        pDst->x = pSrc->x;
+        pDst->y = pSrc->y;
+        pDst->width = pSrc->width;
+        pDst->height = pSrc->height;
+        pDst->nPartitions = pSrc->nPartitions;
+        pDst->iFirstColumn = pSrc->iFirstColumn;
+        pDst->iRows = pSrc->iRows;
+    }
+
+    SHM_FENCE();
+    pRecord->sequence++;
+
+    SHM_FENCE();
+    pHeader->nWritten = iRecord + 1;
+}
+
+// bytes used by a record, garbage while the copy it was read from is torn
+static size_t ShmRecordBytes(const ResultsShmRecord* pRecord)
+{
+    return sizeof(ResultsShmRecord) + (size_t)pRecord->nColumns * pRecord->nColumnChannels * sizeof(int32_t) + (size_t)pRecord->nPartitions * sizeof(ResultsShmPartition) +
+        (size_t)pRecord->nBands * sizeof(ResultsShmBand);
+}
+
+ResultsShmReader* OpenResultsShm(const char* pName)
+{
+    ResultsShmReader* pReader = calloc(1, sizeof(ResultsShmReader));
+
+    if (!pReader)
+        return NULL;
+
+    if (!MapShm(&pReader->mapping, pName, 0, FALSE))
+    {
+        free(pReader);
+        return NULL;
+    }
+
+    pReader->pHeader = pReader->mapping.pBase;
+
+    if (pReader->pHeader->magic != RESULTS_SHM_MAGIC || pReader->pHeader->version != RESULTS_SHM_VERSION)
+    {
+        CloseResultsShm(pReader);
+        return NULL;
+    }
+
+    SHM_FENCE();
+    return pReader;
+}
+
+void CloseResultsShm(ResultsShmReader* pReader)
+{
+    if (!pReader)
+        return;
+
+    UnmapShm(&pReader->mapping);
+    free(pReader);
+}
+
+size_t ResultsShmRecordBytes(const ResultsShmReader* pReader)
+{
+    return pReader->pHeader->slotBytes;
+}
+
+uint64_t ResultsShmWritten(const ResultsShmReader* pReader)
+{
+    uint64_t nWritten = pReader->pHeader->nWritten;
+
+    SHM_FENCE();
+    return nWritten;
+}
+
+int ResultsShmReplaced(const ResultsShmReader* pReader)
+{
+    int bReplaced = pReader->pHeader->replaced != 0;
+
+    SHM_FENCE();
+    return bReplaced;
+}
+
+int ReadResultsShm(ResultsShmReader* pReader, uint64_t iRecord, ResultsShmRecord* pRecord, size_t nBytes)
+{
+    const ResultsShmRecord* pSlot = ShmSlot(pReader->pHeader, iRecord);
+    size_t slotBytes = MIN(nBytes, pReader->pHeader->slotBytes);
+
+    if (slotBytes < sizeof(ResultsShmRecord))
+        return 0;
+
+    for (int iTry = 0; iTry < SHM_READ_RETRIES; iTry++)
+    {
+        uint32_t sequence = pSlot->sequence;
+
+        if (iRecord >= ResultsShmWritten(pReader))
+            return 0;
+
+        // the writer is filling the slot
+        if (sequence & 1)
+            continue;
+
+        // the header first, then only the columns and partitions it holds
+        SHM_FENCE();
+        memcpy(pRecord, (const void*)pSlot, sizeof(ResultsShmRecord));
+        memcpy(pRecord + 1, (const void*)(pSlot + 1), MIN(ShmRecordBytes(pRecord), slotBytes) - sizeof(ResultsShmRecord));
+        SHM_FENCE();
+
+        // otherwise the slot has been reused by a newer record
+        if (pSlot->sequence == sequence)
+            return pRecord->iRecord == iRecord;
+    }
+
+    return 0;
+}
+
+const int32_t* ResultsShmColumns(const ResultsShmRecord* pRecord)
+{
+    return (const int32_t*)(pRecord + 1);
+}
+
+const ResultsShmPartition* ResultsShmPartitions(const ResultsShmRecord* pRecord)
+{
+    return (const ResultsShmPartition*)(ResultsShmColumns(pRecord) + pRecord->nColumns * pRecord->nColumnChannels);
+}
+
+const ResultsShmBand* ResultsShmBands(const ResultsShmRecord* pRecord)
+{
+    return (const ResultsShmBand*)(ResultsShmPartitions(pRecord) + pRecord->nPartitions);
+}
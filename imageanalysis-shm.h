@@ -0,0 +1,90 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// layout of the shared memory ring the element publishes its results in, kept to plain C
+// types so readers in other languages can mirror it, C readers link libimageanalysis
+//
+// the mapping starts with a ResultsShmHeader followed by nSlots slots of slotBytes, record n
+// lives in slot n % nSlots. a slot is a ResultsShmRecord, nColumns * nColumnChannels column
+// sums, nPartitions ResultsShmPartition and nBands ResultsShmBand. every slot is guarded by a
+// sequence lock, the writer makes the sequence odd while it fills the slot, readers copy the
+// slot and retry when the sequence was odd or changed meanwhile
+//
+// the ring is sized for the AOI layout, when the layout changes the writer sets replaced in
+// the old header and creates a new ring under the same name. nothing is written to the old
+// one any more, readers that find it replaced close it and open the name again. on Windows
+// the name stays taken until every reader closed the old ring, the writer publishes nothing
+// until then
+
+#define RESULTS_SHM_MAGIC	0x48535041	// "APSH"
+#define RESULTS_SHM_VERSION	2
+
+// partitions published per record, the rest are left out
+#define RESULTS_SHM_MAX_PARTITIONS	1024
+
+typedef struct ResultsShmHeader
+{
+	uint32_t			magic;
+	uint32_t			version;
+	uint32_t			nSlots;
+	uint32_t			slotBytes;
+	uint32_t			maxColumnValues;
+	uint32_t			maxPartitions;
+	uint32_t			maxBands;
+	volatile uint32_t	replaced;		// set once the writer stopped writing this ring
+	volatile uint64_t	nWritten;		// records published, the newest is nWritten - 1
+} ResultsShmHeader;
+
+typedef struct ResultsShmRecord
+{
+	volatile uint32_t	sequence;
+	uint32_t			analyses;		// AnalysisFlags of the frame
+	uint64_t			iRecord;
+	int64_t				iTimestamp;		// PTS, in ns
+	uint32_t			nColumns;		// 0 unless intensity or mean were computed
+	uint32_t			nColumnChannels;
+	uint32_t			iRows;			// AOI rows summed into every column
+	uint32_t			quality;
+	uint32_t			nPartitions;
+	uint32_t			nBands;			// AOI bands the columns are split in
+} ResultsShmRecord;
+
+typedef struct ResultsShmPartition
+{
+	int32_t	iId;
+	int32_t	total[3];
+	int32_t	avg[3];
+	int32_t	nonUniformity[3];
+} ResultsShmPartition;
+
+// a band clipped to the frame, its columns start at iFirstColumn
+typedef struct ResultsShmBand
+{
+	int32_t	x;
+	int32_t	y;
+	int32_t	width;
+	int32_t	height;
+	int32_t	nPartitions;
+	int32_t	iFirstColumn;
+	int32_t	iRows;			// rows summed into every column of the band
+} ResultsShmBand;
+
+typedef struct ResultsShmReader ResultsShmReader;
+
+ResultsShmReader* OpenResultsShm(const char* pName);
+void CloseResultsShm(ResultsShmReader* pReader);
+
+// bytes a record can take, the size of the buffer ReadResultsShm copies into
+size_t ResultsShmRecordBytes(const ResultsShmReader* pReader);
+uint64_t ResultsShmWritten(const ResultsShmReader* pReader);
+// nonzero once the ring was replaced or its writer went away, open the name again for the new one
+int ResultsShmReplaced(const ResultsShmReader* pReader);
+
+// copies record iRecord, returns 0 when it was not written yet or has been overwritten
+int ReadResultsShm(ResultsShmReader* pReader, uint64_t iRecord, ResultsShmRecord* pRecord, size_t nBytes);
+
+const int32_t* ResultsShmColumns(const ResultsShmRecord* pRecord);
+const ResultsShmPartition* ResultsShmPartitions(const ResultsShmRecord* pRecord);
+const ResultsShmBand* ResultsShmBands(const ResultsShmRecord* pRecord);
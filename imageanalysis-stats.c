@@ -0,0 +1,124 @@
+#include "imageanalysis.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+
+static const char* stageNames[STAGE_LAST] = { "accumulate", "normalize", "scale-graph", "banding", "nozzle-check", "defects", "overlay", "plot", "labels", "json", "frame" };
+
+gint64 StatsNowNs(void)
+{
+#ifdef _WIN32
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+
+    if (!frequency.QuadPart)
+        QueryPerformanceFrequency(&frequency);
+
+    QueryPerformanceCounter(&counter);
+    return (gint64)((double)counter.QuadPart * 1e9 / frequency.QuadPart);
+#else
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (gint64)now.tv_sec * 1000000000 + now.tv_nsec;
+#endif
+}
+
+const char* StageName(AnalysisStage stage)
+{
+    return stage < STAGE_LAST ? stageNames[stage] : "unknown";
+}
+
+void StageBegin(ImageAnalysis* pImageAnalysis, AnalysisStage stage)
+{
+    if (pImageAnalysis->opts.statsEnabled)
+        pImageAnalysis->stats.stages[stage].iStart = StatsNowNs();
+}
+
+void StageEnd(ImageAnalysis* pImageAnalysis, AnalysisStage stage)
+{
+    if (pImageAnalysis->opts.statsEnabled)
+    {
+        StageStats* pStage = &pImageAnalysis->stats.stages[stage];
+
+        pStage->iFrame += StatsNowNs() - pStage->iStart;
+        pStage->bRan = TRUE;
+    }
+}
+
+void BeginStatsFrame(ImageAnalysis* pImageAnalysis)
+{
+    for (int i = 0; i < STAGE_LAST; i++)
+    {
+        pImageAnalysis->stats.stages[i].iFrame = 0;
+        pImageAnalysis->stats.stages[i].bRan = FALSE;
+    }
+}
+
+// every stage that ran during the frame adds one sample, the sum of its measurements
+void EndStatsFrame(ImageAnalysis* pImageAnalysis)
+{
+    if (!pImageAnalysis->opts.statsEnabled)
+        return;
+
+    for (int i = 0; i < STAGE_LAST; i++)
+    {
+        StageStats* pStage = &pImageAnalysis->stats.stages[i];
+
+        if (!pStage->bRan)
+            continue;
+
+        if (!pStage->nSamples || pStage->iFrame < pStage->iMin)
+            pStage->iMin = pStage->iFrame;
+
+        if (pStage->iFrame > pStage->iMax)
+            pStage->iMax = pStage->iFrame;
+
+        pStage->iTotal += pStage->iFrame;
+        pStage->samples[pStage->nSamples % STAGE_STATS_SAMPLES] = pStage->iFrame;
+        pStage->nSamples++;
+    }
+}
+
+static int CompareSamples(const void* a, const void* b)
+{
+    gint64 x = *(const gint64*)a;
+    gint64 y = *(const gint64*)b;
+
+    return (x > y) - (x < y);
+}
+
+void GetStageSummary(const AnalysisStats* pStats, AnalysisStage stage, StageSummary* pSummary)
+{
+    const StageStats* pStage = &pStats->stages[stage];
+    int nRecent = (int)MIN(pStage->nSamples, STAGE_STATS_SAMPLES);
+    gint64 sorted[STAGE_STATS_SAMPLES];
+
+    memset(pSummary, 0, sizeof(StageSummary));
+
+    if (!nRecent)
+        return;
+
+    // the percentile covers the recent frames, min, mean and max every frame since the reset
+    memcpy(sorted, pStage->samples, nRecent * sizeof(gint64));
+    qsort(sorted, nRecent, sizeof(gint64), CompareSamples);
+
+    pSummary->nSamples = pStage->nSamples;
+    pSummary->fMinUs = pStage->iMin / 1000.0;
+    pSummary->fMeanUs = (double)pStage->iTotal / pStage->nSamples / 1000.0;
+    pSummary->fP99Us = sorted[((nRecent - 1) * 99 + 50) / 100] / 1000.0;
+    pSummary->fMaxUs = pStage->iMax / 1000.0;
+}
+
+void ResetStats(AnalysisStats* pStats)
+{
+    memset(pStats, 0, sizeof(AnalysisStats));
+}
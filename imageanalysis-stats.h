@@ -0,0 +1,54 @@
+#pragma once
+
+#include <glib.h>
+
+// stages of a frame timed at their boundaries, the loops inside a stage are never instrumented
+typedef enum
+{
+	STAGE_ACCUMULATE,	// the pass over the frame
+	STAGE_NORMALIZE,	// scaling profiles and histograms to graph rows
+	STAGE_SCALE_GRAPH,	// resampling the histograms to the partition widths, part of STAGE_NORMALIZE
+	STAGE_BANDING,		// the spectra of the column profiles
+	STAGE_NOZZLE_CHECK,	// locating the lines of the nozzle check ladders
+	STAGE_DEFECTS,		// comparing the columns against their baselines
+	STAGE_OVERLAY,		// building and drawing the static overlay
+	STAGE_PLOT,			// drawing the graphs
+	STAGE_LABELS,		// rendering the partition values
+	STAGE_JSON,			// building the results the host emits
+	STAGE_FRAME,		// everything the host does with one frame
+	STAGE_LAST
+} AnalysisStage;
+
+// per frame times of a stage kept for the percentiles
+#define STAGE_STATS_SAMPLES 512
+
+typedef struct StageStats
+{
+	guint64		nSamples;
+	gint64		iMin;
+	gint64		iMax;
+	gint64		iTotal;
+	gint64		iStart;			// begin of the running measurement
+	gint64		iFrame;			// time spent in the stage during the current frame
+	gboolean	bRan;
+	gint64		samples[STAGE_STATS_SAMPLES];	// ring of the last per frame times, in ns
+} StageStats;
+
+typedef struct AnalysisStats
+{
+	StageStats	stages[STAGE_LAST];
+} AnalysisStats;
+
+typedef struct StageSummary
+{
+	guint64	nSamples;
+	double	fMinUs;
+	double	fMeanUs;
+	double	fP99Us;
+	double	fMaxUs;
+} StageSummary;
+
+gint64 StatsNowNs(void);
+const char* StageName(AnalysisStage stage);
+void GetStageSummary(const AnalysisStats* pStats, AnalysisStage stage, StageSummary* pSummary);
+void ResetStats(AnalysisStats* pStats);
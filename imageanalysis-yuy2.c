@@ -1,13 +1,17 @@
 #include "imageanalysis-yuy2.h"
 
+#include <string.h>
 
-#define ROW(pImage, width, y) &pImage[width * sizeof(YUY2PIXEL) * y]
-#define ROWCOL(pImage, width, x, y) &pImage[(width * sizeof(YUY2PIXEL) * y) + (x*sizeof(YUY2PIXEL))]
+
+#define ROW(pImage, stride, y) &pImage[(stride) * (y)]
+#define ROWCOL(pImage, stride, x, y) &pImage[((stride) * (y)) + (x*sizeof(YUY2PIXEL))]
 
 #define YUY2_BLACK ((YUY2PIXEL){0, 128})
 #define YUY2_WHITE ((YUY2PIXEL){255, 128})
 #define YUY2_RED_BLUE ((YUY2PIXEL){80, 255})
 
+#define KERNELS(pImageAnalysisYuy2) (GST_IMAGE_ANALYSIS(pImageAnalysisYuy2)->pKernels)
+
 static inline void AdjustMinMax(INTYUVPIXEL newMin, INTYUVPIXEL newMax, INTYUVPIXEL* min, INTYUVPIXEL* max)
 {
     if (newMax.luma > max->luma) max->luma = newMax.luma;
@@ -29,208 +33,184 @@ static void ComputeMinMax(INTYUVPIXEL* pValues, int iNumValues, INTYUVPIXEL* min
         AdjustMinMax(pValues[i], pValues[i], min, max);
 }
 
-static void NormalizeYUY2(INTYUY2PIXEL* iValue, int iOrigRange, int iMinOrig, int iNewRange, int iMinNew, GrayscaleType eGrayScaleType)
+// two equal pixels as one 32 bit Y0 U Y1 V macropixel
+static inline guint32 Yuy2MacroPixelValue(YUY2PIXEL color)
 {
-    iValue->luma = (int)NormalizeValue(iValue->luma, iOrigRange, iMinOrig, iNewRange, iMinNew);
-        
-    if (eGrayScaleType == GRAY_NONE)
-        iValue->chroma = (int)NormalizeValue(iValue->chroma, iOrigRange, iMinOrig, iNewRange, iMinNew);
+    YUY2PIXEL pair[2] = { color, color };
+    guint32 uValue;
+
+    memcpy(&uValue, pair, sizeof(uValue));
+    return uValue;
 }
 
-static void Normalize(ImageAnalysisYUY2* pImageAnalysisYuy2, int iOrigMin, int iOrigMax, int iRangeMin, int iRangeMax)
+// scales the columns of one AOI band to graph rows inside the band
+static void Normalize(ImageAnalysisYUY2* pImageAnalysisYuy2, const AoiBand* pBand, int iDivisor, int iOrigMin, int iOrigMax)
 {
-    ImageAnalysis* pImageAnalysis = GST_IMAGE_ANALYSIS(pImageAnalysisYuy2);
+    int iRangeMin = pBand->y;
+    int iRangeMax = pBand->y + pBand->height;
     int iNewRange = iRangeMin - iRangeMax;
 
-    for (guint i = 0; i < pImageAnalysis->opts.aoiPartitions; i++)
-    {
-        for (int j = 0; j < pImageAnalysisYuy2->piNumResults[i]; j++)
-            NormalizeYUY2(&pImageAnalysisYuy2->ppResults[i][j], iOrigMax - iOrigMin, iOrigMin, iNewRange, iRangeMax, pImageAnalysis->opts.grayscaleType);
-    }
+    // the accumulated values are kept for the results, the graph goes to pPlot,
+    // chroma is scaled too but only plotted without grayscale
+    KERNELS(pImageAnalysisYuy2)->plotRows((int*)&pImageAnalysisYuy2->pPlot[pBand->iFirstColumn], (const int*)&pImageAnalysisYuy2->pResults[pBand->iFirstColumn],
+        pBand->width * 2, iDivisor, iOrigMax - iOrigMin, iOrigMin, iNewRange, iRangeMax);
 }
 
-static void CheckAllocatedMemory(ImageAnalysisYUY2* pImageAnalysisYuy2)
+static void CheckAllocatedMemory(ImageAnalysisYUY2* pImageAnalysisYuy2, guint analyses)
 {
     ImageAnalysis* pImageAnalysis = GST_IMAGE_ANALYSIS(pImageAnalysisYuy2);
+    const AoiLayout* pLayout = &pImageAnalysis->aoi;
 
-    if (pImageAnalysis->iPrevPartitions != pImageAnalysis->opts.aoiPartitions)
+    // partitions start on a Y0 U Y1 V macropixel
+    if (BuildAoiLayout(pImageAnalysis, 2))
     {
-        if (pImageAnalysisYuy2->ppResults)
-        {
-            for (int i = 0; i < pImageAnalysis->iPrevPartitions; i++)
-                free(pImageAnalysisYuy2->ppResults[i]);
-
-            free(pImageAnalysisYuy2->ppResults);
-            free(pImageAnalysisYuy2->piNumResults);
-        }
-
-        pImageAnalysisYuy2->ppResults = calloc(pImageAnalysis->opts.aoiPartitions, sizeof(INTYUY2PIXEL*));
-        pImageAnalysisYuy2->piNumResults = calloc(pImageAnalysis->opts.aoiPartitions, sizeof(int));
-
-        for (guint i = 0; i < pImageAnalysis->opts.aoiPartitions; i++)
-        {
-            int xStart = (int)((float)pImageAnalysis->iImageWidth / pImageAnalysis->opts.aoiPartitions * i);
-            int xEnd = (int)((float)pImageAnalysis->iImageWidth / pImageAnalysis->opts.aoiPartitions * (i + 1));
-
-            // make multiple to 2
-            xStart = (xStart >> 1) << 1;
-            xEnd = (xEnd >> 1) << 1;
-
-            pImageAnalysisYuy2->piNumResults[i] = xEnd - xStart;
-            pImageAnalysisYuy2->ppResults[i] = calloc(pImageAnalysisYuy2->piNumResults[i], sizeof(INTYUY2PIXEL));
-        }
+        free(pImageAnalysisYuy2->pHistograms);
+        free(pImageAnalysisYuy2->pResults);
+        free(pImageAnalysisYuy2->pPlot);
+        free(pImageAnalysisYuy2->pPlotHistogram);
+        free(pImageAnalysisYuy2->pRowResults);
+        free(pImageAnalysisYuy2->pRowPlot);
+
+        pImageAnalysisYuy2->pHistograms = calloc(MAX(pLayout->nPartitions, 1) * (UCHAR_MAX + 1), sizeof(INTYUVPIXEL));
+        pImageAnalysisYuy2->pResults = calloc(MAX(pLayout->nColumns, 1), sizeof(INTYUY2PIXEL));
+        pImageAnalysisYuy2->pPlot = calloc(MAX(pLayout->nColumns, 1), sizeof(INTYUY2PIXEL));
+        pImageAnalysisYuy2->pPlotHistogram = calloc(MAX(pLayout->nColumns, 1), sizeof(INTYUVPIXEL));
+        pImageAnalysisYuy2->pRowResults = calloc(MAX(pLayout->nRows, 1), sizeof(INTYUVPIXEL));
+        pImageAnalysisYuy2->pRowPlot = calloc(MAX(pLayout->nRows, 1), sizeof(INTYUVPIXEL));
     }
 
-    for (guint i = 0; i < pImageAnalysis->opts.aoiPartitions; i++)
-        memset(pImageAnalysisYuy2->ppResults[i], 0, pImageAnalysisYuy2->piNumResults[i] * sizeof(INTYUY2PIXEL));
+    if (analyses & ANALYSIS_COLUMNS)
+        memset(pImageAnalysisYuy2->pResults, 0, pLayout->nColumns * sizeof(INTYUY2PIXEL));
+
+    if (analyses & ANALYSIS_HISTOGRAM)
+        memset(pImageAnalysisYuy2->pHistograms, 0, pLayout->nPartitions * (UCHAR_MAX + 1) * sizeof(INTYUVPIXEL));
 
-    pImageAnalysis->iPrevPartitions = pImageAnalysis->opts.aoiPartitions;
+    if (analyses & ANALYSIS_ROW_PROFILE)
+        memset(pImageAnalysisYuy2->pRowResults, 0, pLayout->nRows * sizeof(INTYUVPIXEL));
 }
 
-static void DrawLine(guint8* pImage, int iImageWidth, int x0, int y0, int x1, int y1, YUY2PIXEL color)
+// writes the spans of every column in a single left to right pass, later channels are drawn over earlier ones
+static void FillPlotSpans(ImageAnalysisYUY2* pImageAnalysisYuy2, guint8* pImage, const YUY2PIXEL* pColors, int nChannels)
 {
-    int dx = abs(x1 - x0);
-    int dy = abs(y1 - y0);
-    int sx = (x0 < x1) ? 2 : -2;
-    int sy = (y0 < y1) ? 1 : -1;
-    int err = dx - dy;
+    ImageAnalysis* pImageAnalysis = GST_IMAGE_ANALYSIS(pImageAnalysisYuy2);
+    const int* piRowOffset = pImageAnalysis->graph.piRowOffset;
+    const AoiLayout* pLayout = &pImageAnalysis->aoi;
 
-    while (1)
+    for (int b = 0; b < pLayout->nBands; b++)
     {
-        // Set the current pixel to red
-        YUY2PIXEL* pixel = (YUY2PIXEL*)(ROWCOL(pImage, iImageWidth, x0, y0));
-        *pixel = color;
+        const AoiBand* pBand = &pLayout->pBands[b];
 
-        // Check if we've reached the end point
-        if (x0 >= x1 && y0 == y1) break;
-
-        int e2 = 2 * err;
-
-        if (e2 > -dy)
+        for (int x = 0; x < pBand->width; x++)
         {
-            err -= dy;
-            x0 += sx;
-        }
+            guint8* pColumn = pImage + (pBand->x + x) * sizeof(YUY2PIXEL);
+            const PlotSpan* pSpans = &pImageAnalysis->graph.pSpans[(pBand->iFirstColumn + x) * PLOT_MAX_CHANNELS];
 
-        if (e2 < dx)
-        {
-            err += dx;
-            y0 += sy;
+            for (int c = 0; c < nChannels; c++)
+            {
+                for (int y = pSpans[c].y0; y <= pSpans[c].y1; y++)
+                    *(YUY2PIXEL*)(pColumn + piRowOffset[y]) = pColors[c];
+            }
         }
     }
 }
 
-static void PlotValues(ImageAnalysisYUY2* pImageAnalysisYuy2, guint8* pImage)
+// writes the runs of every sampled AOI row, later channels are drawn over earlier ones
+static void FillRowSpans(ImageAnalysisYUY2* pImageAnalysisYuy2, guint8* pImage, const YUY2PIXEL* pColors, int nChannels)
 {
     ImageAnalysis* pImageAnalysis = GST_IMAGE_ANALYSIS(pImageAnalysisYuy2);
+    const AoiLayout* pLayout = &pImageAnalysis->aoi;
+    int iRowStep = pImageAnalysis->results.iRowStep;
 
-    for (guint i = 0; i < pImageAnalysis->opts.aoiPartitions; i++)
+    for (int b = 0; b < pLayout->nBands; b++)
     {
-        int xStart = (int)((float)pImageAnalysis->iImageWidth / pImageAnalysis->opts.aoiPartitions * i);
-        xStart = (xStart >> 1) << 1;
+        const AoiBand* pBand = &pLayout->pBands[b];
 
-        for (int j = 0; j < pImageAnalysisYuy2->piNumResults[i]; j++)
-        {
-            ((YUY2PIXEL*)ROW((pImage), pImageAnalysis->iImageWidth, pImageAnalysisYuy2->ppResults[i][j].luma))[j + xStart] = YUY2_WHITE;
+        if (!pBand->width)
+            continue;
 
-            if (pImageAnalysis->opts.grayscaleType == GRAY_NONE)
-                ((YUY2PIXEL*)ROW((pImage), pImageAnalysis->iImageWidth, pImageAnalysisYuy2->ppResults[i][j].chroma))[j + xStart] = YUY2_RED_BLUE;
+        for (int j = 0; j < pBand->iRows; j++)
+        {
+            YUY2PIXEL* pRow = (YUY2PIXEL*)ROW(pImage, pImageAnalysis->iStride, (pBand->y + j * iRowStep));
+            const RowSpan* pSpans = &pImageAnalysis->graph.pRowSpans[(pBand->iFirstRow + j) * PLOT_MAX_CHANNELS];
 
-            if (pImageAnalysis->opts.connectValues)
+            for (int c = 0; c < nChannels; c++)
             {
-                if (j > 0)
-                    DrawLine(pImage + xStart * sizeof(YUY2PIXEL), pImageAnalysis->iImageWidth, j - 1, pImageAnalysisYuy2->ppResults[i][j - 1].luma, j, pImageAnalysisYuy2->ppResults[i][j].luma, YUY2_WHITE);
-
-                if (j > 1 && pImageAnalysis->opts.grayscaleType == GRAY_NONE)
-                    DrawLine(pImage + xStart * sizeof(YUY2PIXEL), pImageAnalysis->iImageWidth, j - 2, pImageAnalysisYuy2->ppResults[i][j - 2].chroma, j, pImageAnalysisYuy2->ppResults[i][j].chroma, YUY2_RED_BLUE);
+                for (int x = pSpans[c].x0; x <= pSpans[c].x1; x++)
+                    pRow[x] = pColors[c];
             }
         }
     }
 }
 
-static void PlotValuesYUV(ImageAnalysisYUY2* pImageAnalysisYuy2, guint8* pImage)
+// the mean of every row across the band, as a column inside the band, chroma is only
+// plotted without grayscale
+static void PlotRowProfiles(ImageAnalysisYUY2* pImageAnalysisYuy2, guint8* pImage)
 {
+    const YUY2PIXEL colors[] = { YUY2_WHITE, YUY2_RED_BLUE, YUY2_RED_BLUE };
     ImageAnalysis* pImageAnalysis = GST_IMAGE_ANALYSIS(pImageAnalysisYuy2);
+    const AoiLayout* pLayout = &pImageAnalysis->aoi;
+    int nChannels = (pImageAnalysis->opts.grayscaleType == GRAY_NONE) ? 3 : 1;
 
-    for (guint i = 0; i < pImageAnalysis->opts.aoiPartitions; i++)
+    for (int b = 0; b < pLayout->nBands; b++)
     {
-        int xStart = (int)((float)pImageAnalysis->iImageWidth / pImageAnalysis->opts.aoiPartitions * i);
-        xStart = (xStart >> 1) << 1;
+        const AoiBand* pBand = &pLayout->pBands[b];
 
-        for (int j = 0; j < pImageAnalysisYuy2->piNumHistogramResults[i]; j++)
-        {
-            ((YUY2PIXEL*)ROW((pImage), pImageAnalysis->iImageWidth, pImageAnalysisYuy2->ppHistogram[i][j].luma))[j + xStart] = YUY2_WHITE;
+        if (!pBand->width)
+            continue;
 
-            if (pImageAnalysis->opts.grayscaleType == GRAY_NONE)
-            {
-                ((YUY2PIXEL*)ROW((pImage), pImageAnalysis->iImageWidth, pImageAnalysisYuy2->ppHistogram[i][j].Cr))[j + xStart] = YUY2_RED_BLUE;
-                ((YUY2PIXEL*)ROW((pImage), pImageAnalysis->iImageWidth, pImageAnalysisYuy2->ppHistogram[i][j].Cb))[j + xStart] = YUY2_RED_BLUE;
-            }
-
-            if (pImageAnalysis->opts.connectValues && j > 0)
-            {
-                DrawLine(pImage + xStart * sizeof(YUY2PIXEL), pImageAnalysis->iImageWidth, j - 1, pImageAnalysisYuy2->ppHistogram[i][j - 1].luma, j, pImageAnalysisYuy2->ppHistogram[i][j].luma, YUY2_WHITE);
+        // every pixel has a luma sample, every second one a Cr and a Cb sample
+        for (int j = pBand->iFirstRow; j < pBand->iFirstRow + pBand->iRows; j++)
+        {
+            const INTYUVPIXEL* pRow = &pImageAnalysisYuy2->pRowResults[j];
+            INTYUVPIXEL* pPlot = &pImageAnalysisYuy2->pRowPlot[j];
 
-                if (pImageAnalysis->opts.grayscaleType == GRAY_NONE)
-                {
-                    DrawLine(pImage + xStart * sizeof(YUY2PIXEL), pImageAnalysis->iImageWidth, j - 1, pImageAnalysisYuy2->ppHistogram[i][j - 1].Cr, j, pImageAnalysisYuy2->ppHistogram[i][j].Cr, YUY2_RED_BLUE);
-                    DrawLine(pImage + xStart * sizeof(YUY2PIXEL), pImageAnalysis->iImageWidth, j - 1, pImageAnalysisYuy2->ppHistogram[i][j - 1].Cb, j, pImageAnalysisYuy2->ppHistogram[i][j].Cb, YUY2_RED_BLUE);
-                }
-            }
+            pPlot->luma = (int)NormalizeValue(pRow->luma / pBand->width, UCHAR_MAX, 0, pBand->width - 1, pBand->x);
+            pPlot->Cr = (int)NormalizeValue(pRow->Cr / (pBand->width / 2), UCHAR_MAX, 0, pBand->width - 1, pBand->x);
+            pPlot->Cb = (int)NormalizeValue(pRow->Cb / (pBand->width / 2), UCHAR_MAX, 0, pBand->width - 1, pBand->x);
         }
+
+        for (int c = 0; c < nChannels; c++)
+            BuildRowSpans(pImageAnalysis, (const int*)pImageAnalysisYuy2->pRowPlot, 3, c, pBand->iFirstRow, pBand->iRows);
     }
+
+    FillRowSpans(pImageAnalysisYuy2, pImage, colors, nChannels);
 }
 
-static void GrayScale(ImageAnalysisYUY2* pImageAnalysisYuy2, guint8* pImage)
+static void PlotValues(ImageAnalysisYUY2* pImageAnalysisYuy2, guint8* pImage)
 {
+    const YUY2PIXEL colors[] = { YUY2_WHITE, YUY2_RED_BLUE };
     ImageAnalysis* pImageAnalysis = GST_IMAGE_ANALYSIS(pImageAnalysisYuy2);
+    const int* piXStart = pImageAnalysis->aoi.piXStart;
+    int nChannels = (pImageAnalysis->opts.grayscaleType == GRAY_NONE) ? 2 : 1;
 
-    if (pImageAnalysis->opts.grayscaleType == GRAY_ALL)
-    {
-        int iNumPixels = pImageAnalysis->iImageWidth * pImageAnalysis->iImageHeight;
-
-        for (int i = 0; i < iNumPixels; i++)
-            ((YUY2PIXEL*)pImage)[i].chroma = 128;
-    }
-    else if (pImageAnalysis->opts.grayscaleType == GRAY_AOI)
+    for (int i = 0; i < pImageAnalysis->aoi.nPartitions; i++)
     {
-        int iAoiMinY = (pImageAnalysis->iImageHeight - pImageAnalysis->opts.aoiHeight) / 2;
-        int iAoiMaxY = iAoiMinY + pImageAnalysis->opts.aoiHeight;
+        int xStart = piXStart[i];
 
-        for (int y = iAoiMinY; y < iAoiMaxY; y++)
-        {
-            YUY2PIXEL* pYUV = (YUY2PIXEL*)ROW(pImage, pImageAnalysis->iImageWidth, y);
+        BuildPlotSpans(pImageAnalysis, (const int*)pImageAnalysisYuy2->pPlot, 2, 0, 1, xStart, piXStart[i + 1] - xStart);
 
-            for (int x = 0; x < pImageAnalysis->iImageWidth; x++)
-                pYUV[x].chroma = 128;
-        }
+        // u and v alternate, so the chroma graph joins every second column
+        if (nChannels > 1)
+            BuildPlotSpans(pImageAnalysis, (const int*)pImageAnalysisYuy2->pPlot, 2, 1, 2, xStart, piXStart[i + 1] - xStart);
     }
+
+    FillPlotSpans(pImageAnalysisYuy2, pImage, colors, nChannels);
 }
 
-static void Blackout(ImageAnalysisYUY2* pImageAnalysisYuy2, guint8* pImage)
+static void PlotValuesYUV(ImageAnalysisYUY2* pImageAnalysisYuy2, guint8* pImage)
 {
+    const YUY2PIXEL colors[] = { YUY2_WHITE, YUY2_RED_BLUE, YUY2_RED_BLUE };
     ImageAnalysis* pImageAnalysis = GST_IMAGE_ANALYSIS(pImageAnalysisYuy2);
+    const int* piXStart = pImageAnalysis->aoi.piXStart;
+    int nChannels = (pImageAnalysis->opts.grayscaleType == GRAY_NONE) ? 3 : 1;
 
-    if (pImageAnalysis->opts.blackoutType == BLACK_ALL)
+    for (int i = 0; i < pImageAnalysis->aoi.nPartitions; i++)
     {
-        int iNumPixels = pImageAnalysis->iImageWidth * pImageAnalysis->iImageHeight;
-
-        for (int i = 0; i < iNumPixels; i++)
-            ((YUY2PIXEL*)pImage)[i] = YUY2_BLACK;
+        for (int c = 0; c < nChannels; c++)
+            BuildPlotSpans(pImageAnalysis, (const int*)pImageAnalysisYuy2->pPlotHistogram, 3, c, 1, piXStart[i], piXStart[i + 1] - piXStart[i]);
     }
-    else if (pImageAnalysis->opts.blackoutType == BLACK_AOI)
-    {
-        int iAoiMinY = (pImageAnalysis->iImageHeight - pImageAnalysis->opts.aoiHeight) / 2;
-        int iAoiMaxY = iAoiMinY + pImageAnalysis->opts.aoiHeight;
 
-        for (int y = iAoiMinY; y < iAoiMaxY; y++)
-        {
-            YUY2PIXEL* pYUV = (YUY2PIXEL*)ROW(pImage, pImageAnalysis->iImageWidth, y);
-
-            for (int x = 0; x < pImageAnalysis->iImageWidth; x++)
-                pYUV[x] = YUY2_BLACK;
-        }
-    }
+    FillPlotSpans(pImageAnalysisYuy2, pImage, colors, nChannels);
 }
 
 static void ScaleGraph(const INTYUVPIXEL* input, int inSize, INTYUVPIXEL* output, int outSize)
@@ -253,188 +233,218 @@ static void ScaleGraph(const INTYUVPIXEL* input, int inSize, INTYUVPIXEL* output
     }
 }
 
-static void DrawAOI(ImageAnalysisYUY2* pImageAnalysisYuy2, guint8* pImage)
+static void BuildAOIOverlay(ImageAnalysisYUY2* pImageAnalysisYuy2)
 {
     ImageAnalysis* pImageAnalysis = GST_IMAGE_ANALYSIS(pImageAnalysisYuy2);
-    int iAoiMinY = (pImageAnalysis->iImageHeight - pImageAnalysis->opts.aoiHeight) / 2;
-    int iAoiMaxY = iAoiMinY + pImageAnalysis->opts.aoiHeight;
-    YUY2PIXEL* pYuv;
-    YUY2PIXEL aoiColor;
+    const AoiLayout* pLayout = &pImageAnalysis->aoi;
+    guint32 uAoiColor;
+
+    // rows follow each other, so grayscale and blackout of the whole frame are single runs
+    if (pImageAnalysis->opts.grayscaleType == GRAY_ALL)
+        AddOverlayRun(pImageAnalysis, OVERLAY_CHROMA, 0, pImageAnalysis->iRowPixels * pImageAnalysis->iImageHeight, 128);
+    else if (pImageAnalysis->opts.grayscaleType == GRAY_AOI)
+    {
+        for (int b = 0; b < pLayout->nBands; b++)
+            AddOverlayRect(pImageAnalysis, OVERLAY_CHROMA, pLayout->pBands[b].x, pLayout->pBands[b].y, pLayout->pBands[b].width, pLayout->pBands[b].height, 128);
+    }
 
     if (pImageAnalysis->opts.blackoutType == BLACK_NONE)
     {
-        aoiColor = YUY2_BLACK;
+        uAoiColor = Yuy2MacroPixelValue(YUY2_BLACK);
     }
     else
     {
-        Blackout(pImageAnalysisYuy2, pImage);
-        aoiColor = YUY2_WHITE;
-    }
-
-    // Draw the bottom line of our area of interest
-    pYuv = (YUY2PIXEL*)ROW(pImage, pImageAnalysis->iImageWidth, iAoiMinY);
+        if (pImageAnalysis->opts.blackoutType == BLACK_ALL)
+            AddOverlayRun(pImageAnalysis, OVERLAY_FILL, 0, pImageAnalysis->iRowPixels * pImageAnalysis->iImageHeight, Yuy2MacroPixelValue(YUY2_BLACK));
+        else if (pImageAnalysis->opts.blackoutType == BLACK_AOI)
+        {
+            for (int b = 0; b < pLayout->nBands; b++)
+                AddOverlayRect(pImageAnalysis, OVERLAY_FILL, pLayout->pBands[b].x, pLayout->pBands[b].y, pLayout->pBands[b].width, pLayout->pBands[b].height, Yuy2MacroPixelValue(YUY2_BLACK));
+        }
 
-    for (int x = 0; x < pImageAnalysis->iImageWidth; x++)
-        pYuv[x] = aoiColor;
+        uAoiColor = Yuy2MacroPixelValue(YUY2_WHITE);
+    }
 
-    // Draw the top line of our area of interest
-    pYuv = (YUY2PIXEL*)ROW(pImage, pImageAnalysis->iImageWidth, iAoiMaxY);
+    // the bottom and top line of our areas of interest and the partition lines
+    for (int b = 0; b < pLayout->nBands; b++)
+        AddAoiBandOutline(pImageAnalysis, &pLayout->pBands[b], uAoiColor);
+}
 
-    for (int x = 0; x < pImageAnalysis->iImageWidth; x++)
-        pYuv[x] = aoiColor;
+static void BuildPartitionsOverlay(ImageAnalysis* pImageAnalysis)
+{
+    guint32 uColor = Yuy2MacroPixelValue(YUY2_BLACK);
 
-    // draw the partition lines
-    for (guint i = 1; i < pImageAnalysis->opts.aoiPartitions; i++)
+    for (int i = 0; i < pImageAnalysis->nPartitions; i++)
     {
-        int x = (int)((float)pImageAnalysis->iImageWidth / pImageAnalysis->opts.aoiPartitions * i);
-        x = (x >> 1) << 1;
-
-        for (int y = iAoiMinY; y < iAoiMaxY; y++)
-            ((YUY2PIXEL*)ROW(pImage, pImageAnalysis->iImageWidth, y))[x] = aoiColor;
+        PrintPartition* pPartition = &pImageAnalysis->pPartitions[i];
+        int x0 = pPartition->centerX - pPartition->width / 2;
+        int y0 = pPartition->centerY - pPartition->height / 2;
+
+        AddOverlayRow(pImageAnalysis, OVERLAY_FILL, x0, y0, pPartition->width, uColor);
+        AddOverlayRow(pImageAnalysis, OVERLAY_FILL, x0, y0 + pPartition->height, pPartition->width, uColor);
+        AddOverlayColumn(pImageAnalysis, OVERLAY_FILL, x0, y0, pPartition->height, uColor);
+        AddOverlayColumn(pImageAnalysis, OVERLAY_FILL, x0 + pPartition->width, y0, pPartition->height, uColor);
     }
 }
 
-static void CheckAllocatedMemoryHistogram(ImageAnalysisYUY2* pImageAnalysisYuy2)
+static void BuildOverlay(ImageAnalysisYUY2* pImageAnalysisYuy2, guint analyses)
 {
     ImageAnalysis* pImageAnalysis = GST_IMAGE_ANALYSIS(pImageAnalysisYuy2);
-    
-    if (pImageAnalysisYuy2->iPrevHistPartitions != pImageAnalysis->opts.aoiPartitions)
-    {
-        if (pImageAnalysisYuy2->ppHistogram)
-        {
-            for (int i = 0; i < pImageAnalysis->iPrevPartitions; i++)
-                free(pImageAnalysisYuy2->ppHistogram[i]);
-
-            free(pImageAnalysisYuy2->ppHistogram);
-            free(pImageAnalysisYuy2->piNumHistogramResults);
-        }
 
-        pImageAnalysisYuy2->ppHistogram = calloc(pImageAnalysis->opts.aoiPartitions, sizeof(INTYUVPIXEL*));
-        pImageAnalysisYuy2->piNumHistogramResults = calloc(pImageAnalysis->opts.aoiPartitions, sizeof(int));
+    ResetOverlay(pImageAnalysis);
 
-        for (guint i = 0; i < pImageAnalysis->opts.aoiPartitions; i++)
-        {
-            int xStart = (int)((float)pImageAnalysis->iImageWidth / pImageAnalysis->opts.aoiPartitions * i);
-            int xEnd = (int)((float)pImageAnalysis->iImageWidth / pImageAnalysis->opts.aoiPartitions * (i + 1));
-
-            // make multiple to 2
-            xStart = (xStart >> 1) << 1;
-            xEnd = (xEnd >> 1) << 1;
-
-            pImageAnalysisYuy2->piNumHistogramResults[i] = xEnd - xStart;
-            pImageAnalysisYuy2->ppHistogram[i] = calloc(pImageAnalysisYuy2->piNumHistogramResults[i], sizeof(INTYUVPIXEL));
-        }
-    }
+    if (analyses & ANALYSIS_AOI)
+        BuildAOIOverlay(pImageAnalysisYuy2);
 
-    for (guint i = 0; i < pImageAnalysis->opts.aoiPartitions; i++)
-        memset(pImageAnalysisYuy2->ppHistogram[i], 0, pImageAnalysisYuy2->piNumHistogramResults[i] * sizeof(INTYUVPIXEL));
+    pImageAnalysis->overlay.nBaseSpans = pImageAnalysis->overlay.nSpans;
 
-    pImageAnalysisYuy2->iPrevHistPartitions = pImageAnalysis->opts.aoiPartitions;
+    if (analyses & ANALYSIS_TOTAL)
+        BuildPartitionsOverlay(pImageAnalysis);
 }
 
-static void ComputeIntensityActual(ImageAnalysisYUY2* pImageAnalysisYuy2, guint8* pImage, int iAoiMinY, int iAoiMaxY)
+static void DrawOverlay(ImageAnalysisYUY2* pImageAnalysisYuy2, guint8* pImage, int iFirst, int iLast)
 {
-    ImageAnalysis* pImageAnalysis = GST_IMAGE_ANALYSIS(pImageAnalysisYuy2);
-    YUY2PIXEL* pYUV = NULL;
+    OverlaySpan* pSpans = GST_IMAGE_ANALYSIS(pImageAnalysisYuy2)->overlay.pSpans;
 
-    for (int y = iAoiMinY; y < iAoiMaxY; y++)
+    for (int i = iFirst; i < iLast; i++)
     {
-        pYUV = (YUY2PIXEL*)ROW(pImage, pImageAnalysis->iImageWidth, y);
+        guint8* pStart = pImage + pSpans[i].iOffset * sizeof(YUY2PIXEL);
 
-        for (guint i = 0; i < pImageAnalysis->opts.aoiPartitions; i++)
+        if (pSpans[i].op == OVERLAY_CHROMA)
         {
-            int xStart = (int)((float)pImageAnalysis->iImageWidth / pImageAnalysis->opts.aoiPartitions * i);
-
-            for (int j = 0; j < pImageAnalysisYuy2->piNumResults[i]; j++)
-            {
-                pImageAnalysisYuy2->ppResults[i][j].luma += pYUV[j + xStart].luma;
-                pImageAnalysisYuy2->ppResults[i][j].chroma += pYUV[j + xStart].chroma;
-            }
+            KERNELS(pImageAnalysisYuy2)->setChroma(pStart, (guint8)pSpans[i].uValue, pSpans[i].nPixels);
+        }
+        else if (!(pSpans[i].iOffset & 1) && !(pSpans[i].nPixels & 1))
+        {
+            // whole macropixels
+            KERNELS(pImageAnalysisYuy2)->fill32(pStart, pSpans[i].uValue, pSpans[i].nPixels / 2);
+        }
+        else
+        {
+            for (int x = 0; x < pSpans[i].nPixels; x++)
+                memcpy(pStart + x * sizeof(YUY2PIXEL), &pSpans[i].uValue, sizeof(YUY2PIXEL));
         }
     }
 }
-    
-static void ComputeIntensity(ImageAnalysisYUY2* pImageAnalysisYuy2, guint8* pImage)
+
+// accumulators consume nColumns columns of the AOI row iRow from iColumn on, all in partition iPartition,
+// pYUV points to the pixel of iColumn, iColumn and nColumns are always even so segments start on
+// a Y0 U Y1 V macropixel
+typedef void (*AccumulateFunc) (ImageAnalysisYUY2* pImageAnalysisYuy2, const YUY2PIXEL* pYUV, int iPartition, int iColumn, int nColumns, int iRow);
+
+static void AccumulateColumns(ImageAnalysisYUY2* pImageAnalysisYuy2, const YUY2PIXEL* pYUV, int iPartition, int iColumn, int nColumns, int iRow)
 {
-    ImageAnalysis* pImageAnalysis = GST_IMAGE_ANALYSIS(pImageAnalysisYuy2);
-    int iAoiMinY = (pImageAnalysis->iImageHeight - pImageAnalysis->opts.aoiHeight) / 2;
-    int iAoiMaxY = iAoiMinY + pImageAnalysis->opts.aoiHeight;
-
-    CheckAllocatedMemory(pImageAnalysisYuy2);
-    ComputeIntensityActual(pImageAnalysisYuy2, pImage, iAoiMinY, iAoiMaxY);
-    GrayScale(pImageAnalysisYuy2, pImage);
-    DrawAOI(pImageAnalysisYuy2, pImage);
-    Normalize(pImageAnalysisYuy2, 0, (UCHAR_MAX) * pImageAnalysis->opts.aoiHeight, iAoiMinY, iAoiMaxY);
-    PlotValues(pImageAnalysisYuy2, pImage);
+    // luma and chroma bytes map one to one onto the int pairs
+    KERNELS(pImageAnalysisYuy2)->accumulateBytes((int*)&pImageAnalysisYuy2->pResults[iColumn], (const guint8*)pYUV, nColumns * 2);
 }
 
-static void ComputeAverageActual(ImageAnalysisYUY2* pImageAnalysisYuy2, guint8* pImage, int iAoiMinY, int iAoiMaxY)
+static void AccumulateHistogram(ImageAnalysisYUY2* pImageAnalysisYuy2, const YUY2PIXEL* pYUV, int iPartition, int iColumn, int nColumns, int iRow)
 {
-    ImageAnalysis* pImageAnalysis = GST_IMAGE_ANALYSIS(pImageAnalysisYuy2);
-    int iNumValues = iAoiMaxY - iAoiMinY;
-
-    ComputeIntensityActual(pImageAnalysisYuy2, pImage, iAoiMinY, iAoiMaxY);
+    INTYUVPIXEL* pHistogram = &pImageAnalysisYuy2->pHistograms[iPartition * (UCHAR_MAX + 1)];
 
-    for (guint i = 0; i < pImageAnalysis->opts.aoiPartitions; i++)
-    {
-        for (int j = 0; j < pImageAnalysisYuy2->piNumResults[i]; j++)
-        {
-            pImageAnalysisYuy2->ppResults[i][j].luma      /= iNumValues;
-            pImageAnalysisYuy2->ppResults[i][j].chroma    /= iNumValues;
-        }
-    }
+    KERNELS(pImageAnalysisYuy2)->histogramYUY2((int*)pHistogram, (const guint8*)pYUV, nColumns);
 }
 
-static void ComputeAverage(ImageAnalysisYUY2* pImageAnalysisYuy2, guint8* pImage)
+static void AccumulateRow(ImageAnalysisYUY2* pImageAnalysisYuy2, const YUY2PIXEL* pYUV, int iPartition, int iColumn, int nColumns, int iRow)
 {
-    ImageAnalysis* pImageAnalysis = GST_IMAGE_ANALYSIS(pImageAnalysisYuy2);
-    int iAoiMinY = (pImageAnalysis->iImageHeight - pImageAnalysis->opts.aoiHeight) / 2;
-    int iAoiMaxY = iAoiMinY + pImageAnalysis->opts.aoiHeight;
-
-    CheckAllocatedMemory(pImageAnalysisYuy2);
-    ComputeAverageActual(pImageAnalysisYuy2, pImage, iAoiMinY, iAoiMaxY);
-    GrayScale(pImageAnalysisYuy2, pImage);
-    DrawAOI(pImageAnalysisYuy2, pImage);
-    Normalize(pImageAnalysisYuy2, 0, UCHAR_MAX, iAoiMinY, iAoiMaxY);
-    PlotValues(pImageAnalysisYuy2, pImage);
+    INTYUVPIXEL* pRow = &pImageAnalysisYuy2->pRowResults[iRow];
+    int sums[4] = { 0 };
+
+    // y0 u y1 v, one macropixel per two columns
+    KERNELS(pImageAnalysisYuy2)->sumBytes4(sums, (const guint8*)pYUV, nColumns / 2);
+
+    pRow->luma += sums[0] + sums[2];
+    pRow->Cr += sums[1];
+    pRow->Cb += sums[3];
 }
 
-static void ComputeHistogram(ImageAnalysisYUY2* pImageAnalysisYuy2, guint8* pImage)
+typedef struct AccumulatorYUY2
 {
-    ImageAnalysis* pImageAnalysis = GST_IMAGE_ANALYSIS(pImageAnalysisYuy2);
-    YUY2PIXEL* pYUV = NULL;
-    int iAoiMinY = (pImageAnalysis->iImageHeight - pImageAnalysis->opts.aoiHeight) / 2;
-    int iAoiMaxY = iAoiMinY + pImageAnalysis->opts.aoiHeight;
+    guint           analyses;   // analyses fed by this accumulator
+    AccumulateFunc  accumulate;
+} AccumulatorYUY2;
 
-    CheckAllocatedMemoryHistogram(pImageAnalysisYuy2);
+static const AccumulatorYUY2 accumulators[] =
+{
+    { ANALYSIS_COLUMNS,                     AccumulateColumns },
+    { ANALYSIS_HISTOGRAM,                   AccumulateHistogram },
+    { ANALYSIS_ROW_PROFILE,                 AccumulateRow },
+};
 
-    for (guint i = 0; i < pImageAnalysis->opts.aoiPartitions; i++)
+static void AccumulateBandRows(ImageAnalysisYUY2* pImageAnalysisYuy2, guint8* pImage, const AoiBand* pBand, int yStart, int yEnd,
+    const AccumulateFunc* pfnActive, int nActive)
+{
+    ImageAnalysis* pImageAnalysis = GST_IMAGE_ANALYSIS(pImageAnalysisYuy2);
+    const int* piXStart = pImageAnalysis->aoi.piXStart;
+    int iLast = pBand->iFirstPartition + pBand->nPartitions;
+    int iEndColumn = pBand->iFirstColumn + pBand->width;
+    int iBlockColumns = ACCUMULATOR_BLOCK_BYTES / sizeof(INTYUY2PIXEL);
+    int iFirst = pBand->iFirstPartition;
+    int iRowStep = QualityRowStep(pImageAnalysis->quality);
+    int yFirst = FirstSampledRow(yStart, pBand->y, iRowStep);
+
+    // the partitions are contiguous, so accumulate the rows one cache sized block
+    // of columns at a time before moving to the next block, handing every row
+    // segment to all the requested accumulators while it is in cache
+    for (int x0 = pBand->iFirstColumn; x0 < iEndColumn; x0 += iBlockColumns)
     {
-        int xStart = (int)((float)pImageAnalysis->iImageWidth / pImageAnalysis->opts.aoiPartitions * i);
-        int xEnd = (int)((float)pImageAnalysis->iImageWidth / pImageAnalysis->opts.aoiPartitions * (i + 1));
+        int x1 = MIN(x0 + iBlockColumns, iEndColumn);
 
-        // make multiple to 2
-        xStart = (xStart >> 1) << 1;
-        xEnd = (xEnd >> 1) << 1;
+        while (piXStart[iFirst + 1] <= x0)
+            iFirst++;
 
-        memset(pImageAnalysisYuy2->piHistogram, 0, (UCHAR_MAX+1) * sizeof(INTYUVPIXEL));
-
-        for (int y = iAoiMinY; y < iAoiMaxY; y++)
+        for (int y = yFirst; y < yEnd; y += iRowStep)
         {
-            pYUV = (YUY2PIXEL*)ROW(pImage, pImageAnalysis->iImageWidth, y);
+            YUY2PIXEL* pYUV = (YUY2PIXEL*)ROW(pImage, pImageAnalysis->iStride, y) + pBand->x - pBand->iFirstColumn;
+            int iRow = pBand->iFirstRow + (y - pBand->y) / iRowStep;
 
-            for (int x = xStart; x < xEnd; x += 2)
+            for (int i = iFirst; i < iLast && piXStart[i] < x1; i++)
             {
-                pImageAnalysisYuy2->piHistogram[pYUV[x].luma].luma += 1;
-                pImageAnalysisYuy2->piHistogram[pYUV[x].chroma].Cr += 1;
-            }
+                int xa = MAX(x0, piXStart[i]);
+                int xb = MIN(x1, piXStart[i + 1]);
 
-            for (int x = xStart + 1; x < xEnd; x += 2)
-            {
-                pImageAnalysisYuy2->piHistogram[pYUV[x].luma].luma += 1;
-                pImageAnalysisYuy2->piHistogram[pYUV[x].chroma].Cb += 1;
+                for (int a = 0; a < nActive; a++)
+                    pfnActive[a](pImageAnalysisYuy2, &pYUV[xa], i, xa, xb - xa, iRow);
             }
         }
+    }
+}
+
+// feeds the rows [yStart, yEnd) of every AOI band covering them to the accumulators
+static void AccumulateAOIRows(ImageAnalysisYUY2* pImageAnalysisYuy2, guint8* pImage, int yStart, int yEnd, guint analyses)
+{
+    const AoiLayout* pLayout = &GST_IMAGE_ANALYSIS(pImageAnalysisYuy2)->aoi;
+    AccumulateFunc pfnActive[G_N_ELEMENTS(accumulators)];
+    int nActive = 0;
+
+    for (int a = 0; a < G_N_ELEMENTS(accumulators); a++)
+    {
+        if (accumulators[a].analyses & analyses)
+            pfnActive[nActive++] = accumulators[a].accumulate;
+    }
+
+    for (int b = 0; b < pLayout->nBands; b++)
+    {
+        const AoiBand* pBand = &pLayout->pBands[b];
+        int y0 = MAX(yStart, pBand->y);
+        int y1 = MIN(yEnd, pBand->y + pBand->height);
+
+        if (y0 < y1)
+            AccumulateBandRows(pImageAnalysisYuy2, pImage, pBand, y0, y1, pfnActive, nActive);
+    }
+}
+
+static void NormalizeHistograms(ImageAnalysisYUY2* pImageAnalysisYuy2, const AoiBand* pBand)
+{
+    ImageAnalysis* pImageAnalysis = GST_IMAGE_ANALYSIS(pImageAnalysisYuy2);
+    const int* piXStart = pImageAnalysis->aoi.piXStart;
+    int iAoiMinY = pBand->y;
+    int iAoiMaxY = pBand->y + pBand->height;
+
+    for (int i = pBand->iFirstPartition; i < pBand->iFirstPartition + pBand->nPartitions; i++)
+    {
+        // normalize a copy, the counts are kept for the results
+        memcpy(pImageAnalysisYuy2->piHistogram, &pImageAnalysisYuy2->pHistograms[i * (UCHAR_MAX + 1)], (UCHAR_MAX + 1) * sizeof(INTYUVPIXEL));
 
         INTYUVPIXEL min, max;
         ComputeMinMax(pImageAnalysisYuy2->piHistogram, UCHAR_MAX+1, &min, &max);
@@ -447,79 +457,139 @@ static void ComputeHistogram(ImageAnalysisYUY2* pImageAnalysisYuy2, guint8* pIma
             pImageAnalysisYuy2->piHistogram[j].Cb = (int)NormalizeValue(pImageAnalysisYuy2->piHistogram[j].Cb, max.Cb - min.Cb, min.Cb, iAoiMinY - iAoiMaxY, iAoiMaxY);
         }
 
-        ScaleGraph(pImageAnalysisYuy2->piHistogram, UCHAR_MAX+1, pImageAnalysisYuy2->ppHistogram[i], pImageAnalysisYuy2->piNumHistogramResults[i]);
+        StageBegin(pImageAnalysis, STAGE_SCALE_GRAPH);
+        ScaleGraph(pImageAnalysisYuy2->piHistogram, UCHAR_MAX+1, &pImageAnalysisYuy2->pPlotHistogram[piXStart[i]], piXStart[i + 1] - piXStart[i]);
+        StageEnd(pImageAnalysis, STAGE_SCALE_GRAPH);
     }
-
-    GrayScale(pImageAnalysisYuy2, pImage);
-    DrawAOI(pImageAnalysisYuy2, pImage);
-    PlotValuesYUV(pImageAnalysisYuy2, pImage);
 }
 
-static void ComputePartitionTotal(ImageAnalysis* pImageAnalysis, guint8* pImage, PrintPartition* pPartition)
+static void DrawProfiles(ImageAnalysisYUY2* pImageAnalysisYuy2, guint8* pImage, guint analyses)
 {
-    int nStartX = pPartition->centerX - pPartition->width / 2;
-    int nEndX = nStartX + pPartition->width;
-    int nStartY = pPartition->centerY - pPartition->height / 2;
-    int nEndY = nStartY + pPartition->height;
+    ImageAnalysis* pImageAnalysis = GST_IMAGE_ANALYSIS(pImageAnalysisYuy2);
+    const AoiLayout* pLayout = &pImageAnalysis->aoi;
 
-    pPartition->total = (Pixel){ 0, 0, 0 };
-    
-    // make multiple to 2
-    nStartX = (nStartX >> 1) << 1;
-    nEndX = (nEndX >> 1) << 1;
+    if (analyses & ANALYSIS_INTENSITY)
+    {
+        StageBegin(pImageAnalysis, STAGE_NORMALIZE);
 
-    for (int y = nStartY; y < nEndY; y++)
+        for (int b = 0; b < pLayout->nBands; b++)
+            Normalize(pImageAnalysisYuy2, &pLayout->pBands[b], 1, 0, UCHAR_MAX * pLayout->pBands[b].iRows);
+
+        StageEnd(pImageAnalysis, STAGE_NORMALIZE);
+
+        StageBegin(pImageAnalysis, STAGE_PLOT);
+        PlotValues(pImageAnalysisYuy2, pImage);
+        StageEnd(pImageAnalysis, STAGE_PLOT);
+    }
+
+    if (analyses & ANALYSIS_MEAN)
     {
-        YUY2PIXEL* pYUV = (YUY2PIXEL*)ROW(pImage, pImageAnalysis->iImageWidth, y);
+        StageBegin(pImageAnalysis, STAGE_NORMALIZE);
 
-        for (int x = nStartX; x < nEndX; x += 2)
-        {
-            pPartition->total.yuv.y += pYUV[x].luma;
-            pPartition->total.yuv.u += pYUV[x].chroma;
-        }
+        for (int b = 0; b < pLayout->nBands; b++)
+            Normalize(pImageAnalysisYuy2, &pLayout->pBands[b], MAX(pLayout->pBands[b].iRows, 1), 0, UCHAR_MAX);
 
-        for (int x = nStartX + 1; x < nEndX; x += 2)
-        {
-            pPartition->total.yuv.y += pYUV[x].luma;
-            pPartition->total.yuv.v += pYUV[x].chroma;
-        }
+        StageEnd(pImageAnalysis, STAGE_NORMALIZE);
+
+        StageBegin(pImageAnalysis, STAGE_PLOT);
+        PlotValues(pImageAnalysisYuy2, pImage);
+        StageEnd(pImageAnalysis, STAGE_PLOT);
+    }
+
+    if (analyses & ANALYSIS_HISTOGRAM)
+    {
+        StageBegin(pImageAnalysis, STAGE_NORMALIZE);
+
+        for (int b = 0; b < pLayout->nBands; b++)
+            NormalizeHistograms(pImageAnalysisYuy2, &pLayout->pBands[b]);
+
+        StageEnd(pImageAnalysis, STAGE_NORMALIZE);
+
+        StageBegin(pImageAnalysis, STAGE_PLOT);
+        PlotValuesYUV(pImageAnalysisYuy2, pImage);
+        StageEnd(pImageAnalysis, STAGE_PLOT);
+    }
+
+    if (analyses & ANALYSIS_ROW_PROFILE)
+    {
+        StageBegin(pImageAnalysis, STAGE_PLOT);
+        PlotRowProfiles(pImageAnalysisYuy2, pImage);
+        StageEnd(pImageAnalysis, STAGE_PLOT);
     }
 }
 
-static void DrawPartition(ImageAnalysis* pImageAnalysis, guint8* pImage, PrintPartition* pPartition)
+static inline void AccumulatePartitionRow(PartitionStore* pStore, int i, const YUY2PIXEL* pYUV)
 {
-    int x0 = pPartition->centerX - pPartition->width / 2;
-    int x1 = x0 + pPartition->width;
-    int y0 = pPartition->centerY - pPartition->height / 2;
-    int y1 = y0 + pPartition->height;
+    // make multiple to 2
+    int nStartX = (pStore->piX0[i] >> 1) << 1;
+    int nEndX = (pStore->piX1[i] >> 1) << 1;
+    gint y = 0, u = 0, v = 0;
 
-    YUY2PIXEL* pYUV0 = (YUY2PIXEL*)ROW(pImage, pImageAnalysis->iImageWidth, y0);
-    YUY2PIXEL* pYUV1 = (YUY2PIXEL*)ROW(pImage, pImageAnalysis->iImageWidth, y1);
+    for (int x = nStartX; x < nEndX; x += 2)
+    {
+        y += pYUV[x].luma + pYUV[x + 1].luma;
+        u += pYUV[x].chroma;
+        v += pYUV[x + 1].chroma;
+    }
 
-    // draw the horizontal lines
-    for (int x = x0; x < x1; x++)
-        pYUV0[x] = pYUV1[x] = YUY2_BLACK;
+    pStore->piTotal[0][i] += y;
+    pStore->piTotal[1][i] += u;
+    pStore->piTotal[2][i] += v;
+}
 
-    // draw the vertical lines
-    for (int y = y0; y < y1; y++)
+static void SweepPartitionBand(ImageAnalysis* pImageAnalysis, guint8* pImage, int iBand)
+{
+    PartitionIndex* pIndex = &pImageAnalysis->partitionIndex;
+    PartitionStore* pStore = &pImageAnalysis->store;
+    int iFirst = pIndex->piBandStart[iBand];
+    int iLast = pIndex->piBandStart[iBand + 1];
+    int yStart = iBand * PARTITION_BAND_HEIGHT;
+    int yEnd = MIN(yStart + PARTITION_BAND_HEIGHT, pImageAnalysis->iImageHeight);
+
+    if (iFirst == iLast)
+        return;
+
+    // hand every row of the band to the partitions covering it
+    for (int y = yStart; y < yEnd; y++)
     {
-        YUY2PIXEL* pYUV = (YUY2PIXEL*)ROW(pImage, pImageAnalysis->iImageWidth, y);
-        pYUV[x0] = pYUV[x1] = YUY2_BLACK;
+        YUY2PIXEL* pYUV = (YUY2PIXEL*)ROW(pImage, pImageAnalysis->iStride, y);
+
+        for (int k = iFirst; k < iLast; k++)
+        {
+            int i = pIndex->piItems[k];
+
+            if (y >= pStore->piY0[i] && y < pStore->piY1[i])
+                AccumulatePartitionRow(pStore, i, pYUV);
+        }
     }
 }
 
-static void ComputeTotal(ImageAnalysisYUY2* pImageAnalysisRgb, guint8* pImage)
+static void AnalysisPass(ImageAnalysisYUY2* pImageAnalysisYuy2, guint8* pImage, guint analyses)
 {
-    ImageAnalysis* pImageAnalysis = GST_IMAGE_ANALYSIS(pImageAnalysisRgb);
+    ImageAnalysis* pImageAnalysis = GST_IMAGE_ANALYSIS(pImageAnalysisYuy2);
 
-    if (pImageAnalysis->bPartitionsReady)
+    if (analyses & ANALYSIS_TOTAL)
     {
-        for (int i = 0; i < pImageAnalysis->nPartitions; i++)
-            ComputePartitionTotal(pImageAnalysis, pImage, &pImageAnalysis->pPartitions[i]);
+        for (int c = 0; c < PARTITION_CHANNELS; c++)
+            memset(pImageAnalysis->store.piTotal[c], 0, pImageAnalysis->store.nPartitions * sizeof(gint));
     }
 
-    for (int i = 0; i < pImageAnalysis->nPartitions; i++)
-        DrawPartition(pImageAnalysis, pImage, &pImageAnalysis->pPartitions[i]);
+    // walk the image once from top to bottom, band by band, so the AOI bands and the
+    // partitions consume every row while it is still in cache
+    for (int yStart = 0; yStart < pImageAnalysis->iImageHeight; yStart += PARTITION_BAND_HEIGHT)
+    {
+        int yEnd = MIN(yStart + PARTITION_BAND_HEIGHT, pImageAnalysis->iImageHeight);
+        int b = yStart / PARTITION_BAND_HEIGHT;
+
+        if (analyses & ANALYSIS_AOI)
+            AccumulateAOIRows(pImageAnalysisYuy2, pImage, yStart, yEnd, analyses);
+
+        if ((analyses & ANALYSIS_TOTAL) && b < pImageAnalysis->partitionIndex.nBands)
+            SweepPartitionBand(pImageAnalysis, pImage, b);
+    }
+
+    if (analyses & ANALYSIS_TOTAL)
+        PublishPartitions(pImageAnalysis);
 }
 
 void init_yuy2(ImageAnalysis* pImageAnalysis, AnalysisOpts* opts, int iImageWidth, int iImageHeight)
@@ -527,12 +597,13 @@ void init_yuy2(ImageAnalysis* pImageAnalysis, AnalysisOpts* opts, int iImageWidt
     ImageAnalysisYUY2* pImageAnalysisYuy2 = GST_IMAGE_ANALYSIS_YUY2(pImageAnalysis);
 
     pImageAnalysis->opts = *opts;
+    pImageAnalysis->pKernels = GetAnalysisKernels(opts->cpuLevel);
     pImageAnalysis->iImageWidth = iImageWidth;
     pImageAnalysis->iImageHeight = iImageHeight;
-    pImageAnalysis->iPrevPartitions = 0;
-    pImageAnalysisYuy2->iPrevHistPartitions = 0;
 
-    CheckAllocatedMemory(pImageAnalysisYuy2);
+    // the layout sizes the span buffer of the graph renderer, so it has to exist first
+    InitGraphRenderer(pImageAnalysis);
+    CheckAllocatedMemory(pImageAnalysisYuy2, 0);
 
     pImageAnalysisYuy2->piHistogram = calloc(UCHAR_MAX + 1, sizeof(INTYUVPIXEL));
 }
@@ -544,49 +615,113 @@ void deinit_yuy2(ImageAnalysis* pImageAnalysis)
     if (pImageAnalysisYuy2->piHistogram)
         free(pImageAnalysisYuy2->piHistogram);
 
-    if (pImageAnalysisYuy2->ppResults)
-    {
-        for (int i = 0; i < pImageAnalysis->iPrevPartitions; i++)
-            free(pImageAnalysisYuy2->ppResults[i]);
+    free(pImageAnalysisYuy2->pHistograms);
+    free(pImageAnalysisYuy2->pResults);
+    free(pImageAnalysisYuy2->pPlot);
+    free(pImageAnalysisYuy2->pPlotHistogram);
+    free(pImageAnalysisYuy2->pRowResults);
+    free(pImageAnalysisYuy2->pRowPlot);
+
+    FreeAoiLayout(pImageAnalysis);
+    FreeBanding(&pImageAnalysis->banding);
+    FreeNozzleAnalysis(&pImageAnalysis->nozzle);
+    FreeDefects(&pImageAnalysis->defects);
+    FreePartitions(pImageAnalysis);
+    FreeOverlay(pImageAnalysis);
+    FreeGraphRenderer(pImageAnalysis);
+}
 
-        free(pImageAnalysisYuy2->ppResults);
-        free(pImageAnalysisYuy2->piNumResults);
+void analyize_yuy2(ImageAnalysis* pImageAnalysis, guint8* pImage)
+{
+    ImageAnalysisYUY2* pImageAnalysisYuy2 = GST_IMAGE_ANALYSIS_YUY2(pImageAnalysis);
+    AnalysisResults* pResults = &pImageAnalysis->results;
+    guint requested = GetRequestedAnalyses(&pImageAnalysis->opts);
+    guint analyses = requested;
+
+    // partitions are only measured after they have been (re)configured
+    if (!pImageAnalysis->bPartitionsReady)
+        analyses &= ~ANALYSIS_TOTAL;
+
+    CheckAllocatedMemory(pImageAnalysisYuy2, analyses);
+
+    StageBegin(pImageAnalysis, STAGE_OVERLAY);
+
+    if (!pImageAnalysis->overlay.bValid)
+        BuildOverlay(pImageAnalysisYuy2, requested);
+
+    StageEnd(pImageAnalysis, STAGE_OVERLAY);
+
+    StageBegin(pImageAnalysis, STAGE_ACCUMULATE);
+    AnalysisPass(pImageAnalysisYuy2, pImage, analyses);
+    StageEnd(pImageAnalysis, STAGE_ACCUMULATE);
+
+    pResults->analyses = analyses;
+    pResults->nColumns = pImageAnalysis->aoi.nColumns;
+    pResults->iRowStep = QualityRowStep(pImageAnalysis->quality);
+    SetAoiBandRows(pImageAnalysis, pResults->iRowStep);
+    pResults->iRows = pImageAnalysis->aoi.nBands ? pImageAnalysis->aoi.pBands[0].iRows : 0;
+    pResults->nBands = pImageAnalysis->aoi.nBands;
+    pResults->pBands = pImageAnalysis->aoi.pBands;
+    pResults->quality = pImageAnalysis->quality;
+    pResults->nColumnChannels = sizeof(INTYUY2PIXEL) / sizeof(int);
+    pResults->piColumns = (const int*)pImageAnalysisYuy2->pResults;
+    pResults->nHistograms = pImageAnalysis->aoi.nPartitions;
+    pResults->nHistogramChannels = sizeof(INTYUVPIXEL) / sizeof(int);
+    pResults->piHistograms = (const int*)pImageAnalysisYuy2->pHistograms;
+    pResults->nRowChannels = sizeof(INTYUVPIXEL) / sizeof(int);
+    pResults->piRows = (const int*)pImageAnalysisYuy2->pRowResults;
+    pResults->nPartitions = (analyses & ANALYSIS_TOTAL) ? pImageAnalysis->nPartitions : 0;
+    pResults->pPartitions = pImageAnalysis->pPartitions;
+    pResults->pBanding = &pImageAnalysis->banding;
+    pResults->pNozzle = &pImageAnalysis->nozzle;
+    pResults->pDefects = &pImageAnalysis->defects;
+
+    if (analyses & ANALYSIS_BANDING)
+    {
+        // luma alone, chroma is shared by pairs of columns
+        StageBegin(pImageAnalysis, STAGE_BANDING);
+        UpdateBanding(pImageAnalysis, 1);
+        StageEnd(pImageAnalysis, STAGE_BANDING);
     }
 
-    if (pImageAnalysisYuy2->ppHistogram)
+    if (analyses & ANALYSIS_NOZZLE_CHECK)
     {
-        for (int i = 0; i < pImageAnalysisYuy2->iPrevHistPartitions; i++)
-            free(pImageAnalysisYuy2->ppHistogram[i]);
+        StageBegin(pImageAnalysis, STAGE_NOZZLE_CHECK);
+        UpdateNozzleChecks(pImageAnalysis, 1);
+        StageEnd(pImageAnalysis, STAGE_NOZZLE_CHECK);
+    }
 
-        free(pImageAnalysisYuy2->ppHistogram);
-        free(pImageAnalysisYuy2->piNumHistogramResults);
+    if (analyses & ANALYSIS_DEFECTS)
+    {
+        StageBegin(pImageAnalysis, STAGE_DEFECTS);
+        UpdateDefects(pImageAnalysis, 1);
+        StageEnd(pImageAnalysis, STAGE_DEFECTS);
     }
+
+    StageBegin(pImageAnalysis, STAGE_OVERLAY);
+    DrawOverlay(pImageAnalysisYuy2, pImage, 0, pImageAnalysis->overlay.nBaseSpans);
+    StageEnd(pImageAnalysis, STAGE_OVERLAY);
+
+    if ((analyses & ANALYSIS_AOI) && pImageAnalysis->quality < QUALITY_EIGHTH)
+        DrawProfiles(pImageAnalysisYuy2, pImage, analyses);
+
+    StageBegin(pImageAnalysis, STAGE_OVERLAY);
+    DrawOverlay(pImageAnalysisYuy2, pImage, pImageAnalysis->overlay.nBaseSpans, pImageAnalysis->overlay.nSpans);
+    StageEnd(pImageAnalysis, STAGE_OVERLAY);
 }
 
-void analyize_yuy2(ImageAnalysis* pImageAnalysis, GstVideoFrame* frame)
+// draws the static overlay without analyzing the frame, for frames that are too late to be measured
+void overlay_yuy2(ImageAnalysis* pImageAnalysis, guint8* pImage)
 {
     ImageAnalysisYUY2* pImageAnalysisYuy2 = GST_IMAGE_ANALYSIS_YUY2(pImageAnalysis);
-    guint8* pImage = GST_VIDEO_FRAME_PLANE_DATA(frame, 0);
 
-    switch (pImageAnalysis->opts.analysisType)
-    {
-    case INTENSITY:
-        ComputeIntensity(pImageAnalysisYuy2, pImage);
-        break;
+    CheckAllocatedMemory(pImageAnalysisYuy2, 0);
 
-    case MEAN:
-        ComputeAverage(pImageAnalysisYuy2, pImage);
-        break;
+    if (!pImageAnalysis->overlay.bValid)
+        BuildOverlay(pImageAnalysisYuy2, GetRequestedAnalyses(&pImageAnalysis->opts));
 
-    case HISTOGRAM:
-        ComputeHistogram(pImageAnalysisYuy2, pImage);
-        break;
+    pImageAnalysis->results.analyses = 0;
+    pImageAnalysis->results.nPartitions = 0;
 
-    case TOTAL:
-        ComputeTotal(pImageAnalysisYuy2, pImage);
-        break;
-
-    default:
-        break;
-    }
+    DrawOverlay(pImageAnalysisYuy2, pImage, 0, pImageAnalysis->overlay.nSpans);
 }
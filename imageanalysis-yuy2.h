@@ -26,13 +26,13 @@ typedef struct ImageAnalysisYUY2
 {
 	ImageAnalysis	imageAnalysis;
 
-	INTYUVPIXEL*	piHistogram;
-	INTYUY2PIXEL**	ppResults;
-	int*			piNumResults;
-
-	int				iPrevHistPartitions;
-	INTYUVPIXEL**	ppHistogram;
-	int*			piNumHistogramResults;
+	INTYUVPIXEL*	piHistogram;	// scratch for normalizing one partition's histogram
+	INTYUVPIXEL*	pHistograms;	// (UCHAR_MAX + 1) bins per AOI partition
+	INTYUY2PIXEL*	pResults;		// one accumulator per column
+	INTYUY2PIXEL*	pPlot;			// graph rows of the profile being plotted, one per column
+	INTYUVPIXEL*	pPlotHistogram;	// graph rows of the histograms, one per column
+	INTYUVPIXEL*	pRowResults;	// one accumulator per AOI row
+	INTYUVPIXEL*	pRowPlot;		// graph columns of the row profiles, one per AOI row
 } ImageAnalysisYUY2;
 
 #define GST_IMAGE_ANALYSIS_YUY2(obj) ((ImageAnalysisYUY2*) obj) 
@@ -40,6 +40,7 @@ typedef struct ImageAnalysisYUY2
 
 void init_yuy2(ImageAnalysis* pImageAnalysis, AnalysisOpts* opts, int iImageWidth, int iImageHeight);
 void deinit_yuy2(ImageAnalysis* pImageAnalysis);
-void analyize_yuy2(ImageAnalysis* pImageAnalysis, GstVideoFrame* frame);
+void analyize_yuy2(ImageAnalysis* pImageAnalysis, guint8* pImage);
+void overlay_yuy2(ImageAnalysis* pImageAnalysis, guint8* pImage);
 
 #endif // __IMAGE_ANALYSIS_YUY2_H__
\ No newline at end of file
@@ -1,7 +1,10 @@
 #include "imageanalysis.h"
+#include "imageanalysis-history.h"
 
 #include <cjson\cJSON.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 
 double NormalizeValue(double fValue, double fOrigRange, double fMinOrig, double fNewRange, double fMinNew)
@@ -13,16 +16,54 @@ void UpdatePrintAnalysisOpts(ImageAnalysis* pImageAnalysis, AnalysisOpts* pOpts)
 {
     if (pOpts)
     {
+        // a different length starts a new average
+        if (pOpts->bandingFrames != pImageAnalysis->opts.bandingFrames)
+            ResetBanding(&pImageAnalysis->banding);
+
+        // and a different weight a new baseline
+        if (pOpts->defectAlpha != pImageAnalysis->opts.defectAlpha)
+            ResetDefects(&pImageAnalysis->defects);
+
+        // paper white from another source is measured again from the next frame
+        if ((pOpts->paperWhite != pImageAnalysis->opts.paperWhite || pOpts->paperWhitePartition != pImageAnalysis->opts.paperWhitePartition) &&
+            pImageAnalysis->store.piPaperWhiteFrames)
+            memset(pImageAnalysis->store.piPaperWhiteFrames, 0, pImageAnalysis->store.nPartitions * sizeof(gint));
+
+        // the layout only follows the AOI geometry, the overlay also what is drawn over the frame
+        gboolean bLayoutChanged = pOpts->aoiHeight != pImageAnalysis->opts.aoiHeight ||
+            pOpts->aoiPartitions != pImageAnalysis->opts.aoiPartitions;
+        gboolean bOverlayChanged = bLayoutChanged ||
+            pOpts->analysisType != pImageAnalysis->opts.analysisType ||
+            pOpts->analyses != pImageAnalysis->opts.analyses ||
+            pOpts->blackoutType != pImageAnalysis->opts.blackoutType ||
+            pOpts->grayscaleType != pImageAnalysis->opts.grayscaleType ||
+            pOpts->connectValues != pImageAnalysis->opts.connectValues;
+
         pImageAnalysis->opts = *pOpts;
+        pImageAnalysis->pKernels = GetAnalysisKernels(pOpts->cpuLevel);
+
+        if (bLayoutChanged)
+            InvalidateAoiLayout(pImageAnalysis);
+
+        if (bOverlayChanged)
+            InvalidateOverlay(pImageAnalysis);
     }
 }
 
-gboolean ParsePartitionsFromString(ImageAnalysis* pImageAnalysis, const gchar* pJsonStr)
+guint GetRequestedAnalyses(const AnalysisOpts* pOpts)
+{
+    if (pOpts->analyses)
+        return pOpts->analyses & ANALYSIS_ALL;
+
+    return (pOpts->analysisType < NONE || (pOpts->analysisType > NONE && pOpts->analysisType <= DEFECTS)) ? 1u << pOpts->analysisType : 0;
+}
+
+PrintPartition* PartitionsFromJsonStr(const gchar* pJsonStr, int* pnPartitions)
 {
     cJSON* pJson = cJSON_Parse(pJsonStr);
     if (pJson == NULL)
     {
-        return FALSE;
+        return NULL;
     }
 
     // Get "partitions" array
@@ -30,17 +71,14 @@ gboolean ParsePartitionsFromString(ImageAnalysis* pImageAnalysis, const gchar* p
     if (!cJSON_IsArray(pPartitions))
     {
         cJSON_Delete(pJson);
-        return FALSE;
+        return NULL;
     }
 
-    if (pImageAnalysis->pPartitions)
-        free(pImageAnalysis->pPartitions);
-
     // Iterate through the array
     int nPartitions = cJSON_GetArraySize(pPartitions);
-    
-    pImageAnalysis->pPartitions = calloc(nPartitions, sizeof(PrintPartition));
-    pImageAnalysis->nPartitions = 0;
+    PrintPartition* pConfig = calloc(MAX(nPartitions, 1), sizeof(PrintPartition));
+
+    *pnPartitions = 0;
 
     for (int i = 0; i < nPartitions; i++)
     {
@@ -56,50 +94,223 @@ gboolean ParsePartitionsFromString(ImageAnalysis* pImageAnalysis, const gchar* p
         cJSON* bg_g = cJSON_GetObjectItem(partition, "bg_g");
         cJSON* bg_b = cJSON_GetObjectItem(partition, "bg_b");
 
+        // the background is optional, partitions without it have their paper white calibrated
         if (cJSON_IsNumber(id) && cJSON_IsNumber(center_x) && cJSON_IsNumber(center_y) &&
-            cJSON_IsNumber(width) && cJSON_IsNumber(height)&& cJSON_IsNumber(bg_r) &&
-            cJSON_IsNumber(bg_g) && cJSON_IsNumber(bg_b))
+            cJSON_IsNumber(width) && cJSON_IsNumber(height))
         {
+            PrintPartition* pPartition = &pConfig[*pnPartitions];
 
-            pImageAnalysis->pPartitions[i].id = id->valueint;
-            pImageAnalysis->pPartitions[i].centerX = center_x->valueint;
-            pImageAnalysis->pPartitions[i].centerY = center_y->valueint;
-            pImageAnalysis->pPartitions[i].width = width->valueint;
-            pImageAnalysis->pPartitions[i].height = height->valueint;
-			pImageAnalysis->pPartitions[i].bg.rgb.r = bg_r->valueint;
-			pImageAnalysis->pPartitions[i].bg.rgb.g = bg_g->valueint;
-			pImageAnalysis->pPartitions[i].bg.rgb.b = bg_b->valueint;
-            pImageAnalysis->nPartitions++;
+            pPartition->id = id->valueint;
+            pPartition->centerX = center_x->valueint;
+            pPartition->centerY = center_y->valueint;
+            pPartition->width = width->valueint;
+            pPartition->height = height->valueint;
+            pPartition->bg.rgb.r = cJSON_IsNumber(bg_r) ? bg_r->valueint : 0;
+            pPartition->bg.rgb.g = cJSON_IsNumber(bg_g) ? bg_g->valueint : 0;
+            pPartition->bg.rgb.b = cJSON_IsNumber(bg_b) ? bg_b->valueint : 0;
+            (*pnPartitions)++;
         }
     }
 
     // Clean up
     cJSON_Delete(pJson);
-    return TRUE;
+    return pConfig;
 }
 
-char* PartitionsArrayToJsonStr(ImageAnalysis* pImageAnalysis)
+gboolean ParsePartitionsFromString(ImageAnalysis* pImageAnalysis, const gchar* pJsonStr)
+{
+    int nPartitions = 0;
+    PrintPartition* pConfig = PartitionsFromJsonStr(pJsonStr, &nPartitions);
+
+    if (!pConfig)
+        return FALSE;
+
+    gboolean bSet = SetPartitions(pImageAnalysis, pConfig, nPartitions);
+
+    free(pConfig);
+    return bSet;
+}
+
+char* PartitionsConfigToJsonStr(const PrintPartition* pPartitions, int nPartitions)
 {
     char* pJsonStr = NULL;
     cJSON* root = cJSON_CreateObject();
-    
-    if (!root)
-        goto cleanup;
+    cJSON* pArray = root ? cJSON_AddArrayToObject(root, "partitions") : NULL;
 
-    if (!pImageAnalysis->nPartitions)
+    if (!pArray)
         goto cleanup;
 
-    // Create an array for partitions
-    cJSON* pPartitions = cJSON_CreateArray();
+    for (int i = 0; i < nPartitions; i++)
+    {
+        const PrintPartition* pPartition = &pPartitions[i];
+        cJSON* pPartitionJson = cJSON_CreateObject();
+
+        if (!pPartitionJson)
+            goto cleanup;
+
+        cJSON_AddNumberToObject(pPartitionJson, "id", pPartition->id);
+        cJSON_AddNumberToObject(pPartitionJson, "center_x", pPartition->centerX);
+        cJSON_AddNumberToObject(pPartitionJson, "center_y", pPartition->centerY);
+        cJSON_AddNumberToObject(pPartitionJson, "width", pPartition->width);
+        cJSON_AddNumberToObject(pPartitionJson, "height", pPartition->height);
+        cJSON_AddNumberToObject(pPartitionJson, "bg_r", pPartition->bg.rgb.r);
+        cJSON_AddNumberToObject(pPartitionJson, "bg_g", pPartition->bg.rgb.g);
+        cJSON_AddNumberToObject(pPartitionJson, "bg_b", pPartition->bg.rgb.b);
+        cJSON_AddItemToArray(pArray, pPartitionJson);
+    }
+
+    pJsonStr = cJSON_PrintUnformatted(root);
+
+cleanup:
+    cJSON_Delete(root);
+    return pJsonStr;
+}
+
+int FindPartition(const PrintPartition* pPartitions, int nPartitions, gint id)
+{
+    for (int i = 0; i < nPartitions; i++)
+    {
+        if (pPartitions[i].id == id)
+            return i;
+    }
+
+    return -1;
+}
+
+typedef struct PartitionId
+{
+    gint id;
+    int idx;
+} PartitionId;
+
+static int ComparePartitionId(const void* a, const void* b)
+{
+    const PartitionId* pA = a;
+    const PartitionId* pB = b;
+
+    return (pA->id > pB->id) - (pA->id < pB->id);
+}
+
+// the ids of the partitions are all different, the state of a partition follows its id
+gboolean UniquePartitionIds(const PrintPartition* pPartitions, int nPartitions)
+{
+    PartitionId* pIds = calloc(MAX(nPartitions, 1), sizeof(PartitionId));
+    gboolean bUnique = pIds != NULL;
+
+    for (int i = 0; bUnique && i < nPartitions; i++)
+        pIds[i].id = pPartitions[i].id;
+
+    if (bUnique)
+        qsort(pIds, nPartitions, sizeof(PartitionId), ComparePartitionId);
+
+    for (int i = 1; bUnique && i < nPartitions; i++)
+        bUnique = pIds[i].id != pIds[i - 1].id;
+
+    free(pIds);
+    return bUnique;
+}
+
+// only the configuration is taken, the results are computed by the analysis
+static void CopyPartitionConfig(PrintPartition* pPartition, const PrintPartition* pConfig)
+{
+    memset(pPartition, 0, sizeof(PrintPartition));
+    pPartition->id = pConfig->id;
+    pPartition->centerX = pConfig->centerX;
+    pPartition->centerY = pConfig->centerY;
+    pPartition->width = pConfig->width;
+    pPartition->height = pConfig->height;
+    pPartition->bg = pConfig->bg;
+}
+
+static gboolean ReservePartitions(ImageAnalysis* pImageAnalysis, int nPartitions)
+{
+    PrintPartition* pPartitions;
+    int nAllocated = MAX(pImageAnalysis->nAllocatedPartitions, 8);
+
+    if (nPartitions <= pImageAnalysis->nAllocatedPartitions)
+        return TRUE;
+
+    while (nAllocated < nPartitions)
+        nAllocated *= 2;
+
+    pPartitions = realloc(pImageAnalysis->pPartitions, nAllocated * sizeof(PrintPartition));
+
     if (!pPartitions)
-        goto cleanup;
+        return FALSE;
 
-    // Add partitions array to the root object
-    cJSON_AddItemToObject(root, "partitions", pPartitions);
+    pImageAnalysis->pPartitions = pPartitions;
+    pImageAnalysis->nAllocatedPartitions = nAllocated;
+    return TRUE;
+}
+
+// the index, the store and the outlines follow every change of the partitions, the results of
+// the partitions the change left alone are published again from the store
+static void PartitionsChanged(ImageAnalysis* pImageAnalysis)
+{
+    BuildPartitionIndex(pImageAnalysis);
+    PublishPartitions(pImageAnalysis);
+    InvalidateOverlay(pImageAnalysis);
+}
+
+gboolean SetPartitions(ImageAnalysis* pImageAnalysis, const PrintPartition* pPartitions, int nPartitions)
+{
+    if (!UniquePartitionIds(pPartitions, nPartitions) || !ReservePartitions(pImageAnalysis, nPartitions))
+        return FALSE;
+
+    for (int i = 0; i < nPartitions; i++)
+        CopyPartitionConfig(&pImageAnalysis->pPartitions[i], &pPartitions[i]);
+
+    pImageAnalysis->nPartitions = nPartitions;
+    PartitionsChanged(pImageAnalysis);
+    return TRUE;
+}
+
+gboolean AddPartition(ImageAnalysis* pImageAnalysis, const PrintPartition* pPartition)
+{
+    if (FindPartition(pImageAnalysis->pPartitions, pImageAnalysis->nPartitions, pPartition->id) >= 0 ||
+        !ReservePartitions(pImageAnalysis, pImageAnalysis->nPartitions + 1))
+        return FALSE;
+
+    CopyPartitionConfig(&pImageAnalysis->pPartitions[pImageAnalysis->nPartitions++], pPartition);
+    PartitionsChanged(pImageAnalysis);
+    return TRUE;
+}
 
+gboolean UpdatePartition(ImageAnalysis* pImageAnalysis, const PrintPartition* pPartition)
+{
+    int i = FindPartition(pImageAnalysis->pPartitions, pImageAnalysis->nPartitions, pPartition->id);
+
+    if (i < 0)
+        return FALSE;
+
+    CopyPartitionConfig(&pImageAnalysis->pPartitions[i], pPartition);
+    PartitionsChanged(pImageAnalysis);
+    return TRUE;
+}
+
+gboolean RemovePartition(ImageAnalysis* pImageAnalysis, gint id)
+{
+    int i = FindPartition(pImageAnalysis->pPartitions, pImageAnalysis->nPartitions, id);
+
+    if (i < 0)
+        return FALSE;
+
+    memmove(&pImageAnalysis->pPartitions[i], &pImageAnalysis->pPartitions[i + 1],
+        (pImageAnalysis->nPartitions - i - 1) * sizeof(PrintPartition));
+    pImageAnalysis->nPartitions--;
+    PartitionsChanged(pImageAnalysis);
+    return TRUE;
+}
+
+// pbInclude selects the partitions to add, NULL for all of them
+static void AddPartitionsToJson(ImageAnalysis* pImageAnalysis, cJSON* pArray, const gboolean* pbInclude)
+{
     // Iterate through the array and add each partition to the JSON array
     for (int i = 0; i < pImageAnalysis->nPartitions; ++i)
     {
+        if (pbInclude && !pbInclude[i])
+            continue;
+
         cJSON* pPartition = cJSON_CreateObject();
         if (!pPartition)
             continue;
@@ -112,13 +323,6 @@ char* PartitionsArrayToJsonStr(ImageAnalysis* pImageAnalysis)
         //cJSON_AddNumberToObject(pPartition, "height", pImageAnalysis->pPartitions[i].height);
 
         // Add RGB or YUV based on your data
-        cJSON* total = cJSON_CreateObject();
-        if (!total)
-        {
-            cJSON_Delete(pPartition);
-            continue;
-        }
-
         char pTmpStr[128];
         Pixel* pTmp = NULL;
         
@@ -149,9 +353,35 @@ char* PartitionsArrayToJsonStr(ImageAnalysis* pImageAnalysis)
         snprintf(pTmpStr, sizeof(pTmpStr), "%d,%d,%d,%d", pTmp->rgb.r, pTmp->rgb.g, pTmp->rgb.b, pTmp->rgb.k);
         cJSON_AddStringToObject(pPartition, "saturation_avg", pTmpStr);
 
+        pTmp = &pImageAnalysis->pPartitions[i].paperWhite;
+        snprintf(pTmpStr, sizeof(pTmpStr), "%d,%d,%d", pTmp->rgb.r, pTmp->rgb.g, pTmp->rgb.b);
+        cJSON_AddStringToObject(pPartition, "paper_white", pTmpStr);
+
         // Add the partition to the array
-        cJSON_AddItemToArray(pPartitions, pPartition);
+        cJSON_AddItemToArray(pArray, pPartition);
     }
+}
+
+char* PartitionsArrayToJsonStr(ImageAnalysis* pImageAnalysis)
+{
+    char* pJsonStr = NULL;
+    cJSON* root = cJSON_CreateObject();
+    
+    if (!root)
+        goto cleanup;
+
+    if (!pImageAnalysis->nPartitions)
+        goto cleanup;
+
+    // Create an array for partitions
+    cJSON* pPartitions = cJSON_CreateArray();
+    if (!pPartitions)
+        goto cleanup;
+
+    // Add partitions array to the root object
+    cJSON_AddItemToObject(root, "partitions", pPartitions);
+
+    AddPartitionsToJson(pImageAnalysis, pPartitions, NULL);
 
     // Convert the root JSON object to a string
     pJsonStr = cJSON_Print(root);
@@ -160,3 +390,1351 @@ cleanup:
     cJSON_Delete(root);
     return pJsonStr;
 }
+
+static cJSON* ColumnsToJson(const AnalysisResults* pResults, int iFirst, int nColumns, int iDivisor)
+{
+    cJSON* pColumns = cJSON_CreateArray();
+    int pValues[4];
+
+    if (!pColumns)
+        return NULL;
+
+    for (int x = iFirst; x < iFirst + nColumns; x++)
+    {
+        const int* piColumn = &pResults->piColumns[x * pResults->nColumnChannels];
+
+        for (int c = 0; c < pResults->nColumnChannels; c++)
+            pValues[c] = piColumn[c] / iDivisor;
+
+        cJSON_AddItemToArray(pColumns, cJSON_CreateIntArray(pValues, pResults->nColumnChannels));
+    }
+
+    return pColumns;
+}
+
+static cJSON* HistogramsToJson(const AnalysisResults* pResults, int iFirst, int nHistograms)
+{
+    cJSON* pHistograms = cJSON_CreateArray();
+
+    if (!pHistograms)
+        return NULL;
+
+    for (int i = iFirst; i < iFirst + nHistograms; i++)
+    {
+        const int* piHistogram = &pResults->piHistograms[i * (UCHAR_MAX + 1) * pResults->nHistogramChannels];
+        cJSON* pBins = cJSON_CreateArray();
+
+        if (!pBins)
+            continue;
+
+        for (int j = 0; j < UCHAR_MAX + 1; j++)
+            cJSON_AddItemToArray(pBins, cJSON_CreateIntArray(&piHistogram[j * pResults->nHistogramChannels], pResults->nHistogramChannels));
+
+        cJSON_AddItemToArray(pHistograms, pBins);
+    }
+
+    return pHistograms;
+}
+
+static cJSON* RowsToJson(const AnalysisResults* pResults, int iFirst, int nRows)
+{
+    cJSON* pRows = cJSON_CreateArray();
+
+    if (!pRows)
+        return NULL;
+
+    for (int y = iFirst; y < iFirst + nRows; y++)
+        cJSON_AddItemToArray(pRows, cJSON_CreateIntArray(&pResults->piRows[y * pResults->nRowChannels], pResults->nRowChannels));
+
+    return pRows;
+}
+
+// the peaks of every partition from iFirst on, strongest first, empty until the first average completes
+static cJSON* BandingToJson(const AnalysisResults* pResults, int iFirst, int nPartitions)
+{
+    const BandingAnalysis* pBanding = pResults->pBanding;
+    cJSON* pPartitions = cJSON_CreateArray();
+
+    if (!pPartitions)
+        return NULL;
+
+    for (int i = iFirst; i < iFirst + nPartitions && i < pBanding->nSpectra; i++)
+    {
+        const BandingSpectrum* pSpectrum = &pBanding->pSpectra[i];
+        cJSON* pPeaks = cJSON_CreateArray();
+
+        if (!pPeaks)
+            continue;
+
+        for (int j = 0; j < pSpectrum->nPeaks; j++)
+        {
+            cJSON* pPeak = cJSON_CreateObject();
+
+            if (!pPeak)
+                continue;
+
+            cJSON_AddNumberToObject(pPeak, "frequency", pSpectrum->peaks[j].fFrequency);
+            cJSON_AddNumberToObject(pPeak, "period", pSpectrum->peaks[j].fPeriod);
+            cJSON_AddNumberToObject(pPeak, "amplitude", pSpectrum->peaks[j].fAmplitude);
+            cJSON_AddItemToArray(pPeaks, pPeak);
+        }
+
+        cJSON_AddItemToArray(pPartitions, pPeaks);
+    }
+
+    return pPartitions;
+}
+
+// only the lines that failed are listed, ladders run to thousands of lines
+static cJSON* NozzleChecksResultsToJson(const NozzleAnalysis* pNozzle)
+{
+    cJSON* pChecks = cJSON_CreateArray();
+
+    if (!pChecks)
+        return NULL;
+
+    for (int i = 0; i < pNozzle->nChecks; i++)
+    {
+        const NozzleCheck* pCheck = &pNozzle->pChecks[i];
+        const NozzleCheckResult* pResult = &pNozzle->pResults[i];
+        cJSON* pItem = cJSON_CreateObject();
+        cJSON* pMissing;
+        cJSON* pDeviated;
+
+        if (!pItem)
+            continue;
+
+        cJSON_AddItemToArray(pChecks, pItem);
+        cJSON_AddNumberToObject(pItem, "partition", pCheck->iPartition);
+        cJSON_AddNumberToObject(pItem, "lines", pCheck->nLines);
+        cJSON_AddBoolToObject(pItem, "valid", pResult->bValid);
+
+        // the partition is not in the AOI layout
+        if (!pResult->bValid)
+            continue;
+
+        cJSON_AddNumberToObject(pItem, "median_depth", pResult->fMedianDepth);
+        pMissing = cJSON_AddArrayToObject(pItem, "missing");
+        pDeviated = cJSON_AddArrayToObject(pItem, "deviated");
+
+        for (int j = 0; j < pCheck->nLines && (pResult->nMissing || pResult->nDeviated); j++)
+        {
+            const NozzleLine* pLine = &pResult->pLines[j];
+
+            if (pLine->bMissing && pMissing)
+            {
+                cJSON_AddItemToArray(pMissing, cJSON_CreateNumber(j));
+            }
+            else if (pLine->bDeviated && pDeviated)
+            {
+                cJSON* pLineJson = cJSON_CreateObject();
+
+                if (!pLineJson)
+                    continue;
+
+                cJSON_AddNumberToObject(pLineJson, "line", j);
+                cJSON_AddNumberToObject(pLineJson, "position", pLine->fPosition);
+                cJSON_AddNumberToObject(pLineJson, "offset", pLine->fPosition - (pCheck->fFirst + j * pCheck->fPitch));
+                cJSON_AddItemToArray(pDeviated, pLineJson);
+            }
+        }
+    }
+
+    return pChecks;
+}
+
+// events instead of profiles, a defect is listed in every frame until its columns are back on their baseline
+static cJSON* DefectsToJson(const DefectAnalysis* pDefects)
+{
+    cJSON* pEvents = cJSON_CreateArray();
+
+    if (!pEvents)
+        return NULL;
+
+    for (int i = 0; i < pDefects->nEvents; i++)
+    {
+        const DefectEvent* pEvent = &pDefects->pEvents[i];
+        cJSON* pItem = cJSON_CreateObject();
+
+        if (!pItem)
+            continue;
+
+        cJSON_AddNumberToObject(pItem, "x0", pEvent->x0);
+        cJSON_AddNumberToObject(pItem, "x1", pEvent->x1);
+        cJSON_AddNumberToObject(pItem, "severity", pEvent->fSeverity);
+        cJSON_AddNumberToObject(pItem, "deviation", pEvent->fDeviation);
+        cJSON_AddNumberToObject(pItem, "start_pts", (double)pEvent->iStartTimestamp);
+        cJSON_AddNumberToObject(pItem, "start_frame", (double)pEvent->iStartFrame);
+        cJSON_AddItemToArray(pEvents, pItem);
+    }
+
+    return pEvents;
+}
+
+// configured AOI bands report their profiles band by band
+static cJSON* AoiBandsResultsToJson(const AnalysisResults* pResults)
+{
+    cJSON* pBands = cJSON_CreateArray();
+
+    if (!pBands)
+        return NULL;
+
+    for (int b = 0; b < pResults->nBands; b++)
+    {
+        const AoiBand* pBand = &pResults->pBands[b];
+        cJSON* pItem = cJSON_CreateObject();
+
+        if (!pItem)
+            continue;
+
+        cJSON_AddNumberToObject(pItem, "x", pBand->x);
+        cJSON_AddNumberToObject(pItem, "y", pBand->y);
+        cJSON_AddNumberToObject(pItem, "width", pBand->width);
+        cJSON_AddNumberToObject(pItem, "height", pBand->height);
+        cJSON_AddNumberToObject(pItem, "partitions", pBand->nPartitions);
+        cJSON_AddNumberToObject(pItem, "rows", pBand->iRows);
+
+        if (pResults->analyses & ANALYSIS_INTENSITY)
+            cJSON_AddItemToObject(pItem, "intensity", ColumnsToJson(pResults, pBand->iFirstColumn, pBand->width, 1));
+
+        if (pResults->analyses & ANALYSIS_MEAN)
+            cJSON_AddItemToObject(pItem, "mean", ColumnsToJson(pResults, pBand->iFirstColumn, pBand->width, MAX(pBand->iRows, 1)));
+
+        if (pResults->analyses & ANALYSIS_HISTOGRAM)
+            cJSON_AddItemToObject(pItem, "histogram", HistogramsToJson(pResults, pBand->iFirstPartition, pBand->nPartitions));
+
+        if (pResults->analyses & ANALYSIS_ROW_PROFILE)
+            cJSON_AddItemToObject(pItem, "row_profile", RowsToJson(pResults, pBand->iFirstRow, pBand->iRows));
+
+        if (pResults->analyses & ANALYSIS_BANDING)
+            cJSON_AddItemToObject(pItem, "banding", BandingToJson(pResults, pBand->iFirstPartition, pBand->nPartitions));
+
+        cJSON_AddItemToArray(pBands, pItem);
+    }
+
+    return pBands;
+}
+
+char* AnalysisResultsToJsonStr(ImageAnalysis* pImageAnalysis)
+{
+    const AnalysisResults* pResults = &pImageAnalysis->results;
+    char* pJsonStr = NULL;
+    cJSON* root = cJSON_CreateObject();
+
+    if (!root)
+        goto cleanup;
+
+    // per column values are r,g,b for RGB and luma,chroma for YUY2,
+    // histogram bins are r,g,b for RGB and luma,Cr,Cb for YUY2,
+    // row profiles are sums across the band of r,g,b for RGB and luma,Cr,Cb for YUY2,
+    // banding peaks are sinusoids of the column means of r+g+b / 3 for RGB and luma for YUY2
+    if (pResults->analyses & ANALYSIS_AOI)
+    {
+        // intensities are sums over the sampled rows only
+        cJSON_AddNumberToObject(root, "quality", pResults->quality);
+        cJSON_AddNumberToObject(root, "rows", pResults->iRows);
+    }
+
+    // frames averaged into the peaks, 0 until the first average completes
+    if (pResults->analyses & ANALYSIS_BANDING)
+        cJSON_AddNumberToObject(root, "banding_frames", pResults->pBanding->nAveraged);
+
+    if (pImageAnalysis->nAoiBands > 0)
+    {
+        // rows differ between bands, so the profiles are reported per band
+        if (pResults->analyses & ANALYSIS_AOI)
+            cJSON_AddItemToObject(root, "bands", AoiBandsResultsToJson(pResults));
+    }
+    else
+    {
+        if (pResults->analyses & ANALYSIS_INTENSITY)
+            cJSON_AddItemToObject(root, "intensity", ColumnsToJson(pResults, 0, pResults->nColumns, 1));
+
+        if (pResults->analyses & ANALYSIS_MEAN)
+            cJSON_AddItemToObject(root, "mean", ColumnsToJson(pResults, 0, pResults->nColumns, MAX(pResults->iRows, 1)));
+
+        if (pResults->analyses & ANALYSIS_HISTOGRAM)
+            cJSON_AddItemToObject(root, "histogram", HistogramsToJson(pResults, 0, pResults->nHistograms));
+
+        if ((pResults->analyses & ANALYSIS_ROW_PROFILE) && pResults->nBands)
+            cJSON_AddItemToObject(root, "row_profile", RowsToJson(pResults, 0, pResults->iRows));
+
+        if (pResults->analyses & ANALYSIS_BANDING)
+            cJSON_AddItemToObject(root, "banding", BandingToJson(pResults, 0, pResults->nHistograms));
+    }
+
+    // ladders name their partition across all bands, so they are reported outside of them
+    if (pResults->analyses & ANALYSIS_NOZZLE_CHECK)
+        cJSON_AddItemToObject(root, "nozzle_checks", NozzleChecksResultsToJson(pResults->pNozzle));
+
+    // frames in the column baselines, defects are only looked for once there are enough of them
+    if (pResults->analyses & ANALYSIS_DEFECTS)
+    {
+        cJSON_AddNumberToObject(root, "defect_baseline_frames", (double)pResults->pDefects->nLearned);
+        cJSON_AddItemToObject(root, "defects", DefectsToJson(pResults->pDefects));
+    }
+
+    if (pResults->analyses & ANALYSIS_TOTAL)
+    {
+        cJSON* pPartitions = cJSON_CreateArray();
+
+        if (pPartitions)
+        {
+            cJSON_AddItemToObject(root, "partitions", pPartitions);
+            AddPartitionsToJson(pImageAnalysis, pPartitions, NULL);
+        }
+    }
+
+    // profiles can run to thousands of entries, so skip the pretty printing
+    pJsonStr = cJSON_PrintUnformatted(root);
+
+cleanup:
+    cJSON_Delete(root);
+    return pJsonStr;
+}
+
+static cJSON* WindowValuesToJson(const HistoryAggregate* pAggregate, int iFirst)
+{
+    cJSON* pValues = cJSON_CreateObject();
+
+    if (!pValues)
+        return NULL;
+
+    cJSON_AddItemToObject(pValues, "min", cJSON_CreateDoubleArray(&pAggregate->fMin[iFirst], 3));
+    cJSON_AddItemToObject(pValues, "max", cJSON_CreateDoubleArray(&pAggregate->fMax[iFirst], 3));
+    cJSON_AddItemToObject(pValues, "mean", cJSON_CreateDoubleArray(&pAggregate->fMean[iFirst], 3));
+
+    return pValues;
+}
+
+// one document for every frame of the window, values are grouped like in the per frame partitions
+char* PartitionWindowToJsonStr(const PartitionWindow* pWindow)
+{
+    char* pJsonStr = NULL;
+    cJSON* root = cJSON_CreateObject();
+    cJSON* pWindowJson;
+    cJSON* pPartitions;
+
+    if (!root)
+        goto cleanup;
+
+    pWindowJson = cJSON_AddObjectToObject(root, "window");
+    pPartitions = cJSON_AddArrayToObject(root, "partitions");
+
+    if (!pWindowJson || !pPartitions)
+        goto cleanup;
+
+    cJSON_AddNumberToObject(pWindowJson, "start", (double)pWindow->iStart);
+    cJSON_AddNumberToObject(pWindowJson, "end", (double)pWindow->iEnd);
+    cJSON_AddNumberToObject(pWindowJson, "frames", pWindow->nFrames);
+
+    for (int i = 0; i < pWindow->nAggregates; i++)
+    {
+        const HistoryAggregate* pAggregate = &pWindow->pAggregates[i];
+        cJSON* pPartition = cJSON_CreateObject();
+
+        if (!pPartition)
+            continue;
+
+        cJSON_AddNumberToObject(pPartition, "id", pAggregate->iId);
+        cJSON_AddNumberToObject(pPartition, "samples", pAggregate->nSamples);
+        cJSON_AddItemToObject(pPartition, "total", WindowValuesToJson(pAggregate, 0));
+        cJSON_AddItemToObject(pPartition, "average", WindowValuesToJson(pAggregate, 3));
+        cJSON_AddItemToObject(pPartition, "non-uniformity", WindowValuesToJson(pAggregate, 6));
+        cJSON_AddItemToArray(pPartitions, pPartition);
+    }
+
+    pJsonStr = cJSON_PrintUnformatted(root);
+
+cleanup:
+    cJSON_Delete(root);
+    return pJsonStr;
+}
+
+char* PartitionDeltaToJsonStr(ImageAnalysis* pImageAnalysis, const PartitionDelta* pDelta)
+{
+    char* pJsonStr = NULL;
+    cJSON* root = cJSON_CreateObject();
+    cJSON* pPartitions;
+
+    if (!root)
+        goto cleanup;
+
+    cJSON_AddNumberToObject(root, "sequence", (double)pDelta->nSequence);
+    cJSON_AddBoolToObject(root, "keyframe", pDelta->bKeyframe);
+
+    pPartitions = cJSON_AddArrayToObject(root, "partitions");
+
+    if (!pPartitions)
+        goto cleanup;
+
+    // the delta holds the partitions in the order they were measured in
+    if (pDelta->nPartitions == pImageAnalysis->nPartitions)
+        AddPartitionsToJson(pImageAnalysis, pPartitions, pDelta->pbChanged);
+
+    pJsonStr = cJSON_PrintUnformatted(root);
+
+cleanup:
+    cJSON_Delete(root);
+    return pJsonStr;
+}
+
+static cJSON* FindPartitionJson(cJSON* pPartitions, int iId)
+{
+    cJSON* pPartition;
+
+    cJSON_ArrayForEach(pPartition, pPartitions)
+    {
+        cJSON* pId = cJSON_GetObjectItemCaseSensitive(pPartition, "id");
+
+        if (cJSON_IsNumber(pId) && pId->valueint == iId)
+            return pPartition;
+    }
+
+    return NULL;
+}
+
+char* MergePartitionsJsonStr(const char* pStateJsonStr, const char* pDeltaJsonStr)
+{
+    char* pJsonStr = NULL;
+    cJSON* pState = pStateJsonStr ? cJSON_Parse(pStateJsonStr) : NULL;
+    cJSON* pDelta = cJSON_Parse(pDeltaJsonStr);
+    cJSON* pStatePartitions;
+    cJSON* pDeltaPartitions;
+    cJSON* pPartition;
+
+    if (!pDelta)
+        goto cleanup;
+
+    // a keyframe replaces whatever was known
+    if (cJSON_IsTrue(cJSON_GetObjectItemCaseSensitive(pDelta, "keyframe")))
+    {
+        pJsonStr = cJSON_PrintUnformatted(pDelta);
+        goto cleanup;
+    }
+
+    if (!pState)
+        goto cleanup;
+
+    // a missed delta leaves the state stale until the next keyframe
+    if (cJSON_GetNumberValue(cJSON_GetObjectItemCaseSensitive(pDelta, "sequence")) !=
+        cJSON_GetNumberValue(cJSON_GetObjectItemCaseSensitive(pState, "sequence")) + 1)
+        goto cleanup;
+
+    pStatePartitions = cJSON_GetObjectItemCaseSensitive(pState, "partitions");
+    pDeltaPartitions = cJSON_GetObjectItemCaseSensitive(pDelta, "partitions");
+
+    if (!cJSON_IsArray(pStatePartitions) || !cJSON_IsArray(pDeltaPartitions))
+        goto cleanup;
+
+    cJSON_ArrayForEach(pPartition, pDeltaPartitions)
+    {
+        cJSON* pId = cJSON_GetObjectItemCaseSensitive(pPartition, "id");
+        cJSON* pOld = cJSON_IsNumber(pId) ? FindPartitionJson(pStatePartitions, pId->valueint) : NULL;
+        cJSON* pNew = cJSON_Duplicate(pPartition, TRUE);
+
+        if (pOld)
+            cJSON_ReplaceItemViaPointer(pStatePartitions, pOld, pNew);
+        else
+            cJSON_AddItemToArray(pStatePartitions, pNew);
+    }
+
+    cJSON_ReplaceItemInObjectCaseSensitive(pState, "sequence", cJSON_Duplicate(cJSON_GetObjectItemCaseSensitive(pDelta, "sequence"), FALSE));
+    pJsonStr = cJSON_PrintUnformatted(pState);
+
+cleanup:
+    cJSON_Delete(pState);
+    cJSON_Delete(pDelta);
+    return pJsonStr;
+}
+
+static void FreePartitionStore(PartitionStore* pStore)
+{
+    free(pStore->piBlock);
+    free(pStore->piColumns);
+    free(pStore->pfPaperWhite);
+    free(pStore->piSelect);
+    memset(pStore, 0, sizeof(PartitionStore));
+}
+
+static gint* CarveInts(gint** ppiNext, int nInts)
+{
+    gint* piInts = *ppiNext;
+
+    *ppiNext += nInts;
+    return piInts;
+}
+
+static PartitionId* SortStoredIds(const PartitionStore* pStore)
+{
+    PartitionId* pIds = calloc(MAX(pStore->nPartitions, 1), sizeof(PartitionId));
+
+    if (!pIds)
+        return NULL;
+
+    for (int i = 0; i < pStore->nPartitions; i++)
+    {
+        pIds[i].id = pStore->piId[i];
+        pIds[i].idx = i;
+    }
+
+    qsort(pIds, pStore->nPartitions, sizeof(PartitionId), ComparePartitionId);
+    return pIds;
+}
+
+static int FindStoredPartition(const PartitionId* pIds, int nIds, gint id)
+{
+    PartitionId key = { id, 0 };
+    const PartitionId* pId = pIds ? bsearch(&key, pIds, nIds, sizeof(PartitionId), ComparePartitionId) : NULL;
+
+    return pId ? pId->idx : -1;
+}
+
+// a partition keeps its state while its bounds and background stay the same
+static gboolean SameStoredPartition(const PartitionStore* pStore, int i, const PartitionStore* pPrevious, int j)
+{
+    if (pStore->piX0[i] != pPrevious->piX0[j] || pStore->piX1[i] != pPrevious->piX1[j] ||
+        pStore->piY0[i] != pPrevious->piY0[j] || pStore->piY1[i] != pPrevious->piY1[j])
+        return FALSE;
+
+    for (int c = 0; c < PARTITION_CHANNELS; c++)
+    {
+        if (pStore->piBg[c][i] != pPrevious->piBg[c][j])
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+static void CarryPartitionResults(PartitionStore* pStore, int i, const PartitionStore* pPrevious, int j)
+{
+    for (int c = 0; c < PARTITION_CHANNELS; c++)
+    {
+        pStore->piTotal[c][i] = pPrevious->piTotal[c][j];
+        pStore->piAvg[c][i] = pPrevious->piAvg[c][j];
+        pStore->piMin[c][i] = pPrevious->piMin[c][j];
+        pStore->piMax[c][i] = pPrevious->piMax[c][j];
+        pStore->piNonUniformity[c][i] = pPrevious->piNonUniformity[c][j];
+        pStore->piMinSat[c][i] = pPrevious->piMinSat[c][j];
+        pStore->piMaxSat[c][i] = pPrevious->piMaxSat[c][j];
+        pStore->piAvgSat[c][i] = pPrevious->piAvgSat[c][j];
+        pStore->piPaperWhite[c][i] = pPrevious->piPaperWhite[c][j];
+    }
+
+    // the paper white estimate goes on from where it was
+    for (int c = 0; c < 3; c++)
+        pStore->pfPaperWhite[i * 3 + c] = pPrevious->pfPaperWhite[j * 3 + c];
+
+    pStore->piPaperWhiteFrames[i] = pPrevious->piPaperWhiteFrames[j];
+}
+
+// lays the clipped partitions out as arrays, with their columns next to each other in one arena.
+// partitions the change left alone keep their results and paper white, the added and changed ones
+// start empty and seed their paper white again
+static void BuildPartitionStore(ImageAnalysis* pImageAnalysis)
+{
+    PartitionStore* pStore = &pImageAnalysis->store;
+    PartitionStore previous = *pStore;
+    int n = pImageAnalysis->nPartitions;
+    gint* piNext;
+    gint iWidest = 0;
+
+    memset(pStore, 0, sizeof(PartitionStore));
+
+    // the ids, 4 bounds, the column offsets, 10 results of every channel and the paper white frames
+    pStore->piBlock = calloc((7 + 10 * PARTITION_CHANNELS) * n + 1, sizeof(gint));
+    pStore->nPartitions = n;
+    piNext = pStore->piBlock;
+
+    pStore->piId = CarveInts(&piNext, n);
+    pStore->piX0 = CarveInts(&piNext, n);
+    pStore->piX1 = CarveInts(&piNext, n);
+    pStore->piY0 = CarveInts(&piNext, n);
+    pStore->piY1 = CarveInts(&piNext, n);
+    pStore->piColumnStart = CarveInts(&piNext, n + 1);
+
+    for (int c = 0; c < PARTITION_CHANNELS; c++)
+    {
+        pStore->piBg[c] = CarveInts(&piNext, n);
+        pStore->piTotal[c] = CarveInts(&piNext, n);
+        pStore->piAvg[c] = CarveInts(&piNext, n);
+        pStore->piMin[c] = CarveInts(&piNext, n);
+        pStore->piMax[c] = CarveInts(&piNext, n);
+        pStore->piNonUniformity[c] = CarveInts(&piNext, n);
+        pStore->piMinSat[c] = CarveInts(&piNext, n);
+        pStore->piMaxSat[c] = CarveInts(&piNext, n);
+        pStore->piAvgSat[c] = CarveInts(&piNext, n);
+        pStore->piPaperWhite[c] = CarveInts(&piNext, n);
+    }
+
+    pStore->piPaperWhiteFrames = CarveInts(&piNext, n);
+
+    pStore->pfPaperWhite = calloc(MAX(n, 1) * 3, sizeof(float));
+
+    for (int i = 0; i < n; i++)
+    {
+        PrintPartition* pPartition = &pImageAnalysis->pPartitions[i];
+
+        pStore->piId[i] = pPartition->id;
+        pStore->piX0[i] = pPartition->x0;
+        pStore->piX1[i] = pPartition->x1;
+        pStore->piY0[i] = pPartition->y0;
+        pStore->piY1[i] = pPartition->y1;
+        pStore->piColumnStart[i + 1] = pStore->piColumnStart[i] + pPartition->x1 - pPartition->x0;
+        pStore->piBg[0][i] = pPartition->bg.rgb.r;
+        pStore->piBg[1][i] = pPartition->bg.rgb.g;
+        pStore->piBg[2][i] = pPartition->bg.rgb.b;
+
+        // the estimates start from the configured background, calibrating moves them from there
+        for (int c = 0; c < 3; c++)
+        {
+            pStore->piPaperWhite[c][i] = pStore->piBg[c][i];
+            pStore->pfPaperWhite[i * 3 + c] = (float)pStore->piBg[c][i];
+        }
+
+        pStore->piPaperWhite[3][i] = MIN(pStore->piBg[0][i], MIN(pStore->piBg[1][i], pStore->piBg[2][i]));
+        iWidest = MAX(iWidest, pPartition->x1 - pPartition->x0);
+    }
+
+    // the previous ids sorted, so every partition finds its state in log n
+    PartitionId* pPreviousIds = SortStoredIds(&previous);
+
+    for (int i = 0; i < n; i++)
+    {
+        int j = FindStoredPartition(pPreviousIds, previous.nPartitions, pStore->piId[i]);
+
+        if (j >= 0 && SameStoredPartition(pStore, i, &previous, j))
+            CarryPartitionResults(pStore, i, &previous, j);
+    }
+
+    free(pPreviousIds);
+    FreePartitionStore(&previous);
+    pStore->nColumns = pStore->piColumnStart[n];
+
+    // YUY2 sums every row of a partition straight into piTotal, only BGRx finalizes from columns
+    if (pImageAnalysis->format != IMAGE_FORMAT_BGRX)
+    {
+        for (int i = 0; i < n; i++)
+            pImageAnalysis->pPartitions[i].colTotal = NULL;
+
+        return;
+    }
+
+    pStore->piColumns = calloc(MAX(pStore->nColumns, 1) * PARTITION_CHANNELS, sizeof(gint));
+    pStore->piSelect = calloc(MAX(iWidest, 1), sizeof(gint));
+
+    for (int i = 0; i < n; i++)
+        pImageAnalysis->pPartitions[i].colTotal = (Pixel*)&pStore->piColumns[pStore->piColumnStart[i] * PARTITION_CHANNELS];
+}
+
+static void PublishPixel(Pixel* pPixel, gint* const* ppiValues, int i)
+{
+    // r g b k and y u v share the slots of the union
+    gint* piPixel = (gint*)pPixel;
+
+    for (int c = 0; c < PARTITION_CHANNELS; c++)
+        piPixel[c] = ppiValues[c][i];
+}
+
+void PublishPartitions(ImageAnalysis* pImageAnalysis)
+{
+    PartitionStore* pStore = &pImageAnalysis->store;
+
+    for (int i = 0; i < pStore->nPartitions; i++)
+    {
+        PrintPartition* pPartition = &pImageAnalysis->pPartitions[i];
+
+        PublishPixel(&pPartition->total, pStore->piTotal, i);
+        PublishPixel(&pPartition->avg, pStore->piAvg, i);
+        PublishPixel(&pPartition->min, pStore->piMin, i);
+        PublishPixel(&pPartition->max, pStore->piMax, i);
+        PublishPixel(&pPartition->nonUniformity, pStore->piNonUniformity, i);
+        PublishPixel(&pPartition->minSat, pStore->piMinSat, i);
+        PublishPixel(&pPartition->maxSat, pStore->piMaxSat, i);
+        PublishPixel(&pPartition->avgSat, pStore->piAvgSat, i);
+        PublishPixel(&pPartition->paperWhite, pStore->piPaperWhite, i);
+    }
+}
+
+typedef struct PartitionOrder
+{
+    int x0;
+    int idx;
+} PartitionOrder;
+
+static int ComparePartitionOrder(const void* a, const void* b)
+{
+    const PartitionOrder* pA = a;
+    const PartitionOrder* pB = b;
+
+    return (pA->x0 > pB->x0) - (pA->x0 < pB->x0);
+}
+
+void BuildPartitionIndex(ImageAnalysis* pImageAnalysis)
+{
+    PartitionIndex* pIndex = &pImageAnalysis->partitionIndex;
+    int nBands = (pImageAnalysis->iImageHeight + PARTITION_BAND_HEIGHT - 1) / PARTITION_BAND_HEIGHT;
+    int nItems = 0;
+
+    free(pIndex->piBandStart);
+    free(pIndex->piItems);
+
+    pIndex->nBands = nBands;
+    pIndex->piBandStart = calloc(nBands + 1, sizeof(int));
+
+    // clip every partition to the image once, so the sweep doesn't have to
+    for (int i = 0; i < pImageAnalysis->nPartitions; i++)
+    {
+        PrintPartition* pPartition = &pImageAnalysis->pPartitions[i];
+        int x0 = pPartition->centerX - pPartition->width / 2;
+        int y0 = pPartition->centerY - pPartition->height / 2;
+
+        pPartition->x0 = CLAMP(x0, 0, pImageAnalysis->iImageWidth);
+        pPartition->x1 = CLAMP(x0 + pPartition->width, 0, pImageAnalysis->iImageWidth);
+        pPartition->y0 = CLAMP(y0, 0, pImageAnalysis->iImageHeight);
+        pPartition->y1 = CLAMP(y0 + pPartition->height, 0, pImageAnalysis->iImageHeight);
+        pPartition->x1 = MAX(pPartition->x1, pPartition->x0);
+        pPartition->y1 = MAX(pPartition->y1, pPartition->y0);
+
+        if (pPartition->x0 < pPartition->x1 && pPartition->y0 < pPartition->y1)
+        {
+            // count the partition in every band it overlaps
+            for (int b = pPartition->y0 / PARTITION_BAND_HEIGHT; b <= (pPartition->y1 - 1) / PARTITION_BAND_HEIGHT; b++)
+                pIndex->piBandStart[b + 1]++;
+        }
+    }
+
+    for (int b = 0; b < nBands; b++)
+        pIndex->piBandStart[b + 1] += pIndex->piBandStart[b];
+
+    nItems = pIndex->piBandStart[nBands];
+    pIndex->piItems = calloc(MAX(nItems, 1), sizeof(int));
+
+    // insert in x order so each row is walked left to right
+    PartitionOrder* pOrder = calloc(MAX(pImageAnalysis->nPartitions, 1), sizeof(PartitionOrder));
+    int* piFill = calloc(nBands + 1, sizeof(int));
+
+    for (int i = 0; i < pImageAnalysis->nPartitions; i++)
+    {
+        pOrder[i].x0 = pImageAnalysis->pPartitions[i].x0;
+        pOrder[i].idx = i;
+    }
+
+    qsort(pOrder, pImageAnalysis->nPartitions, sizeof(PartitionOrder), ComparePartitionOrder);
+    memcpy(piFill, pIndex->piBandStart, (nBands + 1) * sizeof(int));
+
+    for (int i = 0; i < pImageAnalysis->nPartitions; i++)
+    {
+        PrintPartition* pPartition = &pImageAnalysis->pPartitions[pOrder[i].idx];
+
+        if (pPartition->x0 >= pPartition->x1 || pPartition->y0 >= pPartition->y1)
+            continue;
+
+        for (int b = pPartition->y0 / PARTITION_BAND_HEIGHT; b <= (pPartition->y1 - 1) / PARTITION_BAND_HEIGHT; b++)
+            pIndex->piItems[piFill[b]++] = pOrder[i].idx;
+    }
+
+    free(piFill);
+    free(pOrder);
+
+    BuildPartitionStore(pImageAnalysis);
+}
+
+void FreePartitions(ImageAnalysis* pImageAnalysis)
+{
+    PartitionIndex* pIndex = &pImageAnalysis->partitionIndex;
+
+    FreePartitionStore(&pImageAnalysis->store);
+
+    free(pImageAnalysis->pPartitions);
+    pImageAnalysis->pPartitions = NULL;
+    pImageAnalysis->nPartitions = 0;
+    pImageAnalysis->nAllocatedPartitions = 0;
+
+    free(pIndex->piBandStart);
+    free(pIndex->piItems);
+    memset(pIndex, 0, sizeof(PartitionIndex));
+}
+
+void FreeJsonStr(char* pJsonStr)
+{
+    cJSON_free(pJsonStr);
+}
+
+AoiBand* AoiBandsFromJsonStr(const gchar* pJsonStr, int* pnBands)
+{
+    cJSON* pJson = cJSON_Parse(pJsonStr);
+    cJSON* pBandsJson = pJson ? cJSON_GetObjectItem(pJson, "bands") : NULL;
+    AoiBand* pBands = NULL;
+    int nBands;
+
+    if (!cJSON_IsArray(pBandsJson))
+    {
+        cJSON_Delete(pJson);
+        return NULL;
+    }
+
+    nBands = cJSON_GetArraySize(pBandsJson);
+    pBands = calloc(MAX(nBands, 1), sizeof(AoiBand));
+    *pnBands = 0;
+
+    for (int i = 0; i < nBands; i++)
+    {
+        cJSON* band = cJSON_GetArrayItem(pBandsJson, i);
+        cJSON* x = cJSON_GetObjectItem(band, "x");
+        cJSON* y = cJSON_GetObjectItem(band, "y");
+        cJSON* width = cJSON_GetObjectItem(band, "width");
+        cJSON* height = cJSON_GetObjectItem(band, "height");
+        cJSON* partitions = cJSON_GetObjectItem(band, "partitions");
+
+        if (cJSON_IsNumber(x) && cJSON_IsNumber(y) && cJSON_IsNumber(width) &&
+            cJSON_IsNumber(height) && cJSON_IsNumber(partitions) && partitions->valueint > 0)
+        {
+            AoiBand* pBand = &pBands[(*pnBands)++];
+
+            pBand->x = x->valueint;
+            pBand->y = y->valueint;
+            pBand->width = width->valueint;
+            pBand->height = height->valueint;
+            pBand->nPartitions = partitions->valueint;
+        }
+    }
+
+    cJSON_Delete(pJson);
+    return pBands;
+}
+
+char* AoiBandsToJsonStr(const AoiBand* pBands, int nBands)
+{
+    char* pJsonStr = NULL;
+    cJSON* root = cJSON_CreateObject();
+    cJSON* pArray = root ? cJSON_AddArrayToObject(root, "bands") : NULL;
+
+    if (!pArray)
+        goto cleanup;
+
+    for (int i = 0; i < nBands; i++)
+    {
+        cJSON* pBandJson = cJSON_CreateObject();
+
+        if (!pBandJson)
+            goto cleanup;
+
+        cJSON_AddNumberToObject(pBandJson, "x", pBands[i].x);
+        cJSON_AddNumberToObject(pBandJson, "y", pBands[i].y);
+        cJSON_AddNumberToObject(pBandJson, "width", pBands[i].width);
+        cJSON_AddNumberToObject(pBandJson, "height", pBands[i].height);
+        cJSON_AddNumberToObject(pBandJson, "partitions", pBands[i].nPartitions);
+        cJSON_AddItemToArray(pArray, pBandJson);
+    }
+
+    pJsonStr = cJSON_PrintUnformatted(root);
+
+cleanup:
+    cJSON_Delete(root);
+    return pJsonStr;
+}
+
+NozzleCheck* NozzleChecksFromJsonStr(const gchar* pJsonStr, int* pnChecks)
+{
+    cJSON* pJson = cJSON_Parse(pJsonStr);
+    cJSON* pChecksJson = pJson ? cJSON_GetObjectItem(pJson, "checks") : NULL;
+    NozzleCheck* pChecks = NULL;
+    int nChecks;
+
+    if (!cJSON_IsArray(pChecksJson))
+    {
+        cJSON_Delete(pJson);
+        return NULL;
+    }
+
+    nChecks = cJSON_GetArraySize(pChecksJson);
+    pChecks = calloc(MAX(nChecks, 1), sizeof(NozzleCheck));
+    *pnChecks = 0;
+
+    for (int i = 0; i < nChecks; i++)
+    {
+        cJSON* check = cJSON_GetArrayItem(pChecksJson, i);
+        cJSON* partition = cJSON_GetObjectItem(check, "partition");
+        cJSON* first = cJSON_GetObjectItem(check, "first");
+        cJSON* pitch = cJSON_GetObjectItem(check, "pitch");
+        cJSON* lines = cJSON_GetObjectItem(check, "lines");
+        cJSON* tolerance = cJSON_GetObjectItem(check, "tolerance");
+        cJSON* minContrast = cJSON_GetObjectItem(check, "min_contrast");
+
+        if (cJSON_IsNumber(partition) && partition->valueint >= 0 && cJSON_IsNumber(first) &&
+            cJSON_IsNumber(pitch) && pitch->valuedouble > 0 && cJSON_IsNumber(lines) && lines->valueint > 0)
+        {
+            NozzleCheck* pCheck = &pChecks[(*pnChecks)++];
+
+            pCheck->iPartition = partition->valueint;
+            pCheck->fFirst = (float)first->valuedouble;
+            pCheck->fPitch = (float)pitch->valuedouble;
+            pCheck->nLines = lines->valueint;
+
+            // a quarter pitch off is deviated and half the usual contrast is missing unless configured
+            pCheck->fTolerance = cJSON_IsNumber(tolerance) ? (float)tolerance->valuedouble : pCheck->fPitch / 4;
+            pCheck->fMinContrast = cJSON_IsNumber(minContrast) ? (float)minContrast->valuedouble : 0.5f;
+        }
+    }
+
+    cJSON_Delete(pJson);
+    return pChecks;
+}
+
+char* NozzleChecksToJsonStr(const NozzleCheck* pChecks, int nChecks)
+{
+    char* pJsonStr = NULL;
+    cJSON* root = cJSON_CreateObject();
+    cJSON* pArray = root ? cJSON_AddArrayToObject(root, "checks") : NULL;
+
+    if (!pArray)
+        goto cleanup;
+
+    for (int i = 0; i < nChecks; i++)
+    {
+        cJSON* pCheckJson = cJSON_CreateObject();
+
+        if (!pCheckJson)
+            goto cleanup;
+
+        cJSON_AddNumberToObject(pCheckJson, "partition", pChecks[i].iPartition);
+        cJSON_AddNumberToObject(pCheckJson, "first", pChecks[i].fFirst);
+        cJSON_AddNumberToObject(pCheckJson, "pitch", pChecks[i].fPitch);
+        cJSON_AddNumberToObject(pCheckJson, "lines", pChecks[i].nLines);
+        cJSON_AddNumberToObject(pCheckJson, "tolerance", pChecks[i].fTolerance);
+        cJSON_AddNumberToObject(pCheckJson, "min_contrast", pChecks[i].fMinContrast);
+        cJSON_AddItemToArray(pArray, pCheckJson);
+    }
+
+    pJsonStr = cJSON_PrintUnformatted(root);
+
+cleanup:
+    cJSON_Delete(root);
+    return pJsonStr;
+}
+
+gboolean SetAoiBands(ImageAnalysis* pImageAnalysis, const AoiBand* pBands, int nBands)
+{
+    AoiBand* pCopy = NULL;
+
+    if (nBands)
+    {
+        pCopy = calloc(nBands, sizeof(AoiBand));
+
+        if (!pCopy)
+            return FALSE;
+
+        // only the rectangle and the partitions are taken, the layout fills in the rest
+        for (int i = 0; i < nBands; i++)
+            pCopy[i] = (AoiBand){ pBands[i].x, pBands[i].y, pBands[i].width, pBands[i].height, pBands[i].nPartitions };
+    }
+
+    free(pImageAnalysis->pAoiBands);
+    pImageAnalysis->pAoiBands = pCopy;
+    pImageAnalysis->nAoiBands = nBands;
+
+    InvalidateAoiLayout(pImageAnalysis);
+    InvalidateOverlay(pImageAnalysis);
+    return TRUE;
+}
+
+void InvalidateAoiLayout(ImageAnalysis* pImageAnalysis)
+{
+    pImageAnalysis->aoi.bValid = FALSE;
+}
+
+static void ClearAoiLayout(AoiLayout* pLayout)
+{
+    free(pLayout->pBands);
+    free(pLayout->piXStart);
+    memset(pLayout, 0, sizeof(AoiLayout));
+}
+
+// the columns of both layouts lie at the same place in the frame
+static gboolean SameAoiLayout(const AoiLayout* pA, const AoiLayout* pB)
+{
+    if (pA->nBands != pB->nBands || pA->nColumns != pB->nColumns || pA->nPartitions != pB->nPartitions)
+        return FALSE;
+
+    for (int b = 0; b < pA->nBands; b++)
+    {
+        const AoiBand* pBandA = &pA->pBands[b];
+        const AoiBand* pBandB = &pB->pBands[b];
+
+        if (pBandA->x != pBandB->x || pBandA->y != pBandB->y || pBandA->width != pBandB->width ||
+            pBandA->height != pBandB->height || pBandA->nPartitions != pBandB->nPartitions)
+            return FALSE;
+    }
+
+    return !memcmp(pA->piXStart, pB->piXStart, (pA->nPartitions + 1) * sizeof(int));
+}
+
+// clips the bands to the frame and lays their columns out one after the other, partition bounds
+// are rounded down to multiples of iColumnAlign. returns TRUE when the layout was rebuilt, so the
+// format resizes the buffers that follow it. the defect baseline is learned again when the columns moved
+gboolean BuildAoiLayout(ImageAnalysis* pImageAnalysis, int iColumnAlign)
+{
+    AoiLayout* pLayout = &pImageAnalysis->aoi;
+    AoiLayout previous = *pLayout;
+    int iWidth = pImageAnalysis->iImageWidth;
+    int iHeight = pImageAnalysis->iImageHeight;
+    int nBands = pImageAnalysis->nAoiBands ? pImageAnalysis->nAoiBands : 1;
+    int nColumns = 0;
+    int nPartitions = 0;
+    int nRows = 0;
+    PlotSpan* pSpans;
+    RowSpan* pRowSpans;
+
+    if (pLayout->bValid)
+        return FALSE;
+
+    memset(pLayout, 0, sizeof(AoiLayout));
+    pLayout->pBands = calloc(nBands, sizeof(AoiBand));
+    pLayout->nBands = nBands;
+
+    for (int b = 0; b < nBands; b++)
+    {
+        AoiBand* pBand = &pLayout->pBands[b];
+        int x0, y0;
+
+        if (pImageAnalysis->nAoiBands)
+            *pBand = pImageAnalysis->pAoiBands[b];
+        else
+            *pBand = (AoiBand){ 0, (iHeight - (int)pImageAnalysis->opts.aoiHeight) / 2, iWidth, pImageAnalysis->opts.aoiHeight, pImageAnalysis->opts.aoiPartitions };
+
+        x0 = CLAMP(pBand->x, 0, iWidth) / iColumnAlign * iColumnAlign;
+        y0 = CLAMP(pBand->y, 0, iHeight);
+
+        pBand->width = CLAMP(pBand->x + pBand->width, x0, iWidth) - x0;
+        pBand->height = CLAMP(pBand->y + pBand->height, y0, iHeight) - y0;
+        pBand->x = x0;
+        pBand->y = y0;
+        pBand->nPartitions = MAX(pBand->nPartitions, 0);
+        pBand->iFirstPartition = nPartitions;
+        pBand->iFirstRow = nRows;
+
+        nPartitions += pBand->nPartitions;
+        nRows += pBand->height;
+    }
+
+    pLayout->piXStart = calloc(nPartitions + 1, sizeof(int));
+
+    for (int b = 0; b < nBands; b++)
+    {
+        AoiBand* pBand = &pLayout->pBands[b];
+        int n = pBand->nPartitions;
+
+        pBand->iFirstColumn = nColumns;
+
+        for (int i = 0; i < n; i++)
+        {
+            int xStart = (int)((float)pBand->width / n * i);
+
+            pLayout->piXStart[pBand->iFirstPartition + i] = nColumns + xStart / iColumnAlign * iColumnAlign;
+        }
+
+        pBand->width = n ? (int)((float)pBand->width / n * n) / iColumnAlign * iColumnAlign : 0;
+        nColumns += pBand->width;
+        pLayout->piXStart[pBand->iFirstPartition + n] = nColumns;
+    }
+
+    pLayout->nColumns = nColumns;
+    pLayout->nPartitions = nPartitions;
+    pLayout->nRows = nRows;
+
+    // the graphs are drawn from one run per channel in every column and every row of every band
+    pSpans = realloc(pImageAnalysis->graph.pSpans, MAX(nColumns, 1) * PLOT_MAX_CHANNELS * sizeof(PlotSpan));
+
+    if (pSpans)
+        pImageAnalysis->graph.pSpans = pSpans;
+
+    pRowSpans = realloc(pImageAnalysis->graph.pRowSpans, MAX(nRows, 1) * PLOT_MAX_CHANNELS * sizeof(RowSpan));
+
+    if (pRowSpans)
+        pImageAnalysis->graph.pRowSpans = pRowSpans;
+
+    if (!previous.pBands || !SameAoiLayout(pLayout, &previous))
+        ResetDefects(&pImageAnalysis->defects);
+
+    ClearAoiLayout(&previous);
+    pLayout->bValid = TRUE;
+    return TRUE;
+}
+
+// counts the rows every band samples at the given row step
+void SetAoiBandRows(ImageAnalysis* pImageAnalysis, int iRowStep)
+{
+    for (int b = 0; b < pImageAnalysis->aoi.nBands; b++)
+        pImageAnalysis->aoi.pBands[b].iRows = (pImageAnalysis->aoi.pBands[b].height + iRowStep - 1) / iRowStep;
+}
+
+// the mean of the leading nSignalChannels channels of every column of AOI partition iPartition over the
+// rows summed in the last frame, the profile the analyses of periodic structure work on
+int GetAoiColumnMeans(const ImageAnalysis* pImageAnalysis, int iPartition, int nSignalChannels, float* pfMeans)
+{
+    const AoiLayout* pLayout = &pImageAnalysis->aoi;
+    const AnalysisResults* pResults = &pImageAnalysis->results;
+    const int* piColumns = &pResults->piColumns[pLayout->piXStart[iPartition] * pResults->nColumnChannels];
+    int nColumns = pLayout->piXStart[iPartition + 1] - pLayout->piXStart[iPartition];
+    int iRows = 1;
+
+    for (int b = 0; b < pLayout->nBands; b++)
+    {
+        const AoiBand* pBand = &pLayout->pBands[b];
+
+        if (iPartition < pBand->iFirstPartition + pBand->nPartitions)
+        {
+            iRows = MAX(pBand->iRows, 1);
+            break;
+        }
+    }
+
+    float fDivisor = (float)iRows * nSignalChannels;
+
+    for (int x = 0; x < nColumns; x++)
+    {
+        int iSum = 0;
+
+        for (int c = 0; c < nSignalChannels; c++)
+            iSum += piColumns[x * pResults->nColumnChannels + c];
+
+        pfMeans[x] = iSum / fDivisor;
+    }
+
+    return nColumns;
+}
+
+void FreeAoiLayout(ImageAnalysis* pImageAnalysis)
+{
+    ClearAoiLayout(&pImageAnalysis->aoi);
+
+    free(pImageAnalysis->pAoiBands);
+    pImageAnalysis->pAoiBands = NULL;
+    pImageAnalysis->nAoiBands = 0;
+}
+
+void InvalidateOverlay(ImageAnalysis* pImageAnalysis)
+{
+    pImageAnalysis->overlay.bValid = FALSE;
+}
+
+void ResetOverlay(ImageAnalysis* pImageAnalysis)
+{
+    pImageAnalysis->overlay.nSpans = 0;
+    pImageAnalysis->overlay.nBaseSpans = 0;
+    pImageAnalysis->overlay.bValid = TRUE;
+}
+
+void AddOverlayRun(ImageAnalysis* pImageAnalysis, OverlayOp op, int iOffset, int nPixels, guint32 uValue)
+{
+    OverlayCache* pOverlay = &pImageAnalysis->overlay;
+    int iEnd = MIN(iOffset + nPixels, pImageAnalysis->iRowPixels * (pImageAnalysis->iImageHeight - 1) + pImageAnalysis->iImageWidth);
+
+    iOffset = MAX(iOffset, 0);
+
+    if (iOffset >= iEnd)
+        return;
+
+    // extend the previous span when this one continues it
+    if (pOverlay->nSpans > pOverlay->nBaseSpans)
+    {
+        OverlaySpan* pLast = &pOverlay->pSpans[pOverlay->nSpans - 1];
+
+        if (pLast->op == op && pLast->uValue == uValue && pLast->iOffset + pLast->nPixels == iOffset)
+        {
+            pLast->nPixels += iEnd - iOffset;
+            return;
+        }
+    }
+
+    if (pOverlay->nSpans == pOverlay->nAllocated)
+    {
+        int nAllocated = MAX(pOverlay->nAllocated * 2, 64);
+        OverlaySpan* pSpans = realloc(pOverlay->pSpans, nAllocated * sizeof(OverlaySpan));
+
+        if (!pSpans)
+            return;
+
+        pOverlay->pSpans = pSpans;
+        pOverlay->nAllocated = nAllocated;
+    }
+
+    pOverlay->pSpans[pOverlay->nSpans++] = (OverlaySpan){ iOffset, iEnd - iOffset, op, uValue };
+}
+
+void AddOverlayRow(ImageAnalysis* pImageAnalysis, OverlayOp op, int x, int y, int nPixels, guint32 uValue)
+{
+    int x0 = MAX(x, 0);
+    int x1 = MIN(x + nPixels, pImageAnalysis->iImageWidth);
+
+    if (y < 0 || y >= pImageAnalysis->iImageHeight || x0 >= x1)
+        return;
+
+    AddOverlayRun(pImageAnalysis, op, y * pImageAnalysis->iRowPixels + x0, x1 - x0, uValue);
+}
+
+void AddOverlayColumn(ImageAnalysis* pImageAnalysis, OverlayOp op, int x, int y, int nRows, guint32 uValue)
+{
+    for (int i = 0; i < nRows; i++)
+        AddOverlayRow(pImageAnalysis, op, x, y + i, 1, uValue);
+}
+
+void AddOverlayRect(ImageAnalysis* pImageAnalysis, OverlayOp op, int x, int y, int nPixels, int nRows, guint32 uValue)
+{
+    // full rows follow each other, so they make a single run that covers the padding between them too
+    if (x == 0 && nPixels == pImageAnalysis->iImageWidth)
+    {
+        AddOverlayRun(pImageAnalysis, op, y * pImageAnalysis->iRowPixels, nRows * pImageAnalysis->iRowPixels, uValue);
+        return;
+    }
+
+    for (int i = 0; i < nRows; i++)
+        AddOverlayRow(pImageAnalysis, op, x, y + i, nPixels, uValue);
+}
+
+// the top and bottom line of an AOI band and the lines between its partitions, bands narrower
+// than the frame get their sides too
+void AddAoiBandOutline(ImageAnalysis* pImageAnalysis, const AoiBand* pBand, guint32 uValue)
+{
+    const int* piXStart = pImageAnalysis->aoi.piXStart;
+
+    AddOverlayRow(pImageAnalysis, OVERLAY_FILL, pBand->x, pBand->y, pBand->width, uValue);
+    AddOverlayRow(pImageAnalysis, OVERLAY_FILL, pBand->x, pBand->y + pBand->height, pBand->width, uValue);
+
+    for (int i = 1; i < pBand->nPartitions; i++)
+        AddOverlayColumn(pImageAnalysis, OVERLAY_FILL, pBand->x + piXStart[pBand->iFirstPartition + i] - pBand->iFirstColumn, pBand->y, pBand->height, uValue);
+
+    if (pBand->width < pImageAnalysis->iImageWidth)
+    {
+        AddOverlayColumn(pImageAnalysis, OVERLAY_FILL, pBand->x, pBand->y, pBand->height, uValue);
+        AddOverlayColumn(pImageAnalysis, OVERLAY_FILL, pBand->x + pBand->width, pBand->y, pBand->height, uValue);
+    }
+}
+
+void FreeOverlay(ImageAnalysis* pImageAnalysis)
+{
+    free(pImageAnalysis->overlay.pSpans);
+    memset(&pImageAnalysis->overlay, 0, sizeof(OverlayCache));
+}
+
+void InitGraphRenderer(ImageAnalysis* pImageAnalysis)
+{
+    GraphRenderer* pGraph = &pImageAnalysis->graph;
+
+    FreeGraphRenderer(pImageAnalysis);
+
+    pGraph->piRowOffset = calloc(pImageAnalysis->iImageHeight, sizeof(int));
+    pGraph->pSpans = calloc(pImageAnalysis->iImageWidth * PLOT_MAX_CHANNELS, sizeof(PlotSpan));
+
+    for (int y = 0; y < pImageAnalysis->iImageHeight; y++)
+        pGraph->piRowOffset[y] = y * pImageAnalysis->iStride;
+}
+
+// rows of the frames from now on are iStride bytes apart, the graph rows and the overlay follow them
+void SetImageStride(ImageAnalysis* pImageAnalysis, int iStride, int iPixelBytes)
+{
+    if (iStride == pImageAnalysis->iStride)
+        return;
+
+    pImageAnalysis->iStride = iStride;
+    pImageAnalysis->iRowPixels = iStride / iPixelBytes;
+
+    for (int y = 0; y < pImageAnalysis->iImageHeight; y++)
+        pImageAnalysis->graph.piRowOffset[y] = y * iStride;
+
+    InvalidateOverlay(pImageAnalysis);
+}
+
+// turns the values of one channel in columns [x, x + nColumns) into vertical runs, piValues holds
+// nChannels values per column and a connected graph joins values iStep columns apart
+void BuildPlotSpans(ImageAnalysis* pImageAnalysis, const int* piValues, int nChannels, int iChannel, int iStep, int x, int nColumns)
+{
+    PlotSpan* pSpans = pImageAnalysis->graph.pSpans;
+    int iMaxY = pImageAnalysis->iImageHeight - 1;
+
+    for (int j = 0; j < nColumns; j++)
+    {
+        int iValue = piValues[(x + j) * nChannels + iChannel];
+        int y0 = iValue;
+        int y1 = iValue;
+
+        // each column reaches halfway to its neighbours, the halves meet on the middle row
+        if (pImageAnalysis->opts.connectValues)
+        {
+            if (j >= iStep)
+            {
+                int iMid = (piValues[(x + j - iStep) * nChannels + iChannel] + iValue) / 2;
+
+                y0 = MIN(y0, iMid);
+                y1 = MAX(y1, iMid);
+            }
+
+            if (j + iStep < nColumns)
+            {
+                int iMid = (piValues[(x + j + iStep) * nChannels + iChannel] + iValue) / 2;
+
+                y0 = MIN(y0, iMid);
+                y1 = MAX(y1, iMid);
+            }
+        }
+
+        pSpans[(x + j) * PLOT_MAX_CHANNELS + iChannel] = (PlotSpan){ CLAMP(y0, 0, iMaxY), CLAMP(y1, 0, iMaxY) };
+    }
+}
+
+// turns the values of one channel in rows [iRow, iRow + nRows) of the row profiles into horizontal
+// runs, piValues holds nChannels columns per row, the connected graph joins neighbouring rows
+void BuildRowSpans(ImageAnalysis* pImageAnalysis, const int* piValues, int nChannels, int iChannel, int iRow, int nRows)
+{
+    RowSpan* pSpans = pImageAnalysis->graph.pRowSpans;
+    int iMaxX = pImageAnalysis->iImageWidth - 1;
+
+    for (int j = 0; j < nRows; j++)
+    {
+        int iValue = piValues[(iRow + j) * nChannels + iChannel];
+        int x0 = iValue;
+        int x1 = iValue;
+
+        // each row reaches halfway to its neighbours, the halves meet on the middle column
+        if (pImageAnalysis->opts.connectValues)
+        {
+            if (j > 0)
+            {
+                int iMid = (piValues[(iRow + j - 1) * nChannels + iChannel] + iValue) / 2;
+
+                x0 = MIN(x0, iMid);
+                x1 = MAX(x1, iMid);
+            }
+
+            if (j + 1 < nRows)
+            {
+                int iMid = (piValues[(iRow + j + 1) * nChannels + iChannel] + iValue) / 2;
+
+                x0 = MIN(x0, iMid);
+                x1 = MAX(x1, iMid);
+            }
+        }
+
+        pSpans[(iRow + j) * PLOT_MAX_CHANNELS + iChannel] = (RowSpan){ CLAMP(x0, 0, iMaxX), CLAMP(x1, 0, iMaxX) };
+    }
+}
+
+void FreeGraphRenderer(ImageAnalysis* pImageAnalysis)
+{
+    free(pImageAnalysis->graph.piRowOffset);
+    free(pImageAnalysis->graph.pSpans);
+    free(pImageAnalysis->graph.pRowSpans);
+    memset(&pImageAnalysis->graph, 0, sizeof(GraphRenderer));
+}
+
+int QualityRowStep(AnalysisQuality quality)
+{
+    return 1 << CLAMP(quality, QUALITY_FULL, QUALITY_LOWEST);
+}
+
+// sampled rows are counted from the top of the AOI, so bands starting anywhere agree on them
+int FirstSampledRow(int y, int iAoiMinY, int iRowStep)
+{
+    return y + (iRowStep - (y - iAoiMinY) % iRowStep) % iRowStep;
+}
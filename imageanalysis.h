@@ -1,9 +1,12 @@
 #pragma once
 
-#include <gst/gst.h>
-#include <gst/video/video.h>
+#include <glib.h>
 
-#include "gdiplus_c.h"
+#include "imageanalysis-kernels.h"
+#include "imageanalysis-stats.h"
+#include "imageanalysis-banding.h"
+#include "imageanalysis-nozzle.h"
+#include "imageanalysis-defects.h"
 
 
 typedef enum
@@ -12,9 +15,50 @@ typedef enum
 	MEAN = 1,
 	HISTOGRAM = 2,
 	TOTAL = 3,
-	NONE = 4
+	NONE = 4,
+	ROW_PROFILE = 5,	// after NONE, so the analysis types keep their values
+	BANDING = 6,
+	NOZZLE_CHECK = 7,
+	DEFECTS = 8
 } AnalysisType;
 
+// bits of the analyses mask, computed together in a single pass over the frame
+typedef enum
+{
+	ANALYSIS_INTENSITY	= 1 << INTENSITY,
+	ANALYSIS_MEAN		= 1 << MEAN,
+	ANALYSIS_HISTOGRAM	= 1 << HISTOGRAM,
+	ANALYSIS_TOTAL		= 1 << TOTAL,
+	ANALYSIS_ROW_PROFILE	= 1 << ROW_PROFILE,
+	ANALYSIS_BANDING	= 1 << BANDING,
+	ANALYSIS_NOZZLE_CHECK	= 1 << NOZZLE_CHECK,
+	ANALYSIS_DEFECTS	= 1 << DEFECTS,
+
+	ANALYSIS_COLUMNS	= ANALYSIS_INTENSITY | ANALYSIS_MEAN | ANALYSIS_BANDING | ANALYSIS_NOZZLE_CHECK | ANALYSIS_DEFECTS,	// fed by the column sums
+	ANALYSIS_AOI		= ANALYSIS_COLUMNS | ANALYSIS_HISTOGRAM | ANALYSIS_ROW_PROFILE,
+	ANALYSIS_PROFILES	= ANALYSIS_INTENSITY | ANALYSIS_ROW_PROFILE,	// column and row profiles from one read of each row
+	ANALYSIS_REPORTED	= ANALYSIS_BANDING | ANALYSIS_NOZZLE_CHECK | ANALYSIS_DEFECTS,	// nothing is drawn, the results are the only output
+	ANALYSIS_ALL		= ANALYSIS_AOI | ANALYSIS_TOTAL
+} AnalysisFlags;
+
+// pixel layouts the engine analyzes, rows start on whole 4 byte units and may be padded
+typedef enum
+{
+	IMAGE_FORMAT_BGRX,
+	IMAGE_FORMAT_YUY2
+} ImageFormat;
+
+// precision traded for time when frames run over budget, every level samples half
+// the AOI rows of the previous one
+typedef enum
+{
+	QUALITY_FULL,
+	QUALITY_HALF,
+	QUALITY_QUARTER,	// partition labels are not drawn
+	QUALITY_EIGHTH,		// graphs are not drawn either
+	QUALITY_LOWEST = QUALITY_EIGHTH
+} AnalysisQuality;
+
 typedef enum
 {
 	BLACK_ALL,
@@ -29,6 +73,17 @@ typedef enum
 	GRAY_NONE
 } GrayscaleType;
 
+// where the paper white the saturation of the partitions is measured against comes from
+typedef enum
+{
+	PAPER_WHITE_CONFIGURED,	// bg_r, bg_g and bg_b of every partition, partitions without them are calibrated
+	PAPER_WHITE_BRIGHTEST,	// the brightest columns of every partition
+	PAPER_WHITE_PARTITION	// the columns of a partition on blank paper, for all of them
+} PaperWhiteMode;
+
+#define PAPER_WHITE_DEFAULT_PERCENTILE	95
+#define PAPER_WHITE_DEFAULT_ALPHA		0.01
+
 typedef union
 {
 	struct 
@@ -49,13 +104,26 @@ typedef union
 typedef struct AnalysisOpts
 {
 	AnalysisType	analysisType;
+	guint			analyses;		// AnalysisFlags, 0 to use analysisType alone
 	guint			aoiHeight;
 	guint			aoiPartitions;
 	gboolean		connectValues;
 	BlackoutType	blackoutType;
 	GrayscaleType	grayscaleType;
+	CpuLevel		cpuLevel;		// kernels to run, CPU_LEVEL_AUTO for the plugin default
+	gboolean		statsEnabled;	// time the stages of every frame
+	guint			bandingFrames;	// column spectra averaged per banding result, 0 or 1 for every frame
+	double			defectAlpha;	// weight of a frame in the column baselines, 0 for DEFECT_DEFAULT_ALPHA
+	double			defectSigma;	// standard deviations off the baseline a column deviates at, 0 for the default
+	guint			defectFrames;	// consecutive deviating frames that make a defect, 0 for the default
+	PaperWhiteMode	paperWhite;
+	guint			paperWhitePercentile;	// percentile of the columns taken as paper white, 0 for the default
+	double			paperWhiteAlpha;	// weight of a frame in the paper white estimates, 0 for the default
+	gint			paperWhitePartition;	// id of the blank partition of PAPER_WHITE_PARTITION
 } AnalysisOpts;
 
+// a partition as reported to the host, the engine works on the PartitionStore and copies the
+// results here once a frame's values are final
 typedef struct PrintPartition
 {
 	gint id;
@@ -68,39 +136,282 @@ typedef struct PrintPartition
 	Pixel min, max;
 	Pixel nonUniformity;
 	Pixel avg;
-	Pixel *colTotal;
+	Pixel *colTotal;	// points into the column arena of the PartitionStore, NULL for YUY2
 
-	Pixel bg; //background usually cameras reading of white media
+	Pixel bg; //background usually cameras reading of white media, 0 to calibrate it
+	Pixel paperWhite;	// background the saturation was computed against, bg or the calibrated estimate
 	Pixel minSat;
 	Pixel maxSat;
 	Pixel avgSat;
+
+	// bounds clipped to the image, computed when the partitions are configured
+	gint x0, x1;
+	gint y0, y1;
 } PrintPartition;
 
+// bytes of column accumulators processed per block, sized to stay resident in L1
+#define ACCUMULATOR_BLOCK_BYTES (16 * 1024)
+
+// rows per band of the partition index
+#define PARTITION_BAND_HEIGHT 32
+
+// partitions bucketed by the row bands they overlap, so a single top to bottom
+// sweep of the image can feed every row segment to the partitions covering it
+typedef struct PartitionIndex
+{
+	int		nBands;
+	int*	piBandStart;	// nBands + 1 offsets into piItems
+	int*	piItems;		// partition indices, ordered by x0 within each band
+} PartitionIndex;
+
+// values kept per partition, r g b k for BGRx, y u v for YUY2, BGRx keeps them per column too
+#define PARTITION_CHANNELS 4
+
+// the partitions as parallel arrays, the geometry the sweep reads, one array per channel of every
+// result and a single arena with the column totals of all partitions, so the per partition steps of
+// finalizing run as loops across partitions instead of striding through whole records
+typedef struct PartitionStore
+{
+	int		nPartitions;
+	int		nColumns;			// columns of all partitions together
+	gint*	piBlock;			// the per partition arrays below, in one allocation
+
+	gint*	piId;				// ids, a rebuild carries the state of a partition along with its id
+	gint*	piX0;				// bounds clipped to the image
+	gint*	piX1;
+	gint*	piY0;
+	gint*	piY1;
+	gint*	piColumnStart;		// nPartitions + 1 column offsets into piColumns
+
+	gint*	piBg[PARTITION_CHANNELS];
+	gint*	piTotal[PARTITION_CHANNELS];
+	gint*	piAvg[PARTITION_CHANNELS];
+	gint*	piMin[PARTITION_CHANNELS];
+	gint*	piMax[PARTITION_CHANNELS];
+	gint*	piNonUniformity[PARTITION_CHANNELS];
+	gint*	piMinSat[PARTITION_CHANNELS];
+	gint*	piMaxSat[PARTITION_CHANNELS];
+	gint*	piAvgSat[PARTITION_CHANNELS];
+	gint*	piPaperWhite[PARTITION_CHANNELS];
+	gint*	piPaperWhiteFrames;	// frames in the estimate of every partition, 0 seeds it with the next frame
+
+	gint*	piColumns;			// nColumns * PARTITION_CHANNELS, BGRx only
+	float*	pfPaperWhite;		// rolling paper white of every partition, r g b per partition
+	gint*	piSelect;			// a channel of the widest partition's columns, for the percentile, BGRx only
+} PartitionStore;
+
+// a rectangle of the frame profiled by INTENSITY, MEAN and HISTOGRAM, split in nPartitions
+// partitions of equal width. the columns of all bands follow each other in the results
+typedef struct AoiBand
+{
+	int		x;
+	int		y;
+	int		width;
+	int		height;
+	int		nPartitions;
+
+	int		iFirstColumn;		// set by the layout, first column of the band in the results
+	int		iFirstPartition;	// first of its partitions in the histograms
+	int		iFirstRow;			// first of its rows in the row profiles
+	int		iRows;				// rows summed into every column of the last frame
+} AoiBand;
+
+// the bands profiled, the configured ones clipped to the frame or a single band of aoiHeight
+// rows centered in the frame, all of them read in the same top to bottom sweep
+typedef struct AoiLayout
+{
+	gboolean	bValid;
+	AoiBand*	pBands;
+	int			nBands;
+	int			nColumns;		// columns of all bands
+	int			nPartitions;	// partitions of all bands
+	int			nRows;			// rows of all bands
+	int*		piXStart;		// first column of every partition, nPartitions + 1 entries
+} AoiLayout;
+
+// format independent view of the last frame's results, owned by the format implementation
+typedef struct AnalysisResults
+{
+	guint		analyses;			// AnalysisFlags computed for the last frame
+	int			nColumns;			// columns covered by the AOI partitions
+	int			iRows;				// AOI rows summed into every column of the first band
+	AnalysisQuality	quality;		// precision the values were computed at
+	int			iRowStep;			// distance between the summed rows
+	int			nColumnChannels;	// values per column
+	const int*	piColumns;			// column sums, nColumns * nColumnChannels
+	int			nHistograms;		// one histogram per AOI partition
+	int			nHistogramChannels;	// values per histogram bin
+	const int*	piHistograms;		// nHistograms * (UCHAR_MAX + 1) * nHistogramChannels
+	int			nRowChannels;		// values per row
+	const int*	piRows;				// row sums across the band of every sampled row, from iFirstRow of each band
+	int			nPartitions;		// partitions measured, 0 unless ANALYSIS_TOTAL was computed
+	const PrintPartition*	pPartitions;
+	int			nBands;				// AOI bands the columns and histograms are split in
+	const AoiBand*	pBands;
+	const BandingAnalysis*	pBanding;	// peaks per AOI partition, when ANALYSIS_BANDING was computed
+	const NozzleAnalysis*	pNozzle;	// lines of every ladder, when ANALYSIS_NOZZLE_CHECK was computed
+	const DefectAnalysis*	pDefects;	// columns deviating from their baseline, when ANALYSIS_DEFECTS was computed
+} AnalysisResults;
+
+// draws the values of the measured partitions over the frame, text rendering is left to the host
+typedef void (*PartitionLabelFunc) (void* pUserData, guint8* pImage, int iWidth, int iHeight, int iStride,
+	const PrintPartition* pPartitions, int nPartitions);
+
+typedef enum
+{
+	OVERLAY_FILL,		// set the pixels to uValue
+	OVERLAY_CHROMA		// set the chroma of YUY2 pixels to uValue, luma is kept
+} OverlayOp;
+
+// a run of pixels of the static overlay, rows are iRowPixels apart so a run may span several of them
+// and the padding between them
+typedef struct OverlaySpan
+{
+	int			iOffset;	// first pixel, counted from the start of the frame
+	int			nPixels;
+	OverlayOp	op;
+	guint32		uValue;		// pixel in the format of the frame
+} OverlaySpan;
+
+// blackout, grayscale, AOI and partition outlines don't change from frame to frame, they are
+// turned into spans once and replayed until the options, the partitions or the caps change
+typedef struct OverlayCache
+{
+	gboolean		bValid;
+	OverlaySpan*	pSpans;
+	int				nSpans;
+	int				nAllocated;
+	int				nBaseSpans;		// spans drawn below the graphs, the rest is drawn on top
+} OverlayCache;
+
+// graphs are drawn as vertical runs of rows, at most this many channels per column
+#define PLOT_MAX_CHANNELS 3
+
+// rows [y0, y1] covered by one channel of a graph in one column
+typedef struct PlotSpan
+{
+	int y0;
+	int y1;
+} PlotSpan;
+
+// columns [x0, x1] covered by one channel of a row profile in one row
+typedef struct RowSpan
+{
+	int x0;
+	int x1;
+} RowSpan;
+
+typedef struct GraphRenderer
+{
+	int*		piRowOffset;	// byte offset of every row of the frame
+	PlotSpan*	pSpans;			// PLOT_MAX_CHANNELS runs per column
+	RowSpan*	pRowSpans;		// PLOT_MAX_CHANNELS runs per row of the row profiles
+} GraphRenderer;
+
 typedef struct _ImageAnalysis ImageAnalysis;
 
 struct _ImageAnalysis
 {
 	AnalysisOpts	opts;
-	int				iPrevPartitions;
+	ImageFormat		format;
 	int				iImageWidth;
 	int				iImageHeight;
 	int				iStride;
+	int				iRowPixels;		// iStride in pixels, the overlay counts its offsets in these
 
 	PrintPartition*	pPartitions;
 	int				nPartitions;
+	int				nAllocatedPartitions;
 	gboolean		bPartitionsReady;
+	PartitionIndex	partitionIndex;
+	PartitionStore	store;
+
+	AoiBand*		pAoiBands;		// configured AOI bands, none for the centered band of aoiHeight rows
+	int				nAoiBands;
+	AoiLayout		aoi;
 
-	gdiplus_c*		pGdiObj;
+	AnalysisResults	results;
+	OverlayCache	overlay;
+	GraphRenderer	graph;
+	AnalysisStats	stats;
+	AnalysisQuality	quality;
+	BandingAnalysis	banding;
+	NozzleAnalysis	nozzle;
+	DefectAnalysis	defects;
+	gint64			iTimestamp;		// PTS of the frame being analyzed, in ns, -1 when unknown
+
+	const AnalysisKernels*	pKernels;	// resolved from opts.cpuLevel
+
+	PartitionLabelFunc	drawLabels;		// optional
+	void*				pLabelData;
 
 	void (*init) (ImageAnalysis* pImageAnalysis, AnalysisOpts *opts, int iImageWidth, int iImageHeight);
 	void (*deinit) (ImageAnalysis* pImageAnalysis);
-	void (*analyze) (ImageAnalysis* pImageAnalysis, GstVideoFrame* frame);
+	void (*analyze) (ImageAnalysis* pImageAnalysis, guint8* pImage);
+	void (*drawOverlay) (ImageAnalysis* pImageAnalysis, guint8* pImage);
 };
 
 #define GST_IMAGE_ANALYSIS(obj) ((ImageAnalysis*) obj)
 
 double NormalizeValue(double fValue, double fOrigRange, double fMinOrig, double fNewRange, double fMinNew);
 void UpdatePrintAnalysisOpts(ImageAnalysis* pImageAnalysis, AnalysisOpts* pOpts);
+guint GetRequestedAnalyses(const AnalysisOpts* pOpts);
 
 gboolean ParsePartitionsFromString(ImageAnalysis* pImageAnalysis, const gchar* pJsonStr);
+
+// partitions are configured by id, center, size and background, the rest of a PrintPartition
+// is filled in by the analysis. every change rebuilds the index and the store of the partitions
+PrintPartition* PartitionsFromJsonStr(const gchar* pJsonStr, int* pnPartitions);
+char* PartitionsConfigToJsonStr(const PrintPartition* pPartitions, int nPartitions);
+int FindPartition(const PrintPartition* pPartitions, int nPartitions, gint id);
+gboolean UniquePartitionIds(const PrintPartition* pPartitions, int nPartitions);
+gboolean SetPartitions(ImageAnalysis* pImageAnalysis, const PrintPartition* pPartitions, int nPartitions);
+gboolean AddPartition(ImageAnalysis* pImageAnalysis, const PrintPartition* pPartition);
+gboolean UpdatePartition(ImageAnalysis* pImageAnalysis, const PrintPartition* pPartition);
+gboolean RemovePartition(ImageAnalysis* pImageAnalysis, gint id);
 char* PartitionsArrayToJsonStr(ImageAnalysis* pImageAnalysis);
+char* AnalysisResultsToJsonStr(ImageAnalysis* pImageAnalysis);
+void FreeJsonStr(char* pJsonStr);
+void BuildPartitionIndex(ImageAnalysis* pImageAnalysis);
+void FreePartitions(ImageAnalysis* pImageAnalysis);
+void PublishPartitions(ImageAnalysis* pImageAnalysis);
+
+AoiBand* AoiBandsFromJsonStr(const gchar* pJsonStr, int* pnBands);
+char* AoiBandsToJsonStr(const AoiBand* pBands, int nBands);
+gboolean SetAoiBands(ImageAnalysis* pImageAnalysis, const AoiBand* pBands, int nBands);
+void InvalidateAoiLayout(ImageAnalysis* pImageAnalysis);
+gboolean BuildAoiLayout(ImageAnalysis* pImageAnalysis, int iColumnAlign);
+void SetAoiBandRows(ImageAnalysis* pImageAnalysis, int iRowStep);
+int GetAoiColumnMeans(const ImageAnalysis* pImageAnalysis, int iPartition, int nSignalChannels, float* pfMeans);
+void FreeAoiLayout(ImageAnalysis* pImageAnalysis);
+
+void InvalidateOverlay(ImageAnalysis* pImageAnalysis);
+void ResetOverlay(ImageAnalysis* pImageAnalysis);
+void AddOverlayRun(ImageAnalysis* pImageAnalysis, OverlayOp op, int iOffset, int nPixels, guint32 uValue);
+void AddOverlayRow(ImageAnalysis* pImageAnalysis, OverlayOp op, int x, int y, int nPixels, guint32 uValue);
+void AddOverlayColumn(ImageAnalysis* pImageAnalysis, OverlayOp op, int x, int y, int nRows, guint32 uValue);
+void AddOverlayRect(ImageAnalysis* pImageAnalysis, OverlayOp op, int x, int y, int nPixels, int nRows, guint32 uValue);
+void AddAoiBandOutline(ImageAnalysis* pImageAnalysis, const AoiBand* pBand, guint32 uValue);
+void FreeOverlay(ImageAnalysis* pImageAnalysis);
+
+int QualityRowStep(AnalysisQuality quality);
+int FirstSampledRow(int y, int iAoiMinY, int iRowStep);
+
+void StageBegin(ImageAnalysis* pImageAnalysis, AnalysisStage stage);
+void StageEnd(ImageAnalysis* pImageAnalysis, AnalysisStage stage);
+void BeginStatsFrame(ImageAnalysis* pImageAnalysis);
+void EndStatsFrame(ImageAnalysis* pImageAnalysis);
+
+void UpdateBanding(ImageAnalysis* pImageAnalysis, int nSignalChannels);
+
+NozzleCheck* NozzleChecksFromJsonStr(const gchar* pJsonStr, int* pnChecks);
+char* NozzleChecksToJsonStr(const NozzleCheck* pChecks, int nChecks);
+gboolean SetNozzleChecks(ImageAnalysis* pImageAnalysis, const NozzleCheck* pChecks, int nChecks);
+void UpdateNozzleChecks(ImageAnalysis* pImageAnalysis, int nSignalChannels);
+void UpdateDefects(ImageAnalysis* pImageAnalysis, int nSignalChannels);
+
+void InitGraphRenderer(ImageAnalysis* pImageAnalysis);
+void SetImageStride(ImageAnalysis* pImageAnalysis, int iStride, int iPixelBytes);
+void BuildPlotSpans(ImageAnalysis* pImageAnalysis, const int* piValues, int nChannels, int iChannel, int iStep, int x, int nColumns);
+void BuildRowSpans(ImageAnalysis* pImageAnalysis, const int* piValues, int nChannels, int iChannel, int iRow, int nRows);
+void FreeGraphRenderer(ImageAnalysis* pImageAnalysis);
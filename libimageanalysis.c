@@ -0,0 +1,125 @@
+#include "libimageanalysis.h"
+#include "imageanalysis-rgb.h"
+#include "imageanalysis-yuy2.h"
+
+#include <stdlib.h>
+
+
+ImageAnalysis* CreateImageAnalysis(ImageFormat format, int iImageWidth, int iImageHeight, const AnalysisOpts* pOpts)
+{
+    ImageAnalysis* pImageAnalysis = NULL;
+    AnalysisOpts opts = *pOpts;
+
+    if (iImageWidth <= 0 || iImageHeight <= 0)
+        return NULL;
+
+    switch (format)
+    {
+    case IMAGE_FORMAT_BGRX:
+        pImageAnalysis = calloc(1, sizeof(ImageAnalysisRGB));
+
+        if (!pImageAnalysis)
+            return NULL;
+
+        pImageAnalysis->init = init_rgb;
+        pImageAnalysis->deinit = deinit_rgb;
+        pImageAnalysis->analyze = analyize_rgb;
+        pImageAnalysis->drawOverlay = overlay_rgb;
+        break;
+
+    case IMAGE_FORMAT_YUY2:
+        pImageAnalysis = calloc(1, sizeof(ImageAnalysisYUY2));
+
+        if (!pImageAnalysis)
+            return NULL;
+
+        pImageAnalysis->init = init_yuy2;
+        pImageAnalysis->deinit = deinit_yuy2;
+        pImageAnalysis->analyze = analyize_yuy2;
+        pImageAnalysis->drawOverlay = overlay_yuy2;
+        break;
+
+    default:
+        return NULL;
+    }
+
+    pImageAnalysis->format = format;
+    pImageAnalysis->iTimestamp = -1;
+    pImageAnalysis->iStride = iImageWidth * ImageFormatPixelBytes(format);
+    pImageAnalysis->iRowPixels = iImageWidth;
+    pImageAnalysis->init(pImageAnalysis, &opts, iImageWidth, iImageHeight);
+
+    return pImageAnalysis;
+}
+
+void DestroyImageAnalysis(ImageAnalysis* pImageAnalysis)
+{
+    if (!pImageAnalysis)
+        return;
+
+    pImageAnalysis->deinit(pImageAnalysis);
+    free(pImageAnalysis);
+}
+
+int ImageFormatPixelBytes(ImageFormat format)
+{
+    switch (format)
+    {
+    case IMAGE_FORMAT_BGRX:
+        return sizeof(RGBQUAD);
+
+    case IMAGE_FORMAT_YUY2:
+        return sizeof(YUY2PIXEL);
+
+    default:
+        return 0;
+    }
+}
+
+void SetPartitionLabelRenderer(ImageAnalysis* pImageAnalysis, PartitionLabelFunc drawLabels, void* pUserData)
+{
+    pImageAnalysis->drawLabels = drawLabels;
+    pImageAnalysis->pLabelData = pUserData;
+}
+
+void SetAnalysisQuality(ImageAnalysis* pImageAnalysis, AnalysisQuality quality)
+{
+    pImageAnalysis->quality = CLAMP(quality, QUALITY_FULL, QUALITY_LOWEST);
+}
+
+// rows may be padded, but have to hold a whole row and start on a BGRx pixel or a YUY2 macro pixel
+static gboolean UseImageStride(ImageAnalysis* pImageAnalysis, guint8* pImage, int iStride)
+{
+    int iPixelBytes = ImageFormatPixelBytes(pImageAnalysis->format);
+
+    if (!pImage || iStride < pImageAnalysis->iImageWidth * iPixelBytes || iStride % 4)
+        return FALSE;
+
+    SetImageStride(pImageAnalysis, iStride, iPixelBytes);
+    return TRUE;
+}
+
+const AnalysisResults* AnalyzeImage(ImageAnalysis* pImageAnalysis, guint8* pImage, int iStride)
+{
+    if (!UseImageStride(pImageAnalysis, pImage, iStride))
+        return NULL;
+
+    pImageAnalysis->analyze(pImageAnalysis, pImage);
+
+    return &pImageAnalysis->results;
+}
+
+void SetFrameTimestamp(ImageAnalysis* pImageAnalysis, gint64 iTimestamp)
+{
+    pImageAnalysis->iTimestamp = iTimestamp;
+}
+
+gboolean OverlayImage(ImageAnalysis* pImageAnalysis, guint8* pImage, int iStride)
+{
+    if (!UseImageStride(pImageAnalysis, pImage, iStride))
+        return FALSE;
+
+    pImageAnalysis->drawOverlay(pImageAnalysis, pImage);
+
+    return TRUE;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "imageanalysis.h"
+#include "imageanalysis-history.h"
+#include "imageanalysis-shm.h"
+
+// plain C entry points of the analysis engine, free of GStreamer and GDI+, so the
+// element, batch tools and benchmarks all run the same code on raw frames
+
+ImageAnalysis* CreateImageAnalysis(ImageFormat format, int iImageWidth, int iImageHeight, const AnalysisOpts* pOpts);
+void DestroyImageAnalysis(ImageAnalysis* pImageAnalysis);
+
+int ImageFormatPixelBytes(ImageFormat format);
+void SetPartitionLabelRenderer(ImageAnalysis* pImageAnalysis, PartitionLabelFunc drawLabels, void* pUserData);
+
+// samples fewer AOI rows and draws less of the overlay, the results carry the level they were computed at
+void SetAnalysisQuality(ImageAnalysis* pImageAnalysis, AnalysisQuality quality);
+
+// analyzes the frame and draws the overlay into it, returns NULL when the frame can't be analyzed
+const AnalysisResults* AnalyzeImage(ImageAnalysis* pImageAnalysis, guint8* pImage, int iStride);
+
+// PTS of the frames passed to AnalyzeImage from now on, in ns, -1 when unknown. defects carry the PTS of the
+// frame they started in
+void SetFrameTimestamp(ImageAnalysis* pImageAnalysis, gint64 iTimestamp);
+
+// draws only the static overlay (blackout, grayscale, outlines) and leaves the results empty
+gboolean OverlayImage(ImageAnalysis* pImageAnalysis, guint8* pImage, int iStride);
+
+// publishes the results of every frame in a shared memory ring, the layout and the reader are in imageanalysis-shm.h
+typedef struct ResultsShmWriter ResultsShmWriter;
+
+ResultsShmWriter* CreateResultsShm(const char* pName, int nSlots, int maxColumnValues, int maxBands);
+void DestroyResultsShm(ResultsShmWriter* pWriter);
+void WriteResultsShm(ResultsShmWriter* pWriter, gint64 iTimestamp, const AnalysisResults* pResults);
@@ -1,8 +1,7 @@
 #include <gst/video/video.h>
 
 #include "printanalysis-gst.h"
-#include "imageanalysis-rgb.h"
-#include "imageanalysis-yuy2.h"
+#include "libimageanalysis.h"
 
 GST_DEBUG_CATEGORY_STATIC (printanalysis_debug);
 #define GST_CAT_DEFAULT (printanalysis_debug)
@@ -11,17 +10,48 @@ enum
 {
 	PROP_0,
 	PROP_ANALYSIS_TYPE,
+	PROP_ANALYSES,
 	PROP_PARTITIONS_JSON,
 	PROP_AOI_HEIGHT,
 	PROP_PARTITIONS,
+	PROP_AOI_BANDS_JSON,
+	PROP_BANDING_FRAMES,
+	PROP_NOZZLE_CHECKS_JSON,
+	PROP_DEFECT_ALPHA,
+	PROP_DEFECT_SIGMA,
+	PROP_DEFECT_FRAMES,
+	PROP_PAPER_WHITE,
+	PROP_PAPER_WHITE_PERCENTILE,
+	PROP_PAPER_WHITE_ALPHA,
+	PROP_PAPER_WHITE_PARTITION,
 	PROP_CONNECT_VALUES,
 	PROP_BLACKOUT_TYPE,
 	PROP_GRAYSCALE_TYPE,
+	PROP_CPU_LEVEL,
+	PROP_ACTIVE_CPU_LEVEL,
+	PROP_STATS_ENABLED,
+	PROP_STATS_LOG_INTERVAL,
+	PROP_STATS,
+	PROP_QOS_MODE,
+	PROP_FRAME_BUDGET_US,
+	PROP_QUALITY,
+	PROP_HISTORY_CAPACITY,
+	PROP_SHM_NAME,
+	PROP_SHM_SLOTS,
+	PROP_EMIT_INTERVAL_MS,
+	PROP_DELTA_THRESHOLD,
+	PROP_KEYFRAME_INTERVAL,
 	PROP_LAST
 };
 
 enum {
 	AOI_TOTAL_SIGNAL,
+	ANALYSIS_RESULTS_SIGNAL,
+	QUERY_HISTORY_SIGNAL,
+	ADD_PARTITION_SIGNAL,
+	UPDATE_PARTITION_SIGNAL,
+	REMOVE_PARTITION_SIGNAL,
+	SET_PARTITIONS_SIGNAL,
 	NUM_SIGNALS
 };
 
@@ -33,6 +63,11 @@ G_DEFINE_TYPE (GstPrintAnalysis, gst_print_analysis, GST_TYPE_VIDEO_FILTER);
 GST_ELEMENT_REGISTER_DEFINE (printanalysis, "printanalysis",
     GST_RANK_NONE, gst_print_analysis_get_type ());
 
+// frames measured at a quality level before it is changed again
+#define QUALITY_SETTLE_FRAMES 8
+// frames well under budget before a level of precision is restored
+#define QUALITY_RESTORE_FRAMES 60
+
 #define CAPS_STR GST_VIDEO_CAPS_MAKE ("{ " \
     "ARGB, BGRA, ABGR, RGBA, xRGB, BGRx, xBGR, RGBx, RGB, BGR, AYUV, YUY2 }")
 
@@ -50,6 +85,70 @@ GST_STATIC_PAD_TEMPLATE ("sink",
     GST_STATIC_CAPS (CAPS_STR)
     );
 
+// partition labels are rendered with GDI+, elsewhere the frames only get the outlines
+#ifdef _WIN32
+static void gst_print_analysis_draw_labels(void* pUserData, guint8* pImage, int width, int height, int stride,
+	const PrintPartition* pPartitions, int nPartitions)
+{
+	gdiplus_c* gdiObj = pUserData;
+
+	gdiplus_init_context(gdiObj, pImage, width, height, stride);
+
+	for (int i = 0; i < nPartitions; i++)
+	{
+		const PrintPartition* pPartition = &pPartitions[i];
+		int x0 = pPartition->centerX - pPartition->width / 2;
+		int y0 = pPartition->centerY - pPartition->height / 2;
+
+		gdiplus_draw_rgb(gdiObj, pPartition->total.rgb.r, pPartition->total.rgb.g, pPartition->total.rgb.b, x0, y0);
+	}
+}
+#endif
+
+// (re)creates the shared memory ring for the last AOI layout, before the first frame there is none,
+// called with the object lock held
+static void gst_print_analysis_open_shm(GstPrintAnalysis* filter)
+{
+	DestroyResultsShm(filter->shmWriter);
+	filter->shmWriter = NULL;
+
+	if (!filter->shmName || !*filter->shmName || filter->shmColumnValues < 0)
+		return;
+
+	filter->shmWriter = CreateResultsShm(filter->shmName, filter->shmSlots, filter->shmColumnValues, filter->shmBands);
+
+	if (!filter->shmWriter)
+		GST_WARNING_OBJECT(filter, "results not published, shared memory %s could not be created", filter->shmName);
+}
+
+// a layout of other columns or bands gets a ring of its own, readers open the new one by name
+static void gst_print_analysis_publish_shm(GstPrintAnalysis* filter, const AnalysisResults* pResults, GstBuffer* buffer)
+{
+	if (filter->shmName && *filter->shmName &&
+		(pResults->nColumns * pResults->nColumnChannels != filter->shmColumnValues || pResults->nBands != filter->shmBands))
+	{
+		filter->shmColumnValues = pResults->nColumns * pResults->nColumnChannels;
+		filter->shmBands = pResults->nBands;
+		gst_print_analysis_open_shm(filter);
+	}
+	// on Windows the name of the replaced ring is free once its last reader closed it
+	else if (filter->shmName && *filter->shmName && !filter->shmWriter)
+		filter->shmWriter = CreateResultsShm(filter->shmName, filter->shmSlots, filter->shmColumnValues, filter->shmBands);
+
+	if (filter->shmWriter)
+		WriteResultsShm(filter->shmWriter, GST_CLOCK_TIME_IS_VALID(GST_BUFFER_PTS(buffer)) ? (gint64) GST_BUFFER_PTS(buffer) : -1, pResults);
+}
+
+// the partitions are measured again from the next frame, called with the object lock held
+static void gst_print_analysis_partitions_changed(GstPrintAnalysis* filter)
+{
+	if (filter->pImageAnalysis && filter->pImageAnalysis->nPartitions)
+	{
+		filter->pImageAnalysis->bPartitionsReady = TRUE;
+		filter->partitionsPending = TRUE;
+	}
+}
+
 static gboolean gst_print_analysis_set_info (GstVideoFilter * vfilter, GstCaps * incaps,
     GstVideoInfo * in_info, GstCaps * outcaps, GstVideoInfo * out_info)
 {
@@ -59,53 +158,650 @@ static gboolean gst_print_analysis_set_info (GstVideoFilter * vfilter, GstCaps *
 	GST_DEBUG_OBJECT(filter,
 		"in %" GST_PTR_FORMAT " out %" GST_PTR_FORMAT, incaps, outcaps);
 
-	filter->pImageAnalysis = NULL;
-
 	filter->format = GST_VIDEO_INFO_FORMAT(in_info);
 	filter->width = GST_VIDEO_INFO_WIDTH(in_info);
 	filter->height = GST_VIDEO_INFO_HEIGHT(in_info);
 
 	opts.analysisType = filter->analysisType;
+	opts.analyses = filter->analyses;
 	opts.aoiHeight = filter->aoiHeight;
 	opts.aoiPartitions = filter->partitions;
 	opts.connectValues = filter->connectValues;
 	opts.blackoutType = filter->blackoutType;
 	opts.grayscaleType = filter->grayscaleType;
+	opts.cpuLevel = filter->cpuLevel;
+	opts.statsEnabled = filter->statsEnabled;
+	opts.bandingFrames = filter->bandingFrames;
+	opts.defectAlpha = filter->defectAlpha;
+	opts.defectSigma = filter->defectSigma;
+	opts.defectFrames = filter->defectFrames;
+	opts.paperWhite = filter->paperWhite;
+	opts.paperWhitePercentile = filter->paperWhitePercentile;
+	opts.paperWhiteAlpha = filter->paperWhiteAlpha;
+	opts.paperWhitePartition = filter->paperWhitePartition;
 
 	GST_OBJECT_LOCK(filter);
 
+	DestroyImageAnalysis(filter->pImageAnalysis);
+	filter->pImageAnalysis = NULL;
+
+	// the processing time is measured again for the new frame size
+	filter->maxProcessingTime = 0;
+
+	// and the ring sized for the layout of its first frame
+	filter->shmColumnValues = -1;
+	gst_print_analysis_open_shm(filter);
+
 	switch (filter->format) {
 	case GST_VIDEO_FORMAT_BGRx:
-		filter->pImageAnalysis = calloc(1, sizeof(ImageAnalysisRGB));
-		filter->pImageAnalysis->init = init_rgb;
-		filter->pImageAnalysis->deinit = deinit_rgb;
-		filter->pImageAnalysis->analyze = analyize_rgb;
-		filter->pImageAnalysis->pGdiObj = filter->gdiObj;
+		filter->pImageAnalysis = CreateImageAnalysis(IMAGE_FORMAT_BGRX, filter->width, filter->height, &opts);
 
-		// initialize image analysis
-		filter->pImageAnalysis->init(filter->pImageAnalysis, &opts, filter->width, filter->height);
+#ifdef _WIN32
+		if (filter->pImageAnalysis)
+			SetPartitionLabelRenderer(filter->pImageAnalysis, gst_print_analysis_draw_labels, filter->gdiObj);
+#endif
 		break;
 
 	case GST_VIDEO_FORMAT_YUY2:
-		filter->pImageAnalysis = calloc(1, sizeof(ImageAnalysisYUY2));
-		filter->pImageAnalysis->init = init_yuy2;
-		filter->pImageAnalysis->deinit = deinit_yuy2;
-		filter->pImageAnalysis->analyze = analyize_yuy2;
-		filter->pImageAnalysis->pGdiObj = filter->gdiObj;
-
-		// initialize image analysis
-		filter->pImageAnalysis->init(filter->pImageAnalysis, &opts, filter->width, filter->height);
+		filter->pImageAnalysis = CreateImageAnalysis(IMAGE_FORMAT_YUY2, filter->width, filter->height, &opts);
 		break;
 
 	default:
 		break;
 	}
 
+	if (filter->pImageAnalysis)
+	{
+		SetPartitions(filter->pImageAnalysis, (PrintPartition*)filter->partitionConfig->data, filter->partitionConfig->len);
+		gst_print_analysis_partitions_changed(filter);
+		SetAoiBands(filter->pImageAnalysis, (AoiBand*)filter->aoiBandConfig->data, filter->aoiBandConfig->len);
+		SetNozzleChecks(filter->pImageAnalysis, (NozzleCheck*)filter->nozzleCheckConfig->data, filter->nozzleCheckConfig->len);
+
+		SetAnalysisQuality(filter->pImageAnalysis, filter->quality);
+		GST_INFO_OBJECT(filter, "analysis kernels: %s", filter->pImageAnalysis->pKernels->pName);
+	}
+
 	GST_OBJECT_UNLOCK(filter);
 
 	return filter->pImageAnalysis != NULL;
 }
 
+// running times of the analysis stages, in microseconds
+static GstStructure* gst_print_analysis_stats_structure(GstPrintAnalysis* filter)
+{
+	GstStructure* stats = gst_structure_new_empty("printanalysis-stats");
+
+	if (!filter->pImageAnalysis)
+		return stats;
+
+	gst_structure_set(stats,
+		"cpu-level", G_TYPE_STRING, filter->pImageAnalysis->pKernels->pName,
+		"frames", G_TYPE_UINT64, filter->pImageAnalysis->stats.stages[STAGE_FRAME].nSamples,
+		"shed-frames", G_TYPE_UINT64, filter->shedFrames,
+		"qos-proportion", G_TYPE_DOUBLE, filter->qosProportion,
+		"max-processing-us", G_TYPE_DOUBLE, filter->maxProcessingTime / 1000.0,
+		"quality", G_TYPE_UINT, (guint) filter->quality,
+		NULL);
+
+	for (int i = 0; i < STAGE_LAST; i++)
+	{
+		StageSummary summary;
+		gchar* name;
+
+		GetStageSummary(&filter->pImageAnalysis->stats, (AnalysisStage) i, &summary);
+
+		if (!summary.nSamples)
+			continue;
+
+		name = g_strdup_printf("%s-count", StageName((AnalysisStage) i));
+		gst_structure_set(stats, name, G_TYPE_UINT64, summary.nSamples, NULL);
+		g_free(name);
+
+		name = g_strdup_printf("%s-min-us", StageName((AnalysisStage) i));
+		gst_structure_set(stats, name, G_TYPE_DOUBLE, summary.fMinUs, NULL);
+		g_free(name);
+
+		name = g_strdup_printf("%s-mean-us", StageName((AnalysisStage) i));
+		gst_structure_set(stats, name, G_TYPE_DOUBLE, summary.fMeanUs, NULL);
+		g_free(name);
+
+		name = g_strdup_printf("%s-p99-us", StageName((AnalysisStage) i));
+		gst_structure_set(stats, name, G_TYPE_DOUBLE, summary.fP99Us, NULL);
+		g_free(name);
+
+		name = g_strdup_printf("%s-max-us", StageName((AnalysisStage) i));
+		gst_structure_set(stats, name, G_TYPE_DOUBLE, summary.fMaxUs, NULL);
+		g_free(name);
+	}
+
+	return stats;
+}
+
+static void gst_print_analysis_log_stats(GstPrintAnalysis* filter)
+{
+	gint64 now = g_get_monotonic_time();
+
+	if (!filter->statsEnabled || !filter->statsLogInterval)
+		return;
+
+	if (!filter->lastStatsLog)
+		filter->lastStatsLog = now;
+
+	if (now - filter->lastStatsLog < (gint64) filter->statsLogInterval * G_USEC_PER_SEC)
+		return;
+
+	GstStructure* stats = gst_print_analysis_stats_structure(filter);
+	gchar* str = gst_structure_to_string(stats);
+
+	GST_INFO_OBJECT(filter, "%s", str);
+
+	g_free(str);
+	gst_structure_free(stats);
+	filter->lastStatsLog = now;
+}
+
+static void gst_print_analysis_reset_qos(GstPrintAnalysis* filter)
+{
+	filter->qosProportion = 1.0;
+	filter->qosEarliestTime = GST_CLOCK_TIME_NONE;
+	filter->qosCredit = 0.0;
+}
+
+// frames the sink will drop anyway, or the share of frames over what the pipeline keeps up with
+static gboolean gst_print_analysis_should_shed(GstPrintAnalysis* filter, GstBuffer* buffer)
+{
+	GstBaseTransform* trans = GST_BASE_TRANSFORM(filter);
+	GstClockTime runningTime;
+
+	if (filter->qosMode == QOS_ANALYZE)
+		return FALSE;
+
+	runningTime = gst_segment_to_running_time(&trans->segment, GST_FORMAT_TIME, GST_BUFFER_PTS(buffer));
+
+	if (GST_CLOCK_TIME_IS_VALID(runningTime) && GST_CLOCK_TIME_IS_VALID(filter->qosEarliestTime) &&
+		runningTime <= filter->qosEarliestTime)
+		return TRUE;
+
+	// analyze 1 / proportion of the frames while downstream is falling behind
+	if (filter->qosProportion > 1.0)
+	{
+		filter->qosCredit += 1.0 / filter->qosProportion;
+
+		if (filter->qosCredit < 1.0)
+			return TRUE;
+
+		filter->qosCredit -= 1.0;
+	}
+
+	return FALSE;
+}
+
+static gboolean gst_print_analysis_src_event(GstBaseTransform* trans, GstEvent* event)
+{
+	GstPrintAnalysis* filter = GST_PRINT_ANALYSIS(trans);
+
+	if (GST_EVENT_TYPE(event) == GST_EVENT_QOS)
+	{
+		GstQOSType type;
+		gdouble proportion;
+		GstClockTimeDiff diff;
+		GstClockTime timestamp;
+
+		gst_event_parse_qos(event, &type, &proportion, &diff, &timestamp);
+
+		GST_OBJECT_LOCK(filter);
+
+		// frames before the earliest time are dropped by the sink, late streams are given
+		// twice the jitter to catch up, the same estimate GstBaseTransform uses
+		filter->qosProportion = proportion;
+		filter->qosEarliestTime = diff > 0 ? timestamp + 2 * diff : timestamp + diff;
+
+		GST_OBJECT_UNLOCK(filter);
+	}
+
+	return GST_BASE_TRANSFORM_CLASS(parent_class)->src_event(trans, event);
+}
+
+static gboolean gst_print_analysis_sink_event(GstBaseTransform* trans, GstEvent* event)
+{
+	GstPrintAnalysis* filter = GST_PRINT_ANALYSIS(trans);
+
+	if (GST_EVENT_TYPE(event) == GST_EVENT_FLUSH_STOP)
+	{
+		GST_OBJECT_LOCK(filter);
+		gst_print_analysis_reset_qos(filter);
+		GST_OBJECT_UNLOCK(filter);
+	}
+
+	return GST_BASE_TRANSFORM_CLASS(parent_class)->sink_event(trans, event);
+}
+
+// live pipelines buffer for the worst time a frame spent in the element
+static gboolean gst_print_analysis_query(GstBaseTransform* trans, GstPadDirection direction, GstQuery* query)
+{
+	GstPrintAnalysis* filter = GST_PRINT_ANALYSIS(trans);
+	gboolean res = GST_BASE_TRANSFORM_CLASS(parent_class)->query(trans, direction, query);
+
+	if (res && direction == GST_PAD_SRC && GST_QUERY_TYPE(query) == GST_QUERY_LATENCY)
+	{
+		gboolean live;
+		GstClockTime minLatency, maxLatency, processingTime;
+
+		gst_query_parse_latency(query, &live, &minLatency, &maxLatency);
+
+		GST_OBJECT_LOCK(filter);
+		processingTime = filter->maxProcessingTime;
+		filter->reportedLatency = processingTime;
+		GST_OBJECT_UNLOCK(filter);
+
+		minLatency += processingTime;
+
+		if (GST_CLOCK_TIME_IS_VALID(maxLatency))
+			maxLatency += processingTime;
+
+		GST_DEBUG_OBJECT(filter, "processing latency %" GST_TIME_FORMAT, GST_TIME_ARGS(processingTime));
+
+		gst_query_set_latency(query, live, minLatency, maxLatency);
+	}
+
+	return res;
+}
+
+static void gst_print_analysis_set_quality(GstPrintAnalysis* filter, AnalysisQuality quality)
+{
+	if (quality == filter->quality)
+		return;
+
+	GST_INFO_OBJECT(filter, "analysis quality %d -> %d, %" GST_TIME_FORMAT " per frame",
+		filter->quality, quality, GST_TIME_ARGS(filter->avgFrameTime));
+
+	filter->quality = quality;
+	filter->qualityFrames = 0;
+
+	if (filter->pImageAnalysis)
+		SetAnalysisQuality(filter->pImageAnalysis, quality);
+}
+
+// every level roughly halves the cost of the pass, so precision is dropped as soon as
+// the average runs over budget and only restored once frames take under half of it
+static void gst_print_analysis_adapt_quality(GstPrintAnalysis* filter, GstClockTime frameTime)
+{
+	GstClockTime budget = (GstClockTime) filter->frameBudgetUs * GST_USECOND;
+
+	if (!budget)
+		return;
+
+	filter->avgFrameTime = filter->qualityFrames ? (filter->avgFrameTime * 7 + frameTime) / 8 : frameTime;
+	filter->qualityFrames++;
+
+	if (filter->qualityFrames < QUALITY_SETTLE_FRAMES)
+		return;
+
+	if (filter->avgFrameTime > budget && filter->quality < QUALITY_LOWEST)
+		gst_print_analysis_set_quality(filter, filter->quality + 1);
+	else if (filter->avgFrameTime * 2 < budget && filter->quality > QUALITY_FULL && filter->qualityFrames >= QUALITY_RESTORE_FRAMES)
+		gst_print_analysis_set_quality(filter, filter->quality - 1);
+}
+
+// min, max, mean and trend of the partitions over the last windowMs of PTS, every partition
+// measured in the window unless ids lists some of them ("3,5,8")
+static GstStructure* gst_print_analysis_query_history(GstPrintAnalysis* filter, guint windowMs, const gchar* ids)
+{
+	GstStructure* history = gst_structure_new_empty("printanalysis-history");
+	HistoryAggregate* pAggregates = NULL;
+	int nAggregates = 0;
+
+	GST_OBJECT_LOCK(filter);
+
+	gint64 windowEnd = LatestHistoryTimestamp(&filter->history);
+	gint64 windowStart = windowMs ? MAX(windowEnd - (gint64) windowMs * GST_MSECOND, 0) : 0;
+
+	if (windowEnd < 0)
+		goto done;
+
+	if (ids && *ids)
+	{
+		gchar** idList = g_strsplit(ids, ",", -1);
+
+		for (int i = 0; idList[i]; i++)
+			nAggregates++;
+
+		pAggregates = g_new0(HistoryAggregate, MAX(nAggregates, 1));
+
+		for (int i = 0; i < nAggregates; i++)
+			pAggregates[i].iId = (gint32) g_ascii_strtoll(idList[i], NULL, 10);
+
+		g_strfreev(idList);
+	}
+	else if (filter->pImageAnalysis)
+	{
+		nAggregates = filter->pImageAnalysis->nPartitions;
+		pAggregates = g_new0(HistoryAggregate, MAX(nAggregates, 1));
+
+		for (int i = 0; i < nAggregates; i++)
+			pAggregates[i].iId = filter->pImageAnalysis->pPartitions[i].id;
+	}
+
+	QueryPartitionHistory(&filter->history, windowStart, windowEnd, pAggregates, nAggregates);
+
+	gst_structure_set(history,
+		"window-start", G_TYPE_UINT64, (guint64) windowStart,
+		"window-end", G_TYPE_UINT64, (guint64) windowEnd,
+		NULL);
+
+	for (int i = 0; i < nAggregates; i++)
+	{
+		HistoryAggregate* pAggregate = &pAggregates[i];
+		GstStructure* partition = gst_structure_new("partition", "samples", G_TYPE_INT, pAggregate->nSamples, NULL);
+		gchar* name;
+
+		for (int v = 0; v < HISTORY_VALUES && pAggregate->nSamples; v++)
+		{
+			name = g_strdup_printf("%s-min", HistoryValueName(v));
+			gst_structure_set(partition, name, G_TYPE_DOUBLE, pAggregate->fMin[v], NULL);
+			g_free(name);
+
+			name = g_strdup_printf("%s-max", HistoryValueName(v));
+			gst_structure_set(partition, name, G_TYPE_DOUBLE, pAggregate->fMax[v], NULL);
+			g_free(name);
+
+			name = g_strdup_printf("%s-mean", HistoryValueName(v));
+			gst_structure_set(partition, name, G_TYPE_DOUBLE, pAggregate->fMean[v], NULL);
+			g_free(name);
+
+			name = g_strdup_printf("%s-trend", HistoryValueName(v));
+			gst_structure_set(partition, name, G_TYPE_DOUBLE, pAggregate->fTrend[v], NULL);
+			g_free(name);
+		}
+
+		name = g_strdup_printf("partition-%d", pAggregate->iId);
+		gst_structure_set(history, name, GST_TYPE_STRUCTURE, partition, NULL);
+		g_free(name);
+
+		gst_structure_free(partition);
+	}
+
+done:
+	GST_OBJECT_UNLOCK(filter);
+
+	g_free(pAggregates);
+	return history;
+}
+
+// fields of the partition structures taken by the partition actions, all but the background
+// are needed to add a partition, an update changes the ones it has
+static const struct
+{
+	const gchar* name;
+	gsize offset;
+} partition_fields[] = {
+	{ "id", G_STRUCT_OFFSET(PrintPartition, id) },
+	{ "center-x", G_STRUCT_OFFSET(PrintPartition, centerX) },
+	{ "center-y", G_STRUCT_OFFSET(PrintPartition, centerY) },
+	{ "width", G_STRUCT_OFFSET(PrintPartition, width) },
+	{ "height", G_STRUCT_OFFSET(PrintPartition, height) },
+	{ "bg-r", G_STRUCT_OFFSET(PrintPartition, bg.rgb.r) },
+	{ "bg-g", G_STRUCT_OFFSET(PrintPartition, bg.rgb.g) },
+	{ "bg-b", G_STRUCT_OFFSET(PrintPartition, bg.rgb.b) },
+};
+
+#define PARTITION_REQUIRED_FIELDS 5
+
+// returns the number of fields found in the structure
+static guint gst_print_analysis_read_partition(const GstStructure* structure, PrintPartition* pPartition)
+{
+	guint nFields = 0;
+
+	for (guint i = 0; i < G_N_ELEMENTS(partition_fields); i++)
+	{
+		if (gst_structure_get_int(structure, partition_fields[i].name, (gint*)((guint8*)pPartition + partition_fields[i].offset)))
+			nFields++;
+	}
+
+	return nFields;
+}
+
+static gboolean gst_print_analysis_add_partition(GstPrintAnalysis* filter, const GstStructure* structure)
+{
+	PrintPartition partition = { 0 };
+	gboolean added = FALSE;
+
+	if (!structure || gst_print_analysis_read_partition(structure, &partition) < PARTITION_REQUIRED_FIELDS)
+		return FALSE;
+
+	GST_OBJECT_LOCK(filter);
+
+	// the configuration only takes a partition the analysis took
+	if (FindPartition((PrintPartition*)filter->partitionConfig->data, filter->partitionConfig->len, partition.id) < 0 &&
+		(!filter->pImageAnalysis || AddPartition(filter->pImageAnalysis, &partition)))
+	{
+		g_array_append_val(filter->partitionConfig, partition);
+		gst_print_analysis_partitions_changed(filter);
+		added = TRUE;
+	}
+
+	GST_OBJECT_UNLOCK(filter);
+
+	return added;
+}
+
+static gboolean gst_print_analysis_update_partition(GstPrintAnalysis* filter, const GstStructure* structure)
+{
+	gint id;
+	int i;
+	gboolean updated = FALSE;
+
+	if (!structure || !gst_structure_get_int(structure, "id", &id))
+		return FALSE;
+
+	GST_OBJECT_LOCK(filter);
+
+	i = FindPartition((PrintPartition*)filter->partitionConfig->data, filter->partitionConfig->len, id);
+
+	if (i >= 0)
+	{
+		// the update is read into a copy, the configuration keeps its partition if the analysis refuses it
+		PrintPartition partition = g_array_index(filter->partitionConfig, PrintPartition, i);
+
+		gst_print_analysis_read_partition(structure, &partition);
+
+		if (!filter->pImageAnalysis || UpdatePartition(filter->pImageAnalysis, &partition))
+		{
+			g_array_index(filter->partitionConfig, PrintPartition, i) = partition;
+			gst_print_analysis_partitions_changed(filter);
+			updated = TRUE;
+		}
+	}
+
+	GST_OBJECT_UNLOCK(filter);
+
+	return updated;
+}
+
+static gboolean gst_print_analysis_remove_partition(GstPrintAnalysis* filter, gint id)
+{
+	int i;
+	gboolean removed = FALSE;
+
+	GST_OBJECT_LOCK(filter);
+
+	i = FindPartition((PrintPartition*)filter->partitionConfig->data, filter->partitionConfig->len, id);
+
+	if (i >= 0 && (!filter->pImageAnalysis || RemovePartition(filter->pImageAnalysis, id)))
+	{
+		g_array_remove_index(filter->partitionConfig, i);
+		gst_print_analysis_partitions_changed(filter);
+		removed = TRUE;
+	}
+
+	GST_OBJECT_UNLOCK(filter);
+
+	return removed;
+}
+
+// replaces the partitions with the structures held by the fields of partitions, whatever their names
+static gboolean gst_print_analysis_set_partitions(GstPrintAnalysis* filter, const GstStructure* partitions)
+{
+	GArray* config = g_array_new(FALSE, TRUE, sizeof(PrintPartition));
+	gboolean set = TRUE;
+
+	for (gint i = 0; partitions && i < gst_structure_n_fields(partitions); i++)
+	{
+		GstStructure* structure = NULL;
+		PrintPartition partition = { 0 };
+
+		if (!gst_structure_get(partitions, gst_structure_nth_field_name(partitions, i), GST_TYPE_STRUCTURE, &structure, NULL))
+			continue;
+
+		if (gst_print_analysis_read_partition(structure, &partition) >= PARTITION_REQUIRED_FIELDS &&
+			FindPartition((PrintPartition*)config->data, config->len, partition.id) < 0)
+			g_array_append_val(config, partition);
+		else
+			set = FALSE;
+
+		gst_structure_free(structure);
+	}
+
+	if (set)
+	{
+		GST_OBJECT_LOCK(filter);
+
+		// the configuration is only replaced once the analysis took the partitions
+		if (filter->pImageAnalysis)
+			set = SetPartitions(filter->pImageAnalysis, (PrintPartition*)config->data, config->len);
+
+		if (set)
+		{
+			g_array_unref(filter->partitionConfig);
+			filter->partitionConfig = config;
+			config = NULL;
+			gst_print_analysis_partitions_changed(filter);
+		}
+
+		GST_OBJECT_UNLOCK(filter);
+	}
+
+	if (config)
+		g_array_unref(config);
+
+	return set;
+}
+
+// handlers may call the actions or read the properties, which take the object lock, so the
+// documents are built under it and only emitted after the frame released it
+static void gst_print_analysis_queue_json(GstPrintAnalysis* filter, guint signal, gchar* pJsonStr)
+{
+	if (!pJsonStr)
+		return;
+
+	FreeJsonStr(filter->pendingJson[signal]);
+	filter->pendingJson[signal] = pJsonStr;
+}
+
+static void gst_print_analysis_emit_json(GstPrintAnalysis* filter, guint signal, gchar* pJsonStr)
+{
+	if (!pJsonStr)
+		return;
+
+	g_signal_emit(filter, gst_print_analysis_signals[signal], 0, pJsonStr);
+	FreeJsonStr(pJsonStr);
+}
+
+static gchar* gst_print_analysis_timed_json(GstPrintAnalysis* filter, char* (*toJsonStr) (ImageAnalysis*))
+{
+	StageBegin(filter->pImageAnalysis, STAGE_JSON);
+	gchar* pJsonStr = toJsonStr(filter->pImageAnalysis);
+	StageEnd(filter->pImageAnalysis, STAGE_JSON);
+
+	return pJsonStr;
+}
+
+// the results document goes out for a mask of analyses, or for an analysis type that draws nothing
+static gboolean gst_print_analysis_reports_results(GstPrintAnalysis* filter, const AnalysisResults* pResults)
+{
+	return pResults->analyses && (filter->analyses || (pResults->analyses & ANALYSIS_REPORTED));
+}
+
+// every frame's results as soon as they are computed, the partitions once after they were configured,
+// while a history is kept they are measured on every frame for it
+static void gst_print_analysis_emit_frame(GstPrintAnalysis* filter, const AnalysisResults* pResults, GstClockTime pts)
+{
+	if (pResults->nPartitions && GST_CLOCK_TIME_IS_VALID(pts))
+		RecordPartitions(&filter->history, pts, pResults->pPartitions, pResults->nPartitions);
+
+	// every analysis of the pass is reported together
+	if (gst_print_analysis_reports_results(filter, pResults))
+		gst_print_analysis_queue_json(filter, ANALYSIS_RESULTS_SIGNAL, gst_print_analysis_timed_json(filter, AnalysisResultsToJsonStr));
+	else if (!filter->analyses && filter->analysisType == TOTAL && pResults->nPartitions && filter->partitionsPending)
+		gst_print_analysis_queue_json(filter, AOI_TOTAL_SIGNAL, gst_print_analysis_timed_json(filter, PartitionsArrayToJsonStr));
+
+	if (pResults->analyses & ANALYSIS_TOTAL)
+	{
+		filter->partitionsPending = FALSE;
+		filter->pImageAnalysis->bPartitionsReady = filter->historyCapacity > 0;
+		filter->lastEmitTime = g_get_monotonic_time();
+	}
+}
+
+// the partitions are measured on every frame and aggregated, one document carries the whole
+// interval, the per frame results only go out with it, from the last frame of the interval
+static void gst_print_analysis_emit_window(GstPrintAnalysis* filter, const AnalysisResults* pResults, GstClockTime pts)
+{
+	gint64 now = g_get_monotonic_time();
+
+	if (pResults->nPartitions && GST_CLOCK_TIME_IS_VALID(pts))
+	{
+		RecordPartitions(&filter->history, pts, pResults->pPartitions, pResults->nPartitions);
+		AddToPartitionWindow(&filter->window, pts, pResults->pPartitions, pResults->nPartitions);
+	}
+
+	if (!filter->lastEmitTime)
+		filter->lastEmitTime = now;
+
+	if (now - filter->lastEmitTime < (gint64) filter->emitIntervalMs * 1000)
+		return;
+
+	if (gst_print_analysis_reports_results(filter, pResults))
+		gst_print_analysis_queue_json(filter, ANALYSIS_RESULTS_SIGNAL, gst_print_analysis_timed_json(filter, AnalysisResultsToJsonStr));
+
+	if (filter->window.nFrames)
+	{
+		StageBegin(filter->pImageAnalysis, STAGE_JSON);
+		gchar* pWindowJsonStr = PartitionWindowToJsonStr(&filter->window);
+		StageEnd(filter->pImageAnalysis, STAGE_JSON);
+
+		gst_print_analysis_queue_json(filter, AOI_TOTAL_SIGNAL, pWindowJsonStr);
+	}
+
+	ResetPartitionWindow(&filter->window);
+	filter->lastEmitTime = now;
+}
+
+// the partitions are measured on every frame, only the ones that moved past the threshold since
+// they were last sent go out, with every partition on keyframes, see PartitionDelta for the format
+static void gst_print_analysis_emit_delta(GstPrintAnalysis* filter, const AnalysisResults* pResults, GstClockTime pts)
+{
+	if (gst_print_analysis_reports_results(filter, pResults))
+		gst_print_analysis_queue_json(filter, ANALYSIS_RESULTS_SIGNAL, gst_print_analysis_timed_json(filter, AnalysisResultsToJsonStr));
+
+	if (!pResults->nPartitions)
+		return;
+
+	if (GST_CLOCK_TIME_IS_VALID(pts))
+		RecordPartitions(&filter->history, pts, pResults->pPartitions, pResults->nPartitions);
+
+	StageBegin(filter->pImageAnalysis, STAGE_JSON);
+	gchar* pDeltaJsonStr = NULL;
+
+	if (UpdatePartitionDelta(&filter->delta, pResults->pPartitions, pResults->nPartitions, filter->deltaThreshold, filter->keyframeInterval) || filter->delta.bKeyframe)
+		pDeltaJsonStr = PartitionDeltaToJsonStr(filter->pImageAnalysis, &filter->delta);
+
+	StageEnd(filter->pImageAnalysis, STAGE_JSON);
+
+	gst_print_analysis_queue_json(filter, AOI_TOTAL_SIGNAL, pDeltaJsonStr);
+	filter->lastEmitTime = g_get_monotonic_time();
+}
+
 static GstFlowReturn gst_print_analysis_transform_frame_ip (GstVideoFilter * vfilter, GstVideoFrame * out)
 {
 	GstPrintAnalysis *filter = GST_PRINT_ANALYSIS (vfilter);
@@ -113,28 +809,71 @@ static GstFlowReturn gst_print_analysis_transform_frame_ip (GstVideoFilter * vfi
 	if (!filter->pImageAnalysis)
 		goto not_negotiated;
 
-	time_t currentTime;
-	time(&currentTime);
-
 	GST_OBJECT_LOCK (filter);
 	
-	filter->pImageAnalysis->iStride = filter->stride = GST_VIDEO_FRAME_PLANE_STRIDE(out, 0);
+	filter->stride = GST_VIDEO_FRAME_PLANE_STRIDE(out, 0);
 
-	filter->pImageAnalysis->analyze (filter->pImageAnalysis, out);
+	gint64 startTime = g_get_monotonic_time();
 
-	if (filter->analysisType == TOTAL && filter->pImageAnalysis->bPartitionsReady)
+	if (gst_print_analysis_should_shed(filter, out->buffer))
 	{
-		gchar* pPartitionsJsonStr = PartitionsArrayToJsonStr(filter->pImageAnalysis);
-		
-		if (pPartitionsJsonStr)
-			g_signal_emit(GST_PRINT_ANALYSIS(vfilter), gst_print_analysis_signals[AOI_TOTAL_SIGNAL], 0, pPartitionsJsonStr);
+		filter->shedFrames++;
 
-		filter->pImageAnalysis->bPartitionsReady = FALSE;
-		filter->prevSingalEmitTime = currentTime;
+		if (filter->qosMode == QOS_OVERLAY)
+			OverlayImage(filter->pImageAnalysis, GST_VIDEO_FRAME_PLANE_DATA(out, 0), filter->stride);
+
+		GST_LOG_OBJECT(filter, "late frame not analyzed");
+		goto done;
 	}
 
+	BeginStatsFrame(filter->pImageAnalysis);
+	StageBegin(filter->pImageAnalysis, STAGE_FRAME);
+
+	SetFrameTimestamp(filter->pImageAnalysis, GST_CLOCK_TIME_IS_VALID(GST_BUFFER_PTS(out->buffer)) ? (gint64) GST_BUFFER_PTS(out->buffer) : -1);
+
+	const AnalysisResults* pResults = AnalyzeImage(filter->pImageAnalysis, GST_VIDEO_FRAME_PLANE_DATA(out, 0), filter->stride);
+
+	if (pResults)
+		gst_print_analysis_publish_shm(filter, pResults, out->buffer);
+
+	if (!pResults)
+		GST_WARNING_OBJECT(filter, "frame with stride %d not analyzed, rows must hold the whole width", filter->stride);
+	else if (filter->emitIntervalMs)
+		gst_print_analysis_emit_window(filter, pResults, GST_BUFFER_PTS(out->buffer));
+	else if (filter->deltaThreshold > 0)
+		gst_print_analysis_emit_delta(filter, pResults, GST_BUFFER_PTS(out->buffer));
+	else
+		gst_print_analysis_emit_frame(filter, pResults, GST_BUFFER_PTS(out->buffer));
+
+	StageEnd(filter->pImageAnalysis, STAGE_FRAME);
+	EndStatsFrame(filter->pImageAnalysis);
+
+	gst_print_analysis_adapt_quality(filter, (GstClockTime)(g_get_monotonic_time() - startTime) * GST_USECOND);
+	gst_print_analysis_log_stats(filter);
+
+done:
+	filter->maxProcessingTime = MAX(filter->maxProcessingTime, (GstClockTime)(g_get_monotonic_time() - startTime) * GST_USECOND);
+
+	// downstream buffers for the latency it was told, ask for a new query once frames take a lot longer
+	gboolean latencyChanged = filter->maxProcessingTime > filter->reportedLatency + filter->reportedLatency / 4;
+
+	if (latencyChanged)
+		filter->reportedLatency = filter->maxProcessingTime;
+
+	gchar* pResultsJsonStr = filter->pendingJson[ANALYSIS_RESULTS_SIGNAL];
+	gchar* pTotalJsonStr = filter->pendingJson[AOI_TOTAL_SIGNAL];
+
+	filter->pendingJson[ANALYSIS_RESULTS_SIGNAL] = NULL;
+	filter->pendingJson[AOI_TOTAL_SIGNAL] = NULL;
+
 	GST_OBJECT_UNLOCK (filter);
 
+	gst_print_analysis_emit_json(filter, ANALYSIS_RESULTS_SIGNAL, pResultsJsonStr);
+	gst_print_analysis_emit_json(filter, AOI_TOTAL_SIGNAL, pTotalJsonStr);
+
+	if (latencyChanged)
+		gst_element_post_message(GST_ELEMENT(filter), gst_message_new_latency(GST_OBJECT(filter)));
+
 	return GST_FLOW_OK;
 
 not_negotiated:
@@ -154,15 +893,28 @@ static void gst_print_analysis_set_property(GObject * object, guint prop_id, con
 		filter->analysisType = (AnalysisType) g_value_get_uint(value);
 		break;
 
+	case PROP_ANALYSES:
+		filter->analyses = g_value_get_uint(value);
+		break;
+
 	case PROP_PARTITIONS_JSON:
-		if (filter->pImageAnalysis)
-		{
-			ParsePartitionsFromString(filter->pImageAnalysis, g_value_get_string(value));
+	{
+		int nPartitions = 0;
+		PrintPartition* pConfig = PartitionsFromJsonStr(g_value_get_string(value), &nPartitions);
 
-			if (filter->pImageAnalysis->nPartitions)
-				filter->pImageAnalysis->bPartitionsReady = TRUE;
+		// the configuration is only replaced once the analysis took the partitions, as for set-partitions
+		if (pConfig && (filter->pImageAnalysis ? SetPartitions(filter->pImageAnalysis, pConfig, nPartitions) : UniquePartitionIds(pConfig, nPartitions)))
+		{
+			g_array_set_size(filter->partitionConfig, 0);
+			g_array_append_vals(filter->partitionConfig, pConfig, nPartitions);
+			gst_print_analysis_partitions_changed(filter);
 		}
+		else if (pConfig)
+			GST_WARNING_OBJECT(filter, "partitions not set, %d partitions with duplicate ids or no memory for them", nPartitions);
+
+		free(pConfig);
 		break;
+	}
 	
 	case PROP_AOI_HEIGHT:
 		filter->aoiHeight = g_value_get_uint(value);
@@ -172,6 +924,74 @@ static void gst_print_analysis_set_property(GObject * object, guint prop_id, con
 		filter->partitions = g_value_get_uint(value);
 		break;
 
+	case PROP_AOI_BANDS_JSON:
+	{
+		int nBands = 0;
+		AoiBand* pConfig = AoiBandsFromJsonStr(g_value_get_string(value), &nBands);
+
+		if (pConfig)
+		{
+			g_array_set_size(filter->aoiBandConfig, 0);
+			g_array_append_vals(filter->aoiBandConfig, pConfig, nBands);
+
+			if (filter->pImageAnalysis)
+				SetAoiBands(filter->pImageAnalysis, pConfig, nBands);
+
+			free(pConfig);
+		}
+		break;
+	}
+
+	case PROP_BANDING_FRAMES:
+		filter->bandingFrames = g_value_get_uint(value);
+		break;
+
+	case PROP_NOZZLE_CHECKS_JSON:
+	{
+		int nChecks = 0;
+		NozzleCheck* pConfig = NozzleChecksFromJsonStr(g_value_get_string(value), &nChecks);
+
+		if (pConfig)
+		{
+			g_array_set_size(filter->nozzleCheckConfig, 0);
+			g_array_append_vals(filter->nozzleCheckConfig, pConfig, nChecks);
+
+			if (filter->pImageAnalysis && !SetNozzleChecks(filter->pImageAnalysis, pConfig, nChecks))
+				GST_WARNING_OBJECT(filter, "no memory for %d nozzle checks", nChecks);
+
+			free(pConfig);
+		}
+		break;
+	}
+
+	case PROP_DEFECT_ALPHA:
+		filter->defectAlpha = g_value_get_double(value);
+		break;
+
+	case PROP_DEFECT_SIGMA:
+		filter->defectSigma = g_value_get_double(value);
+		break;
+
+	case PROP_DEFECT_FRAMES:
+		filter->defectFrames = g_value_get_uint(value);
+		break;
+
+	case PROP_PAPER_WHITE:
+		filter->paperWhite = g_value_get_uint(value);
+		break;
+
+	case PROP_PAPER_WHITE_PERCENTILE:
+		filter->paperWhitePercentile = g_value_get_uint(value);
+		break;
+
+	case PROP_PAPER_WHITE_ALPHA:
+		filter->paperWhiteAlpha = g_value_get_double(value);
+		break;
+
+	case PROP_PAPER_WHITE_PARTITION:
+		filter->paperWhitePartition = g_value_get_int(value);
+		break;
+
 	case PROP_CONNECT_VALUES:
 		filter->connectValues = g_value_get_boolean(value);
 		break;
@@ -184,6 +1004,82 @@ static void gst_print_analysis_set_property(GObject * object, guint prop_id, con
 		filter->grayscaleType = g_value_get_uint(value);
 		break;
 
+	case PROP_CPU_LEVEL:
+		filter->cpuLevel = (CpuLevel) g_value_get_uint(value);
+
+		if (filter->cpuLevel > GetSupportedCpuLevel())
+			GST_WARNING_OBJECT(filter, "cpu level %s not supported, using %s", CpuLevelName(filter->cpuLevel), CpuLevelName(GetSupportedCpuLevel()));
+		break;
+
+	case PROP_STATS_ENABLED:
+		filter->statsEnabled = g_value_get_boolean(value);
+
+		// a new measurement starts when the timing is switched back on
+		if (filter->pImageAnalysis)
+			ResetStats(&filter->pImageAnalysis->stats);
+		break;
+
+	case PROP_STATS_LOG_INTERVAL:
+		filter->statsLogInterval = g_value_get_uint(value);
+		break;
+
+	case PROP_QOS_MODE:
+		filter->qosMode = (QosMode) g_value_get_uint(value);
+		gst_print_analysis_reset_qos(filter);
+		break;
+
+	case PROP_FRAME_BUDGET_US:
+		filter->frameBudgetUs = g_value_get_uint(value);
+		filter->qualityFrames = 0;
+
+		// without a budget every frame is analyzed in full
+		if (!filter->frameBudgetUs)
+			gst_print_analysis_set_quality(filter, QUALITY_FULL);
+		break;
+
+	case PROP_HISTORY_CAPACITY:
+		filter->historyCapacity = g_value_get_uint(value);
+
+		if (!InitPartitionHistory(&filter->history, filter->historyCapacity))
+			GST_WARNING_OBJECT(filter, "no memory for %u history samples", filter->historyCapacity);
+
+		// the history samples every frame, without reporting the partitions again
+		if (filter->historyCapacity && filter->pImageAnalysis && filter->pImageAnalysis->nPartitions)
+			filter->pImageAnalysis->bPartitionsReady = TRUE;
+		break;
+
+	case PROP_SHM_NAME:
+		g_free(filter->shmName);
+		filter->shmName = g_value_dup_string(value);
+		gst_print_analysis_open_shm(filter);
+		break;
+
+	case PROP_SHM_SLOTS:
+		filter->shmSlots = g_value_get_uint(value);
+		gst_print_analysis_open_shm(filter);
+		break;
+
+	case PROP_EMIT_INTERVAL_MS:
+		filter->emitIntervalMs = g_value_get_uint(value);
+		ResetPartitionWindow(&filter->window);
+		filter->lastEmitTime = 0;
+
+		// the window needs the partitions of every frame, the single frame mode one more measurement
+		gst_print_analysis_partitions_changed(filter);
+		break;
+
+	case PROP_DELTA_THRESHOLD:
+		filter->deltaThreshold = g_value_get_double(value);
+		ResetPartitionDelta(&filter->delta);
+
+		// the deltas need the partitions of every frame, starting with a keyframe
+		gst_print_analysis_partitions_changed(filter);
+		break;
+
+	case PROP_KEYFRAME_INTERVAL:
+		filter->keyframeInterval = g_value_get_uint(value);
+		break;
+
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
 		break;
@@ -192,15 +1088,31 @@ static void gst_print_analysis_set_property(GObject * object, guint prop_id, con
 	AnalysisOpts opts;
 	
 	opts.analysisType = filter->analysisType;
+	opts.analyses = filter->analyses;
 	opts.aoiHeight = filter->aoiHeight;
 	opts.aoiPartitions = filter->partitions;
 	opts.connectValues = filter->connectValues;
 	opts.blackoutType = filter->blackoutType;
 	opts.grayscaleType = filter->grayscaleType;
+	opts.cpuLevel = filter->cpuLevel;
+	opts.statsEnabled = filter->statsEnabled;
+	opts.bandingFrames = filter->bandingFrames;
+	opts.defectAlpha = filter->defectAlpha;
+	opts.defectSigma = filter->defectSigma;
+	opts.defectFrames = filter->defectFrames;
+	opts.paperWhite = filter->paperWhite;
+	opts.paperWhitePercentile = filter->paperWhitePercentile;
+	opts.paperWhiteAlpha = filter->paperWhiteAlpha;
+	opts.paperWhitePartition = filter->paperWhitePartition;
 	
 	if (filter->pImageAnalysis)
+	{
 		UpdatePrintAnalysisOpts(filter->pImageAnalysis, &opts);
 
+		if (prop_id == PROP_CPU_LEVEL)
+			GST_INFO_OBJECT(filter, "analysis kernels: %s", filter->pImageAnalysis->pKernels->pName);
+	}
+
 	GST_OBJECT_UNLOCK(filter);
 }
 
@@ -215,10 +1127,19 @@ static void gst_print_analysis_get_property(GObject * object, guint prop_id, GVa
 	case PROP_ANALYSIS_TYPE:
 		g_value_set_uint(value, filter->analysisType);
 		break;
+
+	case PROP_ANALYSES:
+		g_value_set_uint(value, filter->analyses);
+		break;
 	
 	case PROP_PARTITIONS_JSON:
-		g_value_set_string(value, "");
+	{
+		char* pJsonStr = PartitionsConfigToJsonStr((PrintPartition*)filter->partitionConfig->data, filter->partitionConfig->len);
+
+		g_value_set_string(value, pJsonStr ? pJsonStr : "");
+		FreeJsonStr(pJsonStr);
 		break;
+	}
 
 	case PROP_AOI_HEIGHT:
 		g_value_set_uint(value, filter->aoiHeight);
@@ -228,6 +1149,56 @@ static void gst_print_analysis_get_property(GObject * object, guint prop_id, GVa
 		g_value_set_uint(value, filter->partitions);
 		break;
 
+	case PROP_AOI_BANDS_JSON:
+	{
+		char* pJsonStr = AoiBandsToJsonStr((AoiBand*)filter->aoiBandConfig->data, filter->aoiBandConfig->len);
+
+		g_value_set_string(value, pJsonStr ? pJsonStr : "");
+		FreeJsonStr(pJsonStr);
+		break;
+	}
+
+	case PROP_BANDING_FRAMES:
+		g_value_set_uint(value, filter->bandingFrames);
+		break;
+
+	case PROP_NOZZLE_CHECKS_JSON:
+	{
+		char* pJsonStr = NozzleChecksToJsonStr((NozzleCheck*)filter->nozzleCheckConfig->data, filter->nozzleCheckConfig->len);
+
+		g_value_set_string(value, pJsonStr ? pJsonStr : "");
+		FreeJsonStr(pJsonStr);
+		break;
+	}
+
+	case PROP_DEFECT_ALPHA:
+		g_value_set_double(value, filter->defectAlpha);
+		break;
+
+	case PROP_DEFECT_SIGMA:
+		g_value_set_double(value, filter->defectSigma);
+		break;
+
+	case PROP_DEFECT_FRAMES:
+		g_value_set_uint(value, filter->defectFrames);
+		break;
+
+	case PROP_PAPER_WHITE:
+		g_value_set_uint(value, filter->paperWhite);
+		break;
+
+	case PROP_PAPER_WHITE_PERCENTILE:
+		g_value_set_uint(value, filter->paperWhitePercentile);
+		break;
+
+	case PROP_PAPER_WHITE_ALPHA:
+		g_value_set_double(value, filter->paperWhiteAlpha);
+		break;
+
+	case PROP_PAPER_WHITE_PARTITION:
+		g_value_set_int(value, filter->paperWhitePartition);
+		break;
+
 	case PROP_CONNECT_VALUES:
 		g_value_set_boolean(value, filter->connectValues);
 		break;
@@ -240,6 +1211,62 @@ static void gst_print_analysis_get_property(GObject * object, guint prop_id, GVa
 	case PROP_GRAYSCALE_TYPE:
 		g_value_set_uint(value, filter->grayscaleType);
 		break;
+
+	case PROP_CPU_LEVEL:
+		g_value_set_uint(value, filter->cpuLevel);
+		break;
+
+	case PROP_ACTIVE_CPU_LEVEL:
+		g_value_set_string(value, filter->pImageAnalysis ? filter->pImageAnalysis->pKernels->pName : GetAnalysisKernels(filter->cpuLevel)->pName);
+		break;
+
+	case PROP_STATS_ENABLED:
+		g_value_set_boolean(value, filter->statsEnabled);
+		break;
+
+	case PROP_STATS_LOG_INTERVAL:
+		g_value_set_uint(value, filter->statsLogInterval);
+		break;
+
+	case PROP_STATS:
+		g_value_take_boxed(value, gst_print_analysis_stats_structure(filter));
+		break;
+
+	case PROP_QOS_MODE:
+		g_value_set_uint(value, filter->qosMode);
+		break;
+
+	case PROP_FRAME_BUDGET_US:
+		g_value_set_uint(value, filter->frameBudgetUs);
+		break;
+
+	case PROP_QUALITY:
+		g_value_set_uint(value, filter->quality);
+		break;
+
+	case PROP_HISTORY_CAPACITY:
+		g_value_set_uint(value, filter->historyCapacity);
+		break;
+
+	case PROP_SHM_NAME:
+		g_value_set_string(value, filter->shmName);
+		break;
+
+	case PROP_SHM_SLOTS:
+		g_value_set_uint(value, filter->shmSlots);
+		break;
+
+	case PROP_EMIT_INTERVAL_MS:
+		g_value_set_uint(value, filter->emitIntervalMs);
+		break;
+
+	case PROP_DELTA_THRESHOLD:
+		g_value_set_double(value, filter->deltaThreshold);
+		break;
+
+	case PROP_KEYFRAME_INTERVAL:
+		g_value_set_uint(value, filter->keyframeInterval);
+		break;
 	
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
@@ -253,15 +1280,25 @@ static void gst_print_analysis_finalize(GObject* object)
 {
 	GstPrintAnalysis* filter = GST_PRINT_ANALYSIS(object);
 	
-	if (filter->pImageAnalysis)
-	{
-		filter->pImageAnalysis->deinit(filter->pImageAnalysis);
-		free(filter->pImageAnalysis);
-		filter->pImageAnalysis = NULL;
-	}
+	DestroyImageAnalysis(filter->pImageAnalysis);
+	filter->pImageAnalysis = NULL;
+
+	FreePartitionHistory(&filter->history);
+
+	DestroyResultsShm(filter->shmWriter);
+	filter->shmWriter = NULL;
+	g_free(filter->shmName);
 
+	FreePartitionWindow(&filter->window);
+	FreePartitionDelta(&filter->delta);
+	g_array_unref(filter->partitionConfig);
+	g_array_unref(filter->aoiBandConfig);
+	g_array_unref(filter->nozzleCheckConfig);
+
+#ifdef _WIN32
 	if (filter->gdiObj)
 		gdiplus_shutdown(filter->gdiObj);
+#endif
 
 	// Chain up to the parent class's finalize method
 	G_OBJECT_CLASS(gst_print_analysis_parent_class)->finalize(object);
@@ -271,6 +1308,7 @@ static void gst_print_analysis_class_init (GstPrintAnalysisClass * klass)
 {
 	GObjectClass* gobject_class = (GObjectClass*)klass;
 	GstElementClass* element_class = (GstElementClass*)klass;
+	GstBaseTransformClass* trans_class = (GstBaseTransformClass*)klass;
 	GstVideoFilterClass* vfilter_class = (GstVideoFilterClass*)klass;
 
 	GST_DEBUG_CATEGORY_INIT(printanalysis_debug, "printanalysis", 0, "printanalysis");
@@ -284,10 +1322,22 @@ static void gst_print_analysis_class_init (GstPrintAnalysisClass * klass)
 		g_param_spec_uint(
 			"analysis-type",
 			"Analysis Type",
-			"Type of analysis to perform",
+			"Type of analysis to perform (0 intensity, 1 mean, 2 histogram, 3 total, 4 none, 5 row profile, 6 banding, 7 nozzle check, 8 defects)",
 			INTENSITY,
+			DEFECTS,
 			NONE,
-			NONE,
+			G_PARAM_READWRITE));
+
+	g_object_class_install_property(
+		gobject_class,
+		PROP_ANALYSES,
+		g_param_spec_uint(
+			"analyses",
+			"Analyses",
+			"Mask of analyses computed in a single pass (1 intensity, 2 mean, 4 histogram, 8 total, 32 row profile, 64 banding, 128 nozzle check, 256 defects), 0 to use analysis-type",
+			0,
+			ANALYSIS_ALL,
+			0,
 			G_PARAM_READWRITE));
 	
 	g_object_class_install_property(
@@ -324,6 +1374,122 @@ static void gst_print_analysis_class_init (GstPrintAnalysisClass * klass)
 			1,
 			G_PARAM_READWRITE));
 
+	g_object_class_install_property(
+		gobject_class,
+		PROP_AOI_BANDS_JSON,
+		g_param_spec_string(
+			"aoi-bands-json",
+			"AOI Bands Json",
+			"Bands profiled in one pass, {\"bands\":[{\"x\",\"y\",\"width\",\"height\",\"partitions\"}]}, replaces aoi-height and aoi-partitions",
+			NULL,
+			G_PARAM_READWRITE));
+
+	g_object_class_install_property(
+		gobject_class,
+		PROP_BANDING_FRAMES,
+		g_param_spec_uint(
+			"banding-frames",
+			"Banding Frames",
+			"Frames whose column spectra are averaged before the banding peaks are reported",
+			1,
+			G_MAXUINT,
+			1,
+			G_PARAM_READWRITE));
+
+	g_object_class_install_property(
+		gobject_class,
+		PROP_NOZZLE_CHECKS_JSON,
+		g_param_spec_string(
+			"nozzle-checks-json",
+			"Nozzle Checks Json",
+			"Nozzle check ladders in AOI partitions, {\"checks\":[{\"partition\",\"first\",\"pitch\",\"lines\",\"tolerance\",\"min_contrast\"}]}",
+			NULL,
+			G_PARAM_READWRITE));
+
+	g_object_class_install_property(
+		gobject_class,
+		PROP_DEFECT_ALPHA,
+		g_param_spec_double(
+			"defect-alpha",
+			"Defect Alpha",
+			"Weight of every frame in the column baselines of the defect analysis, changing it learns them again",
+			0.0001,
+			1.0,
+			DEFECT_DEFAULT_ALPHA,
+			G_PARAM_READWRITE));
+
+	g_object_class_install_property(
+		gobject_class,
+		PROP_DEFECT_SIGMA,
+		g_param_spec_double(
+			"defect-sigma",
+			"Defect Sigma",
+			"Standard deviations off its baseline a column deviates at",
+			0.5,
+			G_MAXDOUBLE,
+			DEFECT_DEFAULT_SIGMA,
+			G_PARAM_READWRITE));
+
+	g_object_class_install_property(
+		gobject_class,
+		PROP_DEFECT_FRAMES,
+		g_param_spec_uint(
+			"defect-frames",
+			"Defect Frames",
+			"Consecutive frames a column has to deviate in before it is reported as a defect",
+			1,
+			G_MAXUINT,
+			DEFECT_DEFAULT_FRAMES,
+			G_PARAM_READWRITE));
+
+	g_object_class_install_property(
+		gobject_class,
+		PROP_PAPER_WHITE,
+		g_param_spec_uint(
+			"paper-white",
+			"Paper White",
+			"Background the saturation is measured against (0 bg of the partitions, 1 brightest columns of every partition, 2 the paper-white-partition)",
+			PAPER_WHITE_CONFIGURED,
+			PAPER_WHITE_PARTITION,
+			PAPER_WHITE_CONFIGURED,
+			G_PARAM_READWRITE));
+
+	g_object_class_install_property(
+		gobject_class,
+		PROP_PAPER_WHITE_PERCENTILE,
+		g_param_spec_uint(
+			"paper-white-percentile",
+			"Paper White Percentile",
+			"Percentile of the columns of a partition taken as its paper white",
+			1,
+			100,
+			PAPER_WHITE_DEFAULT_PERCENTILE,
+			G_PARAM_READWRITE));
+
+	g_object_class_install_property(
+		gobject_class,
+		PROP_PAPER_WHITE_ALPHA,
+		g_param_spec_double(
+			"paper-white-alpha",
+			"Paper White Alpha",
+			"Weight of every frame in the rolling paper white of the partitions",
+			0.0001,
+			1.0,
+			PAPER_WHITE_DEFAULT_ALPHA,
+			G_PARAM_READWRITE));
+
+	g_object_class_install_property(
+		gobject_class,
+		PROP_PAPER_WHITE_PARTITION,
+		g_param_spec_int(
+			"paper-white-partition",
+			"Paper White Partition",
+			"Id of the partition on blank paper the paper white of all partitions is measured in",
+			G_MININT,
+			G_MAXINT,
+			0,
+			G_PARAM_READWRITE));
+
 	g_object_class_install_property(
 		gobject_class,
 		PROP_CONNECT_VALUES,
@@ -357,6 +1523,166 @@ static void gst_print_analysis_class_init (GstPrintAnalysisClass * klass)
 			GRAY_NONE,
 			GRAY_NONE,
 			G_PARAM_READWRITE));
+
+	g_object_class_install_property(
+		gobject_class,
+		PROP_CPU_LEVEL,
+		g_param_spec_uint(
+			"cpu-level",
+			"CPU Level",
+			"Instruction set of the analysis kernels (0 auto, 1 scalar, 2 sse4.1, 3 avx2, 4 avx512), capped to what the cpu supports",
+			CPU_LEVEL_AUTO,
+			CPU_LEVEL_AVX512,
+			CPU_LEVEL_AUTO,
+			G_PARAM_READWRITE));
+
+	g_object_class_install_property(
+		gobject_class,
+		PROP_ACTIVE_CPU_LEVEL,
+		g_param_spec_string(
+			"active-cpu-level",
+			"Active CPU Level",
+			"Instruction set of the analysis kernels in use",
+			NULL,
+			G_PARAM_READABLE));
+
+	g_object_class_install_property(
+		gobject_class,
+		PROP_STATS_ENABLED,
+		g_param_spec_boolean(
+			"stats-enabled",
+			"Stats Enabled",
+			"Time the stages of every frame",
+			TRUE,
+			G_PARAM_READWRITE));
+
+	g_object_class_install_property(
+		gobject_class,
+		PROP_STATS_LOG_INTERVAL,
+		g_param_spec_uint(
+			"stats-log-interval",
+			"Stats Log Interval",
+			"Seconds between stats written to the debug log, 0 to disable",
+			0,
+			G_MAXUINT,
+			10,
+			G_PARAM_READWRITE));
+
+	g_object_class_install_property(
+		gobject_class,
+		PROP_STATS,
+		g_param_spec_boxed(
+			"stats",
+			"Stats",
+			"Frame count, min, mean, p99 and max microseconds of every analysis stage",
+			GST_TYPE_STRUCTURE,
+			G_PARAM_READABLE));
+
+	g_object_class_install_property(
+		gobject_class,
+		PROP_QOS_MODE,
+		g_param_spec_uint(
+			"qos-mode",
+			"QoS Mode",
+			"Frames that are late downstream (0 analyzed, 1 overlay only, 2 passed through untouched)",
+			QOS_ANALYZE,
+			QOS_PASSTHROUGH,
+			QOS_OVERLAY,
+			G_PARAM_READWRITE));
+
+	g_object_class_install_property(
+		gobject_class,
+		PROP_FRAME_BUDGET_US,
+		g_param_spec_uint(
+			"frame-budget-us",
+			"Frame Budget",
+			"Microseconds a frame may spend in the element before fewer rows are sampled and less is drawn, 0 for full quality",
+			0,
+			G_MAXUINT,
+			0,
+			G_PARAM_READWRITE));
+
+	g_object_class_install_property(
+		gobject_class,
+		PROP_QUALITY,
+		g_param_spec_uint(
+			"quality",
+			"Quality",
+			"Current analysis quality (0 full, 1 half the AOI rows, 2 a quarter without labels, 3 an eighth without graphs)",
+			QUALITY_FULL,
+			QUALITY_LOWEST,
+			QUALITY_FULL,
+			G_PARAM_READABLE));
+
+	g_object_class_install_property(
+		gobject_class,
+		PROP_HISTORY_CAPACITY,
+		g_param_spec_uint(
+			"history-capacity",
+			"History Capacity",
+			"Partition samples kept for query-history, one per partition and frame, the partitions are measured on every frame while any are kept, 0 to keep none",
+			0,
+			G_MAXINT / sizeof(PartitionSample),
+			0,
+			G_PARAM_READWRITE));
+
+	g_object_class_install_property(
+		gobject_class,
+		PROP_SHM_NAME,
+		g_param_spec_string(
+			"shm-name",
+			"Shared Memory Name",
+			"Shared memory ring every frame's results are published in for local readers (see imageanalysis-shm.h), created with the first frame and again when the AOI layout changes, NULL to publish none",
+			NULL,
+			G_PARAM_READWRITE));
+
+	g_object_class_install_property(
+		gobject_class,
+		PROP_SHM_SLOTS,
+		g_param_spec_uint(
+			"shm-slots",
+			"Shared Memory Slots",
+			"Records the shared memory ring holds before the oldest is overwritten",
+			1,
+			4096,
+			64,
+			G_PARAM_READWRITE));
+
+	g_object_class_install_property(
+		gobject_class,
+		PROP_EMIT_INTERVAL_MS,
+		g_param_spec_uint(
+			"emit-interval-ms",
+			"Emit Interval",
+			"Milliseconds between emissions, partitions are measured on every frame and sent as the min, max and mean of the interval, 0 to emit every frame",
+			0,
+			G_MAXUINT,
+			0,
+			G_PARAM_READWRITE));
+
+	g_object_class_install_property(
+		gobject_class,
+		PROP_DELTA_THRESHOLD,
+		g_param_spec_double(
+			"delta-threshold",
+			"Delta Threshold",
+			"Change of any partition value that gets the partition sent again, partitions are measured on every frame and only the ones that moved are emitted, 0 to emit every frame",
+			0,
+			G_MAXDOUBLE,
+			0,
+			G_PARAM_READWRITE));
+
+	g_object_class_install_property(
+		gobject_class,
+		PROP_KEYFRAME_INTERVAL,
+		g_param_spec_uint(
+			"keyframe-interval",
+			"Keyframe Interval",
+			"Frames between emissions of every partition in delta-threshold mode, 0 to send them only when the partitions change",
+			0,
+			G_MAXUINT,
+			300,
+			G_PARAM_READWRITE));
 	
 	gst_print_analysis_signals[AOI_TOTAL_SIGNAL] = g_signal_new(
 		"aoi-total-signal",                 // Signal name
@@ -371,6 +1697,98 @@ static void gst_print_analysis_class_init (GstPrintAnalysisClass * klass)
 		G_TYPE_STRING					    // Parameter type: String
 	);
 
+	gst_print_analysis_signals[ANALYSIS_RESULTS_SIGNAL] = g_signal_new(
+		"analysis-results-signal",          // Signal name
+		G_TYPE_FROM_CLASS(klass),           // Signal owner type
+		G_SIGNAL_RUN_LAST,                  // Signal flags
+		0,									// Default handler offset
+		NULL,								// Accumulator
+		NULL,								// Accumulator data
+		NULL,								// Custom marshaller
+		G_TYPE_NONE,						// Return type
+		1,									// Number of parameters
+		G_TYPE_STRING					    // Parameter type: String
+	);
+
+	trans_class->src_event = GST_DEBUG_FUNCPTR(gst_print_analysis_src_event);
+	trans_class->sink_event = GST_DEBUG_FUNCPTR(gst_print_analysis_sink_event);
+	trans_class->query = GST_DEBUG_FUNCPTR(gst_print_analysis_query);
+
+	gst_print_analysis_signals[QUERY_HISTORY_SIGNAL] = g_signal_new(
+		"query-history",                    // Signal name
+		G_TYPE_FROM_CLASS(klass),           // Signal owner type
+		G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,	// Signal flags
+		G_STRUCT_OFFSET(GstPrintAnalysisClass, query_history),	// Class handler
+		NULL,								// Accumulator
+		NULL,								// Accumulator data
+		NULL,								// Custom marshaller
+		GST_TYPE_STRUCTURE,					// Return type
+		2,									// Number of parameters
+		G_TYPE_UINT,						// Window in ms, 0 for the whole history
+		G_TYPE_STRING						// Comma separated partition ids, NULL for all
+	);
+
+	klass->query_history = gst_print_analysis_query_history;
+
+	// the partition actions may be called from the analysis-results and aoi-total handlers, the
+	// documents are emitted after the frame released the object lock
+	gst_print_analysis_signals[ADD_PARTITION_SIGNAL] = g_signal_new(
+		"add-partition",                    // Signal name
+		G_TYPE_FROM_CLASS(klass),           // Signal owner type
+		G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,	// Signal flags
+		G_STRUCT_OFFSET(GstPrintAnalysisClass, add_partition),	// Class handler
+		NULL,								// Accumulator
+		NULL,								// Accumulator data
+		NULL,								// Custom marshaller
+		G_TYPE_BOOLEAN,						// Return type, FALSE if the id is taken or a field is missing
+		1,									// Number of parameters
+		GST_TYPE_STRUCTURE					// id, center-x, center-y, width, height, bg-r, bg-g and bg-b
+	);
+
+	gst_print_analysis_signals[UPDATE_PARTITION_SIGNAL] = g_signal_new(
+		"update-partition",                 // Signal name
+		G_TYPE_FROM_CLASS(klass),           // Signal owner type
+		G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,	// Signal flags
+		G_STRUCT_OFFSET(GstPrintAnalysisClass, update_partition),	// Class handler
+		NULL,								// Accumulator
+		NULL,								// Accumulator data
+		NULL,								// Custom marshaller
+		G_TYPE_BOOLEAN,						// Return type, FALSE if there is no partition with the id
+		1,									// Number of parameters
+		GST_TYPE_STRUCTURE					// id and the fields to change
+	);
+
+	gst_print_analysis_signals[REMOVE_PARTITION_SIGNAL] = g_signal_new(
+		"remove-partition",                 // Signal name
+		G_TYPE_FROM_CLASS(klass),           // Signal owner type
+		G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,	// Signal flags
+		G_STRUCT_OFFSET(GstPrintAnalysisClass, remove_partition),	// Class handler
+		NULL,								// Accumulator
+		NULL,								// Accumulator data
+		NULL,								// Custom marshaller
+		G_TYPE_BOOLEAN,						// Return type, FALSE if there is no partition with the id
+		1,									// Number of parameters
+		G_TYPE_INT							// Partition id
+	);
+
+	gst_print_analysis_signals[SET_PARTITIONS_SIGNAL] = g_signal_new(
+		"set-partitions",                   // Signal name
+		G_TYPE_FROM_CLASS(klass),           // Signal owner type
+		G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,	// Signal flags
+		G_STRUCT_OFFSET(GstPrintAnalysisClass, set_partitions),	// Class handler
+		NULL,								// Accumulator
+		NULL,								// Accumulator data
+		NULL,								// Custom marshaller
+		G_TYPE_BOOLEAN,						// Return type, FALSE and nothing changes if a partition is incomplete
+		1,									// Number of parameters
+		GST_TYPE_STRUCTURE					// A partition structure in every field, as for add-partition
+	);
+
+	klass->add_partition = gst_print_analysis_add_partition;
+	klass->update_partition = gst_print_analysis_update_partition;
+	klass->remove_partition = gst_print_analysis_remove_partition;
+	klass->set_partitions = gst_print_analysis_set_partitions;
+
 	vfilter_class->set_info = GST_DEBUG_FUNCPTR(gst_print_analysis_set_info);
 	vfilter_class->transform_frame_ip =
 		GST_DEBUG_FUNCPTR(gst_print_analysis_transform_frame_ip);
@@ -394,9 +1812,41 @@ static void gst_print_analysis_init(GstPrintAnalysis* filter)
 	GObjectClass* gobject_class = G_OBJECT_CLASS(filter);
 	//gobject_class->finalize = gst_print_analysis_finalize;
 
-	filter->prevSingalEmitTime = 0;
+	filter->emitIntervalMs = 0;
+	filter->lastEmitTime = 0;
+	filter->deltaThreshold = 0;
+	filter->keyframeInterval = 300;
+	filter->statsEnabled = TRUE;
+	filter->bandingFrames = 1;
+	filter->defectAlpha = DEFECT_DEFAULT_ALPHA;
+	filter->defectSigma = DEFECT_DEFAULT_SIGMA;
+	filter->defectFrames = DEFECT_DEFAULT_FRAMES;
+	filter->paperWhite = PAPER_WHITE_CONFIGURED;
+	filter->paperWhitePercentile = PAPER_WHITE_DEFAULT_PERCENTILE;
+	filter->paperWhiteAlpha = PAPER_WHITE_DEFAULT_ALPHA;
+	filter->statsLogInterval = 10;
+	filter->lastStatsLog = 0;
+	filter->qosMode = QOS_OVERLAY;
+	filter->shedFrames = 0;
+	filter->maxProcessingTime = 0;
+	filter->reportedLatency = 0;
+	filter->frameBudgetUs = 0;
+	filter->quality = QUALITY_FULL;
+	filter->avgFrameTime = 0;
+	filter->qualityFrames = 0;
+	filter->shmName = NULL;
+	filter->shmSlots = 64;
+	filter->shmWriter = NULL;
+	filter->shmColumnValues = -1;
+	filter->shmBands = 0;
+	filter->partitionConfig = g_array_new(FALSE, TRUE, sizeof(PrintPartition));
+	filter->aoiBandConfig = g_array_new(FALSE, TRUE, sizeof(AoiBand));
+	filter->nozzleCheckConfig = g_array_new(FALSE, TRUE, sizeof(NozzleCheck));
+	gst_print_analysis_reset_qos(filter);
 	
+#ifdef _WIN32
 	filter->gdiObj = gdiplus_startup();
 
 	gdiplus_setfont(filter->gdiObj, L"Arial", 12, (color_c) {255, 255, 255});
+#endif
 }
@@ -4,7 +4,7 @@
 #include <gst/video/video.h>
 #include <gst/video/gstvideofilter.h>
 
-#include "imageanalysis.h"
+#include "libimageanalysis.h"
 #include "gdiplus_c.h"
 
 G_BEGIN_DECLS
@@ -21,6 +21,14 @@ G_BEGIN_DECLS
 typedef struct _GstPrintAnalysis GstPrintAnalysis;
 typedef struct _GstPrintAnalysisClass GstPrintAnalysisClass;
 
+// what happens to frames that are already late downstream
+typedef enum
+{
+	QOS_ANALYZE,		// analyze every frame
+	QOS_OVERLAY,		// late frames only get the static overlay
+	QOS_PASSTHROUGH		// late frames are pushed untouched
+} QosMode;
+
 /**
  * GstPrintAnalysis:
  *
@@ -38,15 +46,61 @@ struct _GstPrintAnalysis
 	gint stride;
 
 	AnalysisType analysisType;
+	guint analyses;
 	guint aoiHeight;
 	guint partitions;
 	gboolean connectValues;
 	BlackoutType blackoutType;
 	GrayscaleType grayscaleType;
+	guint bandingFrames;
+	gdouble defectAlpha;
+	gdouble defectSigma;
+	guint defectFrames;
+	PaperWhiteMode paperWhite;
+	guint paperWhitePercentile;
+	gdouble paperWhiteAlpha;
+	gint paperWhitePartition;
+	CpuLevel cpuLevel;
+	gboolean statsEnabled;
+	guint statsLogInterval;
+	gint64 lastStatsLog;
+
+	QosMode qosMode;
+	gdouble qosProportion;
+	GstClockTime qosEarliestTime;
+	gdouble qosCredit;
+	guint64 shedFrames;
+	GstClockTime maxProcessingTime;
+	GstClockTime reportedLatency;
+
+	guint frameBudgetUs;
+	AnalysisQuality quality;
+	GstClockTime avgFrameTime;
+	guint qualityFrames;
+
+	PartitionHistory history;
+	guint historyCapacity;
+
+	gchar* shmName;
+	guint shmSlots;
+	ResultsShmWriter* shmWriter;
+	gint shmColumnValues;		// column values and bands of the AOI layout the ring is sized for, -1 until a frame laid it out
+	gint shmBands;
 
 	ImageAnalysis* pImageAnalysis;
+	GArray* partitionConfig;	// PrintPartition configuration, applied to every new pImageAnalysis
+	GArray* aoiBandConfig;		// AoiBand configuration, empty for the centered aoi-height band
+	GArray* nozzleCheckConfig;	// NozzleCheck configuration
 
-	time_t prevSingalEmitTime;
+	guint emitIntervalMs;
+	gint64 lastEmitTime;
+	gboolean partitionsPending;	// the single frame mode has not reported the partitions since they changed
+	gchar* pendingJson[2];		// aoi-total and analysis-results documents of the frame, emitted once the object lock is released
+	PartitionWindow window;
+
+	gdouble deltaThreshold;
+	guint keyframeInterval;
+	PartitionDelta delta;
 	//void (*process) (GstPrintAnalysis* filter, GstVideoFrame * frame);
 	gdiplus_c* gdiObj;
 };
@@ -54,6 +108,13 @@ struct _GstPrintAnalysis
 struct _GstPrintAnalysisClass
 {
   GstVideoFilterClass parent_class;
+
+  /* actions */
+  GstStructure* (*query_history) (GstPrintAnalysis* filter, guint windowMs, const gchar* ids);
+  gboolean (*add_partition) (GstPrintAnalysis* filter, const GstStructure* partition);
+  gboolean (*update_partition) (GstPrintAnalysis* filter, const GstStructure* partition);
+  gboolean (*remove_partition) (GstPrintAnalysis* filter, gint id);
+  gboolean (*set_partitions) (GstPrintAnalysis* filter, const GstStructure* partitions);
 };
 
 GType gst_print_analysis_get_type (void);
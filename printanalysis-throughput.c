@@ -0,0 +1,347 @@
+#include <gst/gst.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#endif
+
+// runs videotestsrc ! printanalysis ! fakesink sync=false for every format and mode and prints one
+// JSON object per configuration with the frame rate, the per buffer latency of the element, the
+// process CPU load and the buffers and memories allocated while it ran
+//
+//   printanalysis-throughput [--buffers N] [--width W] [--height H] [--format BGRx|YUY2] [--mode NAME]
+//
+// the printanalysis plugin is looked up through GST_PLUGIN_PATH
+
+typedef struct ThroughputMode
+{
+	const gchar* pName;
+	guint analysisType;
+	guint analyses;
+	gboolean bPartitions;
+} ThroughputMode;
+
+static const ThroughputMode modes[] =
+{
+	{ "intensity", 0, 0, FALSE },
+	{ "mean", 1, 0, FALSE },
+	{ "histogram", 2, 0, FALSE },
+	{ "total", 3, 0, TRUE },
+	{ "all", 4, 15, TRUE },
+	{ "row-profile", 5, 0, FALSE },
+	{ "profiles", 4, 33, FALSE },
+	{ "banding", 6, 0, FALSE },
+	{ "nozzle-check", 7, 0, FALSE },
+	{ "defects", 8, 0, FALSE },
+};
+
+static const gchar* formats[] = { "BGRx", "YUY2" };
+
+// state shared with the tracer hooks, one pipeline runs at a time
+typedef struct ThroughputRun
+{
+	GstElement* pAnalysis;
+	const gchar* pPartitionsJson;	// re-armed before every buffer, the element measures partitions once per setting
+	GstClockTime startTime;
+	GstClockTime* pLatencies;
+	guint nLatencies;
+	guint nMaxLatencies;
+	gint nBuffers;
+	gint nMemories;
+	guint64 nJsonBytes;
+} ThroughputRun;
+
+static ThroughputRun run;
+
+static gint iBuffers = 500;
+static gint iWidth = 1920;
+static gint iHeight = 1080;
+static gchar* pFormatName = NULL;
+static gchar* pModeName = NULL;
+
+static GOptionEntry entries[] =
+{
+	{ "buffers", 'n', 0, G_OPTION_ARG_INT, &iBuffers, "Buffers pushed per configuration", "N" },
+	{ "width", 'w', 0, G_OPTION_ARG_INT, &iWidth, "Frame width", "W" },
+	{ "height", 'H', 0, G_OPTION_ARG_INT, &iHeight, "Frame height", "H" },
+	{ "format", 'f', 0, G_OPTION_ARG_STRING, &pFormatName, "Only run BGRx or YUY2", "FORMAT" },
+	{ "mode", 'm', 0, G_OPTION_ARG_STRING, &pModeName, "Only run intensity, mean, histogram, total, all, row-profile, profiles, banding, nozzle-check or defects", "NAME" },
+	{ NULL }
+};
+
+/* tracer timing the element from the push into its sink pad to the push out of its src pad */
+
+typedef struct _ThroughputTracer
+{
+	GstTracer parent;
+} ThroughputTracer;
+
+typedef struct _ThroughputTracerClass
+{
+	GstTracerClass parent_class;
+} ThroughputTracerClass;
+
+G_DEFINE_TYPE(ThroughputTracer, throughput_tracer, GST_TYPE_TRACER);
+
+static void throughput_push_buffer_pre(GObject* self, GstClockTime ts, GstPad* pad, GstBuffer* buffer)
+{
+	GstPad* peer = GST_PAD_PEER(pad);
+
+	if (!run.pAnalysis)
+		return;
+
+	if (peer && GST_OBJECT_PARENT(peer) == GST_OBJECT(run.pAnalysis))
+	{
+		if (run.pPartitionsJson)
+		{
+			g_object_set(run.pAnalysis, "partitions-json", run.pPartitionsJson, NULL);
+			ts = gst_util_get_timestamp();
+		}
+
+		run.startTime = ts;
+	}
+	else if (GST_OBJECT_PARENT(pad) == GST_OBJECT(run.pAnalysis) && GST_CLOCK_TIME_IS_VALID(run.startTime))
+	{
+		if (run.nLatencies < run.nMaxLatencies)
+			run.pLatencies[run.nLatencies++] = ts - run.startTime;
+
+		run.startTime = GST_CLOCK_TIME_NONE;
+	}
+}
+
+static void throughput_mini_object_created(GObject* self, GstClockTime ts, GstMiniObject* object)
+{
+	if (GST_IS_BUFFER(object))
+		g_atomic_int_inc(&run.nBuffers);
+	else if (GST_IS_MINI_OBJECT_TYPE(object, GST_TYPE_MEMORY))
+		g_atomic_int_inc(&run.nMemories);
+}
+
+static void throughput_tracer_class_init(ThroughputTracerClass* klass)
+{
+}
+
+static void throughput_tracer_init(ThroughputTracer* self)
+{
+	GstTracer* tracer = GST_TRACER(self);
+
+	gst_tracing_register_hook(tracer, "pad-push-pre", G_CALLBACK(throughput_push_buffer_pre));
+	gst_tracing_register_hook(tracer, "mini-object-created", G_CALLBACK(throughput_mini_object_created));
+}
+
+/* harness */
+
+static gint64 process_cpu_time_us(void)
+{
+#ifdef _WIN32
+	FILETIME creation, exited, kernel, user;
+	ULARGE_INTEGER k, u;
+
+	GetProcessTimes(GetCurrentProcess(), &creation, &exited, &kernel, &user);
+	k.LowPart = kernel.dwLowDateTime;
+	k.HighPart = kernel.dwHighDateTime;
+	u.LowPart = user.dwLowDateTime;
+	u.HighPart = user.dwHighDateTime;
+
+	return (gint64)((k.QuadPart + u.QuadPart) / 10);
+#else
+	struct rusage usage;
+
+	getrusage(RUSAGE_SELF, &usage);
+
+	return (gint64)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * G_USEC_PER_SEC + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+#endif
+}
+
+static int compare_latencies(const void* a, const void* b)
+{
+	GstClockTime x = *(const GstClockTime*)a;
+	GstClockTime y = *(const GstClockTime*)b;
+
+	return (x > y) - (x < y);
+}
+
+static double latency_percentile_us(int iPercent)
+{
+	if (!run.nLatencies)
+		return 0;
+
+	return run.pLatencies[((run.nLatencies - 1) * iPercent + 50) / 100] / 1000.0;
+}
+
+static void on_json(GstElement* element, const gchar* pJson, gpointer user_data)
+{
+	run.nJsonBytes += strlen(pJson);
+}
+
+// a grid of partitions over the frame, as the element expects in partitions-json
+static gchar* build_partitions_json(int nColumns, int nRows)
+{
+	GString* pJson = g_string_new("{\"partitions\":[");
+	int iCellWidth = iWidth / nColumns;
+	int iCellHeight = iHeight / nRows;
+
+	for (int i = 0; i < nColumns * nRows; i++)
+	{
+		g_string_append_printf(pJson, "%s{\"id\":%d,\"center_x\":%d,\"center_y\":%d,\"width\":%d,\"height\":%d,\"bg_r\":255,\"bg_g\":255,\"bg_b\":255}",
+			i ? "," : "", i, (i % nColumns) * iCellWidth + iCellWidth / 2, (i / nColumns) * iCellHeight + iCellHeight / 2, iCellWidth * 3 / 4, iCellHeight * 3 / 4);
+	}
+
+	g_string_append(pJson, "]}");
+	return g_string_free(pJson, FALSE);
+}
+
+static gboolean run_config(const gchar* pFormat, const ThroughputMode* pMode, const gchar* pPartitionsJson)
+{
+	gchar* pDescription = g_strdup_printf(
+		"videotestsrc num-buffers=%d pattern=smpte ! video/x-raw,format=%s,width=%d,height=%d ! "
+		"printanalysis name=analysis analysis-type=%u analyses=%u aoi-height=%d aoi-partitions=8 connect-values=true ! "
+		"fakesink sync=false",
+		iBuffers, pFormat, iWidth, iHeight, pMode->analysisType, pMode->analyses, MIN(256, iHeight - 2));
+	GError* pError = NULL;
+	GstElement* pPipeline = gst_parse_launch(pDescription, &pError);
+	GstMessage* pMessage;
+	gboolean bOk;
+
+	g_free(pDescription);
+
+	if (!pPipeline)
+	{
+		fprintf(stderr, "%s %s: %s\n", pFormat, pMode->pName, pError ? pError->message : "pipeline not created");
+		g_clear_error(&pError);
+		return FALSE;
+	}
+
+	run.nLatencies = 0;
+	run.nBuffers = 0;
+	run.nMemories = 0;
+	run.nJsonBytes = 0;
+	run.startTime = GST_CLOCK_TIME_NONE;
+	run.pPartitionsJson = pMode->bPartitions ? pPartitionsJson : NULL;
+	run.pAnalysis = gst_bin_get_by_name(GST_BIN(pPipeline), "analysis");
+
+	// a ladder of 8 pixel pitch across the first of the 8 AOI partitions, for the nozzle check to look for
+	if (pMode->analysisType == 7)
+	{
+		gchar* pChecksJson = g_strdup_printf("{\"checks\":[{\"partition\":0,\"first\":4,\"pitch\":8,\"lines\":%d}]}", MAX(iWidth / 64, 1));
+
+		g_object_set(run.pAnalysis, "nozzle-checks-json", pChecksJson, NULL);
+		g_free(pChecksJson);
+	}
+
+	// consume the results the way an application would, so building and emitting the JSON is measured
+	g_signal_connect(run.pAnalysis, "analysis-results-signal", G_CALLBACK(on_json), NULL);
+	g_signal_connect(run.pAnalysis, "aoi-total-signal", G_CALLBACK(on_json), NULL);
+
+	gint64 iCpuStart = process_cpu_time_us();
+	gint64 iWallStart = g_get_monotonic_time();
+
+	gst_element_set_state(pPipeline, GST_STATE_PLAYING);
+
+	pMessage = gst_bus_timed_pop_filtered(GST_ELEMENT_BUS(pPipeline), GST_CLOCK_TIME_NONE, GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+
+	gint64 iWall = MAX(g_get_monotonic_time() - iWallStart, 1);
+	gint64 iCpu = process_cpu_time_us() - iCpuStart;
+
+	bOk = pMessage && GST_MESSAGE_TYPE(pMessage) == GST_MESSAGE_EOS;
+
+	if (!bOk && pMessage)
+	{
+		gst_message_parse_error(pMessage, &pError, NULL);
+		fprintf(stderr, "%s %s: %s\n", pFormat, pMode->pName, pError->message);
+		g_clear_error(&pError);
+	}
+
+	if (pMessage)
+		gst_message_unref(pMessage);
+
+	gst_element_set_state(pPipeline, GST_STATE_NULL);
+
+	GstElement* pAnalysis = run.pAnalysis;
+	run.pAnalysis = NULL;
+	gst_object_unref(pAnalysis);
+	gst_object_unref(pPipeline);
+
+	if (!bOk)
+		return FALSE;
+
+	qsort(run.pLatencies, run.nLatencies, sizeof(GstClockTime), compare_latencies);
+
+	printf("{\"format\":\"%s\",\"mode\":\"%s\",\"width\":%d,\"height\":%d,\"buffers\":%u,"
+		"\"fps\":%.1f,\"wall_ms\":%.1f,\"cpu_percent\":%.1f,"
+		"\"latency_us\":{\"min\":%.1f,\"p50\":%.1f,\"p90\":%.1f,\"p99\":%.1f,\"max\":%.1f},"
+		"\"buffers_allocated\":%d,\"memories_allocated\":%d,\"json_bytes_per_buffer\":%.0f}\n",
+		pFormat, pMode->pName, iWidth, iHeight, run.nLatencies,
+		run.nLatencies * (double)G_USEC_PER_SEC / iWall, iWall / 1000.0, 100.0 * iCpu / iWall,
+		latency_percentile_us(0), latency_percentile_us(50), latency_percentile_us(90), latency_percentile_us(99), latency_percentile_us(100),
+		run.nBuffers, run.nMemories, run.nLatencies ? (double)run.nJsonBytes / run.nLatencies : 0.0);
+	fflush(stdout);
+
+	return TRUE;
+}
+
+int main(int argc, char* argv[])
+{
+	GOptionContext* pContext = g_option_context_new("- measure printanalysis in a pipeline");
+	GError* pError = NULL;
+	gboolean bOk = TRUE;
+
+	g_option_context_add_main_entries(pContext, entries, NULL);
+	g_option_context_add_group(pContext, gst_init_get_option_group());
+
+	if (!g_option_context_parse(pContext, &argc, &argv, &pError))
+	{
+		fprintf(stderr, "%s\n", pError->message);
+		g_error_free(pError);
+		g_option_context_free(pContext);
+		return 1;
+	}
+
+	g_option_context_free(pContext);
+
+	GstElementFactory* pFactory = gst_element_factory_find("printanalysis");
+
+	if (!pFactory)
+	{
+		fprintf(stderr, "printanalysis not found, add the plugin directory to GST_PLUGIN_PATH\n");
+		return 1;
+	}
+
+	gst_object_unref(pFactory);
+
+	iBuffers = MAX(iBuffers, 1);
+	iWidth = MAX(iWidth, 16) & ~1;
+	iHeight = MAX(iHeight, 16);
+
+	// hooks are dispatched to every tracer object, so the harness doesn't need GST_TRACERS
+	GstTracer* pTracer = g_object_new(throughput_tracer_get_type(), NULL);
+	gchar* pPartitionsJson = build_partitions_json(8, 4);
+
+	run.nMaxLatencies = iBuffers;
+	run.pLatencies = g_new0(GstClockTime, iBuffers);
+
+	for (guint f = 0; f < G_N_ELEMENTS(formats); f++)
+	{
+		if (pFormatName && g_ascii_strcasecmp(pFormatName, formats[f]) != 0)
+			continue;
+
+		for (guint m = 0; m < G_N_ELEMENTS(modes); m++)
+		{
+			if (pModeName && g_ascii_strcasecmp(pModeName, modes[m].pName) != 0)
+				continue;
+
+			bOk &= run_config(formats[f], &modes[m], pPartitionsJson);
+		}
+	}
+
+	g_free(run.pLatencies);
+	g_free(pPartitionsJson);
+	gst_object_unref(pTracer);
+
+	return bOk ? 0 : 1;
+}